@@ -0,0 +1,511 @@
+// Drives the office the way a busy branch does: N cashier threads submit exchanges through the same
+// path as the console (Cashier::handleRequest, log append, reserve persist) while manager threads
+// update rates, all against a throwaway data directory. Reports throughput and tail latency, plus
+// heap allocations per stage when built with `make ALLOC=1`.
+//
+//   bench/load_generator [--cashiers <n>] [--requests <n per cashier>] [--managers <n>]
+//                        [--rate-interval-ms <n>] [--split <0..1>] [--remainder <0..1>] [--skew <s>]
+//                        [--think-us <n>] [--seed <n>] [--replay <transactions.log|segment dir>]
+//                        [--json <file>] [--keep-data]
+//
+// --replay resubmits a recorded transaction log instead of synthetic requests; each recorded cashier
+// keeps its own order and its recorded payout split. Lines from before payouts were logged pay out
+// in LOCAL (or USD for LOCAL sources).
+#include "employee.h"
+#include "exchange_manager.h"
+#include "journal.h"
+#include "latency_histogram.h"
+#include "persistence.h"
+#include "transaction_log.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+    using Clock = std::chrono::steady_clock;
+
+    constexpr Currency kCurrencies[] = {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL};
+    constexpr std::size_t kClientPool = 2'000;
+
+    struct Settings {
+        std::size_t cashiers = 4;
+        std::size_t requestsPerCashier = 5'000;
+        std::size_t managers = 1;
+        int rateIntervalMs = 10;
+        double splitRatio = 0.3;     // Share of requests with several portions
+        double remainderRatio = 0.7; // Share of split requests whose last portion takes the remainder
+        double skew = 1.2;           // Zipf exponent over currencies and clients
+        int thinkMicros = 0;
+        unsigned seed = 42;
+        std::string replayPath;
+        std::string jsonPath;
+        bool keepData = false;
+    };
+
+    struct Submission {
+        int cashierId;
+        std::string cashierName;
+        ExchangeRequest request;
+    };
+
+    struct LatencySummary {
+        std::size_t count = 0;
+        double p50 = 0.0;
+        double p90 = 0.0;
+        double p99 = 0.0;
+        double p999 = 0.0;
+        double max = 0.0;
+    };
+
+    struct WorkerStats {
+        std::vector<double> latencies; // Microseconds, successful and rejected requests alike
+        std::size_t succeeded = 0;
+        std::size_t rejectedReserve = 0;
+        std::size_t rejectedRate = 0;
+        std::size_t rejectedOther = 0;
+    };
+
+    // Discrete Zipf: rank r is drawn with weight 1 / r^s.
+    class ZipfPicker {
+    private:
+        std::discrete_distribution<std::size_t> distribution;
+
+        static std::vector<double> weights(std::size_t count, double exponent) {
+            std::vector<double> result(count);
+            for (std::size_t rank = 0; rank < count; ++rank) {
+                result[rank] = 1.0 / std::pow(static_cast<double>(rank + 1), exponent);
+            }
+            return result;
+        }
+
+    public:
+        ZipfPicker(std::size_t count, double exponent) {
+            auto w = weights(count, exponent);
+            distribution = std::discrete_distribution<std::size_t>(w.begin(), w.end());
+        }
+
+        std::size_t operator()(std::mt19937_64& random) {
+            return distribution(random);
+        }
+    };
+
+    class RequestMix {
+    private:
+        const Settings& settings;
+        std::mt19937_64 random;
+        ZipfPicker currencyRank;
+        ZipfPicker clientRank;
+        std::lognormal_distribution<double> amount;
+        std::uniform_real_distribution<double> unit;
+
+        double roundCents(double value) {
+            return std::round(value * 100.0) / 100.0;
+        }
+
+        Currency otherThan(Currency source) {
+            Currency target = source;
+            while (target == source) {
+                target = kCurrencies[currencyRank(random)];
+            }
+            return target;
+        }
+
+    public:
+        RequestMix(const Settings& options, std::uint64_t seed)
+            : settings(options),
+              random(seed),
+              currencyRank(std::size(kCurrencies), options.skew),
+              clientRank(kClientPool, options.skew),
+              amount(5.0, 1.0), // Median around 150, long tail into the thousands
+              unit(0.0, 1.0) {}
+
+        ExchangeRequest next() {
+            Currency source = kCurrencies[currencyRank(random)];
+            double total = roundCents(std::clamp(amount(random), 5.0, 50'000.0));
+            int clientId = static_cast<int>(clientRank(random)) + 1;
+            std::vector<ExchangePortion> portions;
+            if (unit(random) < settings.splitRatio) {
+                std::size_t parts = 2 + static_cast<std::size_t>(unit(random) * 2.0); // 2 or 3 portions
+                bool remainderLast = unit(random) < settings.remainderRatio;
+                double left = total;
+                for (std::size_t i = 0; i < parts; ++i) {
+                    Currency target = otherThan(source);
+                    if (i + 1 == parts) {
+                        if (remainderLast) {
+                            portions.push_back(ExchangePortion::remainder(target));
+                        } else {
+                            portions.emplace_back(target, roundCents(left));
+                        }
+                        break;
+                    }
+                    double slice = roundCents(left * (0.2 + 0.5 * unit(random)));
+                    portions.emplace_back(target, slice);
+                    left -= slice;
+                }
+            } else if (unit(random) < settings.remainderRatio) {
+                portions.push_back(ExchangePortion::remainder(otherThan(source)));
+            } else {
+                portions.emplace_back(otherThan(source), total);
+            }
+            return ExchangeRequest(clientId, "Client " + std::to_string(clientId), source, total, std::move(portions));
+        }
+    };
+
+    LatencySummary summarize(std::vector<double> samples) {
+        LatencySummary summary;
+        summary.count = samples.size();
+        if (samples.empty()) {
+            return summary;
+        }
+        std::sort(samples.begin(), samples.end());
+        auto at = [&samples](double quantile) {
+            auto index = static_cast<std::size_t>(quantile * static_cast<double>(samples.size() - 1));
+            return samples[index];
+        };
+        summary.p50 = at(0.50);
+        summary.p90 = at(0.90);
+        summary.p99 = at(0.99);
+        summary.p999 = at(0.999);
+        summary.max = samples.back();
+        return summary;
+    }
+
+    std::vector<std::filesystem::path> replaySources(const std::filesystem::path& path) {
+        std::vector<std::filesystem::path> files;
+        if (std::filesystem::is_directory(path)) {
+            for (const auto& entry : std::filesystem::directory_iterator(path)) {
+                const auto name = entry.path().filename().string();
+                if (entry.is_regular_file() && name.rfind("segment-", 0) == 0 && entry.path().extension() == ".log") {
+                    files.push_back(entry.path());
+                }
+            }
+            std::sort(files.begin(), files.end());
+        } else {
+            files.push_back(path);
+        }
+        if (files.empty()) {
+            throw ExchangeError("No transaction log segments in " + path.string());
+        }
+        return files;
+    }
+
+    // The recorded split, with the last slice taking up whatever the logged rounding left over.
+    std::vector<ExchangePortion> replayPortions(const TransactionRecord& record) {
+        if (record.payouts.empty()) {
+            return {ExchangePortion::remainder(record.sourceCurrency == Currency::LOCAL ? Currency::USD : Currency::LOCAL)};
+        }
+        std::vector<ExchangePortion> portions;
+        double allocated = 0.0;
+        for (const auto& payout : record.payouts) {
+            portions.emplace_back(payout.currency, payout.sourceAmount);
+            allocated += payout.sourceAmount;
+        }
+        if (std::fabs(allocated - record.sourceAmount) <= 0.005 * static_cast<double>(portions.size())) {
+            portions.back() = ExchangePortion::remainder(portions.back().targetCurrency);
+        }
+        return portions;
+    }
+
+    // Splits a recorded log into per-cashier queues, keeping each cashier's order.
+    std::vector<std::vector<Submission>> loadReplay(const Settings& settings, std::size_t& malformed) {
+        std::vector<std::vector<Submission>> queues(settings.cashiers);
+        malformed = 0;
+        for (const auto& file : replaySources(settings.replayPath)) {
+            std::ifstream input(file);
+            if (!input) {
+                throw ExchangeError("Unable to open " + file.string());
+            }
+            std::string line;
+            while (std::getline(input, line)) {
+                if (line.empty()) {
+                    continue;
+                }
+                auto record = TransactionLog::parseRecord(line);
+                if (!record || record->sourceAmount <= 0.0) {
+                    ++malformed;
+                    continue;
+                }
+                auto& queue = queues[static_cast<std::size_t>(record->cashierId) % settings.cashiers];
+                queue.push_back(Submission{record->cashierId, record->cashierName,
+                                           ExchangeRequest(record->clientId, record->clientName, record->sourceCurrency,
+                                                           record->sourceAmount, replayPortions(*record))});
+            }
+        }
+        return queues;
+    }
+
+    std::vector<std::vector<Submission>> generateLoad(const Settings& settings) {
+        std::vector<std::vector<Submission>> queues(settings.cashiers);
+        for (std::size_t c = 0; c < settings.cashiers; ++c) {
+            RequestMix mix(settings, settings.seed * 7919 + c);
+            std::string name = "Cashier " + std::to_string(c + 1);
+            queues[c].reserve(settings.requestsPerCashier);
+            for (std::size_t i = 0; i < settings.requestsPerCashier; ++i) {
+                queues[c].push_back(Submission{static_cast<int>(c + 1), name, mix.next()});
+            }
+        }
+        return queues;
+    }
+
+    std::map<Currency, double> ampleReserve() {
+        return {
+            {Currency::USD, 1e9},
+            {Currency::EUR, 1e9},
+            {Currency::GBP, 1e9},
+            {Currency::LOCAL, 1e9}
+        };
+    }
+
+    void appendSummary(std::string& out, const char* name, const LatencySummary& summary) {
+        out += '"';
+        out += name;
+        out += "\":{\"count\":";
+        append_integer(out, static_cast<long long>(summary.count));
+        for (auto [label, value] : {std::pair{"p50_us", summary.p50}, std::pair{"p90_us", summary.p90},
+                                    std::pair{"p99_us", summary.p99}, std::pair{"p999_us", summary.p999},
+                                    std::pair{"max_us", summary.max}}) {
+            out += ",\"";
+            out += label;
+            out += "\":";
+            append_fixed(out, value, 1);
+        }
+        out += '}';
+    }
+
+    void printSummary(const char* name, const LatencySummary& summary) {
+        std::fprintf(stderr, "%-10s n=%-8zu p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  p99.9 %8.1f us  max %9.1f us\n",
+                     name, summary.count, summary.p50, summary.p90, summary.p99, summary.p999, summary.max);
+    }
+
+    Settings parseArguments(int argc, char* argv[]) {
+        Settings settings;
+        for (int index = 1; index < argc; ++index) {
+            std::string argument = argv[index];
+            if (argument == "--keep-data") {
+                settings.keepData = true;
+                continue;
+            }
+            if (index + 1 >= argc) {
+                throw ExchangeError(argument + " requires a value");
+            }
+            std::string value = argv[++index];
+            if (argument == "--cashiers") {
+                settings.cashiers = std::max<std::size_t>(1, std::stoul(value));
+            } else if (argument == "--requests") {
+                settings.requestsPerCashier = std::stoul(value);
+            } else if (argument == "--managers") {
+                settings.managers = std::stoul(value);
+            } else if (argument == "--rate-interval-ms") {
+                settings.rateIntervalMs = std::max(1, std::stoi(value));
+            } else if (argument == "--split") {
+                settings.splitRatio = std::stod(value);
+            } else if (argument == "--remainder") {
+                settings.remainderRatio = std::stod(value);
+            } else if (argument == "--skew") {
+                settings.skew = std::stod(value);
+            } else if (argument == "--think-us") {
+                settings.thinkMicros = std::stoi(value);
+            } else if (argument == "--seed") {
+                settings.seed = static_cast<unsigned>(std::stoul(value));
+            } else if (argument == "--replay") {
+                settings.replayPath = value;
+            } else if (argument == "--json") {
+                settings.jsonPath = value;
+            } else {
+                throw ExchangeError("Unknown argument: " + argument);
+            }
+        }
+        return settings;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Settings settings = parseArguments(argc, argv);
+
+        std::size_t malformed = 0;
+        auto queues = settings.replayPath.empty() ? generateLoad(settings) : loadReplay(settings, malformed);
+
+        auto root = std::filesystem::temp_directory_path() / ("cx-load-" + std::to_string(::getpid()));
+        std::filesystem::remove_all(root);
+        DataStore store(root.string());
+        store.initialize(StartupSource::Csv);
+
+        RateTable rates(Currency::LOCAL);
+        rates.setRate(Currency::USD, Currency::LOCAL, 1.08);
+        rates.setRate(Currency::EUR, Currency::LOCAL, 1.00);
+        rates.setRate(Currency::GBP, Currency::LOCAL, 1.22);
+        ExchangeOffice office(rates, Reserve(ampleReserve()), 0.03);
+        store.saveRates(office);
+        store.saveReserve(office.reserve().allBalances());
+
+        Journal journal(store.journalFile());
+        journal.open(office);
+        office.addListener(&journal);
+
+        // Same serialisation the session host uses: one lock around office and store.
+        std::mutex officeMutex;
+        std::vector<WorkerStats> cashierStats(queues.size());
+        std::vector<WorkerStats> managerStats(settings.managers);
+        std::atomic<bool> cashiersDone(false);
+
+        auto started = Clock::now();
+        std::vector<std::thread> managers;
+        for (std::size_t m = 0; m < settings.managers; ++m) {
+            managers.emplace_back([&, m]() {
+                std::mt19937_64 random(settings.seed + 1000 + m);
+                std::uniform_real_distribution<double> drift(-0.005, 0.005);
+                auto& stats = managerStats[m];
+                while (!cashiersDone.load(std::memory_order_relaxed)) {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(settings.rateIntervalMs));
+                    Currency from = kCurrencies[random() % 3]; // Foreign currency against the base
+                    auto begin = Clock::now();
+                    {
+                        std::lock_guard<std::mutex> guard(officeMutex);
+                        double current = office.rateConfig()->getRate(from, Currency::LOCAL);
+                        office.updateRate(from, Currency::LOCAL, current * (1.0 + drift(random)));
+                        store.saveRates(office);
+                    }
+                    stats.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+                    ++stats.succeeded;
+                }
+            });
+        }
+
+        std::vector<std::thread> cashiers;
+        for (std::size_t c = 0; c < queues.size(); ++c) {
+            cashiers.emplace_back([&, c]() {
+                auto& stats = cashierStats[c];
+                stats.latencies.reserve(queues[c].size());
+                std::map<int, Cashier> desks;
+                for (const auto& submission : queues[c]) {
+                    auto desk = desks.find(submission.cashierId);
+                    if (desk == desks.end()) {
+                        desk = desks.emplace(std::piecewise_construct, std::forward_as_tuple(submission.cashierId),
+                                             std::forward_as_tuple(submission.cashierId, submission.cashierName, office)).first;
+                    }
+                    auto begin = Clock::now();
+                    try {
+                        std::lock_guard<std::mutex> guard(officeMutex);
+                        store.ensurePersonId("client", submission.request.clientName);
+                        Receipt receipt = desk->second.handleRequest(submission.request);
+                        store.appendTransaction(receipt);
+                        store.saveReserve(office.reserve().allBalances());
+                        ++stats.succeeded;
+                    } catch (const ReserveError&) {
+                        ++stats.rejectedReserve;
+                    } catch (const RateNotFoundError&) {
+                        ++stats.rejectedRate;
+                    } catch (const std::exception&) {
+                        ++stats.rejectedOther;
+                    }
+                    stats.latencies.push_back(std::chrono::duration<double, std::micro>(Clock::now() - begin).count());
+                    if (settings.thinkMicros > 0) {
+                        std::this_thread::sleep_for(std::chrono::microseconds(settings.thinkMicros));
+                    }
+                }
+            });
+        }
+        for (auto& cashier : cashiers) {
+            cashier.join();
+        }
+        double elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+        cashiersDone = true;
+        for (auto& manager : managers) {
+            manager.join();
+        }
+        office.removeListener(&journal);
+
+        WorkerStats total;
+        std::vector<double> rateLatencies;
+        for (auto& stats : cashierStats) {
+            total.succeeded += stats.succeeded;
+            total.rejectedReserve += stats.rejectedReserve;
+            total.rejectedRate += stats.rejectedRate;
+            total.rejectedOther += stats.rejectedOther;
+            total.latencies.insert(total.latencies.end(), stats.latencies.begin(), stats.latencies.end());
+        }
+        for (auto& stats : managerStats) {
+            rateLatencies.insert(rateLatencies.end(), stats.latencies.begin(), stats.latencies.end());
+        }
+        std::size_t submitted = total.latencies.size();
+        double throughput = elapsed > 0.0 ? static_cast<double>(submitted) / elapsed : 0.0;
+        LatencySummary exchangeLatency = summarize(std::move(total.latencies));
+        LatencySummary rateLatency = summarize(std::move(rateLatencies));
+
+        std::fprintf(stderr, "%s: %zu cashier thread(s), %zu request(s) in %.2f s = %.0f req/s\n",
+                     settings.replayPath.empty() ? "synthetic" : "replay", queues.size(), submitted, elapsed, throughput);
+        std::fprintf(stderr, "ok %zu, reserve rejects %zu, rate rejects %zu, other rejects %zu",
+                     total.succeeded, total.rejectedReserve, total.rejectedRate, total.rejectedOther);
+        if (malformed > 0) {
+            std::fprintf(stderr, ", %zu malformed log line(s) skipped", malformed);
+        }
+        std::fputc('\n', stderr);
+        printSummary("exchange", exchangeLatency);
+        printSummary("rates", rateLatency);
+        auto stages = LatencyRegistry::snapshot();
+        auto allocated = LatencyRegistry::allocations();
+        if (AllocationTracker::kCompiledIn) {
+            std::fputs(LatencyRegistry::formatAllocationTable(stages, allocated).c_str(), stderr);
+        }
+
+        std::string json = "{\"schema\":1,\"mode\":";
+        append_json_string(json, settings.replayPath.empty() ? "synthetic" : "replay");
+        json += ",\"cashiers\":";
+        append_integer(json, static_cast<long long>(queues.size()));
+        json += ",\"managers\":";
+        append_integer(json, static_cast<long long>(settings.managers));
+        json += ",\"requests\":";
+        append_integer(json, static_cast<long long>(submitted));
+        json += ",\"succeeded\":";
+        append_integer(json, static_cast<long long>(total.succeeded));
+        json += ",\"rejected\":";
+        append_integer(json, static_cast<long long>(total.rejectedReserve + total.rejectedRate + total.rejectedOther));
+        json += ",\"elapsed_s\":";
+        append_fixed(json, elapsed, 3);
+        json += ",\"requests_per_second\":";
+        append_fixed(json, throughput, 1);
+        json += ',';
+        appendSummary(json, "exchange_latency", exchangeLatency);
+        json += ',';
+        appendSummary(json, "rate_update_latency", rateLatency);
+        if (AllocationTracker::kCompiledIn) {
+            const auto transactions = static_cast<std::size_t>(LatencyStage::Transaction);
+            double runs = static_cast<double>(std::max<std::uint64_t>(stages[transactions].count(), 1));
+            json += ",\"allocs_per_transaction\":";
+            append_fixed(json, static_cast<double>(allocated[transactions].allocations) / runs, 2);
+            json += ",\"bytes_per_transaction\":";
+            append_fixed(json, static_cast<double>(allocated[transactions].bytes) / runs, 1);
+        }
+        json += "}\n";
+        if (settings.jsonPath.empty()) {
+            std::fwrite(json.data(), 1, json.size(), stdout);
+        } else {
+            std::ofstream(settings.jsonPath, std::ios::trunc) << json;
+        }
+
+        if (settings.keepData) {
+            std::fprintf(stderr, "Data kept in %s\n", root.string().c_str());
+        } else {
+            std::filesystem::remove_all(root);
+        }
+    } catch (const std::exception& error) {
+        std::cerr << "Load generator failed: " << error.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
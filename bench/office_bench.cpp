@@ -0,0 +1,573 @@
+// Microbenchmarks for the hot paths of the office: rate lookups, transactions, the transaction log,
+// the CSV loaders, daily reports, the people directory and multi-branch hosting. Results go to stdout
+// as one JSON document (or to --json <file>) so runs can be diffed for regressions. Built with `make ALLOC=1`, each result
+// also carries heap allocations and bytes per operation.
+//
+//   bench/office_bench [--json <file>] [--filter <substring>] [--max-records <n>] [--rounds <n>]
+#include "alloc_tracking.h"
+#include "anomaly_monitor.h"
+#include "branch_network.h"
+#include "client_limits.h"
+#include "exchange_manager.h"
+#include "persistence.h"
+#include "rate_feed.h"
+#include "reserve_planner.h"
+#include "split_optimizer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+    volatile double sink = 0.0;
+
+    struct Measurement {
+        std::string name;
+        std::size_t operations;     // Operations per round
+        std::vector<double> rounds; // Seconds per round
+        AllocationCount allocated;  // Summed over every round, prepare() excluded
+    };
+
+    struct Settings {
+        std::string jsonPath;
+        std::string filter;
+        std::size_t maxRecords = 1'000'000;
+        int rounds = 5;
+    };
+
+    class Suite {
+    private:
+        Settings settings;
+        std::vector<Measurement> results;
+
+    public:
+        explicit Suite(Settings options) : settings(std::move(options)) {}
+
+        bool wants(const std::string& name) const {
+            return settings.filter.empty() || name.find(settings.filter) != std::string::npos;
+        }
+
+        std::size_t maxRecords() const {
+            return settings.maxRecords;
+        }
+
+        static double perOperation(const Measurement& measurement, std::uint64_t total) {
+            return static_cast<double>(total) / static_cast<double>(measurement.operations * measurement.rounds.size());
+        }
+
+        // Runs `body(i)` for i in [0, operations) once per round; `prepare` runs untimed before each round.
+        template <typename Prepare, typename Body>
+        void measure(const std::string& name, std::size_t operations, Prepare&& prepare, Body&& body) {
+            if (!wants(name)) {
+                return;
+            }
+            Measurement measurement{name, operations, {}, {}};
+            for (int round = 0; round < settings.rounds; ++round) {
+                prepare();
+                AllocationCount before = AllocationTracker::thread();
+                auto started = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < operations; ++i) {
+                    body(i);
+                }
+                measurement.rounds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count());
+                measurement.allocated += AllocationTracker::thread() - before;
+            }
+            std::sort(measurement.rounds.begin(), measurement.rounds.end());
+            double best = measurement.rounds.front() * 1e9 / static_cast<double>(operations);
+            if (AllocationTracker::kCompiledIn) {
+                std::fprintf(stderr, "%-44s %14.1f ns/op %10.2f allocs/op %10.1f B/op\n", name.c_str(), best,
+                             perOperation(measurement, measurement.allocated.allocations),
+                             perOperation(measurement, measurement.allocated.bytes));
+            } else {
+                std::fprintf(stderr, "%-44s %14.1f ns/op\n", name.c_str(), best);
+            }
+            results.push_back(std::move(measurement));
+        }
+
+        template <typename Body>
+        void measure(const std::string& name, std::size_t operations, Body&& body) {
+            measure(name, operations, []() {}, std::forward<Body>(body));
+        }
+
+        std::string json() const {
+            std::string out = "{\"schema\":1,\"allocation_tracking\":";
+            out += AllocationTracker::kCompiledIn ? "true" : "false";
+            out += ",\"timestamp\":";
+            append_integer(out, static_cast<long long>(std::time(nullptr)));
+            out += ",\"compiler\":";
+            append_json_string(out, __VERSION__);
+            out += ",\"benchmarks\":[";
+            for (std::size_t i = 0; i < results.size(); ++i) {
+                const auto& result = results[i];
+                double operations = static_cast<double>(result.operations);
+                double best = result.rounds.front();
+                double median = result.rounds[result.rounds.size() / 2];
+                out += i == 0 ? "\n  {" : ",\n  {";
+                out += "\"name\":";
+                append_json_string(out, result.name);
+                out += ",\"operations\":";
+                append_integer(out, static_cast<long long>(result.operations));
+                out += ",\"rounds\":";
+                append_integer(out, static_cast<long long>(result.rounds.size()));
+                out += ",\"ns_per_op_min\":";
+                append_fixed(out, best * 1e9 / operations, 3);
+                out += ",\"ns_per_op_median\":";
+                append_fixed(out, median * 1e9 / operations, 3);
+                out += ",\"ops_per_second\":";
+                append_fixed(out, operations / best, 1);
+                if (AllocationTracker::kCompiledIn) {
+                    out += ",\"allocs_per_op\":";
+                    append_fixed(out, perOperation(result, result.allocated.allocations), 3);
+                    out += ",\"bytes_per_op\":";
+                    append_fixed(out, perOperation(result, result.allocated.bytes), 1);
+                }
+                out += '}';
+            }
+            out += "\n]}\n";
+            return out;
+        }
+
+        void emit() const {
+            std::string document = json();
+            if (settings.jsonPath.empty()) {
+                std::fwrite(document.data(), 1, document.size(), stdout);
+                return;
+            }
+            std::ofstream file(settings.jsonPath, std::ios::trunc);
+            file << document;
+            if (!file) {
+                throw ExchangeError("Unable to write " + settings.jsonPath);
+            }
+        }
+    };
+
+    RateTable sampleRates() {
+        RateTable table(Currency::LOCAL);
+        table.setRate(Currency::USD, Currency::LOCAL, 1.08);
+        table.setRate(Currency::EUR, Currency::LOCAL, 1.00);
+        table.setRate(Currency::GBP, Currency::LOCAL, 1.22);
+        table.setMargin(Currency::USD, Currency::LOCAL, 0.004);
+        table.setMargin(Currency::EUR, Currency::LOCAL, 0.005);
+        table.setMargin(Currency::GBP, Currency::LOCAL, 0.006);
+        return table;
+    }
+
+    // Deep enough that no benchmark ever trips a reserve shortfall.
+    std::map<Currency, double> ampleReserve() {
+        return {
+            {Currency::USD, 1e12},
+            {Currency::EUR, 1e12},
+            {Currency::GBP, 1e12},
+            {Currency::LOCAL, 1e12}
+        };
+    }
+
+    ExchangeRequest singlePortion(std::size_t i) {
+        return ExchangeRequest(1 + static_cast<int>(i % 500), "Client", Currency::USD, 100.0 + static_cast<double>(i % 900),
+                               {ExchangePortion::remainder(Currency::EUR)});
+    }
+
+    ExchangeRequest multiPortion(std::size_t i) {
+        std::vector<ExchangePortion> portions;
+        portions.emplace_back(Currency::EUR, 40.0);
+        portions.emplace_back(Currency::LOCAL, 25.0);
+        portions.push_back(ExchangePortion::remainder(Currency::GBP));
+        return ExchangeRequest(1 + static_cast<int>(i % 500), "Client", Currency::USD, 150.0 + static_cast<double>(i % 900),
+                               std::move(portions));
+    }
+
+    TransactionRecord sampleRecord(int receiptId, time_t now) {
+        return TransactionRecord{receiptId, 7, "Cashier", 1 + receiptId % 500, "Client " + std::to_string(receiptId % 500),
+                                 Currency::USD, 120.0, {PayoutDetail{Currency::EUR, 125.0, 3.9, {}, 120.0}}, 3.9, now};
+    }
+
+    std::string scaleLabel(std::size_t count) {
+        if (count >= 1'000'000 && count % 1'000'000 == 0) {
+            return std::to_string(count / 1'000'000) + "M";
+        }
+        if (count >= 1'000 && count % 1'000 == 0) {
+            return std::to_string(count / 1'000) + "k";
+        }
+        return std::to_string(count);
+    }
+
+    void benchRates(Suite& suite) {
+        RateTable table = sampleRates();
+        constexpr std::size_t kOperations = 1'000'000;
+        const Currency currencies[] = {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL};
+        suite.measure("RateTable::convert/direct", kOperations, [&](std::size_t i) {
+            sink = sink + table.convert(100.0 + static_cast<double>(i & 1023), Currency::USD, Currency::LOCAL);
+        });
+        suite.measure("RateTable::convert/cross", kOperations, [&](std::size_t i) {
+            sink = sink + table.convert(100.0 + static_cast<double>(i & 1023), Currency::USD, Currency::GBP);
+        });
+        suite.measure("RateTable::quoteRate", kOperations, [&](std::size_t i) {
+            sink = sink + table.quoteRate(currencies[i & 3], currencies[(i >> 2) & 3]);
+        });
+        suite.measure("RateTable::canConvert", kOperations, [&](std::size_t i) {
+            sink = sink + (table.canConvert(currencies[i & 3], currencies[(i >> 2) & 3]) ? 1.0 : 0.0);
+        });
+    }
+
+    // Feed lines are parsed one by one, then a coalesced batch is applied with one table copy
+    // instead of one per update.
+    void benchRateFeed(Suite& suite) {
+        constexpr std::size_t kOperations = 100'000;
+        const std::string lines[] = {"USD,LOCAL,1.0812", "LOCAL,EUR,0.99871", "GBP,LOCAL,1.2214,0.006", "EUR,GBP,0.8537"};
+        suite.measure("RateFeed::parseLine", kOperations * 10, [&](std::size_t i) {
+            sink = sink + RateFeed::parseLine(lines[i & 3])->mid;
+        });
+        ExchangeOffice office(sampleRates(), Reserve(ampleReserve()), 0.03);
+        suite.measure("ExchangeOffice::updateRate/3-pairs", kOperations, [&](std::size_t i) {
+            double drift = 1.0 + static_cast<double>(i & 15) * 1e-4;
+            office.updateRate(Currency::USD, Currency::LOCAL, 1.08 * drift);
+            office.updateRate(Currency::EUR, Currency::LOCAL, 1.00 * drift);
+            office.updateRate(Currency::GBP, Currency::LOCAL, 1.22 * drift);
+        });
+        suite.measure("ExchangeOffice::applyRates/3-pairs", kOperations, [&](std::size_t i) {
+            double drift = 1.0 + static_cast<double>(i & 15) * 1e-4;
+            office.applyRates({RateUpdate{Currency::USD, Currency::LOCAL, 1.08 * drift, std::nullopt},
+                               RateUpdate{Currency::EUR, Currency::LOCAL, 1.00 * drift, std::nullopt},
+                               RateUpdate{Currency::GBP, Currency::LOCAL, 1.22 * drift, std::nullopt}});
+        });
+        sink = sink + office.rateConfig()->getRate(Currency::USD, Currency::LOCAL);
+    }
+
+    void benchRebalance(Suite& suite) {
+        constexpr std::size_t kOperations = 20'000;
+        // A day of traffic draining EUR against critical minimums the reserve no longer covers.
+        ExchangeOffice office(sampleRates(), Reserve(ampleReserve()), 0.03);
+        for (std::size_t i = 0; i < 2'000; ++i) {
+            office.executeTransaction(singlePortion(i), "Cashier", 7);
+        }
+        for (const auto& [currency, balance] : office.reserve().allBalances()) {
+            office.setCriticalMinimum(currency, currency == Currency::EUR ? balance * 1.5 : balance * 0.2);
+        }
+        ReservePlanner planner(RebalanceOptions{4.0, 1.0, 0.02});
+        std::time_t now = std::time(nullptr);
+        suite.measure("ReservePlanner::plan", kOperations, [&](std::size_t) {
+            sink = sink + planner.plan(office, now).costBase;
+        });
+    }
+
+    void benchSplitPlan(Suite& suite) {
+        constexpr std::size_t kOperations = 200'000;
+        // EUR close to its critical minimum, so the plan has to spill into the next currency.
+        ExchangeOffice office(sampleRates(), Reserve(ampleReserve()), 0.03);
+        office.setCriticalMinimum(Currency::EUR, office.reserve().getBalance(Currency::EUR) - 50.0);
+        office.setClientLimits({{Currency::GBP, ClientLimit{1e9, 0.0}}});
+        ExchangeRequest request(42, "Client", Currency::USD, 250.0);
+        SplitPreferences preferences{{{Currency::EUR, 0.0}, {Currency::GBP, 120.0}, {Currency::LOCAL, 0.0}}, SplitObjective::ClientPayout};
+        std::time_t now = std::time(nullptr);
+        suite.measure("SplitOptimizer::plan", kOperations, [&](std::size_t) {
+            sink = sink + SplitOptimizer::plan(office, request, preferences, now).payoutBase;
+        });
+    }
+
+    void benchTransactions(Suite& suite) {
+        constexpr std::size_t kOperations = 100'000;
+        std::unique_ptr<ExchangeOffice> office;
+        auto freshOffice = [&]() {
+            office = std::make_unique<ExchangeOffice>(sampleRates(), Reserve(ampleReserve()), 0.03);
+        };
+        suite.measure("ExchangeOffice::executeTransaction/single", kOperations, freshOffice, [&](std::size_t i) {
+            sink = sink + office->executeTransaction(singlePortion(i), "Cashier", 7).profitInBase();
+        });
+        suite.measure("ExchangeOffice::executeTransaction/multi", kOperations, freshOffice, [&](std::size_t i) {
+            sink = sink + office->executeTransaction(multiPortion(i), "Cashier", 7).profitInBase();
+        });
+    }
+
+    void benchStore(Suite& suite, const std::filesystem::path& root) {
+        constexpr std::size_t kAppends = 50'000;
+        ExchangeOffice office(sampleRates(), Reserve(ampleReserve()), 0.03);
+        std::vector<Receipt> receipts;
+        receipts.reserve(kAppends);
+        for (std::size_t i = 0; i < kAppends; ++i) {
+            receipts.push_back(office.executeTransaction(i % 3 == 0 ? multiPortion(i) : singlePortion(i), "Cashier", 7));
+        }
+
+        std::unique_ptr<DataStore> store;
+        auto freshStore = [&]() {
+            store.reset();
+            std::filesystem::remove_all(root / "log");
+            store = std::make_unique<DataStore>((root / "log").string());
+            store->initialize(StartupSource::Csv);
+        };
+        suite.measure("DataStore::appendTransaction", kAppends, freshStore, [&](std::size_t i) {
+            store->appendTransaction(receipts[i]);
+        });
+        suite.measure("DataStore::appendTransaction/bulk", kAppends, [&]() {
+            freshStore();
+            store->setBulkMode(true);
+        }, [&](std::size_t i) {
+            store->appendTransaction(receipts[i]);
+        });
+        store.reset();
+
+        // Loaders read the files the office keeps next to the snapshot.
+        DataStore csv((root / "csv").string());
+        csv.initialize(StartupSource::Csv);
+        csv.saveRates(sampleRates());
+        csv.saveReserve(ampleReserve());
+        csv.saveCriticalMinimums({{Currency::USD, 1'000.0}, {Currency::EUR, 900.0}, {Currency::GBP, 800.0}, {Currency::LOCAL, 1'500.0}});
+        constexpr std::size_t kLoads = 20'000;
+        suite.measure("DataStore::loadRates", kLoads, [&](std::size_t) {
+            sink = sink + static_cast<double>(csv.loadRates().size());
+        });
+        suite.measure("DataStore::loadReserve", kLoads, [&](std::size_t) {
+            sink = sink + static_cast<double>(csv.loadReserve({}).size());
+        });
+        suite.measure("DataStore::loadCriticalMinimums", kLoads, [&](std::size_t) {
+            sink = sink + static_cast<double>(csv.loadCriticalMinimums().size());
+        });
+    }
+
+    void benchPeople(Suite& suite, const std::filesystem::path& root) {
+        constexpr std::size_t kPeople = 100'000;
+        std::vector<std::string> names;
+        names.reserve(kPeople);
+        for (std::size_t i = 0; i < kPeople; ++i) {
+            names.push_back("Client " + std::to_string(i));
+        }
+
+        std::unique_ptr<DataStore> store;
+        auto freshStore = [&]() {
+            store.reset();
+            std::filesystem::remove_all(root / "people");
+            store = std::make_unique<DataStore>((root / "people").string());
+            store->initialize(StartupSource::Csv);
+            store->setBulkMode(true);
+        };
+        // Every call below registers a new person; bulk mode keeps this from rewriting people.csv each time.
+        suite.measure("DataStore::ensurePersonId/insert-" + scaleLabel(kPeople), kPeople, freshStore, [&](std::size_t i) {
+            sink = sink + store->ensurePersonId("client", names[i]);
+        });
+        if (!store) {
+            freshStore();
+            for (const auto& name : names) {
+                store->ensurePersonId("client", name);
+            }
+        }
+        store->setBulkMode(false);
+        suite.measure("DataStore::ensurePersonId/lookup-" + scaleLabel(kPeople), kPeople, [&](std::size_t i) {
+            sink = sink + store->ensurePersonId("client", names[(i * 7919) % kPeople]);
+        });
+        store.reset();
+
+        // Reopening parses people.csv, which is the CSV load path for the directory.
+        suite.measure("DataStore::initialize/people-" + scaleLabel(kPeople), 1, [&](std::size_t) {
+            DataStore reopened((root / "people").string());
+            reopened.initialize(StartupSource::Csv);
+            sink = sink + static_cast<double>(reopened.peopleEntries().size());
+        });
+    }
+
+    void benchDailyReport(Suite& suite) {
+        time_t now = std::time(nullptr);
+        for (std::size_t records : {std::size_t{1'000}, std::size_t{100'000}, std::size_t{1'000'000}}) {
+            if (records > suite.maxRecords()) {
+                continue;
+            }
+            std::string name = "ExchangeOffice::compileDailyReport/" + scaleLabel(records);
+            if (!suite.wants(name)) {
+                continue;
+            }
+            ExchangeOffice office(sampleRates(), Reserve(ampleReserve()), 0.03);
+            for (std::size_t i = 0; i < records; ++i) {
+                office.applyRecordedTransaction(sampleRecord(static_cast<int>(i + 1), now));
+            }
+            std::size_t operations = std::max<std::size_t>(1, 100'000 / records);
+            suite.measure(name, operations, [&](std::size_t) {
+                sink = sink + office.compileDailyReport().profitInBase();
+            });
+        }
+    }
+
+    void benchBonuses(Suite& suite) {
+        constexpr std::size_t kRecords = 100'000;
+        constexpr int kCashiers = 50;
+        time_t now = std::time(nullptr);
+        ExchangeOffice office(sampleRates(), Reserve(ampleReserve()), 0.03);
+        for (std::size_t i = 0; i < std::min(kRecords, suite.maxRecords()); ++i) {
+            TransactionRecord record = sampleRecord(static_cast<int>(i + 1), now);
+            record.cashierId = 1 + static_cast<int>(i % kCashiers);
+            record.cashierName = "Cashier " + std::to_string(record.cashierId);
+            office.applyRecordedTransaction(record);
+        }
+        TieredBonusPolicy policy({{0.0, 0.01}, {1'000.0, 0.03}, {10'000.0, 0.05}});
+        // What per-cashier bonuses cost without the aggregates: a pass over the day's history.
+        suite.measure("BonusPolicy::rescan/" + scaleLabel(kRecords), 100, [&](std::size_t) {
+            std::map<int, double> profit;
+            for (const auto& record : office.transactionsToday()) {
+                profit[record.cashierId] += record.profitInBaseCurrency;
+            }
+            for (const auto& [cashierId, total] : profit) {
+                sink = sink + policy.calculateBonus(total);
+            }
+        });
+        suite.measure("BonusPolicy::evaluate/" + std::to_string(kCashiers) + "-cashiers", 100'000, [&](std::size_t) {
+            sink = sink + policy.evaluate(office.cashierTotalsMap(), BonusWindow::Month).front().bonus;
+        });
+    }
+
+    void benchClientLimits(Suite& suite) {
+        constexpr int kClients = 100'000;
+        time_t now = std::time(nullptr);
+        ClientLimitTracker tracker;
+        tracker.setLimits({{Currency::USD, ClientLimit{1e12, 1e13}}, {Currency::EUR, ClientLimit{1e12, 1e13}}});
+        ClientVolume volume{100.0, 90.0, 0.0, 0.0};
+        for (int client = 1; client <= kClients; ++client) {
+            for (int day = 7; day >= 0; --day) {
+                tracker.record(client, volume, now - day * 24 * 3600);
+            }
+        }
+        std::uint64_t state = 42;
+        auto next_client = [&]() {
+            state = state * 6364136223846793005ull + 1442695040888963407ull;
+            return 1 + static_cast<int>((state >> 33) % kClients);
+        };
+        suite.measure("ClientLimitTracker::check/" + scaleLabel(kClients) + "-clients", 1'000'000, [&](std::size_t) {
+            tracker.check(next_client(), volume, now);
+        });
+        suite.measure("ClientLimitTracker::record/" + scaleLabel(kClients) + "-clients", 1'000'000, [&](std::size_t) {
+            tracker.record(next_client(), volume, now);
+        });
+    }
+
+    void benchAnomalies(Suite& suite) {
+        constexpr std::size_t kEvents = 100'000;
+        time_t now = std::time(nullptr);
+        RateTable rates = sampleRates();
+        std::vector<AnomalyEvent> events;
+        for (std::size_t i = 0; i < kEvents; ++i) {
+            TransactionRecord record = sampleRecord(static_cast<int>(i + 1), now + static_cast<time_t>(i / 50));
+            record.clientId = 1 + static_cast<int>((i * 7919) % 20'000);
+            record.cashierId = 1 + static_cast<int>(i % 20);
+            events.push_back(AnomalyMonitor::summarize(record, rates));
+        }
+        // The part that runs on the transaction path, under the office lock.
+        TransactionRecord record = sampleRecord(1, now);
+        suite.measure("AnomalyMonitor::summarize", 1'000'000, [&](std::size_t) {
+            sink = sink + AnomalyMonitor::summarize(record, rates).valueBase;
+        });
+        auto detectors = AnomalyMonitor::defaultDetectors({{Currency::USD, ClientLimit{125.0, 0.0}}});
+        std::vector<AnomalyAlert> alerts;
+        suite.measure("AnomalyDetector::observe/all-" + std::to_string(detectors.size()), kEvents, [&](std::size_t i) {
+            alerts.clear();
+            for (auto& detector : detectors) {
+                detector->observe(events[i], alerts);
+            }
+            sink = sink + static_cast<double>(alerts.size());
+        });
+    }
+
+    void benchBranches(Suite& suite, const std::filesystem::path& root) {
+        constexpr std::size_t kBranches = 500;
+        constexpr std::size_t kRecordsPerBranch = 200;
+        std::string openName = "BranchNetwork::open/branches-" + scaleLabel(kBranches);
+        std::string consolidateName = "BranchNetwork::consolidate/" + scaleLabel(kBranches) + "x" + scaleLabel(kRecordsPerBranch);
+        if (!suite.wants(openName) && !suite.wants(consolidateName)) {
+            return;
+        }
+        DataStore head((root / "network").string());
+        head.initialize(StartupSource::Csv);
+        head.saveRates(sampleRates());
+        auto rates = std::make_shared<RateBoard>(sampleRates());
+        BranchDefaults defaults{ampleReserve(), {{Currency::USD, 1'000.0}}, 0.03, {}};
+        std::vector<std::string> names;
+        for (std::size_t i = 0; i < kBranches; ++i) {
+            names.push_back("branch-" + std::to_string(i));
+        }
+
+        // Creating a branch writes its reserve and critical CSVs; with ALLOC=1, B/op is the heap cost of one branch.
+        std::unique_ptr<BranchNetwork> network;
+        auto freshNetwork = [&]() {
+            network.reset();
+            std::filesystem::remove_all(head.branchesDirectory());
+            network = std::make_unique<BranchNetwork>(head.branchesDirectory(), head, rates, defaults);
+        };
+        suite.measure(openName, kBranches, freshNetwork, [&](std::size_t i) {
+            sink = sink + static_cast<double>(network->open(names[i]).office.nextReceiptNumber());
+        });
+        if (!network || network->size() != kBranches) {
+            freshNetwork();
+            for (const auto& name : names) {
+                network->open(name);
+            }
+        }
+
+        time_t now = std::time(nullptr);
+        for (const auto& name : names) {
+            Branch& branch = network->open(name);
+            for (std::size_t i = 0; i < kRecordsPerBranch; ++i) {
+                branch.office.applyRecordedTransaction(sampleRecord(static_cast<int>(i + 1), now));
+            }
+        }
+        suite.measure(consolidateName, 20, [&](std::size_t) {
+            sink = sink + network->consolidate().profitInBase;
+        });
+        suite.measure(consolidateName + "/1-thread", 20, [&](std::size_t) {
+            sink = sink + network->consolidate(1).profitInBase;
+        });
+    }
+
+    Settings parseArguments(int argc, char* argv[]) {
+        Settings settings;
+        for (int index = 1; index < argc; ++index) {
+            std::string argument = argv[index];
+            if (index + 1 >= argc) {
+                throw ExchangeError(argument + " requires a value");
+            }
+            std::string value = argv[++index];
+            if (argument == "--json") {
+                settings.jsonPath = value;
+            } else if (argument == "--filter") {
+                settings.filter = value;
+            } else if (argument == "--max-records") {
+                settings.maxRecords = static_cast<std::size_t>(std::stoull(value));
+            } else if (argument == "--rounds") {
+                settings.rounds = std::max(1, std::stoi(value));
+            } else {
+                throw ExchangeError("Unknown argument: " + argument);
+            }
+        }
+        return settings;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        Suite suite(parseArguments(argc, argv));
+        auto root = std::filesystem::temp_directory_path() / "cx-office-bench";
+        std::filesystem::remove_all(root);
+
+        benchRates(suite);
+        benchRateFeed(suite);
+        benchRebalance(suite);
+        benchSplitPlan(suite);
+        benchTransactions(suite);
+        benchStore(suite, root);
+        benchPeople(suite, root);
+        benchDailyReport(suite);
+        benchBonuses(suite);
+        benchClientLimits(suite);
+        benchAnomalies(suite);
+        benchBranches(suite, root);
+
+        std::filesystem::remove_all(root);
+        suite.emit();
+    } catch (const std::exception& error) {
+        std::cerr << "Benchmark failed: " << error.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,212 @@
+// Compares the binary wire codec with the text encoding the server uses for the same messages:
+// batch CSV rows for requests and JSON lines for receipts.
+#include "batch_processor.h"
+#include "persistence.h"
+#include "wire_protocol.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace {
+    constexpr int kMessages = 200'000;
+
+    volatile double sink = 0.0;
+
+    struct Result {
+        double seconds;
+        std::size_t bytes;
+    };
+
+    template <typename Body>
+    double timeIt(Body&& body) {
+        auto started = std::chrono::steady_clock::now();
+        body();
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    }
+
+    std::vector<ExchangeRequest> sampleRequests() {
+        std::vector<ExchangeRequest> requests;
+        requests.reserve(kMessages);
+        for (int i = 0; i < kMessages; ++i) {
+            std::vector<ExchangePortion> portions;
+            if (i % 3 == 0) {
+                portions.emplace_back(Currency::EUR, 40.0 + i % 50);
+                portions.push_back(ExchangePortion::remainder(Currency::GBP));
+            } else {
+                portions.push_back(ExchangePortion::remainder(Currency::EUR));
+            }
+            requests.emplace_back(1 + i % 500, "Client " + std::to_string(i % 500), Currency::USD, 100.0 + i % 900, std::move(portions));
+        }
+        return requests;
+    }
+
+    std::vector<Receipt> sampleReceipts() {
+        std::vector<Receipt> receipts;
+        receipts.reserve(kMessages);
+        time_t now = std::time(nullptr);
+        for (int i = 0; i < kMessages; ++i) {
+            std::vector<PayoutDetail> payouts{PayoutDetail{Currency::EUR, 96.5 + i % 100, 2.99, {}, 100.0}};
+            if (i % 3 == 0) {
+                payouts.push_back(PayoutDetail{Currency::GBP, 41.25, 1.28, {}, 50.0});
+            }
+            receipts.emplace_back(i + 1, 7, "Cashier", 1 + i % 500, "Client " + std::to_string(i % 500),
+                                  Currency::USD, 150.0 + i % 900, std::move(payouts), 3.2, 3.2, 0.0, now);
+        }
+        return receipts;
+    }
+
+    std::string textRequest(const ExchangeRequest& request) {
+        std::string row = request.clientName;
+        row.append(",").append(to_string(request.sourceCurrency)).push_back(',');
+        append_fixed(row, request.totalAmount);
+        row.push_back(',');
+        for (std::size_t i = 0; i < request.portions.size(); ++i) {
+            const auto& portion = request.portions[i];
+            if (i > 0) {
+                row.push_back(';');
+            }
+            row.append(to_string(portion.targetCurrency)).push_back(':');
+            if (portion.useRemainder) {
+                row.push_back('*');
+            } else {
+                append_fixed(row, portion.sourceAmount);
+            }
+        }
+        row.push_back(',');
+        append_integer(row, request.clientId);
+        return row;
+    }
+
+    // Pulls every number out of a receipt JSON line, which is what a text client has to do at least.
+    double scanReceiptJson(std::string_view line) {
+        double total = 0.0;
+        for (std::size_t colon = line.find(':'); colon != std::string_view::npos; colon = line.find(':', colon + 1)) {
+            const char* start = line.data() + colon + 1;
+            if (*start == '-' || (*start >= '0' && *start <= '9')) {
+                total += std::strtod(start, nullptr);
+            }
+        }
+        return total;
+    }
+
+    void report(const char* name, const Result& binary, const Result& text) {
+        std::printf("%-10s binary %9.0f msg/s %6.1f B/msg | text %9.0f msg/s %6.1f B/msg | speedup %.2fx\n",
+                    name,
+                    kMessages / binary.seconds, static_cast<double>(binary.bytes) / kMessages,
+                    kMessages / text.seconds, static_cast<double>(text.bytes) / kMessages,
+                    text.seconds / binary.seconds);
+    }
+
+    void appendJson(std::string& out, const std::string& name, const Result& result) {
+        out += out.empty() ? "{\"schema\":1,\"benchmarks\":[\n  {" : ",\n  {";
+        out += "\"name\":";
+        append_json_string(out, name);
+        out += ",\"operations\":";
+        append_integer(out, kMessages);
+        out += ",\"ns_per_op_min\":";
+        append_fixed(out, result.seconds * 1e9 / kMessages, 3);
+        out += ",\"ops_per_second\":";
+        append_fixed(out, kMessages / result.seconds, 1);
+        out += ",\"bytes_per_op\":";
+        append_fixed(out, static_cast<double>(result.bytes) / kMessages, 1);
+        out += '}';
+    }
+}
+
+int main(int argc, char* argv[]) {
+    auto requests = sampleRequests();
+    auto receipts = sampleReceipts();
+    DataStore store((std::filesystem::temp_directory_path() / "cx-wire-bench").string());
+    RequestParser parser(store);
+
+    std::string binaryBuffer;
+    Result binaryRequests{};
+    binaryRequests.seconds = timeIt([&]() {
+        binaryBuffer.clear();
+        for (std::size_t i = 0; i < requests.size(); ++i) {
+            WireCodec::appendRequest(binaryBuffer, static_cast<std::uint32_t>(i), requests[i]);
+        }
+        std::string_view cursor = binaryBuffer;
+        WireFrame frame{};
+        while (std::size_t used = WireCodec::nextFrame(cursor, frame)) {
+            ExchangeRequestView view = WireCodec::decodeRequest(frame.payload);
+            ExchangeRequest decoded = WireCodec::toRequest(view, static_cast<int>(view.clientId));
+            sink = sink + decoded.totalAmount;
+            cursor.remove_prefix(used);
+        }
+    });
+    binaryRequests.bytes = binaryBuffer.size();
+
+    std::string textBuffer;
+    Result textRequests{};
+    textRequests.seconds = timeIt([&]() {
+        textBuffer.clear();
+        for (const auto& request : requests) {
+            textBuffer.append(textRequest(request)).push_back('\n');
+        }
+        std::string_view cursor = textBuffer;
+        while (!cursor.empty()) {
+            auto newline = cursor.find('\n');
+            ExchangeRequest decoded = parser.parse(cursor.substr(0, newline), BatchFormat::Csv);
+            sink = sink + decoded.totalAmount;
+            cursor.remove_prefix(newline + 1);
+        }
+    });
+    textRequests.bytes = textBuffer.size();
+
+    Result binaryReceipts{};
+    binaryReceipts.seconds = timeIt([&]() {
+        binaryBuffer.clear();
+        for (std::size_t i = 0; i < receipts.size(); ++i) {
+            WireCodec::appendReceipt(binaryBuffer, static_cast<std::uint32_t>(i), receipts[i]);
+        }
+        std::string_view cursor = binaryBuffer;
+        WireFrame frame{};
+        while (std::size_t used = WireCodec::nextFrame(cursor, frame)) {
+            ReceiptView view = WireCodec::decodeReceipt(frame.payload);
+            double total = WireCodec::fromMinor(view.sourceAmountMinor);
+            WireCodec::forEachPayout(view, [&total](const PayoutView& payout) {
+                total += WireCodec::fromMinor(payout.amountMinor);
+            });
+            sink = sink + total;
+            cursor.remove_prefix(used);
+        }
+    });
+    binaryReceipts.bytes = binaryBuffer.size();
+
+    Result textReceipts{};
+    textReceipts.seconds = timeIt([&]() {
+        textBuffer.clear();
+        for (const auto& receipt : receipts) {
+            BatchProcessor::appendReceiptJson(textBuffer, receipt);
+            textBuffer.push_back('\n');
+        }
+        std::string_view cursor = textBuffer;
+        while (!cursor.empty()) {
+            auto newline = cursor.find('\n');
+            sink = sink + scanReceiptJson(cursor.substr(0, newline));
+            cursor.remove_prefix(newline + 1);
+        }
+    });
+    textReceipts.bytes = textBuffer.size();
+
+    std::printf("%d messages, encode + decode\n", kMessages);
+    report("requests", binaryRequests, textRequests);
+    report("receipts", binaryReceipts, textReceipts);
+
+    if (argc == 3 && std::string(argv[1]) == "--json") {
+        std::string json;
+        appendJson(json, "wire/requests/binary", binaryRequests);
+        appendJson(json, "wire/requests/text", textRequests);
+        appendJson(json, "wire/receipts/binary", binaryReceipts);
+        appendJson(json, "wire/receipts/text", textReceipts);
+        json += "\n]}\n";
+        std::ofstream(argv[2], std::ios::trunc) << json;
+    }
+    return 0;
+}
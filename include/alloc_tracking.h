@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation accounting. Build with `make clean && make ALLOC=1` to replace the global
+// operator new/delete with counting versions; otherwise nothing is replaced and every count is zero.
+#ifndef CX_ALLOC_TRACKING
+#define CX_ALLOC_TRACKING 0
+#endif
+
+struct AllocationCount {
+    std::uint64_t allocations = 0;
+    std::uint64_t bytes = 0;
+
+    AllocationCount& operator+=(const AllocationCount& other) {
+        allocations += other.allocations;
+        bytes += other.bytes;
+        return *this;
+    }
+
+    AllocationCount operator-(const AllocationCount& earlier) const {
+        return AllocationCount{allocations - earlier.allocations, bytes - earlier.bytes};
+    }
+};
+
+class AllocationTracker {
+public:
+    static constexpr bool kCompiledIn = CX_ALLOC_TRACKING != 0;
+
+    // Allocations made by the calling thread since it started. Take two readings and subtract
+    // them to charge a scope; frees are not tracked.
+    static AllocationCount thread();
+};
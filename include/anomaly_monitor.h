@@ -0,0 +1,204 @@
+#pragma once
+
+#include "client_limits.h"
+#include "exchange_manager.h"
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// What the detectors see of one committed transaction; fixed-size so queueing it never allocates.
+struct AnomalyEvent {
+    std::time_t timestamp = 0;
+    int receiptId = 0;
+    int clientId = 0;
+    int cashierId = 0;
+    Currency sourceCurrency = Currency::LOCAL;
+    double sourceAmount = 0.0;
+    double valueBase = 0.0;            // Source amount at mid, in the base currency
+    ClientVolume volume{};             // As counted against client limits
+    std::size_t portions = 0;
+    unsigned targetMask = 0;           // Bit per Currency paid out
+    double smallestPortionShare = 1.0; // Smallest payout's slice of the source amount
+};
+
+struct AnomalyAlert {
+    std::time_t timestamp;
+    int receiptId;
+    std::string detector;
+    std::string subject;
+    std::string detail;
+};
+
+// Count-min sketch of exponentially decayed totals: fixed memory however many keys it sees, and an
+// estimate that never undercounts. Each cell decays lazily from its own last update.
+class DecayedSketch {
+private:
+    static constexpr std::size_t kDepth = 4;
+
+    struct Cell {
+        double value = 0.0;
+        std::time_t updated = 0;
+    };
+
+    unsigned widthBits;
+    double meanLife;
+    std::vector<Cell> cells;
+
+    std::size_t index(std::size_t row, std::uint64_t key) const;
+
+public:
+    // `widthBits` sets 2^widthBits cells per row; `meanLifeSeconds` is the decay time constant.
+    DecayedSketch(unsigned widthBits, double meanLifeSeconds);
+
+    // Adds `amount` for `key` and returns the key's decayed total just before it.
+    double add(std::uint64_t key, double amount, std::time_t timestamp);
+    double estimate(std::uint64_t key, std::time_t timestamp) const;
+};
+
+// One pluggable detection stage. Detectors run on the monitor thread only, one event at a time.
+class AnomalyDetector {
+public:
+    virtual ~AnomalyDetector() = default;
+    virtual const char* name() const = 0;
+    virtual void observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) = 0;
+};
+
+// Bursts of exchanges from one client: alerts when a client's decayed count crosses `burst`.
+class ClientVelocityDetector : public AnomalyDetector {
+private:
+    double burst;
+    double meanLife;
+    DecayedSketch counts;
+
+public:
+    explicit ClientVelocityDetector(double burstCount = 5.0, double meanLifeSeconds = 600.0);
+    const char* name() const override;
+    void observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) override;
+};
+
+// Splits whose shape (currencies paid out and portion count) is rare in recent traffic, or that carve
+// off a sliver portion.
+class SplitPatternDetector : public AnomalyDetector {
+private:
+    static constexpr std::size_t kShapes = 16 * 8;
+
+    double rarity;
+    double warmup;
+    double sliver;
+    double meanLife;
+    std::array<double, kShapes> shapes{};
+    double total = 0.0;
+    std::time_t updated = 0;
+
+public:
+    SplitPatternDetector(double rareShare = 0.02, double warmupCount = 50.0, double sliverShare = 0.01,
+                         double meanLifeSeconds = 86400.0);
+    const char* name() const override;
+    void observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) override;
+};
+
+// Cashiers whose short-term volume rate runs well above their own longer baseline.
+class CashierVolumeDetector : public AnomalyDetector {
+private:
+    struct Rates {
+        double fast = 0.0;
+        double slow = 0.0;
+        std::time_t firstSeen = 0;
+        std::time_t updated = 0;
+        bool alerted = false;
+    };
+
+    double factor;
+    double minimumVolume;
+    double fastLife;
+    double slowLife;
+    double minimumHistory;
+    std::map<int, Rates> cashiers;
+
+public:
+    CashierVolumeDetector(double spikeFactor = 4.0, double minimumVolumeBase = 10'000.0, double fastLifeSeconds = 900.0,
+                          double slowLifeSeconds = 28'800.0, double minimumHistorySeconds = 3'600.0);
+    const char* name() const override;
+    void observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) override;
+};
+
+// Single exchanges landing just under a client limit, and how often the same client has done so lately.
+class NearLimitDetector : public AnomalyDetector {
+private:
+    std::array<ClientLimit, 4> limits{};
+    double margin;
+    DecayedSketch hits;
+
+public:
+    NearLimitDetector(const std::map<Currency, ClientLimit>& clientLimits, double marginShare = 0.1);
+    const char* name() const override;
+    void observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) override;
+};
+
+struct AnomalyStatistics {
+    std::size_t observed = 0;
+    std::size_t dropped = 0; // Events lost to a full queue
+    std::size_t alerts = 0;
+};
+
+// Inline anomaly detection hooked after each committed transaction.
+//
+// onTransaction runs under the office lock, so it only summarises the record into an AnomalyEvent and
+// pushes it onto a fixed ring; when the ring is full the event is dropped and counted rather than
+// stalling the counter. A worker thread drains the ring through the detectors and appends their
+// alerts to the log file.
+class AnomalyMonitor : public OfficeEventListener {
+private:
+    static constexpr std::size_t kQueueCapacity = 4096;
+
+    const ExchangeOffice& office;
+    std::filesystem::path logPath;
+    std::ofstream log;
+    std::vector<std::unique_ptr<AnomalyDetector>> detectors;
+    std::thread worker;
+    std::mutex queueMutex;
+    std::condition_variable queueReady;
+    std::vector<AnomalyEvent> ring;
+    std::size_t head;
+    std::size_t queued;
+    bool stopping;
+    std::atomic<std::size_t> observed;
+    std::atomic<std::size_t> dropped;
+    std::atomic<std::size_t> alertCount;
+
+    void run();
+    void write(const AnomalyAlert& alert);
+
+public:
+    AnomalyMonitor(const ExchangeOffice& exchangeOffice, std::filesystem::path alertLog);
+    ~AnomalyMonitor() override;
+
+    AnomalyMonitor(const AnomalyMonitor&) = delete;
+    AnomalyMonitor& operator=(const AnomalyMonitor&) = delete;
+
+    // Detectors are added before start().
+    void add(std::unique_ptr<AnomalyDetector> detector);
+    // Opens the log for appending (throwing if it cannot) and starts the worker.
+    void start();
+    // Drains what is still queued and joins the worker.
+    void stop();
+    AnomalyStatistics stats() const;
+
+    void onTransaction(const TransactionRecord& record) override;
+
+    static AnomalyEvent summarize(const TransactionRecord& record, const RateTable& rates);
+    // Velocity, split and cashier volume detectors, plus near-limit ones when any client limit is set.
+    static std::vector<std::unique_ptr<AnomalyDetector>> defaultDetectors(const std::map<Currency, ClientLimit>& clientLimits);
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "employee.h"
+#include "persistence.h"
+
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+enum class BatchFormat {
+    Auto,
+    Csv,
+    JsonLines
+};
+
+struct BatchSummary {
+    std::size_t processed = 0;
+    std::size_t succeeded = 0;
+    std::size_t failed = 0;
+    double elapsedSeconds = 0.0;
+};
+
+// Turns one CSV or JSON line into an ExchangeRequest, registering unknown clients on the way.
+//
+// CSV rows:  client,source,amount,portions[,client_id]
+//            portions is "EUR" (whole amount) or "EUR:40;GBP:*" with optional "@10/20" denominations,
+//            or an automatic split such as "prefer:EUR;USD" (see SplitOptimizer::parse).
+// JSON Lines: {"client":"Bob","source":"USD","amount":100,"portions":[{"target":"EUR","amount":40},{"target":"GBP"}]}
+//            "target":"EUR" may replace "portions" for a single-currency exchange, and "split":"payout:EUR;GBP" plans one.
+class RequestParser {
+private:
+    DataStore& store;
+
+    ExchangeRequest parseCsv(std::string_view line);
+    ExchangeRequest parseJson(std::string_view line);
+    int resolveClient(const std::string& name, int explicitId);
+
+public:
+    explicit RequestParser(DataStore& persistence);
+
+    ExchangeRequest parse(std::string_view line, BatchFormat format);
+    static BatchFormat detect(std::string_view line);
+};
+
+// Streams exchange requests into Cashier::handleRequest without prompts.
+// Every input line yields one JSON object on the output: the receipt, or {"line":N,"error":"..."}.
+class BatchProcessor {
+private:
+    Cashier& cashier;
+    DataStore& store;
+    RequestParser parser;
+    BatchFormat format;
+
+public:
+    BatchProcessor(Cashier& batchCashier, DataStore& persistence, BatchFormat inputFormat = BatchFormat::Auto);
+
+    BatchSummary run(std::istream& input, std::ostream& output);
+
+    static BatchFormat parseFormat(const std::string& name);
+    static void appendReceiptJson(std::string& out, const Receipt& receipt);
+};
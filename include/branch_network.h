@@ -0,0 +1,92 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "persistence.h"
+
+#include <cstddef>
+#include <ctime>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct BranchDefaults {
+    std::map<Currency, double> reserve;
+    std::map<Currency, double> criticalMinimums;
+    double commission = 0.03;
+    std::map<Currency, ClientLimit> clientLimits; // Used when a branch has no limits.csv of its own
+};
+
+// One branch office under <root>/<name>/: its own reserve, critical minimums, people and transaction
+// log, quoting from the rates every branch shares. Idle branches hold no open files.
+class Branch {
+private:
+    bool storeOpen;
+
+public:
+    const std::string name;
+    DataStore store;
+    ExchangeOffice office;
+    std::mutex mutex; // Serialises the sessions working at this branch
+
+    Branch(std::string branchName, const std::filesystem::path& directory, const DataStore& ratesOwner,
+           std::shared_ptr<RateBoard> rates, const BranchDefaults& defaults);
+
+    // Loads people.csv and opens the transaction log on first use. Call with the mutex held.
+    void openStore();
+};
+
+struct BranchTotals {
+    std::string name;
+    std::size_t transactions = 0;
+    double profitInBase = 0.0;
+    std::map<Currency, double> startBalances;
+    std::map<Currency, double> endBalances;
+    std::vector<Currency> belowCritical;
+};
+
+struct ConsolidatedReport {
+    std::vector<BranchTotals> branches;       // Sorted by name
+    std::map<Currency, double> startBalances; // Summed over every branch
+    std::map<Currency, double> endBalances;
+    std::map<Currency, double> volumeIn;      // Source amounts taken in
+    std::map<Currency, double> volumeOut;     // Payouts handed out, commission excluded
+    std::size_t transactions = 0;
+    double profitInBase = 0.0;
+    time_t generatedAt = 0;
+};
+
+// Many branch offices in one process. Each branch has its own state and lock; only the rate board
+// and rates.csv (owned by the head office store) are shared.
+class BranchNetwork {
+private:
+    std::filesystem::path root;
+    const DataStore& headOffice;
+    std::shared_ptr<RateBoard> rates;
+    BranchDefaults defaults;
+    mutable std::mutex mutex; // Guards the branch list, not the branches
+    std::vector<std::unique_ptr<Branch>> branches;
+
+    Branch* locate(const std::string& name) const;
+
+public:
+    BranchNetwork(std::filesystem::path directory, const DataStore& ratesOwner, std::shared_ptr<RateBoard> sharedRates,
+                  BranchDefaults branchDefaults);
+
+    // Opens every branch directory under the root. Returns the number of branches hosted.
+    std::size_t loadAll();
+    // Finds a branch, creating it from the defaults if it does not exist yet.
+    Branch& open(const std::string& name);
+    Branch* find(const std::string& name) const;
+    std::vector<std::string> names() const;
+    std::size_t size() const;
+
+    // Writes every branch's reserve and critical minimums.
+    void saveAll() const;
+    // Totals every branch over its day so far, splitting the branches across `workers` threads
+    // (0 = one per core).
+    ConsolidatedReport consolidate(std::size_t workers = 0) const;
+    static std::string format(const ConsolidatedReport& report);
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "utils.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <map>
+#include <vector>
+
+// Most a client may exchange in one currency over a rolling day and a rolling week; 0 means no limit.
+struct ClientLimit {
+    double daily = 0.0;
+    double weekly = 0.0;
+};
+
+// Amount of each currency one transaction moves for the client (handed over or paid out), indexed by Currency.
+using ClientVolume = std::array<double, 4>;
+
+// One client's recent volume: a ring of per-day buckets for each currency, the newest for `newestDay`.
+struct ClientWindow {
+    static constexpr std::size_t kDays = 8; // Today, the six days before and the day the week window partly covers
+
+    int clientId = 0;
+    std::int32_t newestDay = 0; // Days since the epoch (UTC)
+    std::array<std::array<double, kDays>, 4> buckets{};
+};
+
+// Rolling per-client limits in a flat open-addressing table keyed by client id, O(1) per check.
+//
+// Windows slide a day bucket at a time: the rolling day is today's bucket plus the share of yesterday's
+// the window still covers, and the rolling week likewise adds the part of the eighth day back to the last seven.
+class ClientLimitTracker {
+private:
+    static constexpr int kEmpty = -2147483647 - 1;
+
+    std::array<ClientLimit, 4> limits{};
+    bool limited = false;
+    std::vector<int> keys; // kEmpty marks a free slot; parallel to windows
+    std::vector<ClientWindow> windows;
+    std::size_t occupied = 0;
+
+    std::size_t slotFor(int clientId) const;
+    void grow();
+
+public:
+    ClientLimitTracker();
+
+    void setLimits(const std::map<Currency, ClientLimit>& configured);
+    std::map<Currency, ClientLimit> limitsMap() const;
+    // False while no currency has a limit, so unlimited offices skip the check entirely.
+    bool enabled() const;
+
+    // Throws LimitExceededError if `volume` at `timestamp` would take the client over a limit.
+    void check(int clientId, const ClientVolume& volume, std::time_t timestamp) const;
+    void record(int clientId, const ClientVolume& volume, std::time_t timestamp);
+    // Rolling day and week volume of one currency for a client.
+    std::pair<double, double> usage(int clientId, Currency currency, std::time_t timestamp) const;
+    // What the client may still move in `currency` before a limit; infinity when the currency has none.
+    double headroom(int clientId, Currency currency, std::time_t timestamp) const;
+
+    std::size_t clients() const;
+    // Windows with volume still inside the rolling week, for snapshots; stale clients are dropped here.
+    std::vector<ClientWindow> activeWindows(std::time_t timestamp) const;
+    void restore(const std::vector<ClientWindow>& saved);
+};
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "persistence.h"
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+// Follows rates.csv and critical.csv with inotify and pushes outside edits into a running office.
+// The changed file is re-parsed on the watcher thread; only the swap into the office takes the office
+// mutex, and it goes through applyRates / updateCriticalMinimums so the journal records it. Files the
+// office's own DataStore wrote are recognised and skipped.
+class ConfigWatcher {
+private:
+    ExchangeOffice& office;
+    DataStore& store;
+    std::mutex& officeMutex;
+    std::thread worker;
+    std::atomic<bool> stopping;
+    std::atomic<std::size_t> reloads;
+    int inotifyDescriptor;
+    int ratesWatch;
+    int criticalWatch;
+
+    void run();
+    void reloadRates();
+    void reloadCriticalMinimums();
+
+public:
+    ConfigWatcher(ExchangeOffice& exchangeOffice, DataStore& persistence, std::mutex& sharedOfficeMutex);
+    ~ConfigWatcher();
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    // Sets up the watches (throwing if it cannot) and starts the watcher thread.
+    void start();
+    void stop();
+    // Reloads that changed the office.
+    std::size_t reloadCount() const;
+};
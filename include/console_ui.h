@@ -2,9 +2,16 @@
 
 #include "client.h"
 #include "employee.h"
+#include "latency_histogram.h"
+#include "output_sink.h"
 #include "persistence.h"
+#include "session_runtime.h"
+#include "transaction_query.h"
 
 #include <functional>
+#include <future>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -12,29 +19,41 @@ class ConsoleUI {
 private:
     ExchangeOffice& office;
     DataStore& store;
-
-    std::string readLine(const std::string& prompt) const;
-    int readInt(const std::string& prompt, int minValue, int maxValue) const;
-    double readDouble(const std::string& prompt, double minValue) const;
-    Currency readCurrency(const std::string& prompt) const;
-    bool readYesNo(const std::string& prompt) const;
-    std::vector<int> readDenominations(const std::string& prompt) const;
-
-    void employeeSession();
-    void employeeExchangeFlow(Cashier& cashier);
+    OutputSink& out;
+    LineInput& input;
+    std::mutex& officeMutex; // Shared by every session driving the same office
+    std::vector<std::future<ReportFiles>> pendingReports;
+
+    // Coroutine parameters are taken by value so they outlive the caller's temporaries.
+    Task<std::string> readLine(std::string prompt) const;
+    Task<int> readInt(std::string prompt, int minValue, int maxValue) const;
+    Task<double> readDouble(std::string prompt, double minValue) const;
+    Task<Currency> readCurrency(std::string prompt) const;
+    Task<bool> readYesNo(std::string prompt) const;
+    Task<std::vector<int>> readDenominations(std::string prompt) const;
+
+    Task<void> employeeSession();
+    Task<void> employeeExchangeFlow(Cashier& cashier);
     void employeeReserveCheck() const;
 
-    void managerSession();
+    Task<void> managerSession();
     void managerShowReport(Manager& manager);
-    void managerAdjustRates(Manager& manager);
-    void managerSetCriticalReserve(Manager& manager);
+    Task<void> managerAdjustRates(Manager& manager);
+    Task<void> managerSetCriticalReserve(Manager& manager);
+    Task<void> managerPlanRebalancing(Manager& manager);
+    Task<void> managerQueryTransactions();
+    void managerShowLatencies();
+    void collectFinishedReports(bool wait);
 
     void persistReserve() const;
     void persistRates() const;
     void persistCriticalMinimums() const;
 
 public:
-    ConsoleUI(ExchangeOffice& office, DataStore& persistence);
+    ConsoleUI(ExchangeOffice& office, DataStore& persistence, OutputSink& output, LineInput& lineInput, std::mutex& sharedOfficeMutex);
 
+    // Whole operator session; suspends only while waiting for input.
+    Task<void> session();
+    // Drives session() over blocking input on the calling thread.
     void run();
 };
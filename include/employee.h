@@ -1,6 +1,8 @@
 #pragma once
 
 #include "exchange_manager.h"
+#include "output_sink.h"
+#include "reserve_planner.h"
 #include "utils.h"
 
 #include <memory>
@@ -19,7 +21,7 @@ public:
     int getId() const;
     const std::string& getName() const;
     virtual std::string role() const = 0;
-    virtual void performDailyDuties() = 0;
+    virtual void performDailyDuties(OutputSink& out) = 0;
 };
 
 class Cashier : public Employee {
@@ -30,30 +32,37 @@ public:
     Cashier(int cashierId, std::string cashierName, ExchangeOffice& exchangeOffice);
 
     Receipt handleRequest(const ExchangeRequest& request);
-    void printReceipt(const Receipt& receipt) const;
+    void printReceipt(const Receipt& receipt, OutputSink& out) const;
     bool collectLowReserveAlerts(std::vector<Currency>& lowCurrencies) const;
 
     std::string role() const override;
-    void performDailyDuties() override;
+    void performDailyDuties(OutputSink& out) override;
 };
 
 class Manager : public Employee {
 private:
     ExchangeOffice& office;
     std::unique_ptr<BonusPolicy> bonusPolicy;
+    std::unique_ptr<BonusPolicy> monthlyBonusPolicy;
 
 public:
     Manager(int managerId,
             std::string managerName,
             ExchangeOffice& exchangeOffice,
-            std::unique_ptr<BonusPolicy> policy = std::make_unique<PercentageBonusPolicy>(0.05));
+            std::unique_ptr<BonusPolicy> policy = std::make_unique<PercentageBonusPolicy>(0.05),
+            std::unique_ptr<BonusPolicy> monthlyPolicy = nullptr);
 
     std::string role() const override;
-    void performDailyDuties() override;
+    void performDailyDuties(OutputSink& out) override;
 
     void setExchangeRate(Currency from, Currency to, double rate);
+    void setExchangeMargin(Currency from, Currency to, double margin);
     void setCriticalReserve(Currency currency, double amount);
     void topUpReserve(Currency currency, double amount);
+    // Carries out a ReservePlanner plan: each conversion leaves one currency and lands in another.
+    void applyRebalancing(const RebalancePlan& plan);
     double calculateBonus(double profitBaseCurrency) const;
+    // Bonus for every cashier with transactions in the window; empty when no policy covers it.
+    std::vector<CashierBonus> cashierBonuses(BonusWindow window) const;
     DailyReport compileDailyReport() const;
 };
@@ -1,12 +1,17 @@
 #pragma once
 
+#include "client_limits.h"
 #include "utils.h"
 
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <ctime>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <string>
-#include <tuple>
 #include <vector>
 
 class Reserve {
@@ -25,20 +30,83 @@ public:
     const std::map<Currency, double>& allBalances() const;
 };
 
+// A configured pair: the mid rate for `from` -> `to` and the margin taken on either side of it.
+struct PairRate {
+    Currency from;
+    Currency to;
+    double mid;
+    double margin;
+};
+
+// A new mid for a pair, optionally with a new margin; without one the pair keeps its margin.
+struct RateUpdate {
+    Currency from;
+    Currency to;
+    double mid;
+    std::optional<double> margin;
+};
+
+// Rates are kept as 4x4 matrices indexed by currency. The configured mids and margins are expanded
+// into mid and client quote matrices (crosses via the base currency included) whenever they change,
+// so pricing a transaction is two array reads.
+//
+// For a pair with mid m and margin s the client receives m * (1 - s) per unit in either direction:
+// the bid for from -> to is m * (1 - s) and the ask is m / (1 - s).
 class RateTable {
 private:
-    std::map<std::pair<Currency, Currency>, double> directRates;
+    using Matrix = std::array<std::array<double, 4>, 4>;
+
+    Matrix mids{};         // Configured mid rates, both directions; 0 = not configured
+    Matrix margins{};      // Configured margins, symmetric
+    Matrix midQuotes{};    // Mid rate for every convertible pair; 0 = not convertible
+    Matrix clientQuotes{}; // Rate the client receives for every convertible pair
     Currency baseCurrency;
 
+    void storeRate(Currency from, Currency to, double rate);
+    void storeMargin(Currency from, Currency to, double margin);
+    void rebuildQuotes();
+    double lookup(const Matrix& matrix, Currency from, Currency to) const;
+
 public:
     explicit RateTable(Currency base = Currency::LOCAL);
 
+    // Sets the mid rate, keeping the pair's margin.
     void setRate(Currency from, Currency to, double rate);
+    // Sets the margin for a configured pair, as a fraction of the mid (0 <= margin < 0.5).
+    void setMargin(Currency from, Currency to, double margin);
+    // Sets the pair from a bid and an ask quote for `from` -> `to`.
+    void setBidAsk(Currency from, Currency to, double bid, double ask);
+    // Applies several updates, rebuilding the quote matrices once.
+    void apply(const std::vector<RateUpdate>& updates);
     double getRate(Currency from, Currency to) const;
+    double margin(Currency from, Currency to) const;
     bool canConvert(Currency from, Currency to) const;
+    // Converts at the mid rate; used for valuing amounts, not for paying clients.
     double convert(double amount, Currency from, Currency to) const;
+    double midRate(Currency from, Currency to) const;
+    // Rate a client receives when selling `from` for `to`.
+    double quoteRate(Currency from, Currency to) const;
+    double bid(Currency from, Currency to) const;
+    double ask(Currency from, Currency to) const;
     Currency base() const;
-    std::vector<std::tuple<Currency, Currency, double>> serialize() const;
+    std::vector<PairRate> serialize() const;
+};
+
+// Rates shared by every office (branch) in the process. Readers take an immutable snapshot, so an
+// update never changes rates under a transaction in flight; writers publish a modified copy.
+class RateBoard {
+private:
+    std::mutex writerMutex;
+    std::atomic<std::shared_ptr<const RateTable>> current;
+
+public:
+    explicit RateBoard(RateTable initial);
+
+    std::shared_ptr<const RateTable> snapshot() const;
+    void setRate(Currency from, Currency to, double rate);
+    void setMargin(Currency from, Currency to, double margin);
+    // Publishes every update in one copy, so readers see either none of them or all of them.
+    void apply(const std::vector<RateUpdate>& updates);
 };
 
 struct TransactionRecord {
@@ -52,6 +120,18 @@ struct TransactionRecord {
     std::vector<PayoutDetail> payouts;
     double profitInBaseCurrency;
     time_t timestamp;
+    double spreadInBaseCurrency = 0.0; // Part of the profit earned on the bid/ask spread
+};
+
+struct ExchangeQuote {
+    Currency sourceCurrency;
+    Currency targetCurrency;
+    double sourceAmount;
+    double convertedAmount;
+    double commission;
+    double payout;
+    double spread; // Target currency given up to the margin, versus converting at mid
+    bool reserveCovers;
 };
 
 class Receipt {
@@ -66,6 +146,7 @@ private:
     std::vector<PayoutDetail> payoutDetails;
     double profitBaseCurrency;
     double commissionBaseCurrency;
+    double spreadBaseCurrency;
     time_t transactionTime;
 
 public:
@@ -79,6 +160,7 @@ public:
             std::vector<PayoutDetail> details,
             double profitBase,
             double commissionBase,
+            double spreadBase,
             time_t timestamp);
 
     int id() const;
@@ -91,6 +173,7 @@ public:
     const std::vector<PayoutDetail>& payouts() const;
     double profitInBase() const;
     double commissionInBase() const;
+    double spreadInBase() const;
     time_t timestamp() const;
 };
 
@@ -101,6 +184,8 @@ private:
     std::map<Currency, double> minimumThresholds;
     std::vector<TransactionRecord> transactions;
     double totalProfitBase;
+    double totalSpreadBase;
+    double totalRebalancingBase;
     time_t generatedAt;
 
 public:
@@ -109,6 +194,8 @@ public:
                 std::map<Currency, double> thresholds,
                 std::vector<TransactionRecord> records,
                 double profit,
+                double spreadIncome,
+                double rebalancingCost,
                 time_t generated);
 
     const std::map<Currency, double>& startBalances() const;
@@ -116,13 +203,42 @@ public:
     const std::map<Currency, double>& criticalThresholds() const;
     const std::vector<TransactionRecord>& history() const;
     double profitInBase() const;
+    double spreadIncomeBase() const;
+    double commissionIncomeBase() const;
+    double rebalancingCostBase() const;
     time_t generatedOn() const;
 };
 
+// Profit one cashier has earned in the current daily cycle and calendar month, updated as each transaction commits.
+struct CashierTotals {
+    std::string name;
+    double dayProfitBase = 0.0;
+    std::size_t dayTransactions = 0;
+    double monthProfitBase = 0.0;
+    std::size_t monthTransactions = 0;
+};
+
+enum class BonusWindow {
+    Day,
+    Month
+};
+
+struct CashierBonus {
+    int cashierId;
+    std::string cashierName;
+    double profitBase;
+    double bonus;
+};
+
 class BonusPolicy {
 public:
     virtual ~BonusPolicy() = default;
     virtual double calculateBonus(double profitBaseCurrency) const = 0;
+    // Every cashier's bonus for the window in one pass over the commit-time aggregates.
+    virtual std::vector<CashierBonus> evaluate(const std::map<int, CashierTotals>& cashiers, BonusWindow window) const;
+
+    // "percent:5", "threshold:2000@10" or "tiered:0@1;5000@3;20000@5"; rates are percentages of profit.
+    static std::unique_ptr<BonusPolicy> parse(const std::string& specification);
 };
 
 class PercentageBonusPolicy : public BonusPolicy {
@@ -134,37 +250,122 @@ public:
     double calculateBonus(double profitBaseCurrency) const override;
 };
 
+// Pays a share of the profit above the threshold and nothing up to it.
+class ThresholdBonusPolicy : public BonusPolicy {
+private:
+    double threshold;
+    double percentage;
+
+public:
+    ThresholdBonusPolicy(double profitThreshold, double percent);
+    double calculateBonus(double profitBaseCurrency) const override;
+};
+
+// Marginal tiers: each tier's share applies to the profit between its lower bound and the next tier's.
+class TieredBonusPolicy : public BonusPolicy {
+private:
+    std::vector<std::pair<double, double>> tiers; // Lower bound and share, ascending by bound
+
+public:
+    explicit TieredBonusPolicy(std::vector<std::pair<double, double>> bandRates);
+    double calculateBonus(double profitBaseCurrency) const override;
+};
+
+class OfficeEventListener {
+public:
+    virtual ~OfficeEventListener() = default;
+    virtual void onTransaction(const TransactionRecord&) {}
+    virtual void onReserveAdjusted(Currency, double) {}
+    virtual void onReservesRebalanced(const std::map<Currency, double>&, double) {}
+    virtual void onRateChanged(Currency, Currency, double) {}
+    virtual void onSpreadChanged(Currency, Currency, double) {}
+    virtual void onCriticalMinimumChanged(Currency, double) {}
+    virtual void onDailyReset() {}
+};
+
 class ExchangeOffice {
 private:
-    RateTable rateTable;
+    std::shared_ptr<RateBoard> rateBoard;
     Reserve currentReserve;
     Reserve startingReserve;
     std::map<Currency, double> criticalMinimums;
     std::vector<TransactionRecord> dailyTransactions;
     double profitInBase;
+    double spreadIncomeBase;
+    double rebalancingCostBase; // Already deducted from profitInBase
     double commissionPercent;
     int nextReceiptId;
+    bool gaugesEnabled;
+    std::vector<OfficeEventListener*> listeners;
+    std::map<int, CashierTotals> cashierTotals;
+    std::time_t monthStart;
+    std::time_t monthEnd;
+    ClientLimitTracker clientLimits;
 
     double commissionFor(double amount) const;
+    void accrueCashierProfit(const TransactionRecord& record);
+    Receipt settleTransaction(const ExchangeRequest& request, const std::string& cashierName, int cashierId);
+    // The request with portions planned from its automatic split preferences against the current reserve.
+    ExchangeRequest plannedSplit(const ExchangeRequest& request) const;
 
 public:
     ExchangeOffice(RateTable rates, Reserve reserve, double commission);
+    // An office quoting from rates shared with other offices; updateRate changes them for all.
+    ExchangeOffice(std::shared_ptr<RateBoard> sharedRates, Reserve reserve, double commission);
 
     Receipt executeTransaction(const ExchangeRequest& request, const std::string& cashierName, int cashierId);
+    ExchangeQuote quote(Currency from, Currency to, double amount) const;
     bool isBelowCritical(Currency currency) const;
     double criticalMinimum(Currency currency) const;
     void setCriticalMinimum(Currency currency, double amount);
     void initializeCriticalMinimums(const std::map<Currency, double>& minima);
+    // Replaces every critical minimum at once; currencies left out drop to zero.
+    void updateCriticalMinimums(const std::map<Currency, double>& minima);
+    // Per-currency daily and weekly limits on what one client may exchange; checked before a transaction commits.
+    void setClientLimits(const std::map<Currency, ClientLimit>& limits);
     void topUpReserve(Currency currency, double amount);
     void reduceReserve(Currency currency, double amount);
+    // Applies net reserve changes as one event, charging costBase to the day's profit; nothing moves if a withdrawal is not covered.
+    void rebalanceReserves(const std::map<Currency, double>& deltas, double costBase);
     void updateRate(Currency from, Currency to, double rate);
+    void updateMargin(Currency from, Currency to, double margin);
+    // Applies a batch of rate updates atomically, then reports each one to the listeners.
+    void applyRates(const std::vector<RateUpdate>& updates);
 
     double currentProfitBase() const;
+    double currentSpreadIncomeBase() const;
+    double currentRebalancingCostBase() const;
     const Reserve& reserve() const;
-    RateTable& rateConfig();
-    const RateTable& rateConfig() const;
+    std::shared_ptr<const RateTable> rateConfig() const;
+    const std::shared_ptr<RateBoard>& sharedRates() const;
     const std::map<Currency, double>& criticalMinimumsMap() const;
+    const Reserve& startOfDayReserve() const;
+    const std::vector<TransactionRecord>& transactionsToday() const;
+    const std::map<int, CashierTotals>& cashierTotalsMap() const;
+    // Start of the calendar month the monthly cashier totals cover; 0 before the first transaction.
+    std::time_t cashierMonthStart() const;
+    const ClientLimitTracker& clientLimitTracker() const;
+    double commissionRate() const;
+    int nextReceiptNumber() const;
+
+    void addListener(OfficeEventListener* listener);
+    void removeListener(OfficeEventListener* listener);
+
+    // Restores state captured elsewhere (journal checkpoints, snapshots) without emitting events.
+    void restoreDailyState(const Reserve& startOfDay, double profit, double spreadIncome, double rebalancingCost, int nextReceipt);
+    void restoreCashierTotals(std::map<int, CashierTotals> totals, std::time_t month);
+    void restoreClientWindows(const std::vector<ClientWindow>& windows);
+    // The day's records only; profit, totals and limits are restored separately.
+    void restoreDailyTransactions(std::vector<TransactionRecord> records);
+    void applyRecordedTransaction(const TransactionRecord& record);
+    // Takes back today's logged records on a reserve that already includes them, rewinding the
+    // start-of-day balances instead of moving the reserve again.
+    void restoreLoggedDay(const std::vector<TransactionRecord>& records, int lastReceiptId);
 
     DailyReport compileDailyReport() const;
     void resetDailyCycle();
+    // Pushes reserve, profit and critical-level gauges to the metrics registry.
+    void publishMetrics() const;
+    // The gauges are process-wide, so only one office per process should publish them.
+    void setGaugesEnabled(bool enabled);
 };
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "batch_processor.h"
+#include "employee.h"
+#include "exchange_manager.h"
+#include "journal.h"
+#include "persistence.h"
+#include "wire_protocol.h"
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+struct ServerEndpoint {
+    std::string host = "127.0.0.1";
+    int port = -1;              // TCP port; 0 picks a free one
+    std::string unixSocketPath; // Used instead of TCP when set
+};
+
+// Bound, listening, non-blocking socket for `endpoint`; boundPort receives the TCP port actually used.
+int open_listen_socket(const ServerEndpoint& endpoint, int& boundPort);
+
+// Line-oriented service over one epoll loop; requests on a connection may be pipelined.
+//
+//   PING                                -> OK PONG
+//   LOGIN <cashier name>                -> OK <cashier id>
+//   QUOTE <source> <amount> <target>    -> OK {"source":...,"payout":...}
+//   EXCHANGE <csv row | json object>    -> OK <receipt json>   (same grammar as --batch)
+//   RESERVE                             -> OK {"USD":...,...}
+//   REPORT                              -> OK <daily report json>
+//   QUIT                                -> OK BYE, then the connection is closed
+//
+// Failures answer "ERR <message>". A connection that opens with "CXB1" speaks the binary framing
+// from wire_protocol.h instead (QuoteRequest and ExchangeRequest frames). Journal and log writes are group-committed once per loop
+// iteration, before any of that iteration's responses are sent.
+class ExchangeServer {
+private:
+    enum class Framing {
+        Unknown,
+        Text,
+        Binary
+    };
+
+    struct Connection {
+        int descriptor = -1;
+        Framing framing = Framing::Unknown;
+        std::string input;
+        std::string output;
+        std::size_t written = 0;
+        bool closing = false;
+        bool readPaused = false;
+        bool inputPending = false; // Complete requests left in `input` while the output was backlogged
+        bool writeInterest = false;
+        std::unique_ptr<Cashier> cashier;
+    };
+
+    ExchangeOffice& office;
+    DataStore& store;
+    Journal& journal;
+    std::mutex& officeMutex; // Held while a loop iteration touches the office; see RateFeed
+    RequestParser parser;
+    ServerEndpoint endpoint;
+    int listenDescriptor;
+    int epollDescriptor;
+    int signalDescriptor;
+    int boundPort;
+    std::unordered_map<int, Connection> connections;
+
+    void openListener();
+    void acceptConnections();
+    void readFrom(Connection& connection);
+    bool writeTo(Connection& connection);
+    void updateInterest(Connection& connection, bool wantWrite);
+    void closeConnection(int descriptor);
+    void consumeLines(Connection& connection);
+    void consumeFrames(Connection& connection);
+    void handleLine(Connection& connection, std::string_view line);
+    void handleFrame(Connection& connection, const WireFrame& frame);
+    Cashier& cashierFor(Connection& connection, const std::string& name);
+
+public:
+    ExchangeServer(ExchangeOffice& exchangeOffice, DataStore& persistence, Journal& eventJournal, std::mutex& sharedOfficeMutex,
+                   ServerEndpoint address);
+    ~ExchangeServer();
+
+    ExchangeServer(const ExchangeServer&) = delete;
+    ExchangeServer& operator=(const ExchangeServer&) = delete;
+
+    // Serves until SIGINT or SIGTERM arrives.
+    void run();
+    std::string boundAddress() const;
+};
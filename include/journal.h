@@ -0,0 +1,84 @@
+#pragma once
+
+#include "exchange_manager.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Append-only record of every ExchangeOffice state mutation.
+//
+// Each line is "<sequence>|<type>|<timestamp>|<fields...>" where type is one of
+//   C  checkpoint of the full office state (written whenever the journal is opened)
+//   X  committed exchange including every payout
+//   T  reserve adjustment (positive top-up, negative reduction)
+//   R  rate change as entered
+//   S  bid/ask margin change for a pair
+//   M  critical minimum change
+//   D  daily cycle reset
+class Journal : public OfficeEventListener {
+private:
+    std::filesystem::path journalPath;
+    std::uintmax_t rotateBytes;
+    std::ofstream output;
+    std::uint64_t nextSequence;
+    std::string lineBuffer;
+    bool autoFlush;
+
+    void beginLine(char type);
+    void commitLine();
+
+public:
+    explicit Journal(std::filesystem::path path, std::uintmax_t rotateAfterBytes = 64 * 1024 * 1024);
+
+    void open(const ExchangeOffice& office);
+    void writeCheckpoint(const ExchangeOffice& office);
+    // Starts a fresh file (previous one kept as <path>.1) once a snapshot covers every event so far.
+    void rollover(const ExchangeOffice& office);
+    std::uint64_t lastSequence() const;
+    void flush();
+    // Bulk callers turn off the per-event flush and flush once per batch instead.
+    void setAutoFlush(bool enabled);
+    const std::filesystem::path& path() const;
+
+    void onTransaction(const TransactionRecord& record) override;
+    void onReserveAdjusted(Currency currency, double delta) override;
+    void onReservesRebalanced(const std::map<Currency, double>& deltas, double costBase) override;
+    void onRateChanged(Currency from, Currency to, double rate) override;
+    void onSpreadChanged(Currency from, Currency to, double margin) override;
+    void onCriticalMinimumChanged(Currency currency, double amount) override;
+    void onDailyReset() override;
+};
+
+struct ReplayStatistics {
+    std::size_t linesRead = 0;
+    std::size_t eventsApplied = 0;
+    std::size_t malformedLines = 0;
+    std::uint64_t lastSequence = 0;
+    double elapsedMilliseconds = 0.0;
+};
+
+class JournalReplayer {
+private:
+    static std::string readJournal(const std::filesystem::path& journalPath);
+    static void applyLines(ExchangeOffice& office,
+                           const std::vector<std::string>& lines,
+                           std::size_t firstLine,
+                           std::uint64_t afterSequence,
+                           ReplayStatistics& statistics);
+
+public:
+    // Rebuilds the office from the last checkpoint and every event after it.
+    static std::unique_ptr<ExchangeOffice> replay(const std::filesystem::path& journalPath, ReplayStatistics& statistics);
+    // Applies the events newer than afterSequence to an office restored from a snapshot.
+    static ReplayStatistics applySince(ExchangeOffice& office, const std::filesystem::path& journalPath, std::uint64_t afterSequence);
+
+    static std::vector<std::string> compare(const ExchangeOffice& office,
+                                            const std::map<Currency, double>& reserve,
+                                            const std::vector<PairRate>& rates,
+                                            const std::map<Currency, double>& criticalMinimums);
+};
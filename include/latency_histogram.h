@@ -0,0 +1,114 @@
+#pragma once
+
+#include "alloc_tracking.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Steps of one exchange, from request validation to the reserve hitting disk.
+enum class LatencyStage : std::uint8_t {
+    Validate,
+    RateLookup,     // RateTable::canConvert
+    Convert,        // RateTable::convert and commission
+    ReserveUpdate,  // Reserve withdraw/deposit
+    Notify,         // Office listeners, i.e. the journal
+    Receipt,
+    Transaction,    // Whole ExchangeOffice::executeTransaction
+    LogAppend,      // DataStore::appendTransaction
+    ReservePersist, // DataStore::saveReserve
+    RatesPersist,   // DataStore::saveRates
+    Count
+};
+
+std::string to_string(LatencyStage stage);
+
+// Log-linear (HDR-style) histogram of nanosecond values: exact below 128 ns, then 64 sub-buckets
+// per power of two, so any reported value is within 1.6% of the recorded one.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 6;
+    static constexpr std::uint64_t kLinearLimit = 2u << kSubBucketBits;  // 128
+    static constexpr unsigned kMaxMagnitude = 40;                         // ~18 minutes
+    static constexpr std::size_t kBuckets = kLinearLimit + (kMaxMagnitude - kSubBucketBits - 1) * (1u << kSubBucketBits);
+
+private:
+    std::vector<std::uint64_t> counts;
+    std::uint64_t total;
+    std::uint64_t sum;
+    std::uint64_t largest;
+
+public:
+    LatencyHistogram();
+
+    static std::size_t bucketFor(std::uint64_t nanos);
+    static std::uint64_t bucketUpperBound(std::size_t bucket);
+
+    void record(std::uint64_t nanos);
+    void addBucket(std::size_t bucket, std::uint64_t count);
+    void addTotals(std::uint64_t count, std::uint64_t nanosSum, std::uint64_t maxNanos);
+    void merge(const LatencyHistogram& other);
+
+    std::uint64_t count() const;
+    std::uint64_t max() const;
+    double mean() const;
+    // Highest value equivalent to the sample at the given percentile (0-100).
+    std::uint64_t percentile(double percent) const;
+};
+
+// Process-wide stage histograms. Each thread records into its own block without locks;
+// snapshot() merges every block, including those of threads that have since exited.
+class LatencyRegistry {
+public:
+    using Snapshot = std::array<LatencyHistogram, static_cast<std::size_t>(LatencyStage::Count)>;
+    using AllocationSnapshot = std::array<AllocationCount, static_cast<std::size_t>(LatencyStage::Count)>;
+
+    static void record(LatencyStage stage, std::uint64_t nanos, const AllocationCount& allocated = {});
+    static Snapshot snapshot();
+    // Heap allocations charged to each stage; all zero unless built with ALLOC=1.
+    static AllocationSnapshot allocations();
+    static std::string formatTable(const Snapshot& stages);
+    // Allocations and bytes per stage run; the transaction row is the per-exchange total.
+    static std::string formatAllocationTable(const Snapshot& stages, const AllocationSnapshot& allocated);
+    static void writeDump(const std::filesystem::path& path);
+};
+
+// Times one scope into a stage, along with the allocations it makes. A scope left by an exception is
+// not recorded, so failed and rejected operations stay out of the stage's histogram.
+class ScopedLatency {
+private:
+    LatencyStage stage;
+    std::chrono::steady_clock::time_point started;
+    AllocationCount allocationsAtStart;
+    int exceptionsAtStart;
+
+public:
+    explicit ScopedLatency(LatencyStage timedStage);
+    ~ScopedLatency();
+
+    ScopedLatency(const ScopedLatency&) = delete;
+    ScopedLatency& operator=(const ScopedLatency&) = delete;
+};
+
+// Splits one operation into consecutive stages: lap(stage) charges the time since the previous lap
+// to that stage. Laps in loops accumulate, and each touched stage is recorded once on destruction.
+class StageClock {
+private:
+    std::chrono::steady_clock::time_point mark;
+    AllocationCount allocationMark;
+    std::array<std::uint64_t, static_cast<std::size_t>(LatencyStage::Count)> spent;
+    LatencyRegistry::AllocationSnapshot allocated;
+    std::uint32_t touched;
+
+public:
+    StageClock();
+    ~StageClock();
+
+    StageClock(const StageClock&) = delete;
+    StageClock& operator=(const StageClock&) = delete;
+
+    void lap(LatencyStage stage);
+};
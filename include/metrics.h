@@ -0,0 +1,143 @@
+#pragma once
+
+#include "utils.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class Counter {
+private:
+    std::atomic<std::uint64_t> value{0};
+
+public:
+    void increment(std::uint64_t by = 1) {
+        value.fetch_add(by, std::memory_order_relaxed);
+    }
+
+    std::uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+class Gauge {
+private:
+    std::atomic<double> value{0.0};
+
+public:
+    void set(double amount) {
+        value.store(amount, std::memory_order_relaxed);
+    }
+
+    void add(double amount) {
+        value.fetch_add(amount, std::memory_order_relaxed);
+    }
+
+    double get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+};
+
+// Named counters and gauges rendered in the Prometheus text exposition format. Registration takes a
+// lock and returns a reference that stays valid for the registry's lifetime; updates are lock-free.
+class MetricsRegistry {
+private:
+    enum class Kind {
+        Counter,
+        Gauge
+    };
+
+    struct Series {
+        std::string labels; // Already rendered, e.g. currency="USD"
+        Counter* counter;
+        Gauge* gauge;
+    };
+
+    struct Family {
+        std::string name;
+        std::string help;
+        Kind kind;
+        std::vector<Series> series;
+    };
+
+    mutable std::mutex mutex;
+    std::deque<Family> families;
+    std::deque<Counter> counters;
+    std::deque<Gauge> gauges;
+
+    Family& family(const std::string& name, const std::string& help, Kind kind);
+
+public:
+    Counter& counter(const std::string& name, const std::string& help, const std::string& labels = "");
+    Gauge& gauge(const std::string& name, const std::string& help, const std::string& labels = "");
+
+    std::string exposition() const;
+
+    static MetricsRegistry& global();
+};
+
+// The series the office, store and journal keep current.
+struct OfficeMetrics {
+    Counter& transactions;
+    Counter& invalidRequests;
+    Counter& missingRates;
+    Counter& reserveShortfalls;
+    Counter& clientLimitRejections;
+    std::array<Counter*, 4> criticalBreaches; // Indexed by Currency
+    std::array<Gauge*, 4> reserveBalance;
+    Gauge& currenciesBelowCritical;
+    Gauge& profit;
+    Counter& logAppends;
+    Counter& fileWrites;
+    Gauge& journalSequence;
+    Gauge& snapshotSequence;
+    Gauge& walLag; // Journal events a restart would have to replay on top of the snapshot
+    Counter& feedUpdates;
+    Counter& feedApplied;
+
+    void countFailure(const ExchangeError& error);
+    void updateWalLag();
+
+    static OfficeMetrics& instance();
+};
+
+struct MetricsExportOptions {
+    std::filesystem::path file;       // Rewritten atomically every interval
+    std::filesystem::path socketPath; // Unix socket answering each connection with the current text
+    std::chrono::milliseconds interval{5000};
+};
+
+// Background thread publishing a registry without touching the threads that update it.
+class MetricsExporter {
+private:
+    MetricsRegistry& registry;
+    MetricsExportOptions options;
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping;
+    int listenDescriptor;
+
+    void run();
+    void writeFile() const;
+    void serveClients();
+
+public:
+    MetricsExporter(MetricsRegistry& metrics, MetricsExportOptions exportOptions);
+    ~MetricsExporter();
+
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    void start();
+    // Writes a final file and joins the thread.
+    void stop();
+};
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Buffered text output with explicit flush points; subclasses decide where the bytes go.
+// Nothing reaches the destination until the buffer fills or flush() is called.
+class OutputSink {
+private:
+    std::string buffer;
+    std::size_t capacity;
+
+protected:
+    explicit OutputSink(std::size_t bufferBytes);
+
+    virtual void drain(const char* data, std::size_t size) = 0;
+    virtual void sync() {}
+
+public:
+    static constexpr std::size_t kDefaultCapacity = 64 * 1024;
+
+    virtual ~OutputSink() = default;
+    OutputSink(const OutputSink&) = delete;
+    OutputSink& operator=(const OutputSink&) = delete;
+
+    OutputSink& write(std::string_view text);
+    OutputSink& writeFixed(double value, int precision);
+    OutputSink& writeNumber(double value); // Shortest form that round-trips
+    void flush();
+
+    OutputSink& operator<<(std::string_view text);
+    OutputSink& operator<<(const std::string& text);
+    OutputSink& operator<<(const char* text);
+    OutputSink& operator<<(char ch);
+    OutputSink& operator<<(int value);
+    OutputSink& operator<<(long long value);
+    OutputSink& operator<<(std::size_t value);
+    OutputSink& operator<<(double value); // Money: fixed, two decimals
+};
+
+// Console or any other iostream; flush() also flushes the stream.
+class StreamSink : public OutputSink {
+private:
+    std::ostream& stream;
+
+protected:
+    void drain(const char* data, std::size_t size) override;
+    void sync() override;
+
+public:
+    explicit StreamSink(std::ostream& target, std::size_t bufferBytes = kDefaultCapacity);
+    ~StreamSink() override;
+};
+
+class FileSink : public OutputSink {
+private:
+    std::ofstream file;
+
+protected:
+    void drain(const char* data, std::size_t size) override;
+    void sync() override;
+
+public:
+    explicit FileSink(const std::filesystem::path& path, bool append = false, std::size_t bufferBytes = kDefaultCapacity);
+    ~FileSink() override;
+};
+
+// Raw descriptor (socket, pipe, PTY); blocking writes of whole chunks.
+class DescriptorSink : public OutputSink {
+private:
+    int descriptor;
+
+protected:
+    void drain(const char* data, std::size_t size) override;
+
+public:
+    explicit DescriptorSink(int fileDescriptor, std::size_t bufferBytes = kDefaultCapacity);
+    ~DescriptorSink() override;
+};
+
+// Collects everything in memory, e.g. to hand a rendered receipt to another transport.
+class StringSink : public OutputSink {
+private:
+    std::string collected;
+
+protected:
+    void drain(const char* data, std::size_t size) override;
+
+public:
+    explicit StringSink(std::size_t bufferBytes = 4096);
+
+    const std::string& str();
+    void clear();
+};
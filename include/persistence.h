@@ -2,11 +2,19 @@
 
 #include "employee.h"
 #include "exchange_manager.h"
+#include "report_writer.h"
+#include "transaction_log.h"
+#include "transaction_query.h"
 
+#include <array>
+#include <cstdint>
 #include <filesystem>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
-#include <tuple>
 #include <vector>
 
 struct PersonEntry {
@@ -15,39 +23,135 @@ struct PersonEntry {
     std::string name;
 };
 
+struct OfficeSnapshot {
+    std::uint64_t journalSequence;  // Last journal event already reflected in this snapshot
+    Currency baseCurrency;
+    double commissionRate;
+    int nextReceiptId;
+    double profitInBase;
+    double spreadIncomeBase;        // Part of profitInBase earned on bid/ask spreads
+    std::map<Currency, double> reserve;
+    std::map<Currency, double> startOfDayReserve;
+    std::map<Currency, double> criticalMinimums;
+    std::vector<PairRate> rates;
+    std::vector<PersonEntry> people;
+    std::time_t cashierMonthStart = 0;          // Month the monthly cashier totals cover
+    std::map<int, CashierTotals> cashierTotals; // Keyed by cashier id
+    std::vector<ClientWindow> clientWindows;    // Clients with volume inside the rolling week
+    std::vector<TransactionRecord> transactions; // Since the last daily reset
+    double rebalancingCostBase = 0.0;            // Already deducted from profitInBase
+};
+
+// Bonus policies a manager applies per cashier, from data/bonus.csv ("day,<policy>" / "month,<policy>").
+struct BonusPolicies {
+    std::unique_ptr<BonusPolicy> daily;   // Defaults to 5% of the cashier's profit
+    std::unique_ptr<BonusPolicy> monthly; // None unless configured
+};
+
+// What a store's transaction log holds since a point in time, for offices that restart without a journal.
+struct LoggedDay {
+    std::vector<TransactionRecord> records;
+    int lastReceiptId = 0; // Highest receipt id anywhere in the log
+};
+
+enum class StartupSource {
+    Snapshot,
+    Csv
+};
+
 class DataStore {
 private:
     std::filesystem::path baseDirectory;
     std::filesystem::path reportsDirectory;
+    std::filesystem::path sharedRatesPath; // Set for branch stores, which keep no rates of their own
+    std::shared_ptr<std::mutex> ratesMutex; // Shared with every store saving the same rates.csv
+    ReportWriter reportWriter;
+    TransactionLog transactionLog;
 
     std::map<std::string, PersonEntry> people;
     int nextPersonId;
+    bool bulkMode;
+    bool peopleDirty;
+    std::optional<OfficeSnapshot> startupState;
+    std::optional<TransactionIndex> queryIndex; // Built on first query, then fed by appendTransaction
+    // Fingerprints of the last config files this store wrote, so reloads can skip its own writes.
+    mutable std::mutex writesMutex;
+    mutable std::array<std::size_t, 8> recentWrites{};
+    mutable std::size_t nextWriteSlot = 0;
 
     std::filesystem::path reserveFile() const;
-    std::filesystem::path ratesFile() const;
-    std::filesystem::path criticalFile() const;
     std::filesystem::path peopleFile() const;
     std::filesystem::path transactionsFile() const;
+    std::filesystem::path snapshotFile() const;
+    std::filesystem::path bonusFile() const;
+    std::filesystem::path limitsFile() const;
 
     void loadPeople();
+    void restorePeople(const std::vector<PersonEntry>& entries);
     void persistPeople() const;
+    void writeRates(const RateTable& table) const;
+    void rememberWrite(const std::filesystem::path& path, const std::string& content) const;
+    // The file's content, unless it is missing or one this store recently wrote itself.
+    std::optional<std::string> readIfForeign(const std::filesystem::path& path) const;
 
 public:
     explicit DataStore(const std::string& baseDir = "data");
 
-    void initialize();
+    void initialize(StartupSource source = StartupSource::Snapshot);
+    // Points loadRates/saveRates at another store's rates.csv, so every branch persists one table.
+    void shareRatesWith(const DataStore& owner);
+    std::filesystem::path journalFile() const;
+    std::filesystem::path latencyDumpFile() const;
+    std::filesystem::path branchesDirectory() const;
+    std::filesystem::path ratesFile() const;
+    std::filesystem::path criticalFile() const;
+
+    const std::optional<OfficeSnapshot>& startupSnapshot() const;
+    void saveSnapshot(const ExchangeOffice& office, std::uint64_t journalSequence) const;
+    std::vector<PersonEntry> peopleEntries() const;
 
     std::map<Currency, double> loadReserve(const std::map<Currency, double>& defaults) const;
     void saveReserve(const std::map<Currency, double>& balances) const;
 
-    std::vector<std::tuple<Currency, Currency, double>> loadRates() const;
+    std::vector<PairRate> loadRates() const;
     void saveRates(const RateTable& table) const;
+    // Takes the office's rates under the save lock, so the last save to finish always holds the newest table.
+    void saveRates(const ExchangeOffice& office) const;
+    // Re-reads rates.csv after an outside edit; nullopt when it is missing or holds what this store wrote.
+    std::optional<std::vector<PairRate>> reloadRates() const;
 
     std::map<Currency, double> loadCriticalMinimums() const;
     void saveCriticalMinimums(const std::map<Currency, double>& minima) const;
+    std::optional<std::map<Currency, double>> reloadCriticalMinimums() const;
+
+    BonusPolicies loadBonusPolicies() const;
+    // Per-currency client limits from limits.csv ("currency,daily,weekly"); none when the file is missing.
+    std::map<Currency, ClientLimit> loadClientLimits() const;
 
     int ensurePersonId(const std::string& role, const std::string& name);
+    // Defers people.csv rewrites and log flushes until bulk mode is switched off again.
+    void setBulkMode(bool enabled);
+    void flushPending();
 
-    void appendTransaction(const Receipt& receipt) const;
+    void appendTransaction(const Receipt& receipt);
+    const TransactionLog& transactions() const;
+    // One index for every session on this store; use it under the lock that guards appendTransaction.
+    TransactionIndex& transactionIndex();
+    // Reads the log on disk without opening it for writing, so it can run before initialize().
+    LoggedDay loadLoggedDay(std::time_t since) const;
     std::filesystem::path persistReport(const DailyReport& report, const Manager& manager) const;
+    std::future<ReportFiles> persistReportAsync(DailyReport report, const Manager& manager) const;
+};
+
+// Keeps a store in bulk mode for one scope and switches it back on every way out, exceptions included.
+class BulkModeScope {
+private:
+    DataStore& store;
+
+public:
+    explicit BulkModeScope(DataStore& bulkStore);
+    ~BulkModeScope();
+
+    BulkModeScope(const BulkModeScope&) = delete;
+    BulkModeScope& operator=(const BulkModeScope&) = delete;
 };
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "persistence.h"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+struct RateFeedOptions {
+    std::filesystem::path source;                    // FIFO, or a regular file followed from its end like tail -f
+    std::chrono::milliseconds batchWindow{50};       // Updates arriving within one window are coalesced
+    std::chrono::milliseconds persistInterval{1000}; // Least time between two rates.csv rewrites
+};
+
+struct RateFeedStatistics {
+    std::size_t linesRead = 0;
+    std::size_t malformedLines = 0;
+    std::size_t updatesApplied = 0; // After coalescing, so at most one per pair per batch
+    std::size_t batchesApplied = 0;
+    std::size_t saves = 0;
+};
+
+// Background ingestion of rate updates from a local stand-in for a market feed.
+//
+// Lines use the rates.csv format, "FROM,TO,mid[,margin]"; without a margin the pair keeps its own.
+// Updates for the same pair within one batch window collapse into the latest, and each batch is
+// applied with ExchangeOffice::applyRates under the office mutex, so a transaction sees the whole
+// batch or none of it. rates.csv is rewritten at most once per persist interval, with the latest table.
+class RateFeed {
+private:
+    ExchangeOffice& office;
+    DataStore& store;
+    std::mutex& officeMutex;
+    RateFeedOptions options;
+    std::thread worker;
+    std::atomic<bool> stopping;
+    int descriptor;
+    bool followingFile;
+    std::string partialLine;
+    std::array<std::optional<RateUpdate>, 16> pending; // Indexed by from * 4 + to with from < to
+    std::size_t pendingCount;
+    mutable std::mutex statisticsMutex;
+    RateFeedStatistics statistics;
+
+    void run();
+    // Reads whatever is available; false once a followed file has nothing new.
+    bool readAvailable();
+    void ingest(std::string_view line);
+    void applyPending();
+    void persist();
+
+public:
+    RateFeed(ExchangeOffice& exchangeOffice, DataStore& persistence, std::mutex& sharedOfficeMutex, RateFeedOptions feedOptions);
+    ~RateFeed();
+
+    RateFeed(const RateFeed&) = delete;
+    RateFeed& operator=(const RateFeed&) = delete;
+
+    // Opens the source (throwing if it cannot) and starts the reader thread.
+    void start();
+    // Applies anything still pending, saves the rates if they changed and joins the thread.
+    void stop();
+    RateFeedStatistics stats() const;
+
+    // One feed line as an update, normalised so that from < to; nullopt when malformed.
+    static std::optional<RateUpdate> parseLine(std::string_view line);
+};
@@ -0,0 +1,36 @@
+#pragma once
+
+#include "exchange_manager.h"
+
+#include <filesystem>
+#include <future>
+#include <string>
+
+struct RenderedReport {
+    std::string text;
+    std::string csv;
+    std::string json;
+};
+
+struct ReportFiles {
+    std::filesystem::path text;
+    std::filesystem::path csv;
+    std::filesystem::path json;
+};
+
+class ReportRenderer {
+public:
+    // Renders every output format in a single pass over the report history.
+    static RenderedReport render(const DailyReport& report, const std::string& managerName, int managerId);
+};
+
+class ReportWriter {
+private:
+    std::filesystem::path outputDirectory;
+
+public:
+    explicit ReportWriter(std::filesystem::path directory);
+
+    ReportFiles write(const DailyReport& report, const std::string& managerName, int managerId) const;
+    std::future<ReportFiles> writeAsync(DailyReport report, std::string managerName, int managerId) const;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "utils.h"
+
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+struct RebalanceOptions {
+    double horizonHours = 4.0; // How far ahead every currency must stay above its critical minimum
+    double windowHours = 1.0;  // Recent transactions the outflow rates are measured over
+    double topUpCost = 0.02;   // Cost of an external delivery, as a fraction of the value delivered
+};
+
+// Converting part of one currency's surplus into another inside the reserve, at the client quote.
+struct ReserveConversion {
+    Currency from;
+    Currency to;
+    double amountFrom;
+    double amountTo;
+};
+
+struct ReserveTopUp {
+    Currency currency;
+    double amount;
+};
+
+struct RebalancePlan {
+    std::map<Currency, double> outflowPerHour; // Net payouts less receipts, never below zero
+    std::map<Currency, double> required;       // Critical minimum plus the outflow over the horizon
+    std::vector<ReserveConversion> conversions;
+    std::vector<ReserveTopUp> topUps;
+    double costBase = 0.0; // Value lost to margins and deliveries, in the base currency
+
+    bool empty() const;
+};
+
+// Plans the cheapest way to keep every currency above its critical minimum for the forecast horizon.
+//
+// Each currency needs its critical minimum plus its recent net outflow rate times the horizon; what it
+// holds beyond that is surplus. Surpluses and external top-ups supply the shortfalls as a min-cost flow
+// over base-currency value: surplus -> shortfall arcs cost the value lost to the quoted margin (crosses
+// pay both legs), external arcs cost topUpCost, and each shortfall drains to the sink. Surplus capacity
+// is discounted by the currency's dearest conversion so every planned conversion can be paid in full.
+class ReservePlanner {
+private:
+    RebalanceOptions options;
+
+public:
+    explicit ReservePlanner(RebalanceOptions plannerOptions = {});
+
+    RebalancePlan plan(const ExchangeOffice& office, std::time_t now) const;
+    // Net outflow per hour of each currency over the window ending at `now`.
+    static std::map<Currency, double> outflowRates(const std::vector<TransactionRecord>& transactions,
+                                                   std::time_t now,
+                                                   double windowHours);
+    // Plan as an operator-facing table; `balances` are the reserve balances it was made from.
+    static std::string format(const RebalancePlan& plan, const std::map<Currency, double>& balances);
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include "branch_network.h"
+#include "console_ui.h"
+#include "exchange_server.h"
+#include "output_sink.h"
+#include "persistence.h"
+#include "session_runtime.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+struct SessionHostOptions {
+    std::optional<ServerEndpoint> endpoint; // Operators connecting over TCP or a Unix socket
+    std::size_t pseudoTerminals = 0;        // PTYs opened up front, one kiosk session each
+    std::size_t workerThreads = 4;
+};
+
+// Line buffer for one terminal, fed by the reactor and drained by that terminal's session.
+class TerminalInput : public LineInput {
+private:
+    mutable std::mutex mutex;
+    std::string partial;
+    std::deque<std::string> lines;
+    bool eof;
+    std::coroutine_handle<> waiter;
+    std::optional<std::string>* waiterSlot;
+    WorkerPool& pool;
+
+protected:
+    bool takeOrPark(std::coroutine_handle<> waiting, std::optional<std::string>& line) override;
+
+public:
+    explicit TerminalInput(WorkerPool& workers);
+
+    void feed(const char* data, std::size_t size);
+    void close();
+    bool closed() const override;
+};
+
+// Runs ConsoleUI sessions for many terminals in one process: an epoll reactor reads terminals
+// and resumes suspended sessions on a small worker pool. Office access is serialised by one mutex,
+// or, when hosting a branch network, by each branch's own mutex after the operator picks a branch.
+class SessionHost {
+private:
+    struct Terminal {
+        int descriptor = -1;
+        int slaveDescriptor = -1; // PTYs keep their slave open so the master never reports hang-up
+        std::string label;
+        std::unique_ptr<TerminalInput> input;
+        std::unique_ptr<DescriptorSink> output;
+        std::unique_ptr<ConsoleUI> ui;
+    };
+
+    ExchangeOffice* office;
+    DataStore* store;
+    std::mutex* officeMutex;
+    BranchNetwork* network;
+    SessionHostOptions options;
+    WorkerPool pool;
+    int epollDescriptor;
+    int listenDescriptor;
+    int wakeDescriptor;
+    int signalDescriptor;
+    std::unordered_map<int, std::unique_ptr<Terminal>> terminals;
+    std::mutex finishedMutex;
+    std::vector<int> finished;
+
+    void openListener();
+    void openPseudoTerminal(std::size_t index);
+    void acceptTerminals();
+    void addTerminal(int descriptor, int slaveDescriptor, std::string label);
+    void startSession(Terminal& terminal);
+    Task<void> branchSession(Terminal& terminal);
+    void readTerminal(Terminal& terminal);
+    void reapFinished(bool stopping);
+    void closeTerminal(int descriptor);
+
+public:
+    SessionHost(ExchangeOffice& exchangeOffice, DataStore& persistence, std::mutex& sharedOfficeMutex, SessionHostOptions hostOptions);
+    SessionHost(BranchNetwork& branches, SessionHostOptions hostOptions);
+    ~SessionHost();
+
+    SessionHost(const SessionHost&) = delete;
+    SessionHost& operator=(const SessionHost&) = delete;
+
+    // Serves until SIGINT/SIGTERM, then lets every session see end of input and finish.
+    void run();
+};
@@ -0,0 +1,208 @@
+#pragma once
+
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <istream>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Lazily started coroutine that resumes whoever awaits it when it finishes.
+template <typename T>
+class Task;
+
+namespace detail {
+    template <typename Derived>
+    struct TaskPromiseBase {
+        std::coroutine_handle<> continuation;
+        std::exception_ptr error;
+
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<Derived> finished) noexcept {
+                auto next = finished.promise().continuation;
+                return next ? next : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {}
+        };
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void unhandled_exception() noexcept {
+            error = std::current_exception();
+        }
+    };
+
+    template <typename T>
+    struct TaskPromise : TaskPromiseBase<TaskPromise<T>> {
+        std::optional<T> value;
+
+        Task<T> get_return_object() noexcept;
+
+        void return_value(T result) {
+            value = std::move(result);
+        }
+
+        T take() {
+            if (this->error) {
+                std::rethrow_exception(this->error);
+            }
+            return std::move(*value);
+        }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase<TaskPromise<void>> {
+        Task<void> get_return_object() noexcept;
+
+        void return_void() noexcept {}
+
+        void take() {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    };
+}
+
+template <typename T>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+private:
+    std::coroutine_handle<promise_type> handle;
+
+public:
+    explicit Task(std::coroutine_handle<promise_type> coroutine) noexcept : handle(coroutine) {}
+    Task(Task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+
+    ~Task() {
+        if (handle) {
+            handle.destroy();
+        }
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle.promise().continuation = awaiting;
+        return handle;
+    }
+
+    T await_resume() {
+        return handle.promise().take();
+    }
+};
+
+namespace detail {
+    template <typename T>
+    Task<T> TaskPromise<T>::get_return_object() noexcept {
+        return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+    }
+
+    inline Task<void> TaskPromise<void>::get_return_object() noexcept {
+        return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+    }
+}
+
+// Source of operator input lines. co_await readLine() yields std::nullopt once the terminal is gone.
+class LineInput {
+public:
+    class Awaiter {
+    private:
+        LineInput& input;
+        std::optional<std::string> line;
+
+    public:
+        explicit Awaiter(LineInput& source) : input(source) {}
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        bool await_suspend(std::coroutine_handle<> waiter) {
+            return input.takeOrPark(waiter, line);
+        }
+
+        std::optional<std::string> await_resume() {
+            return std::move(line);
+        }
+    };
+
+    virtual ~LineInput() = default;
+
+    Awaiter readLine() {
+        return Awaiter(*this);
+    }
+
+    virtual bool closed() const = 0;
+
+protected:
+    // Fills `line` and returns false when input is ready now; otherwise keeps `waiter`, returns true
+    // and resumes it later with `line` filled in.
+    virtual bool takeOrPark(std::coroutine_handle<> waiter, std::optional<std::string>& line) = 0;
+};
+
+// Reads synchronously; sessions over it never actually suspend.
+class BlockingLineInput : public LineInput {
+private:
+    std::istream& stream;
+
+protected:
+    bool takeOrPark(std::coroutine_handle<> waiter, std::optional<std::string>& line) override;
+
+public:
+    explicit BlockingLineInput(std::istream& source);
+
+    bool closed() const override;
+};
+
+class WorkerPool {
+private:
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::deque<std::function<void()>> jobs;
+    std::vector<std::thread> workers;
+    bool stopping;
+
+    void work();
+
+public:
+    explicit WorkerPool(std::size_t threads);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    void post(std::function<void()> job);
+    void resume(std::coroutine_handle<> coroutine);
+    // Runs what is queued, then joins the workers.
+    void stop();
+};
+
+// Starts `task` on the calling thread and reports completion (with any escaped exception) through `done`.
+void spawn_task(Task<void> task, std::function<void(std::exception_ptr)> done);
+// Drives a task whose input never suspends (BlockingLineInput) to completion.
+void run_blocking(Task<void> task);
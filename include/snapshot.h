@@ -0,0 +1,29 @@
+#pragma once
+
+#include "persistence.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+
+// Versioned binary image of the whole office state.
+//
+// Layout (little endian): 8-byte magic "CXSNAP\0\0", u32 version, u32 reserved,
+// u64 payload size, u64 FNV-1a checksum of the payload, then the payload.
+class SnapshotCodec {
+public:
+    // 2 added rate margins and spread income, 3 per-cashier profit totals, 4 client limit windows,
+    // 5 the day's transactions, 6 the day's rebalancing cost; older versions still decode
+    static constexpr std::uint32_t kVersion = 6;
+
+    static std::string encode(const OfficeSnapshot& snapshot);
+    static bool decode(const unsigned char* data, std::size_t size, OfficeSnapshot& snapshot, std::string& error);
+
+    static std::optional<OfficeSnapshot> readFile(const std::filesystem::path& path, std::string& error);
+    static void writeFile(const std::filesystem::path& path, const OfficeSnapshot& snapshot);
+
+    static OfficeSnapshot capture(const ExchangeOffice& office, std::vector<PersonEntry> people, std::uint64_t journalSequence);
+    static std::unique_ptr<ExchangeOffice> buildOffice(const OfficeSnapshot& snapshot);
+};
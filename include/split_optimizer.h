@@ -0,0 +1,35 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "utils.h"
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+struct SplitPlan {
+    std::vector<ExchangePortion> portions;
+    std::vector<double> payouts; // Expected payout of each portion, in its currency
+    double returnedSource = 0.0; // Source amount the plan keeps back for the client
+    double payoutBase = 0.0;     // Value paid out, at mid in the base currency
+    double profitBase = 0.0;     // Commission plus spread, in the base currency
+};
+
+// Turns a client's accepted currencies into portions the office can pay right now.
+//
+// Each currency can take source up to the least of: what the reserve can pay out gross, what keeps its
+// balance at or above the critical minimum after the payout, the client's own cap and the client's limit
+// headroom. With one shared budget (the source amount) and fixed per-unit values, filling currencies
+// greedily in objective order is optimal: the client's order, or payout value per unit of source
+// descending (ClientPayout) or ascending (OfficeProfit, whose profit is the source value less the payout).
+// Listing the source currency itself never takes a share ahead of the others: what they cannot take is
+// returned to the client.
+class SplitOptimizer {
+public:
+    // Throws ReserveError when none of the accepted currencies can take any of the amount.
+    static SplitPlan plan(const ExchangeOffice& office, const ExchangeRequest& request, const SplitPreferences& preferences,
+                          std::time_t now);
+    // "prefer:EUR;USD", "payout:EUR<=300;GBP" or "profit:EUR;GBP"; throws ExchangeError when malformed.
+    static SplitPreferences parse(const std::string& specification);
+    static std::string format(const SplitPlan& plan, Currency source);
+};
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+
+// Scoped spans written as Chrome trace events (load the file in chrome://tracing or Perfetto).
+// Build with `make TRACE=1` to compile them in; otherwise TRACE_SPAN expands to nothing.
+#ifndef CX_TRACING
+#define CX_TRACING 0
+#endif
+
+class Tracer {
+public:
+    static constexpr bool kCompiledIn = CX_TRACING != 0;
+    static constexpr std::size_t kEventsPerThread = 1u << 16; // Oldest events are overwritten first
+
+    // Records one complete event on the calling thread's ring; name and category must be literals.
+    static void record(const char* name, const char* category,
+                       std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end);
+    // Merges every thread's ring into one trace file. Returns the number of events written.
+    static std::size_t writeChromeTrace(const std::filesystem::path& path);
+};
+
+class TraceSpan {
+private:
+    const char* name;
+    const char* category;
+    std::chrono::steady_clock::time_point started;
+
+public:
+    TraceSpan(const char* spanName, const char* spanCategory)
+        : name(spanName), category(spanCategory), started(std::chrono::steady_clock::now()) {}
+
+    ~TraceSpan() {
+        Tracer::record(name, category, started, std::chrono::steady_clock::now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define CX_TRACE_CONCAT_INNER(a, b) a##b
+#define CX_TRACE_CONCAT(a, b) CX_TRACE_CONCAT_INNER(a, b)
+
+#if CX_TRACING
+#define TRACE_SPAN(name, category) TraceSpan CX_TRACE_CONCAT(traceSpan, __LINE__)(name, category)
+#else
+#define TRACE_SPAN(name, category) static_cast<void>(0)
+#endif
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "exchange_manager.h"
+
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct LogRotationPolicy {
+    std::uintmax_t maxSegmentBytes = 4 * 1024 * 1024;
+    bool rotateDaily = true;
+    std::size_t retainedSegments = 30;  // Sealed segments kept live before archiving
+    std::size_t indexStride = 64;       // One sparse index entry every N records
+};
+
+struct LogSegmentInfo {
+    int sequence;
+    int firstReceiptId;
+    int lastReceiptId;
+    time_t firstTimestamp;
+    time_t lastTimestamp;
+    std::uintmax_t bytes;
+    std::size_t records;
+    bool sealed;
+};
+
+struct LogIndexEntry {
+    int receiptId;
+    std::uintmax_t offset;
+    time_t timestamp;
+};
+
+class TransactionLog {
+private:
+    std::filesystem::path directory;
+    std::filesystem::path archiveDirectory;
+    LogRotationPolicy policy;
+    std::vector<LogSegmentInfo> segments;
+    std::ofstream activeStream;
+    std::ofstream activeIndex;
+    int activeDay;
+    bool autoFlush;
+
+    std::filesystem::path segmentFile(int sequence) const;
+    std::filesystem::path indexFile(int sequence) const;
+    std::filesystem::path manifestFile() const;
+
+    void loadManifest();
+    void persistManifest() const;
+    void openSegment(int sequence);
+    void recoverActiveSegment();
+    void rescanSegment(LogSegmentInfo& segment, std::ofstream* index) const;
+    void sealActiveSegment();
+    void archiveExpiredSegments();
+    void importLegacyLog(const std::filesystem::path& legacyLog);
+    bool needsRotation(time_t timestamp, std::size_t lineBytes) const;
+    std::vector<LogIndexEntry> loadIndex(int sequence) const;
+    std::vector<std::filesystem::path> archiveFiles() const;
+
+public:
+    explicit TransactionLog(std::filesystem::path logDirectory, LogRotationPolicy rotation = LogRotationPolicy{});
+
+    void open(const std::filesystem::path& legacyLog);
+    // Loads the manifest and catches up on the open segment without opening anything for writing.
+    void load();
+    void append(const Receipt& receipt);
+    void appendLine(const std::string& line, int receiptId, time_t timestamp);
+    void flush();
+    void setAutoFlush(bool enabled);
+
+    // Falls back to the monthly archive files when no live segment holds the receipt.
+    std::optional<std::string> findReceipt(int receiptId) const;
+    // Archived lines are visited first, before the live segments.
+    void scan(time_t from, time_t to, const std::function<void(const std::string&)>& visitor, bool includeArchive = false) const;
+    const std::vector<LogSegmentInfo>& manifest() const;
+
+    static std::string formatLine(const Receipt& receipt);
+    // The record a line was written from; payouts are empty for lines from before they were logged.
+    static std::optional<TransactionRecord> parseRecord(const std::string& line);
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "transaction_log.h"
+
+#include <array>
+#include <cstdint>
+#include <ctime>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct TransactionQuery {
+    std::optional<int> clientId;
+    std::optional<std::string> clientName;
+    std::optional<int> cashierId;
+    std::optional<std::string> cashierName;
+    std::optional<Currency> currency;
+    std::optional<time_t> from;
+    std::optional<time_t> to;
+    std::optional<double> minAmount;
+    std::optional<double> maxAmount;
+    std::size_t limit = 0; // 0 means no limit on returned rows; aggregates always cover every match
+
+    static TransactionQuery parse(const std::string& specification);
+};
+
+struct TransactionRow {
+    int receiptId;
+    int cashierId;
+    int clientId;
+    Currency sourceCurrency;
+    double sourceAmount;
+    double profitInBase;
+    time_t timestamp;
+    std::array<double, 4> paid; // Amount paid out per currency; all zero for log lines without payouts
+};
+
+struct QueryResult {
+    std::vector<TransactionRow> rows;
+    std::size_t matched = 0;
+    std::array<double, 4> totalSource{};
+    std::array<double, 4> totalPaid{};
+    double totalProfit = 0.0;
+};
+
+class TransactionIndex {
+private:
+    // Identifies a receipt across log segments; duplicates come from overlapping loads.
+    struct RowKey {
+        int receiptId;
+        time_t timestamp;
+        int clientId;
+
+        bool operator==(const RowKey&) const = default;
+    };
+    struct RowKeyHash {
+        std::size_t operator()(const RowKey& key) const;
+    };
+
+    std::vector<TransactionRow> rows;
+    std::unordered_map<int, std::vector<std::uint32_t>> byClient;
+    std::unordered_map<int, std::vector<std::uint32_t>> byCashier;
+    std::array<std::vector<std::uint32_t>, 4> byCurrency; // Source and payout currencies
+    std::unordered_map<int, std::string> clientNames;
+    std::unordered_map<int, std::string> cashierNames;
+    std::unordered_set<RowKey, RowKeyHash> seenKeys;
+    bool timeOrdered;
+
+    void indexRow(std::uint32_t position);
+
+public:
+    TransactionIndex();
+
+    bool add(const TransactionRow& row, const std::string& cashierName, const std::string& clientName);
+    void add(const TransactionRecord& record);
+    void add(const Receipt& receipt);
+    void loadFrom(const TransactionLog& log);
+    void reindex();
+
+    QueryResult run(const TransactionQuery& query) const;
+    std::string format(const QueryResult& result) const;
+    std::size_t size() const;
+    std::optional<int> findClientByName(const std::string& name) const;
+    std::optional<int> findCashierByName(const std::string& name) const;
+    const std::string& clientName(int clientId) const;
+    const std::string& cashierName(int cashierId) const;
+
+    static bool parseLogLine(const std::string& line, TransactionRow& row, std::string& cashierName, std::string& clientName);
+};
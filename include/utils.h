@@ -1,6 +1,9 @@
 #pragma once
 
+#include <filesystem>
+#include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <stdexcept>
 #include <ctime>
@@ -15,6 +18,17 @@ enum class Currency {
 std::string to_string(Currency currency);
 Currency currency_from_string(const std::string& symbol);
 
+// Locale-free number formatting for hot output paths (reports, receipts, logs).
+void append_fixed(std::string& out, double value, int precision = 2);
+void append_integer(std::string& out, long long value);
+void append_json_string(std::string& out, const std::string& value);
+bool local_time(std::time_t timestamp, std::tm& result);
+// Leading and trailing whitespace removed; the view aliases the input.
+std::string_view trim_view(std::string_view text);
+std::string trim(std::string_view text);
+// Writes a sibling temporary file and renames it over path, so readers never see a partial file.
+void replace_file(const std::filesystem::path& path, const std::string& content);
+
 class ExchangeError : public std::runtime_error {
 public:
     explicit ExchangeError(const std::string& message);
@@ -30,6 +44,11 @@ public:
     explicit ReserveError(const std::string& message);
 };
 
+class LimitExceededError : public ExchangeError {
+public:
+    explicit LimitExceededError(const std::string& message);
+};
+
 struct ExchangePortion {
     Currency targetCurrency;
     double sourceAmount;          // How much of the source currency should be converted
@@ -40,12 +59,31 @@ struct ExchangePortion {
     static ExchangePortion remainder(Currency target);
 };
 
+// How an automatic split orders the currencies the client accepts.
+enum class SplitObjective {
+    Preference,   // The client's own order
+    ClientPayout, // Most value paid out to the client first
+    OfficeProfit  // Most commission and spread for the office first
+};
+
+// A currency the client accepts in an automatic split; maxPayout caps how much of it they want (0 = no cap).
+struct SplitTarget {
+    Currency currency;
+    double maxPayout = 0.0;
+};
+
+struct SplitPreferences {
+    std::vector<SplitTarget> targets; // Most wanted first; the source currency means "keep the rest"
+    SplitObjective objective = SplitObjective::Preference;
+};
+
 struct ExchangeRequest {
     int clientId;
     std::string clientName;
     Currency sourceCurrency;
     double totalAmount;
     std::vector<ExchangePortion> portions;
+    std::optional<SplitPreferences> automaticSplit; // When set, the office plans the portions at execution
 
     ExchangeRequest(int clientIdentifier, std::string client, Currency source, double amount, std::vector<ExchangePortion> parts = {});
     double totalAllocatedSource() const;
@@ -57,4 +95,6 @@ struct PayoutDetail {
     double amountPaid;
     double commissionTaken;
     std::vector<int> denominations;
+    double sourceAmount;          // Slice of the source currency converted for this payout
+    double spreadTaken = 0.0;     // Target currency kept by the bid/ask margin
 };
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "exchange_manager.h"
+#include "utils.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Binary framing used by the server once a client opens with the "CXB1" preamble.
+//
+// Frame:  u32 payload length | u8 type | u32 correlation id | payload      (little endian)
+// Amounts travel as zigzag LEB128 varints in hundredths, currencies as their enum id and names as
+// u8 length + bytes. Responses carry the correlation id of their request, so a client may keep
+// any number of requests in flight and match answers without waiting.
+enum class WireType : std::uint8_t {
+    QuoteRequest = 1,
+    Quote = 2,
+    ExchangeRequest = 3,
+    Receipt = 4,
+    Error = 5
+};
+
+struct WireFrame {
+    WireType type;
+    std::uint32_t correlationId;
+    std::string_view payload;
+};
+
+struct QuoteRequestView {
+    Currency source;
+    Currency target;
+    std::int64_t amountMinor;
+};
+
+struct PortionView {
+    Currency target;
+    bool remainder;
+    std::int64_t amountMinor;
+    std::string_view denominations; // Encoded varints, walked by WireCodec::forEachDenomination
+    std::uint8_t denominationCount;
+};
+
+struct PayoutView {
+    Currency currency;
+    std::int64_t amountMinor;
+    std::int64_t commissionMinor;
+};
+
+// Decoded views point into the receive buffer and stay valid only while it is untouched.
+struct ExchangeRequestView {
+    std::uint32_t clientId;
+    std::string_view clientName;
+    Currency source;
+    std::int64_t amountMinor;
+    std::uint8_t portionCount;
+    std::string_view portions;
+};
+
+struct ReceiptView {
+    std::uint32_t receiptId;
+    std::uint64_t timestamp;
+    std::uint32_t cashierId;
+    std::string_view cashierName;
+    std::uint32_t clientId;
+    std::string_view clientName;
+    Currency source;
+    std::int64_t sourceAmountMinor;
+    std::int64_t profitMinor;
+    std::uint8_t payoutCount;
+    std::string_view payouts;
+};
+
+class WireCodec {
+public:
+    static constexpr std::size_t kHeaderSize = 9;
+    static constexpr std::size_t kMaxPayload = 64 * 1024;
+    static constexpr std::string_view kPreamble = "CXB1";
+
+    // Returns the bytes taken by the next complete frame, or 0 when more input is needed.
+    static std::size_t nextFrame(std::string_view buffer, WireFrame& frame);
+
+    static void appendQuoteRequest(std::string& out, std::uint32_t correlationId, Currency source, Currency target, double amount);
+    static void appendQuote(std::string& out, std::uint32_t correlationId, const ExchangeQuote& quote);
+    static void appendRequest(std::string& out, std::uint32_t correlationId, const ExchangeRequest& request);
+    static void appendReceipt(std::string& out, std::uint32_t correlationId, const Receipt& receipt);
+    static void appendError(std::string& out, std::uint32_t correlationId, std::string_view message);
+
+    static QuoteRequestView decodeQuoteRequest(std::string_view payload);
+    static ExchangeQuote decodeQuote(std::string_view payload);
+    static ExchangeRequestView decodeRequest(std::string_view payload);
+    static ReceiptView decodeReceipt(std::string_view payload);
+    static std::string_view decodeError(std::string_view payload);
+
+    // Walk the packed portion/payout lists of a view without materialising them.
+    template <typename Visitor>
+    static void forEachPortion(const ExchangeRequestView& request, Visitor&& visit);
+    template <typename Visitor>
+    static void forEachPayout(const ReceiptView& receipt, Visitor&& visit);
+    template <typename Visitor>
+    static void forEachDenomination(const PortionView& portion, Visitor&& visit);
+
+    // Builds the office-facing request; the only step that copies out of the buffer.
+    static ExchangeRequest toRequest(const ExchangeRequestView& request, int clientId);
+
+    static double fromMinor(std::int64_t minor);
+
+    static PortionView readPortion(std::string_view& cursor);
+    static PayoutView readPayout(std::string_view& cursor);
+    static std::uint64_t readVarint(std::string_view& cursor);
+};
+
+template <typename Visitor>
+void WireCodec::forEachPortion(const ExchangeRequestView& request, Visitor&& visit) {
+    std::string_view cursor = request.portions;
+    for (std::uint8_t i = 0; i < request.portionCount; ++i) {
+        visit(readPortion(cursor));
+    }
+}
+
+template <typename Visitor>
+void WireCodec::forEachPayout(const ReceiptView& receipt, Visitor&& visit) {
+    std::string_view cursor = receipt.payouts;
+    for (std::uint8_t i = 0; i < receipt.payoutCount; ++i) {
+        visit(readPayout(cursor));
+    }
+}
+
+template <typename Visitor>
+void WireCodec::forEachDenomination(const PortionView& portion, Visitor&& visit) {
+    std::string_view cursor = portion.denominations;
+    for (std::uint8_t i = 0; i < portion.denominationCount; ++i) {
+        visit(static_cast<int>(readVarint(cursor)));
+    }
+}
@@ -0,0 +1,123 @@
+#include "alloc_tracking.h"
+
+#if CX_ALLOC_TRACKING
+#include <cstdlib>
+#include <new>
+
+namespace {
+    // Plain thread_local integers: no constructor, so they are safe to touch from operator new
+    // at any point in a thread's life.
+    thread_local std::uint64_t allocationCount = 0;
+    thread_local std::uint64_t allocatedBytes = 0;
+
+    void* counted_allocate(std::size_t size) {
+        ++allocationCount;
+        allocatedBytes += size;
+        return std::malloc(size == 0 ? 1 : size);
+    }
+
+    void* counted_allocate_aligned(std::size_t size, std::align_val_t alignment) {
+        ++allocationCount;
+        allocatedBytes += size;
+        auto align = static_cast<std::size_t>(alignment);
+        // aligned_alloc wants a size that is a multiple of the alignment.
+        std::size_t rounded = (size + align - 1) / align * align;
+        return std::aligned_alloc(align, rounded == 0 ? align : rounded);
+    }
+
+    void* allocate_or_throw(void* memory) {
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+}
+
+AllocationCount AllocationTracker::thread() {
+    return AllocationCount{allocationCount, allocatedBytes};
+}
+
+void* operator new(std::size_t size) {
+    return allocate_or_throw(counted_allocate(size));
+}
+
+void* operator new[](std::size_t size) {
+    return allocate_or_throw(counted_allocate(size));
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return counted_allocate(size);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(counted_allocate_aligned(size, alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return allocate_or_throw(counted_allocate_aligned(size, alignment));
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_allocate_aligned(size, alignment);
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return counted_allocate_aligned(size, alignment);
+}
+
+void operator delete(void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::size_t, std::align_val_t) noexcept {
+    std::free(memory);
+}
+
+void operator delete(void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+
+void operator delete[](void* memory, std::align_val_t, const std::nothrow_t&) noexcept {
+    std::free(memory);
+}
+#else
+AllocationCount AllocationTracker::thread() {
+    return AllocationCount{};
+}
+#endif
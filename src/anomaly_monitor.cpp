@@ -0,0 +1,348 @@
+#include "anomaly_monitor.h"
+
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <utility>
+
+namespace {
+    constexpr std::array<std::uint64_t, 4> kRowSeeds{
+        0x9e3779b97f4a7c15ull, 0xc2b2ae3d27d4eb4full, 0x165667b19e3779f9ull, 0xd6e8feb86659fd93ull};
+
+    double decayed(double value, std::time_t from, std::time_t to, double meanLife) {
+        if (to <= from) {
+            return value; // Out-of-order events are counted without decay
+        }
+        return value * std::exp(-static_cast<double>(to - from) / meanLife);
+    }
+
+    std::string ordinal(long long count) {
+        const char* suffix = "th";
+        if (count % 100 < 11 || count % 100 > 13) {
+            suffix = count % 10 == 1 ? "st" : count % 10 == 2 ? "nd" : count % 10 == 3 ? "rd" : "th";
+        }
+        return std::to_string(count) + suffix;
+    }
+
+    std::string currency_list(unsigned mask) {
+        std::string text;
+        for (Currency currency : {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL}) {
+            if (mask & (1u << static_cast<unsigned>(currency))) {
+                text += text.empty() ? "" : "+";
+                text += to_string(currency);
+            }
+        }
+        return text;
+    }
+}
+
+DecayedSketch::DecayedSketch(unsigned bits, double meanLifeSeconds)
+    : widthBits(bits), meanLife(meanLifeSeconds), cells(kDepth << bits) {
+    if (bits == 0 || bits > 24 || meanLifeSeconds <= 0.0) {
+        throw ExchangeError("A decayed sketch needs 1-24 width bits and a positive mean life");
+    }
+}
+
+std::size_t DecayedSketch::index(std::size_t row, std::uint64_t key) const {
+    std::uint64_t mixed = (key + 1) * kRowSeeds[row];
+    return (row << widthBits) + static_cast<std::size_t>(mixed >> (64 - widthBits));
+}
+
+double DecayedSketch::add(std::uint64_t key, double amount, std::time_t timestamp) {
+    double before = -1.0;
+    for (std::size_t row = 0; row < kDepth; ++row) {
+        Cell& cell = cells[index(row, key)];
+        cell.value = decayed(cell.value, cell.updated, timestamp, meanLife);
+        cell.updated = std::max(cell.updated, timestamp);
+        before = before < 0.0 ? cell.value : std::min(before, cell.value);
+        cell.value += amount;
+    }
+    return before;
+}
+
+double DecayedSketch::estimate(std::uint64_t key, std::time_t timestamp) const {
+    double estimate = -1.0;
+    for (std::size_t row = 0; row < kDepth; ++row) {
+        const Cell& cell = cells[index(row, key)];
+        double value = decayed(cell.value, cell.updated, timestamp, meanLife);
+        estimate = estimate < 0.0 ? value : std::min(estimate, value);
+    }
+    return estimate;
+}
+
+ClientVelocityDetector::ClientVelocityDetector(double burstCount, double meanLifeSeconds)
+    : burst(burstCount), meanLife(meanLifeSeconds), counts(12, meanLifeSeconds) {}
+
+const char* ClientVelocityDetector::name() const {
+    return "velocity";
+}
+
+void ClientVelocityDetector::observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) {
+    double before = counts.add(static_cast<std::uint32_t>(event.clientId), 1.0, event.timestamp);
+    // Only the crossing alerts, so a sustained burst is reported once until it decays.
+    if (before < burst && before + 1.0 >= burst) {
+        char detail[128];
+        std::snprintf(detail, sizeof(detail), "%.1f exchanges (decayed) within about %.0f minutes", before + 1.0,
+                      meanLife / 60.0);
+        alerts.push_back(AnomalyAlert{event.timestamp, event.receiptId, name(), "client " + std::to_string(event.clientId), detail});
+    }
+}
+
+SplitPatternDetector::SplitPatternDetector(double rareShare, double warmupCount, double sliverShare, double meanLifeSeconds)
+    : rarity(rareShare), warmup(warmupCount), sliver(sliverShare), meanLife(meanLifeSeconds) {}
+
+const char* SplitPatternDetector::name() const {
+    return "split";
+}
+
+void SplitPatternDetector::observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) {
+    // Every shape decays together, so one factor per event keeps the shares exact.
+    if (event.timestamp > updated) {
+        double factor = decayed(1.0, updated, event.timestamp, meanLife);
+        for (double& count : shapes) {
+            count *= factor;
+        }
+        total *= factor;
+        updated = event.timestamp;
+    }
+    std::size_t shape = (event.targetMask & 0xf) * 8 + std::min<std::size_t>(event.portions, 7);
+    double share = total > 0.0 ? shapes[shape] / total : 0.0;
+    bool warmed = total >= warmup;
+    shapes[shape] += 1.0;
+    total += 1.0;
+    if (event.portions < 2) {
+        return;
+    }
+    std::string subject = "client " + std::to_string(event.clientId);
+    char detail[160];
+    if (warmed && share < rarity) {
+        std::snprintf(detail, sizeof(detail), "%zu-way split into %s, %.2f%% of recent exchanges", event.portions,
+                      currency_list(event.targetMask).c_str(), share * 100.0);
+        alerts.push_back(AnomalyAlert{event.timestamp, event.receiptId, name(), subject, detail});
+    }
+    if (event.smallestPortionShare < sliver) {
+        std::snprintf(detail, sizeof(detail), "%zu-way split with a %.2f%% portion of %.2f %s", event.portions,
+                      event.smallestPortionShare * 100.0, event.sourceAmount, to_string(event.sourceCurrency).c_str());
+        alerts.push_back(AnomalyAlert{event.timestamp, event.receiptId, name(), subject, detail});
+    }
+}
+
+CashierVolumeDetector::CashierVolumeDetector(double spikeFactor, double minimumVolumeBase, double fastLifeSeconds,
+                                             double slowLifeSeconds, double minimumHistorySeconds)
+    : factor(spikeFactor),
+      minimumVolume(minimumVolumeBase),
+      fastLife(fastLifeSeconds),
+      slowLife(slowLifeSeconds),
+      minimumHistory(minimumHistorySeconds) {}
+
+const char* CashierVolumeDetector::name() const {
+    return "cashier-volume";
+}
+
+void CashierVolumeDetector::observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) {
+    auto [entry, inserted] = cashiers.try_emplace(event.cashierId);
+    Rates& rates = entry->second;
+    if (inserted) {
+        rates.firstSeen = event.timestamp;
+        rates.updated = event.timestamp;
+    }
+    rates.fast = decayed(rates.fast, rates.updated, event.timestamp, fastLife) + event.valueBase;
+    rates.slow = decayed(rates.slow, rates.updated, event.timestamp, slowLife) + event.valueBase;
+    rates.updated = std::max(rates.updated, event.timestamp);
+
+    // Decayed sums over their time constants are volume per second at each horizon.
+    double fastRate = rates.fast / fastLife;
+    double slowRate = rates.slow / slowLife;
+    if (rates.alerted) {
+        rates.alerted = fastRate > slowRate * factor / 2.0; // Re-arms once the spike has halved
+        return;
+    }
+    if (static_cast<double>(event.timestamp - rates.firstSeen) < minimumHistory || rates.fast < minimumVolume
+        || fastRate <= slowRate * factor) {
+        return;
+    }
+    rates.alerted = true;
+    char detail[160];
+    std::snprintf(detail, sizeof(detail), "%.0f base/hour over about %.0f minutes, %.1fx the %.0f-hour baseline",
+                  fastRate * 3600.0, fastLife / 60.0, fastRate / slowRate, slowLife / 3600.0);
+    alerts.push_back(AnomalyAlert{event.timestamp, event.receiptId, name(), "cashier " + std::to_string(event.cashierId), detail});
+}
+
+NearLimitDetector::NearLimitDetector(const std::map<Currency, ClientLimit>& clientLimits, double marginShare)
+    : margin(marginShare), hits(12, 86400.0) {
+    for (const auto& [currency, limit] : clientLimits) {
+        limits[static_cast<std::size_t>(currency)] = limit;
+    }
+}
+
+const char* NearLimitDetector::name() const {
+    return "near-limit";
+}
+
+void NearLimitDetector::observe(const AnomalyEvent& event, std::vector<AnomalyAlert>& alerts) {
+    for (std::size_t currency = 0; currency < limits.size(); ++currency) {
+        double amount = event.volume[currency];
+        const ClientLimit& limit = limits[currency];
+        double cap = 0.0;
+        const char* window = nullptr;
+        if (limit.daily > 0.0 && amount <= limit.daily && amount >= limit.daily * (1.0 - margin)) {
+            cap = limit.daily;
+            window = "daily";
+        } else if (limit.weekly > 0.0 && amount <= limit.weekly && amount >= limit.weekly * (1.0 - margin)) {
+            cap = limit.weekly;
+            window = "weekly";
+        }
+        if (!window) {
+            continue;
+        }
+        double recent = hits.add(static_cast<std::uint32_t>(event.clientId), 1.0, event.timestamp) + 1.0;
+        char detail[160];
+        std::snprintf(detail, sizeof(detail), "%.2f %s is %.1f%% of the %s limit (%s such exchange in about a day)", amount,
+                      to_string(static_cast<Currency>(currency)).c_str(), amount / cap * 100.0, window,
+                      ordinal(std::llround(recent)).c_str());
+        alerts.push_back(AnomalyAlert{event.timestamp, event.receiptId, name(), "client " + std::to_string(event.clientId), detail});
+    }
+}
+
+AnomalyMonitor::AnomalyMonitor(const ExchangeOffice& exchangeOffice, std::filesystem::path alertLog)
+    : office(exchangeOffice),
+      logPath(std::move(alertLog)),
+      ring(kQueueCapacity),
+      head(0),
+      queued(0),
+      stopping(false),
+      observed(0),
+      dropped(0),
+      alertCount(0) {}
+
+AnomalyMonitor::~AnomalyMonitor() {
+    stop();
+}
+
+void AnomalyMonitor::add(std::unique_ptr<AnomalyDetector> detector) {
+    if (worker.joinable()) {
+        throw ExchangeError("Anomaly detectors must be added before the monitor starts");
+    }
+    detectors.push_back(std::move(detector));
+}
+
+void AnomalyMonitor::start() {
+    log.open(logPath, std::ios::app);
+    if (!log) {
+        throw ExchangeError("Unable to open anomaly log " + logPath.string());
+    }
+    worker = std::thread([this]() { run(); });
+}
+
+void AnomalyMonitor::stop() {
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    queueReady.notify_one();
+    if (worker.joinable()) {
+        worker.join();
+    }
+}
+
+AnomalyStatistics AnomalyMonitor::stats() const {
+    return AnomalyStatistics{observed.load(std::memory_order_relaxed), dropped.load(std::memory_order_relaxed),
+                             alertCount.load(std::memory_order_relaxed)};
+}
+
+AnomalyEvent AnomalyMonitor::summarize(const TransactionRecord& record, const RateTable& rates) {
+    AnomalyEvent event;
+    event.timestamp = record.timestamp;
+    event.receiptId = record.receiptId;
+    event.clientId = record.clientId;
+    event.cashierId = record.cashierId;
+    event.sourceCurrency = record.sourceCurrency;
+    event.sourceAmount = record.sourceAmount;
+    event.valueBase = record.sourceCurrency == rates.base() ? record.sourceAmount
+        : rates.canConvert(record.sourceCurrency, rates.base()) ? record.sourceAmount * rates.midRate(record.sourceCurrency, rates.base())
+        : 0.0;
+    event.volume[static_cast<std::size_t>(record.sourceCurrency)] += record.sourceAmount;
+    event.portions = record.payouts.size();
+    for (const auto& payout : record.payouts) {
+        event.volume[static_cast<std::size_t>(payout.currency)] += payout.amountPaid + payout.commissionTaken;
+        event.targetMask |= 1u << static_cast<unsigned>(payout.currency);
+        if (record.sourceAmount > 0.0) {
+            event.smallestPortionShare = std::min(event.smallestPortionShare, payout.sourceAmount / record.sourceAmount);
+        }
+    }
+    return event;
+}
+
+void AnomalyMonitor::onTransaction(const TransactionRecord& record) {
+    AnomalyEvent event = summarize(record, *office.rateConfig());
+    observed.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard(queueMutex);
+        if (queued == ring.size()) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        ring[(head + queued) % ring.size()] = event;
+        queued++;
+    }
+    queueReady.notify_one();
+}
+
+void AnomalyMonitor::run() {
+    std::vector<AnomalyEvent> batch;
+    batch.reserve(ring.size());
+    std::vector<AnomalyAlert> alerts;
+    while (true) {
+        batch.clear();
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueReady.wait(lock, [this]() { return stopping || queued > 0; });
+            if (queued == 0) {
+                return; // Stopping and drained
+            }
+            for (; queued > 0; --queued) {
+                batch.push_back(ring[head]);
+                head = (head + 1) % ring.size();
+            }
+        }
+        TRACE_SPAN("AnomalyMonitor::detect", "exchange");
+        for (const auto& event : batch) {
+            alerts.clear();
+            for (auto& detector : detectors) {
+                detector->observe(event, alerts);
+            }
+            for (const auto& alert : alerts) {
+                write(alert);
+            }
+        }
+        log.flush();
+    }
+}
+
+void AnomalyMonitor::write(const AnomalyAlert& alert) {
+    std::tm timeInfo{};
+    char stamp[32];
+    if (!local_time(alert.timestamp, timeInfo) || std::strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &timeInfo) == 0) {
+        std::snprintf(stamp, sizeof(stamp), "%lld", static_cast<long long>(alert.timestamp));
+    }
+    log << stamp << " [" << alert.detector << "] " << alert.subject << ", receipt " << alert.receiptId << ": " << alert.detail
+        << '\n';
+    alertCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<std::unique_ptr<AnomalyDetector>> AnomalyMonitor::defaultDetectors(const std::map<Currency, ClientLimit>& clientLimits) {
+    std::vector<std::unique_ptr<AnomalyDetector>> detectors;
+    detectors.push_back(std::make_unique<ClientVelocityDetector>());
+    detectors.push_back(std::make_unique<SplitPatternDetector>());
+    detectors.push_back(std::make_unique<CashierVolumeDetector>());
+    if (!clientLimits.empty()) {
+        detectors.push_back(std::make_unique<NearLimitDetector>(clientLimits));
+    }
+    return detectors;
+}
@@ -0,0 +1,452 @@
+#include "batch_processor.h"
+
+#include "split_optimizer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <chrono>
+#include <optional>
+#include <cstdlib>
+#include <string_view>
+#include <utility>
+
+namespace {
+    constexpr std::size_t kOutputChunkBytes = 1 << 20;
+
+    double parseAmount(std::string_view text) {
+        text = trim_view(text);
+        std::string buffer(text);
+        char* end = nullptr;
+        double value = std::strtod(buffer.c_str(), &end);
+        if (buffer.empty() || end != buffer.c_str() + buffer.size()) {
+            throw ExchangeError("Invalid amount: " + buffer);
+        }
+        return value;
+    }
+
+    int parseId(std::string_view text) {
+        text = trim_view(text);
+        int value = 0;
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (text.empty() || result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+            throw ExchangeError("Invalid id: " + std::string(text));
+        }
+        return value;
+    }
+
+    Currency parseCurrencyView(std::string_view text) {
+        return currency_from_string(std::string(trim_view(text)));
+    }
+
+    // "prefer:", "payout:" or "profit:" in place of portions asks the office to plan the split.
+    bool isAutomaticSplit(std::string_view text) {
+        auto colon = text.find(':');
+        std::string_view prefix = colon == std::string_view::npos ? std::string_view() : trim_view(text.substr(0, colon));
+        return prefix == "prefer" || prefix == "payout" || prefix == "profit";
+    }
+
+    std::vector<int> parseDenominations(std::string_view text) {
+        std::vector<int> denominations;
+        while (!text.empty()) {
+            auto slash = text.find('/');
+            int value = parseId(text.substr(0, slash));
+            if (value > 0) {
+                denominations.push_back(value);
+            }
+            if (slash == std::string_view::npos) {
+                break;
+            }
+            text.remove_prefix(slash + 1);
+        }
+        return denominations;
+    }
+
+    // Minimal JSON reader for flat request objects; nested arrays of objects are supported for "portions".
+    class JsonCursor {
+    private:
+        std::string_view text;
+        std::size_t position;
+
+    public:
+        explicit JsonCursor(std::string_view input) : text(input), position(0) {}
+
+        void skipSpace() {
+            while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position]))) {
+                ++position;
+            }
+        }
+
+        bool consume(char expected) {
+            skipSpace();
+            if (position < text.size() && text[position] == expected) {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+
+        void expect(char expected) {
+            if (!consume(expected)) {
+                throw ExchangeError(std::string("Malformed JSON: expected '") + expected + "'");
+            }
+        }
+
+        char peek() {
+            skipSpace();
+            return position < text.size() ? text[position] : '\0';
+        }
+
+        std::string readString() {
+            expect('"');
+            std::string value;
+            while (position < text.size() && text[position] != '"') {
+                char ch = text[position++];
+                if (ch == '\\' && position < text.size()) {
+                    char escaped = text[position++];
+                    switch (escaped) {
+                        case 'n': value.push_back('\n'); break;
+                        case 't': value.push_back('\t'); break;
+                        case 'r': value.push_back('\r'); break;
+                        default: value.push_back(escaped); break;
+                    }
+                } else {
+                    value.push_back(ch);
+                }
+            }
+            expect('"');
+            return value;
+        }
+
+        double readNumber() {
+            skipSpace();
+            char* end = nullptr;
+            std::string buffer(text.substr(position, std::min<std::size_t>(32, text.size() - position)));
+            double value = std::strtod(buffer.c_str(), &end);
+            if (end == buffer.c_str()) {
+                throw ExchangeError("Malformed JSON number");
+            }
+            position += static_cast<std::size_t>(end - buffer.c_str());
+            return value;
+        }
+
+        std::string readScalarAsString() {
+            if (peek() == '"') {
+                return readString();
+            }
+            double value = readNumber();
+            std::string text;
+            append_fixed(text, value, 0);
+            return text;
+        }
+
+        void skipValue() {
+            char next = peek();
+            if (next == '"') {
+                readString();
+            } else if (next == '{' || next == '[') {
+                char close = next == '{' ? '}' : ']';
+                expect(next);
+                while (!consume(close)) {
+                    if (next == '{') {
+                        readString();
+                        expect(':');
+                    }
+                    skipValue();
+                    consume(',');
+                }
+            } else if (next == 't' || next == 'f' || next == 'n') {
+                while (position < text.size() && std::isalpha(static_cast<unsigned char>(text[position]))) {
+                    ++position;
+                }
+            } else {
+                readNumber();
+            }
+        }
+    };
+
+    ExchangePortion parseJsonPortion(JsonCursor& cursor) {
+        std::optional<Currency> target;
+        std::optional<double> amount;
+        std::vector<int> denominations;
+        cursor.expect('{');
+        while (!cursor.consume('}')) {
+            std::string key = cursor.readString();
+            cursor.expect(':');
+            if (key == "target" || key == "currency") {
+                target = currency_from_string(cursor.readString());
+            } else if (key == "amount") {
+                if (cursor.peek() == '"') {
+                    std::string text = cursor.readString();
+                    if (text != "*" && text != "ALL" && text != "all") {
+                        amount = parseAmount(text);
+                    }
+                } else {
+                    amount = cursor.readNumber();
+                }
+            } else if (key == "denominations") {
+                cursor.expect('[');
+                while (!cursor.consume(']')) {
+                    denominations.push_back(static_cast<int>(cursor.readNumber()));
+                    cursor.consume(',');
+                }
+            } else {
+                cursor.skipValue();
+            }
+            cursor.consume(',');
+        }
+        if (!target) {
+            throw ExchangeError("Portion is missing its target currency");
+        }
+        ExchangePortion portion = amount ? ExchangePortion(*target, *amount) : ExchangePortion::remainder(*target);
+        portion.denominations = std::move(denominations);
+        return portion;
+    }
+}
+
+RequestParser::RequestParser(DataStore& persistence) : store(persistence) {}
+
+BatchFormat RequestParser::detect(std::string_view line) {
+    line = trim_view(line);
+    return !line.empty() && line.front() == '{' ? BatchFormat::JsonLines : BatchFormat::Csv;
+}
+
+ExchangeRequest RequestParser::parse(std::string_view line, BatchFormat format) {
+    if (format == BatchFormat::Auto) {
+        format = detect(line);
+    }
+    return format == BatchFormat::JsonLines ? parseJson(line) : parseCsv(line);
+}
+
+BatchProcessor::BatchProcessor(Cashier& batchCashier, DataStore& persistence, BatchFormat inputFormat)
+    : cashier(batchCashier),
+      store(persistence),
+      parser(persistence),
+      format(inputFormat) {}
+
+BatchFormat BatchProcessor::parseFormat(const std::string& name) {
+    if (name == "csv") {
+        return BatchFormat::Csv;
+    }
+    if (name == "jsonl" || name == "json") {
+        return BatchFormat::JsonLines;
+    }
+    if (name == "auto") {
+        return BatchFormat::Auto;
+    }
+    throw ExchangeError("Unknown batch format: " + name);
+}
+
+int RequestParser::resolveClient(const std::string& name, int explicitId) {
+    if (explicitId > 0) {
+        return explicitId;
+    }
+    return store.ensurePersonId("client", name);
+}
+
+ExchangeRequest RequestParser::parseCsv(std::string_view line) {
+    std::string_view fields[5];
+    std::size_t count = 0;
+    std::string_view rest(line);
+    while (count < 5) {
+        auto comma = rest.find(',');
+        fields[count++] = rest.substr(0, comma);
+        if (comma == std::string_view::npos) {
+            break;
+        }
+        rest.remove_prefix(comma + 1);
+    }
+    if (count < 4) {
+        throw ExchangeError("Expected client,source,amount,portions");
+    }
+
+    std::string clientName(trim_view(fields[0]));
+    Currency source = parseCurrencyView(fields[1]);
+    double amount = parseAmount(fields[2]);
+    int clientId = resolveClient(clientName, count == 5 ? parseId(fields[4]) : 0);
+
+    std::string_view portionText = trim_view(fields[3]);
+    if (isAutomaticSplit(portionText)) {
+        ExchangeRequest request(clientId, clientName, source, amount);
+        request.automaticSplit = SplitOptimizer::parse(std::string(portionText));
+        return request;
+    }
+    std::vector<ExchangePortion> portions;
+    bool single = portionText.find(';') == std::string_view::npos;
+    while (!portionText.empty()) {
+        auto separator = portionText.find(';');
+        std::string_view part = trim_view(portionText.substr(0, separator));
+
+        std::vector<int> denominations;
+        auto at = part.find('@');
+        if (at != std::string_view::npos) {
+            denominations = parseDenominations(part.substr(at + 1));
+            part = part.substr(0, at);
+        }
+        auto colon = part.find(':');
+        Currency target = parseCurrencyView(part.substr(0, colon));
+        std::string_view sliceText = colon == std::string_view::npos ? std::string_view() : trim_view(part.substr(colon + 1));
+        bool remainder = sliceText.empty() ? single : sliceText == "*";
+        if (sliceText.empty() && !single) {
+            throw ExchangeError("Split portions need an amount or '*'");
+        }
+
+        ExchangePortion portion = remainder ? ExchangePortion::remainder(target) : ExchangePortion(target, parseAmount(sliceText));
+        portion.denominations = std::move(denominations);
+        portions.push_back(std::move(portion));
+
+        if (separator == std::string_view::npos) {
+            break;
+        }
+        portionText.remove_prefix(separator + 1);
+    }
+    if (portions.empty()) {
+        throw ExchangeError("Request has no payout portions");
+    }
+    return ExchangeRequest(clientId, clientName, source, amount, std::move(portions));
+}
+
+ExchangeRequest RequestParser::parseJson(std::string_view line) {
+    JsonCursor cursor(line);
+    std::string clientName;
+    int clientId = 0;
+    std::optional<Currency> source;
+    std::optional<double> amount;
+    std::vector<ExchangePortion> portions;
+    std::optional<SplitPreferences> automaticSplit;
+
+    cursor.expect('{');
+    while (!cursor.consume('}')) {
+        std::string key = cursor.readString();
+        cursor.expect(':');
+        if (key == "client") {
+            clientName = cursor.readScalarAsString();
+        } else if (key == "client_id") {
+            clientId = static_cast<int>(cursor.readNumber());
+        } else if (key == "source") {
+            source = currency_from_string(cursor.readString());
+        } else if (key == "amount") {
+            amount = cursor.readNumber();
+        } else if (key == "target") {
+            portions.push_back(ExchangePortion::remainder(currency_from_string(cursor.readString())));
+        } else if (key == "split") {
+            automaticSplit = SplitOptimizer::parse(cursor.readString());
+        } else if (key == "portions") {
+            cursor.expect('[');
+            while (!cursor.consume(']')) {
+                portions.push_back(parseJsonPortion(cursor));
+                cursor.consume(',');
+            }
+        } else {
+            cursor.skipValue();
+        }
+        cursor.consume(',');
+    }
+
+    if (clientName.empty() || !source || !amount) {
+        throw ExchangeError("Request needs client, source and amount");
+    }
+    if (portions.empty() && !automaticSplit) {
+        throw ExchangeError("Request has no payout portions");
+    }
+    ExchangeRequest request(resolveClient(clientName, clientId), clientName, *source, *amount, std::move(portions));
+    if (automaticSplit) {
+        if (!request.portions.empty()) {
+            throw ExchangeError("A request takes either \"split\" or payout portions, not both");
+        }
+        request.automaticSplit = std::move(automaticSplit);
+    }
+    return request;
+}
+
+void BatchProcessor::appendReceiptJson(std::string& out, const Receipt& receipt) {
+    out.append("{\"receipt_id\":");
+    append_integer(out, receipt.id());
+    out.append(",\"timestamp\":");
+    append_integer(out, static_cast<long long>(receipt.timestamp()));
+    out.append(",\"cashier_id\":");
+    append_integer(out, receipt.cashierIdentifier());
+    out.append(",\"client_id\":");
+    append_integer(out, receipt.clientIdentifier());
+    out.append(",\"client\":");
+    append_json_string(out, receipt.client());
+    out.append(",\"source\":\"").append(to_string(receipt.source())).append("\",\"source_amount\":");
+    append_fixed(out, receipt.sourceAmountValue());
+    out.append(",\"payouts\":[");
+    bool first = true;
+    for (const auto& payout : receipt.payouts()) {
+        if (!first) {
+            out.push_back(',');
+        }
+        first = false;
+        out.append("{\"currency\":\"").append(to_string(payout.currency)).append("\",\"amount\":");
+        append_fixed(out, payout.amountPaid);
+        out.append(",\"commission\":");
+        append_fixed(out, payout.commissionTaken);
+        out.append(",\"spread\":");
+        append_fixed(out, payout.spreadTaken);
+        out.push_back('}');
+    }
+    out.append("],\"profit_base\":");
+    append_fixed(out, receipt.profitInBase());
+    out.append(",\"spread_base\":");
+    append_fixed(out, receipt.spreadInBase());
+    out.push_back('}');
+}
+
+BatchSummary BatchProcessor::run(std::istream& input, std::ostream& output) {
+    BatchSummary summary;
+    auto started = std::chrono::steady_clock::now();
+
+    std::string buffer;
+    buffer.reserve(kOutputChunkBytes + 4096);
+    auto drain = [&buffer, &output]() {
+        output.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        buffer.clear();
+    };
+
+    BulkModeScope bulk(store);
+    std::string line;
+    std::size_t lineNumber = 0;
+    BatchFormat lineFormat = format;
+    while (std::getline(input, line)) {
+        ++lineNumber;
+        std::string_view content = trim_view(line);
+        if (content.empty() || content.front() == '#') {
+            continue;
+        }
+        if (lineFormat == BatchFormat::Auto) {
+            lineFormat = RequestParser::detect(content);
+        }
+        if (lineFormat == BatchFormat::Csv && summary.processed == 0 && content.rfind("client,", 0) == 0) {
+            continue; // Header row
+        }
+
+        summary.processed++;
+        try {
+            ExchangeRequest request = parser.parse(content, lineFormat);
+            Receipt receipt = cashier.handleRequest(request);
+            store.appendTransaction(receipt);
+            appendReceiptJson(buffer, receipt);
+            buffer.push_back('\n');
+            summary.succeeded++;
+        } catch (const std::exception& error) {
+            buffer.append("{\"line\":");
+            append_integer(buffer, static_cast<long long>(lineNumber));
+            buffer.append(",\"error\":");
+            append_json_string(buffer, error.what());
+            buffer.append("}\n");
+            summary.failed++;
+        }
+
+        if (buffer.size() >= kOutputChunkBytes) {
+            drain();
+        }
+    }
+    drain();
+    output.flush();
+
+    summary.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+    return summary;
+}
@@ -0,0 +1,261 @@
+#include "branch_network.h"
+
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdio>
+#include <ctime>
+#include <future>
+#include <thread>
+
+namespace {
+    std::string prepared_directory(const std::filesystem::path& directory) {
+        std::filesystem::create_directories(directory);
+        return directory.string();
+    }
+
+    std::time_t local_day_start(std::time_t now) {
+        std::tm local{};
+        local_time(now, local);
+        local.tm_hour = 0;
+        local.tm_min = 0;
+        local.tm_sec = 0;
+        local.tm_isdst = -1;
+        return std::mktime(&local);
+    }
+
+    void validate_branch_name(const std::string& name) {
+        bool valid = !name.empty() && name.size() <= 64 && std::all_of(name.begin(), name.end(), [](unsigned char ch) {
+            return std::isalnum(ch) || ch == '-' || ch == '_';
+        });
+        if (!valid) {
+            throw ExchangeError("Branch names use letters, digits, '-' and '_' only: \"" + name + "\"");
+        }
+    }
+
+    void add_balances(std::map<Currency, double>& total, const std::map<Currency, double>& balances) {
+        for (const auto& [currency, amount] : balances) {
+            total[currency] += amount;
+        }
+    }
+
+    BranchTotals total_branch(Branch& branch, ConsolidatedReport& partial) {
+        std::lock_guard<std::mutex> guard(branch.mutex);
+        const ExchangeOffice& office = branch.office;
+        BranchTotals totals;
+        totals.name = branch.name;
+        totals.transactions = office.transactionsToday().size();
+        totals.profitInBase = office.currentProfitBase();
+        totals.startBalances = office.startOfDayReserve().allBalances();
+        totals.endBalances = office.reserve().allBalances();
+        for (const auto& [currency, _] : office.criticalMinimumsMap()) {
+            if (office.isBelowCritical(currency)) {
+                totals.belowCritical.push_back(currency);
+            }
+        }
+        std::array<double, 4> taken{};
+        std::array<double, 4> paid{};
+        for (const auto& record : office.transactionsToday()) {
+            for (const auto& payout : record.payouts) {
+                taken[static_cast<std::size_t>(record.sourceCurrency)] += payout.sourceAmount;
+                paid[static_cast<std::size_t>(payout.currency)] += payout.amountPaid;
+            }
+        }
+        for (Currency currency : {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL}) {
+            partial.volumeIn[currency] += taken[static_cast<std::size_t>(currency)];
+            partial.volumeOut[currency] += paid[static_cast<std::size_t>(currency)];
+        }
+        return totals;
+    }
+
+    void merge_into(ConsolidatedReport& total, ConsolidatedReport&& partial) {
+        for (auto& branch : partial.branches) {
+            add_balances(total.startBalances, branch.startBalances);
+            add_balances(total.endBalances, branch.endBalances);
+            total.transactions += branch.transactions;
+            total.profitInBase += branch.profitInBase;
+            total.branches.push_back(std::move(branch));
+        }
+        add_balances(total.volumeIn, partial.volumeIn);
+        add_balances(total.volumeOut, partial.volumeOut);
+    }
+}
+
+Branch::Branch(std::string branchName, const std::filesystem::path& directory, const DataStore& ratesOwner,
+               std::shared_ptr<RateBoard> rates, const BranchDefaults& defaults)
+    : storeOpen(false),
+      name(std::move(branchName)),
+      store(prepared_directory(directory)),
+      office(std::move(rates), Reserve(store.loadReserve(defaults.reserve)), defaults.commission) {
+    store.shareRatesWith(ratesOwner);
+    auto criticalMinima = store.loadCriticalMinimums();
+    if (criticalMinima.empty()) {
+        criticalMinima = defaults.criticalMinimums;
+        store.saveCriticalMinimums(criticalMinima);
+    }
+    office.initializeCriticalMinimums(criticalMinima);
+    auto clientLimits = store.loadClientLimits();
+    office.setClientLimits(clientLimits.empty() ? defaults.clientLimits : clientLimits);
+    // Branches keep no journal; today's receipts in their log carry the day across a restart.
+    auto day = store.loadLoggedDay(local_day_start(std::time(nullptr)));
+    office.restoreLoggedDay(day.records, day.lastReceiptId);
+    office.setGaugesEnabled(false);
+}
+
+void Branch::openStore() {
+    if (!storeOpen) {
+        store.initialize(StartupSource::Csv);
+        storeOpen = true;
+    }
+}
+
+BranchNetwork::BranchNetwork(std::filesystem::path directory, const DataStore& ratesOwner, std::shared_ptr<RateBoard> sharedRates,
+                             BranchDefaults branchDefaults)
+    : root(std::move(directory)),
+      headOffice(ratesOwner),
+      rates(std::move(sharedRates)),
+      defaults(std::move(branchDefaults)) {}
+
+Branch* BranchNetwork::locate(const std::string& name) const {
+    auto found = std::lower_bound(branches.begin(), branches.end(), name, [](const auto& branch, const std::string& key) {
+        return branch->name < key;
+    });
+    return found != branches.end() && (*found)->name == name ? found->get() : nullptr;
+}
+
+std::size_t BranchNetwork::loadAll() {
+    TRACE_SPAN("BranchNetwork::loadAll", "persistence");
+    if (std::filesystem::exists(root)) {
+        for (const auto& entry : std::filesystem::directory_iterator(root)) {
+            if (entry.is_directory()) {
+                open(entry.path().filename().string());
+            }
+        }
+    }
+    return size();
+}
+
+Branch& BranchNetwork::open(const std::string& name) {
+    validate_branch_name(name);
+    std::lock_guard<std::mutex> guard(mutex);
+    if (Branch* existing = locate(name)) {
+        return *existing;
+    }
+    auto branch = std::make_unique<Branch>(name, root / name, headOffice, rates, defaults);
+    auto position = std::upper_bound(branches.begin(), branches.end(), name, [](const std::string& key, const auto& other) {
+        return key < other->name;
+    });
+    return **branches.insert(position, std::move(branch));
+}
+
+Branch* BranchNetwork::find(const std::string& name) const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return locate(name);
+}
+
+std::vector<std::string> BranchNetwork::names() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<std::string> result;
+    result.reserve(branches.size());
+    for (const auto& branch : branches) {
+        result.push_back(branch->name);
+    }
+    return result;
+}
+
+std::size_t BranchNetwork::size() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return branches.size();
+}
+
+void BranchNetwork::saveAll() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    for (const auto& branch : branches) {
+        std::lock_guard<std::mutex> branchGuard(branch->mutex);
+        branch->store.saveReserve(branch->office.reserve().allBalances());
+        branch->store.saveCriticalMinimums(branch->office.criticalMinimumsMap());
+    }
+}
+
+ConsolidatedReport BranchNetwork::consolidate(std::size_t workers) const {
+    TRACE_SPAN("BranchNetwork::consolidate", "report");
+    std::vector<Branch*> hosted;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        hosted.reserve(branches.size());
+        for (const auto& branch : branches) {
+            hosted.push_back(branch.get());
+        }
+    }
+    if (workers == 0) {
+        workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    workers = std::clamp<std::size_t>(workers, 1, std::max<std::size_t>(hosted.size(), 1));
+
+    // Contiguous slices keep the merged branch list in name order.
+    std::vector<std::future<ConsolidatedReport>> slices;
+    std::size_t sliceSize = (hosted.size() + workers - 1) / workers;
+    for (std::size_t first = 0; first < hosted.size(); first += sliceSize) {
+        std::size_t last = std::min(hosted.size(), first + sliceSize);
+        slices.push_back(std::async(std::launch::async, [&hosted, first, last]() {
+            ConsolidatedReport partial;
+            partial.branches.reserve(last - first);
+            for (std::size_t index = first; index < last; ++index) {
+                partial.branches.push_back(total_branch(*hosted[index], partial));
+            }
+            return partial;
+        }));
+    }
+
+    ConsolidatedReport report;
+    report.branches.reserve(hosted.size());
+    for (auto& slice : slices) {
+        merge_into(report, slice.get());
+    }
+    report.generatedAt = std::time(nullptr);
+    return report;
+}
+
+std::string BranchNetwork::format(const ConsolidatedReport& report) {
+    std::string text = "\n=== Consolidated Report ===\n";
+    std::tm generatedInfo{};
+    char generatedText[32];
+    if (local_time(report.generatedAt, generatedInfo)
+        && std::strftime(generatedText, sizeof(generatedText), "%Y-%m-%d %H:%M:%S", &generatedInfo) > 0) {
+        text.append("Generated at: ").append(generatedText).push_back('\n');
+    }
+    text += "Branches: ";
+    append_integer(text, static_cast<long long>(report.branches.size()));
+    text += "  Transactions: ";
+    append_integer(text, static_cast<long long>(report.transactions));
+    text += "  Profit (base currency): ";
+    append_fixed(text, report.profitInBase, 2);
+    text += '\n';
+
+    char line[160];
+    text += "\nBranch                Transactions        Profit  Below critical\n";
+    for (const auto& branch : report.branches) {
+        std::string below;
+        for (Currency currency : branch.belowCritical) {
+            below += below.empty() ? to_string(currency) : ' ' + to_string(currency);
+        }
+        std::snprintf(line, sizeof(line), "%-20s %13zu %13.2f  %s\n",
+                      branch.name.c_str(), branch.transactions, branch.profitInBase, below.empty() ? "-" : below.c_str());
+        text += line;
+    }
+
+    text += "\nCurrency            Start            End          In         Out\n";
+    for (const auto& [currency, start] : report.startBalances) {
+        auto valueOf = [currency](const std::map<Currency, double>& values) {
+            auto found = values.find(currency);
+            return found != values.end() ? found->second : 0.0;
+        };
+        std::snprintf(line, sizeof(line), "%-8s %14.2f %14.2f %11.2f %11.2f\n", to_string(currency).c_str(), start,
+                      valueOf(report.endBalances), valueOf(report.volumeIn), valueOf(report.volumeOut));
+        text += line;
+    }
+    return text;
+}
@@ -0,0 +1,220 @@
+#include "client_limits.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <limits>
+
+namespace {
+    constexpr std::int64_t kSecondsPerDay = 24 * 3600;
+    constexpr double kTolerance = 1e-6;
+
+    std::int32_t day_of(std::time_t timestamp) {
+        std::int64_t seconds = static_cast<std::int64_t>(timestamp);
+        std::int64_t day = seconds / kSecondsPerDay;
+        if (seconds % kSecondsPerDay < 0) {
+            --day;
+        }
+        return static_cast<std::int32_t>(day);
+    }
+
+    // Share of yesterday (and of the eighth day back) the rolling windows still cover.
+    double carried_share(std::time_t timestamp) {
+        std::int64_t seconds = static_cast<std::int64_t>(timestamp) - static_cast<std::int64_t>(day_of(timestamp)) * kSecondsPerDay;
+        return 1.0 - static_cast<double>(seconds) / static_cast<double>(kSecondsPerDay);
+    }
+
+    std::size_t ring_index(std::int32_t day) {
+        auto days = static_cast<std::int32_t>(ClientWindow::kDays);
+        return static_cast<std::size_t>(((day % days) + days) % days);
+    }
+
+    double bucket(const ClientWindow& window, std::size_t currency, std::int32_t day) {
+        if (day > window.newestDay || window.newestDay - day >= static_cast<std::int32_t>(ClientWindow::kDays)) {
+            return 0.0;
+        }
+        return window.buckets[currency][ring_index(day)];
+    }
+
+    std::pair<double, double> rolling(const ClientWindow& window, std::size_t currency, std::time_t timestamp) {
+        std::int32_t today = day_of(timestamp);
+        double share = carried_share(timestamp);
+        double day = bucket(window, currency, today) + bucket(window, currency, today - 1) * share;
+        double week = bucket(window, currency, today - 7) * share;
+        for (std::int32_t back = 0; back < 7; ++back) {
+            week += bucket(window, currency, today - back);
+        }
+        return {day, week};
+    }
+}
+
+ClientLimitTracker::ClientLimitTracker() = default;
+
+void ClientLimitTracker::setLimits(const std::map<Currency, ClientLimit>& configured) {
+    limits = {};
+    limited = false;
+    for (const auto& [currency, limit] : configured) {
+        if (limit.daily < 0.0 || limit.weekly < 0.0) {
+            throw ExchangeError("Client limits for " + to_string(currency) + " cannot be negative");
+        }
+        limits[static_cast<std::size_t>(currency)] = limit;
+        limited = limited || limit.daily > 0.0 || limit.weekly > 0.0;
+    }
+}
+
+std::map<Currency, ClientLimit> ClientLimitTracker::limitsMap() const {
+    std::map<Currency, ClientLimit> configured;
+    for (Currency currency : {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL}) {
+        const ClientLimit& limit = limits[static_cast<std::size_t>(currency)];
+        if (limit.daily > 0.0 || limit.weekly > 0.0) {
+            configured[currency] = limit;
+        }
+    }
+    return configured;
+}
+
+bool ClientLimitTracker::enabled() const {
+    return limited;
+}
+
+std::size_t ClientLimitTracker::slotFor(int clientId) const {
+    // Fibonacci hashing spreads sequential ids; the table is a power of two and never more than half full.
+    std::size_t mask = keys.size() - 1;
+    std::size_t slot = static_cast<std::size_t>((static_cast<std::uint32_t>(clientId) * 2654435769u) >> 7) & mask;
+    while (keys[slot] != clientId && keys[slot] != kEmpty) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+void ClientLimitTracker::grow() {
+    std::vector<int> oldKeys = std::move(keys);
+    std::vector<ClientWindow> oldWindows = std::move(windows);
+    std::size_t capacity = std::max<std::size_t>(64, oldKeys.size() * 2);
+    keys.assign(capacity, kEmpty);
+    windows.assign(capacity, ClientWindow{});
+    for (std::size_t i = 0; i < oldKeys.size(); ++i) {
+        if (oldKeys[i] != kEmpty) {
+            std::size_t slot = slotFor(oldKeys[i]);
+            keys[slot] = oldKeys[i];
+            windows[slot] = oldWindows[i];
+        }
+    }
+}
+
+void ClientLimitTracker::check(int clientId, const ClientVolume& volume, std::time_t timestamp) const {
+    if (!limited) {
+        return;
+    }
+    const ClientWindow* window = nullptr;
+    if (!keys.empty()) {
+        std::size_t slot = slotFor(clientId);
+        window = keys[slot] == clientId ? &windows[slot] : nullptr;
+    }
+    for (std::size_t currency = 0; currency < limits.size(); ++currency) {
+        const ClientLimit& limit = limits[currency];
+        if (volume[currency] <= 0.0 || (limit.daily <= 0.0 && limit.weekly <= 0.0)) {
+            continue;
+        }
+        auto [day, week] = window ? rolling(*window, currency, timestamp) : std::pair<double, double>{0.0, 0.0};
+        bool overDay = limit.daily > 0.0 && day + volume[currency] > limit.daily + kTolerance;
+        bool overWeek = limit.weekly > 0.0 && week + volume[currency] > limit.weekly + kTolerance;
+        if (overDay || overWeek) {
+            char message[200];
+            std::snprintf(message, sizeof(message), "Client %d would exceed the %s %s limit of %.2f (%.2f already used)",
+                          clientId, overDay ? "daily" : "weekly", to_string(static_cast<Currency>(currency)).c_str(),
+                          overDay ? limit.daily : limit.weekly, overDay ? day : week);
+            throw LimitExceededError(message);
+        }
+    }
+}
+
+void ClientLimitTracker::record(int clientId, const ClientVolume& volume, std::time_t timestamp) {
+    if (!limited) {
+        return; // Volume counts from when limits are configured
+    }
+    if ((occupied + 1) * 2 > keys.size()) {
+        grow();
+    }
+    std::size_t slot = slotFor(clientId);
+    ClientWindow& window = windows[slot];
+    std::int32_t today = day_of(timestamp);
+    if (keys[slot] == kEmpty) {
+        keys[slot] = clientId;
+        occupied++;
+        window = ClientWindow{};
+        window.clientId = clientId;
+        window.newestDay = today;
+    } else if (today > window.newestDay) {
+        std::int32_t cleared = std::min(today - window.newestDay, static_cast<std::int32_t>(ClientWindow::kDays));
+        for (std::int32_t offset = 0; offset < cleared; ++offset) {
+            for (auto& currency : window.buckets) {
+                currency[ring_index(today - offset)] = 0.0;
+            }
+        }
+        window.newestDay = today;
+    } else if (window.newestDay - today >= static_cast<std::int32_t>(ClientWindow::kDays)) {
+        return; // Older than anything the windows still cover
+    }
+    for (std::size_t currency = 0; currency < volume.size(); ++currency) {
+        window.buckets[currency][ring_index(today)] += volume[currency];
+    }
+}
+
+std::pair<double, double> ClientLimitTracker::usage(int clientId, Currency currency, std::time_t timestamp) const {
+    if (keys.empty()) {
+        return {0.0, 0.0};
+    }
+    std::size_t slot = slotFor(clientId);
+    if (keys[slot] != clientId) {
+        return {0.0, 0.0};
+    }
+    return rolling(windows[slot], static_cast<std::size_t>(currency), timestamp);
+}
+
+double ClientLimitTracker::headroom(int clientId, Currency currency, std::time_t timestamp) const {
+    const ClientLimit& limit = limits[static_cast<std::size_t>(currency)];
+    double room = std::numeric_limits<double>::infinity();
+    if (limit.daily <= 0.0 && limit.weekly <= 0.0) {
+        return room;
+    }
+    auto [day, week] = usage(clientId, currency, timestamp);
+    if (limit.daily > 0.0) {
+        room = std::min(room, limit.daily - day);
+    }
+    if (limit.weekly > 0.0) {
+        room = std::min(room, limit.weekly - week);
+    }
+    return std::max(0.0, room);
+}
+
+std::size_t ClientLimitTracker::clients() const {
+    return occupied;
+}
+
+std::vector<ClientWindow> ClientLimitTracker::activeWindows(std::time_t timestamp) const {
+    std::int32_t oldest = day_of(timestamp) - static_cast<std::int32_t>(ClientWindow::kDays) + 1;
+    std::vector<ClientWindow> active;
+    for (std::size_t slot = 0; slot < keys.size(); ++slot) {
+        if (keys[slot] != kEmpty && windows[slot].newestDay >= oldest) {
+            active.push_back(windows[slot]);
+        }
+    }
+    return active;
+}
+
+void ClientLimitTracker::restore(const std::vector<ClientWindow>& saved) {
+    keys.clear();
+    windows.clear();
+    occupied = 0;
+    for (const auto& window : saved) {
+        if ((occupied + 1) * 2 > keys.size()) {
+            grow();
+        }
+        std::size_t slot = slotFor(window.clientId);
+        if (keys[slot] == kEmpty) {
+            keys[slot] = window.clientId;
+            occupied++;
+        }
+        windows[slot] = window;
+    }
+}
@@ -0,0 +1,178 @@
+#include "config_watcher.h"
+
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr int kPollMilliseconds = 100;
+    constexpr double kRateTolerance = 1e-9; // rates.csv keeps ten significant digits
+
+    bool same_value(double left, double right) {
+        return std::fabs(left - right) <= kRateTolerance * std::max(1.0, std::fabs(right));
+    }
+}
+
+ConfigWatcher::ConfigWatcher(ExchangeOffice& exchangeOffice, DataStore& persistence, std::mutex& sharedOfficeMutex)
+    : office(exchangeOffice),
+      store(persistence),
+      officeMutex(sharedOfficeMutex),
+      stopping(false),
+      reloads(0),
+      inotifyDescriptor(-1),
+      ratesWatch(-1),
+      criticalWatch(-1) {}
+
+ConfigWatcher::~ConfigWatcher() {
+    stop();
+}
+
+std::size_t ConfigWatcher::reloadCount() const {
+    return reloads.load(std::memory_order_relaxed);
+}
+
+void ConfigWatcher::reloadRates() {
+    TRACE_SPAN("ConfigWatcher::reloadRates", "persistence");
+    auto stored = store.reloadRates();
+    if (!stored) {
+        return;
+    }
+    auto current = office.rateConfig();
+    std::vector<RateUpdate> changes;
+    for (const auto& [from, to, mid, margin] : *stored) {
+        bool known = current->canConvert(from, to) && from != to;
+        try {
+            if (known && same_value(current->getRate(from, to), mid) && same_value(current->margin(from, to), margin)) {
+                continue;
+            }
+        } catch (const RateNotFoundError&) {
+            // Only reachable through the base currency so far: a new pair
+        }
+        changes.push_back(RateUpdate{from, to, mid, margin});
+    }
+    if (changes.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(officeMutex);
+        office.applyRates(changes);
+    }
+    reloads.fetch_add(1, std::memory_order_relaxed);
+    std::cerr << "Reloaded " << store.ratesFile().filename().string() << ": " << changes.size() << " pair(s) changed.\n";
+}
+
+void ConfigWatcher::reloadCriticalMinimums() {
+    TRACE_SPAN("ConfigWatcher::reloadCriticalMinimums", "persistence");
+    auto stored = store.reloadCriticalMinimums();
+    if (!stored) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(officeMutex);
+        if (office.criticalMinimumsMap() == *stored) {
+            return;
+        }
+        office.updateCriticalMinimums(*stored);
+    }
+    reloads.fetch_add(1, std::memory_order_relaxed);
+    std::cerr << "Reloaded " << store.criticalFile().filename().string() << ".\n";
+}
+
+#ifdef __linux__
+
+void ConfigWatcher::start() {
+    inotifyDescriptor = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotifyDescriptor < 0) {
+        throw ExchangeError(std::string("inotify_init1: ") + std::strerror(errno));
+    }
+    // Directories rather than files: saves replace rates.csv by renaming a new file over it.
+    constexpr std::uint32_t kEvents = IN_CLOSE_WRITE | IN_MOVED_TO;
+    ratesWatch = ::inotify_add_watch(inotifyDescriptor, store.ratesFile().parent_path().c_str(), kEvents);
+    criticalWatch = ::inotify_add_watch(inotifyDescriptor, store.criticalFile().parent_path().c_str(), kEvents);
+    if (ratesWatch < 0 || criticalWatch < 0) {
+        throw ExchangeError("Unable to watch " + store.ratesFile().parent_path().string() + ": " + std::strerror(errno));
+    }
+    worker = std::thread(&ConfigWatcher::run, this);
+}
+
+void ConfigWatcher::stop() {
+    if (stopping.exchange(true)) {
+        return;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (inotifyDescriptor >= 0) {
+        ::close(inotifyDescriptor);
+        inotifyDescriptor = -1;
+    }
+}
+
+void ConfigWatcher::run() {
+    // SIGINT/SIGTERM belong to the session threads, not this one.
+    sigset_t all;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+    const std::string ratesName = store.ratesFile().filename().string();
+    const std::string criticalName = store.criticalFile().filename().string();
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (!stopping.load(std::memory_order_relaxed)) {
+        pollfd entry{inotifyDescriptor, POLLIN, 0};
+        if (::poll(&entry, 1, kPollMilliseconds) <= 0) {
+            continue;
+        }
+        // One reload per file however many events a save or an editor produced.
+        bool ratesChanged = false;
+        bool criticalChanged = false;
+        ssize_t received = 0;
+        while ((received = ::read(inotifyDescriptor, buffer, sizeof(buffer))) > 0) {
+            for (char* cursor = buffer; cursor < buffer + received;) {
+                auto* event = reinterpret_cast<inotify_event*>(cursor);
+                if (event->len > 0) {
+                    ratesChanged |= event->wd == ratesWatch && ratesName == event->name;
+                    criticalChanged |= event->wd == criticalWatch && criticalName == event->name;
+                }
+                cursor += sizeof(inotify_event) + event->len;
+            }
+        }
+        try {
+            if (ratesChanged) {
+                reloadRates();
+            }
+            if (criticalChanged) {
+                reloadCriticalMinimums();
+            }
+        } catch (const std::exception& error) {
+            std::cerr << "Configuration reload failed: " << error.what() << '\n';
+        }
+    }
+}
+
+#else
+
+void ConfigWatcher::start() {
+    throw ExchangeError("Watching configuration files requires Linux (inotify).");
+}
+
+void ConfigWatcher::stop() {
+    stopping = true;
+}
+
+void ConfigWatcher::run() {}
+
+#endif
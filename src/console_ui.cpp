@@ -1,23 +1,16 @@
 #include "console_ui.h"
 
+#include "split_optimizer.h"
+#include "utils.h"
+
 #include <cctype>
+#include <chrono>
 #include <ctime>
 #include <exception>
 #include <filesystem>
-#include <iomanip>
-#include <iostream>
 #include <sstream>
 
 namespace {
-    std::string trim(const std::string& text) {
-        const auto first = text.find_first_not_of(" \t\r\n");
-        if (first == std::string::npos) {
-            return "";
-        }
-        const auto last = text.find_last_not_of(" \t\r\n");
-        return text.substr(first, last - first + 1);
-    }
-
     std::string to_upper(std::string value) {
         for (auto& ch : value) {
             ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
@@ -26,81 +19,85 @@ namespace {
     }
 }
 
-ConsoleUI::ConsoleUI(ExchangeOffice& officeRef, DataStore& persistence)
+ConsoleUI::ConsoleUI(ExchangeOffice& officeRef, DataStore& persistence, OutputSink& output, LineInput& lineInput, std::mutex& sharedOfficeMutex)
     : office(officeRef),
-      store(persistence) {}
-
-std::string ConsoleUI::readLine(const std::string& prompt) const {
-    std::cout << prompt;
-    std::cout.flush();
-    std::string input;
-    if (!std::getline(std::cin, input)) {
+      store(persistence),
+      out(output),
+      input(lineInput),
+      officeMutex(sharedOfficeMutex) {}
+
+Task<std::string> ConsoleUI::readLine(std::string prompt) const {
+    out << prompt;
+    out.flush(); // Everything queued so far must be visible before waiting for input
+    std::optional<std::string> line = co_await input.readLine();
+    if (!line) {
         throw ExchangeError("Input stream closed unexpectedly");
     }
-    return trim(input);
+    co_return trim(*line);
 }
 
-int ConsoleUI::readInt(const std::string& prompt, int minValue, int maxValue) const {
+Task<int> ConsoleUI::readInt(std::string prompt, int minValue, int maxValue) const {
     while (true) {
-        std::string text = readLine(prompt);
+        std::string text = co_await readLine(prompt);
         try {
             int value = std::stoi(text);
             if (value < minValue || value > maxValue) {
-                std::cout << "Please enter a number between " << minValue << " and " << maxValue << ".\n";
+                out << "Please enter a number between " << minValue << " and " << maxValue << ".\n";
                 continue;
             }
-            return value;
+            co_return value;
         } catch (...) {
-            std::cout << "Invalid number. Try again.\n";
+            out << "Invalid number. Try again.\n";
         }
     }
 }
 
-double ConsoleUI::readDouble(const std::string& prompt, double minValue) const {
+Task<double> ConsoleUI::readDouble(std::string prompt, double minValue) const {
     while (true) {
-        std::string text = readLine(prompt);
+        std::string text = co_await readLine(prompt);
         try {
             double value = std::stod(text);
             if (value < minValue) {
-                std::cout << "Value must be at least " << minValue << ".\n";
+                out << "Value must be at least ";
+                out.writeNumber(minValue) << ".\n";
                 continue;
             }
-            return value;
+            co_return value;
         } catch (...) {
-            std::cout << "Invalid number. Try again.\n";
+            out << "Invalid number. Try again.\n";
         }
     }
 }
 
-Currency ConsoleUI::readCurrency(const std::string& prompt) const {
+Task<Currency> ConsoleUI::readCurrency(std::string prompt) const {
     while (true) {
-        std::string text = readLine(prompt);
+        std::string text = co_await readLine(prompt);
         try {
-            return currency_from_string(text);
+            co_return currency_from_string(text);
         } catch (const std::exception& error) {
-            std::cout << error.what() << ". Please try again.\n";
+            out << error.what() << ". Please try again.\n";
         }
     }
 }
 
-bool ConsoleUI::readYesNo(const std::string& prompt) const {
+Task<bool> ConsoleUI::readYesNo(std::string prompt) const {
     while (true) {
-        std::string text = to_upper(readLine(prompt));
+        std::string text = to_upper(co_await readLine(prompt));
         if (text == "Y" || text == "YES") {
-            return true;
+            co_return true;
         }
         if (text == "N" || text == "NO") {
-            return false;
+            co_return false;
         }
-        std::cout << "Please enter 'y' or 'n'.\n";
+        out << "Please enter 'y' or 'n'.\n";
     }
 }
 
-std::vector<int> ConsoleUI::readDenominations(const std::string& prompt) const {
-    std::string text = readLine(prompt);
+Task<std::vector<int>> ConsoleUI::readDenominations(std::string prompt) const {
+    std::string text = co_await readLine(prompt);
     std::vector<int> denominations;
     if (text.empty()) {
-        return denominations;
+        co_return denominations;
     }
 
     std::istringstream stream(text);
@@ -110,7 +107,7 @@ std::vector<int> ConsoleUI::readDenominations(const std::string& prompt) const {
             denominations.push_back(value);
         }
     }
-    return denominations;
+    co_return denominations;
 }
 
 void ConsoleUI::persistReserve() const {
@@ -118,7 +115,7 @@ void ConsoleUI::persistReserve() const {
 }
 
 void ConsoleUI::persistRates() const {
-    store.saveRates(office.rateConfig());
+    store.saveRates(office);
 }
 
 void ConsoleUI::persistCriticalMinimums() const {
@@ -126,28 +123,32 @@ void ConsoleUI::persistCriticalMinimums() const {
 }
 
 void ConsoleUI::run() {
+    run_blocking(session());
+}
+
+Task<void> ConsoleUI::session() {
     bool running = true;
-    while (running && std::cin) {
-        std::cout << "\n=== Currency Exchange System ===\n";
-        std::cout << "1. Employee login\n";
-        std::cout << "2. Manager login\n";
-        std::cout << "3. Quit\n";
+    while (running && !input.closed()) {
+        out << "\n=== Currency Exchange System ===\n";
+        out << "1. Employee login\n";
+        out << "2. Manager login\n";
+        out << "3. Quit\n";
 
-        int choice = readInt("Select option: ", 1, 3);
+        int choice = co_await readInt("Select option: ", 1, 3);
 
         switch (choice) {
             case 1:
                 try {
-                    employeeSession();
+                    co_await employeeSession();
                 } catch (const std::exception& error) {
-                    std::cout << "Employee session ended: " << error.what() << '\n';
+                    out << "Employee session ended: " << error.what() << '\n';
                 }
                 break;
             case 2:
                 try {
-                    managerSession();
+                    co_await managerSession();
                 } catch (const std::exception& error) {
-                    std::cout << "Manager session ended: " << error.what() << '\n';
+                    out << "Manager session ended: " << error.what() << '\n';
                 }
                 break;
             case 3:
@@ -156,25 +157,31 @@ void ConsoleUI::run() {
         }
     }
 
-    std::cout << "Shutting down. Goodbye!\n";
+    collectFinishedReports(true);
+    out << "Shutting down. Goodbye!\n";
+    out.flush();
 }
 
-void ConsoleUI::employeeSession() {
-    std::string employeeName = readLine("Enter employee name: ");
-    int employeeId = store.ensurePersonId("cashier", employeeName);
+Task<void> ConsoleUI::employeeSession() {
+    std::string employeeName = co_await readLine("Enter employee name: ");
+    int employeeId = 0;
+    {
+        std::lock_guard<std::mutex> guard(officeMutex);
+        employeeId = store.ensurePersonId("cashier", employeeName);
+    }
     Cashier cashier(employeeId, employeeName, office);
 
     bool active = true;
     while (active) {
-        std::cout << "\n-- Cashier Menu --\n";
-        std::cout << "1. Perform exchange\n";
-        std::cout << "2. Check reserve balances\n";
-        std::cout << "3. Logout\n";
-        int choice = readInt("Select option: ", 1, 3);
+        out << "\n-- Cashier Menu --\n";
+        out << "1. Perform exchange\n";
+        out << "2. Check reserve balances\n";
+        out << "3. Logout\n";
+        int choice = co_await readInt("Select option: ", 1, 3);
 
         switch (choice) {
             case 1:
-                employeeExchangeFlow(cashier);
+                co_await employeeExchangeFlow(cashier);
                 break;
             case 2:
                 employeeReserveCheck();
@@ -186,34 +193,43 @@ void ConsoleUI::employeeSession() {
     }
 }
 
-void ConsoleUI::employeeExchangeFlow(Cashier& cashier) {
+Task<void> ConsoleUI::employeeExchangeFlow(Cashier& cashier) {
     try {
-        std::string clientName = readLine("Client name: ");
-        int clientId = store.ensurePersonId("client", clientName);
+        std::string clientName = co_await readLine("Client name: ");
+        int clientId = 0;
+        {
+            std::lock_guard<std::mutex> guard(officeMutex);
+            clientId = store.ensurePersonId("client", clientName);
+        }
         Client client(clientId, clientName);
 
-        Currency sourceCurrency = readCurrency("Source currency (USD/EUR/GBP/LOCAL): ");
-        double totalAmount = readDouble("Amount to exchange (in source currency): ", 0.01);
+        Currency sourceCurrency = co_await readCurrency("Source currency (USD/EUR/GBP/LOCAL): ");
+        double totalAmount = co_await readDouble("Amount to exchange (in source currency): ", 0.01);
 
         std::vector<ExchangePortion> portions;
-        bool split = readYesNo("Split payout into multiple currencies? (y/n): ");
+        bool split = co_await readYesNo("Split payout into multiple currencies? (y/n): ");
         bool remainderDeclared = false;
-
-        auto collectDenominations = [this](int index) {
-            return readDenominations("Preferred denominations for portion " + std::to_string(index) + " (space separated, blank for any): ");
-        };
+        std::optional<SplitPreferences> automaticSplit;
+        if (split && co_await readYesNo("Plan the split from the client's preferences? (y/n): ")) {
+            std::string accepted = co_await readLine("Currencies, most wanted first, with optional payout caps (e.g. EUR<=300;USD): ");
+            automaticSplit = SplitOptimizer::parse("prefer:" + accepted);
+            int objective = co_await readInt("Fill by 1) preference order 2) client payout 3) office profit: ", 1, 3);
+            automaticSplit->objective = objective == 2 ? SplitObjective::ClientPayout
+                : objective == 3 ? SplitObjective::OfficeProfit : SplitObjective::Preference;
+            remainderDeclared = true;
+        }
 
         if (!split) {
-            Currency target = readCurrency("Target currency: ");
+            Currency target = co_await readCurrency("Target currency: ");
             ExchangePortion portion = ExchangePortion::remainder(target);
-            portion.denominations = readDenominations("Preferred denominations (space separated, blank for any): ");
+            portion.denominations = co_await readDenominations("Preferred denominations (space separated, blank for any): ");
             portions.push_back(portion);
             remainderDeclared = true;
-        } else {
-            int portionCount = readInt("How many payout portions? (1-5): ", 1, 5);
+        } else if (!automaticSplit) {
+            int portionCount = co_await readInt("How many payout portions? (1-5): ", 1, 5);
             for (int i = 0; i < portionCount; ++i) {
-                Currency target = readCurrency("Portion " + std::to_string(i + 1) + " target currency: ");
-                std::string amountText = to_upper(readLine("Portion " + std::to_string(i + 1) + " amount in source currency or 'ALL': "));
+                Currency target = co_await readCurrency("Portion " + std::to_string(i + 1) + " target currency: ");
+                std::string amountText = to_upper(co_await readLine("Portion " + std::to_string(i + 1) + " amount in source currency or 'ALL': "));
 
                 ExchangePortion portion = ExchangePortion::remainder(target);
                 if (amountText != "ALL") {
@@ -233,139 +249,309 @@ void ConsoleUI::employeeExchangeFlow(Cashier& cashier) {
                     portion = ExchangePortion::remainder(target);
                     remainderDeclared = true;
                 }
-                portion.denominations = collectDenominations(i + 1);
+                portion.denominations = co_await readDenominations("Preferred denominations for portion " + std::to_string(i + 1)
+                                                                   + " (space separated, blank for any): ");
                 portions.push_back(portion);
             }
         }
 
         if (!remainderDeclared) {
-            std::cout << "No remainder specified. Any leftover source currency will be returned to the client.\n";
+            out << "No remainder specified. Any leftover source currency will be returned to the client.\n";
         }
 
         ExchangeRequest request(client.id(), client.name(), sourceCurrency, totalAmount, portions);
+        std::lock_guard<std::mutex> guard(officeMutex);
+        if (automaticSplit) {
+            // Planned under the lock, against the reserve the exchange will draw on.
+            SplitPlan plan = SplitOptimizer::plan(office, request, *automaticSplit, std::time(nullptr));
+            out << "Planned split:\n" << SplitOptimizer::format(plan, sourceCurrency);
+            request.portions = std::move(plan.portions);
+        }
         Receipt receipt = cashier.handleRequest(request);
-        cashier.printReceipt(receipt);
+        cashier.printReceipt(receipt, out);
         store.appendTransaction(receipt);
         persistReserve();
     } catch (const std::exception& error) {
-        std::cout << "Exchange failed: " << error.what() << '\n';
+        out << "Exchange failed: " << error.what() << '\n';
     }
 }
 
 void ConsoleUI::employeeReserveCheck() const {
-    std::cout << "\nCurrent reserve balances:\n";
+    std::lock_guard<std::mutex> guard(officeMutex);
+    out << "\nCurrent reserve balances:\n";
     for (const auto& [currency, balance] : office.reserve().allBalances()) {
-        std::cout << "  " << to_string(currency) << ": " << std::fixed << std::setprecision(2) << balance;
+        out << "  " << to_string(currency) << ": " << balance;
         if (office.isBelowCritical(currency)) {
-            std::cout << " (below critical minimum of "
-                      << std::fixed << std::setprecision(2) << office.criticalMinimum(currency) << ")";
+            out << " (below critical minimum of " << office.criticalMinimum(currency) << ")";
         }
-        std::cout << '\n';
+        out << '\n';
     }
 }
 
-void ConsoleUI::managerSession() {
-    std::string managerName = readLine("Enter manager name: ");
-    int managerId = store.ensurePersonId("manager", managerName);
-    Manager manager(managerId, managerName, office);
+Task<void> ConsoleUI::managerSession() {
+    std::string managerName = co_await readLine("Enter manager name: ");
+    int managerId = 0;
+    {
+        std::lock_guard<std::mutex> guard(officeMutex);
+        managerId = store.ensurePersonId("manager", managerName);
+    }
+    BonusPolicies policies = store.loadBonusPolicies();
+    Manager manager(managerId, managerName, office, std::move(policies.daily), std::move(policies.monthly));
 
     bool active = true;
     while (active) {
-        std::cout << "\n-- Manager Menu --\n";
-        std::cout << "1. Generate end-of-day report\n";
-        std::cout << "2. Adjust exchange rate\n";
-        std::cout << "3. Set critical reserve level\n";
-        std::cout << "4. View reserve balances\n";
-        std::cout << "5. Reset daily cycle\n";
-        std::cout << "6. Logout\n";
-
-        int choice = readInt("Select option: ", 1, 6);
+        collectFinishedReports(false);
+        out << "\n-- Manager Menu --\n";
+        out << "1. Generate end-of-day report\n";
+        out << "2. Adjust exchange rate\n";
+        out << "3. Set critical reserve level\n";
+        out << "4. View reserve balances\n";
+        out << "5. Reset daily cycle\n";
+        out << "6. Query transactions\n";
+        out << (AllocationTracker::kCompiledIn ? "7. Stage latencies and allocations\n" : "7. Stage latencies\n");
+        out << "8. Plan reserve rebalancing\n";
+        out << "9. Logout\n";
+
+        int choice = co_await readInt("Select option: ", 1, 9);
         switch (choice) {
             case 1:
                 managerShowReport(manager);
                 break;
             case 2:
-                managerAdjustRates(manager);
+                co_await managerAdjustRates(manager);
                 break;
             case 3:
-                managerSetCriticalReserve(manager);
+                co_await managerSetCriticalReserve(manager);
                 break;
             case 4:
                 employeeReserveCheck();
                 break;
-            case 5:
+            case 5: {
+                std::lock_guard<std::mutex> guard(officeMutex);
                 office.resetDailyCycle();
                 persistReserve();
-                std::cout << "Daily cycle reset. Starting balances updated.\n";
+                out << "Daily cycle reset. Starting balances updated.\n";
                 break;
+            }
             case 6:
+                co_await managerQueryTransactions();
+                break;
+            case 7:
+                managerShowLatencies();
+                break;
+            case 8:
+                co_await managerPlanRebalancing(manager);
+                break;
+            case 9:
                 active = false;
                 break;
         }
     }
 }
 
+void ConsoleUI::managerShowLatencies() {
+    auto stages = LatencyRegistry::snapshot();
+    if (stages[static_cast<std::size_t>(LatencyStage::Transaction)].count() == 0) {
+        out << "No exchanges timed yet.\n";
+        return;
+    }
+    out << "\nStage latencies since start-up (microseconds, all sessions):\n";
+    out << LatencyRegistry::formatTable(stages);
+    if (AllocationTracker::kCompiledIn) {
+        out << "\nHeap allocations per stage (the transaction row is per exchange):\n";
+        out << LatencyRegistry::formatAllocationTable(stages, LatencyRegistry::allocations());
+    }
+    try {
+        LatencyRegistry::writeDump(store.latencyDumpFile());
+        out << "Full distribution written to " << store.latencyDumpFile().string() << '\n';
+    } catch (const std::exception& error) {
+        out << "Latency dump failed: " << error.what() << '\n';
+    }
+}
+
 void ConsoleUI::managerShowReport(Manager& manager) {
+    std::unique_lock<std::mutex> guard(officeMutex);
     DailyReport report = manager.compileDailyReport();
-    std::cout << "\n=== Daily Report ===\n";
+    std::vector<CashierBonus> dayBonuses = manager.cashierBonuses(BonusWindow::Day);
+    std::vector<CashierBonus> monthBonuses = manager.cashierBonuses(BonusWindow::Month);
+    guard.unlock();
+    std::size_t transactionCount = report.history().size();
+
+    std::string summary;
+    summary.reserve(512 + transactionCount * 128);
+    summary.append("\n=== Daily Report ===\n");
     std::time_t generated = report.generatedOn();
-    std::tm* generatedInfo = std::localtime(&generated);
-    if (generatedInfo) {
-        std::cout << "Generated at: " << std::put_time(generatedInfo, "%Y-%m-%d %H:%M:%S") << '\n';
+    std::tm generatedInfo{};
+    char generatedText[32];
+    if (local_time(generated, generatedInfo)
+        && std::strftime(generatedText, sizeof(generatedText), "%Y-%m-%d %H:%M:%S", &generatedInfo) > 0) {
+        summary.append("Generated at: ").append(generatedText).push_back('\n');
     } else {
-        std::cout << "Generated at timestamp: " << static_cast<long long>(generated) << '\n';
+        summary.append("Generated at timestamp: ");
+        append_integer(summary, static_cast<long long>(generated));
+        summary.push_back('\n');
     }
-    std::cout << "Profit (base currency): " << std::fixed << std::setprecision(2) << report.profitInBase() << '\n';
-
-    std::cout << "\nEnding reserves:\n";
+    summary.append("Profit (base currency): ");
+    append_fixed(summary, report.profitInBase());
+    summary.append(" (commission ");
+    append_fixed(summary, report.commissionIncomeBase());
+    summary.append(", spread ");
+    append_fixed(summary, report.spreadIncomeBase());
+    summary.append(", rebalancing cost ");
+    append_fixed(summary, report.rebalancingCostBase());
+    summary.append(")\n\nEnding reserves:\n");
     for (const auto& [currency, balance] : report.endBalances()) {
-        std::cout << "  " << to_string(currency) << ": " << std::fixed << std::setprecision(2) << balance;
+        summary.append("  ").append(to_string(currency)).append(": ");
+        append_fixed(summary, balance);
         auto thresholdIt = report.criticalThresholds().find(currency);
         if (thresholdIt != report.criticalThresholds().end()) {
-            std::cout << " (critical min " << std::fixed << std::setprecision(2) << thresholdIt->second << ")";
+            summary.append(" (critical min ");
+            append_fixed(summary, thresholdIt->second);
+            summary.push_back(')');
         }
-        std::cout << '\n';
+        summary.push_back('\n');
     }
-
-    std::cout << "\nTransactions (" << report.history().size() << "):\n";
+    summary.append("\nTransactions (");
+    append_integer(summary, static_cast<long long>(transactionCount));
+    summary.append("):\n");
     for (const auto& record : report.history()) {
-        std::cout << "  Receipt #" << record.receiptId << " | Cashier "
-                  << record.cashierName << " (ID " << record.cashierId << ") | Client "
-                  << record.clientName << " (ID " << record.clientId << ") | Source "
-                  << to_string(record.sourceCurrency) << " "
-                  << std::fixed << std::setprecision(2) << record.sourceAmount
-                  << " | Profit base " << std::fixed << std::setprecision(2) << record.profitInBaseCurrency << '\n';
+        summary.append("  Receipt #");
+        append_integer(summary, record.receiptId);
+        summary.append(" | Cashier ").append(record.cashierName).append(" (ID ");
+        append_integer(summary, record.cashierId);
+        summary.append(") | Client ").append(record.clientName).append(" (ID ");
+        append_integer(summary, record.clientId);
+        summary.append(") | Source ").append(to_string(record.sourceCurrency)).push_back(' ');
+        append_fixed(summary, record.sourceAmount);
+        summary.append(" | Profit base ");
+        append_fixed(summary, record.profitInBaseCurrency);
+        summary.push_back('\n');
     }
+    auto appendBonuses = [&summary](const char* title, const std::vector<CashierBonus>& bonuses) {
+        if (bonuses.empty()) {
+            return;
+        }
+        summary.append(title);
+        for (const auto& bonus : bonuses) {
+            summary.append("  ").append(bonus.cashierName).append(" (ID ");
+            append_integer(summary, bonus.cashierId);
+            summary.append("): profit ");
+            append_fixed(summary, bonus.profitBase);
+            summary.append(", bonus ");
+            append_fixed(summary, bonus.bonus);
+            summary.push_back('\n');
+        }
+    };
+    appendBonuses("\nCashier bonuses today:\n", dayBonuses);
+    appendBonuses("\nCashier bonuses this month:\n", monthBonuses);
+    out << summary;
+
+    // Full text/CSV/JSON rendering of the history happens off the menu thread.
+    pendingReports.push_back(store.persistReportAsync(std::move(report), manager));
+    out << "Full report is being written in the background.\n";
+}
 
-    double bonus = manager.calculateBonus(report.profitInBase());
-    std::cout << "Calculated cashier bonus (5% of profit): "
-              << std::fixed << std::setprecision(2) << bonus << '\n';
-
-    auto reportPath = store.persistReport(report, manager);
-    std::cout << "Report saved to " << reportPath << '\n';
+void ConsoleUI::collectFinishedReports(bool wait) {
+    for (auto iterator = pendingReports.begin(); iterator != pendingReports.end();) {
+        if (!wait && iterator->wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            ++iterator;
+            continue;
+        }
+        try {
+            ReportFiles files = iterator->get();
+            out << "Report saved to " << files.text.string() << " (also " << files.csv.filename().string()
+                << ", " << files.json.filename().string() << ")\n";
+        } catch (const std::exception& error) {
+            out << "Report generation failed: " << error.what() << '\n';
+        }
+        iterator = pendingReports.erase(iterator);
+    }
 }
 
-void ConsoleUI::managerAdjustRates(Manager& manager) {
+Task<void> ConsoleUI::managerAdjustRates(Manager& manager) {
     try {
-        Currency from = readCurrency("From currency: ");
-        Currency to = readCurrency("To currency: ");
+        Currency from = co_await readCurrency("From currency: ");
+        Currency to = co_await readCurrency("To currency: ");
         if (from == to) {
             throw ExchangeError("From and to currencies must be different");
         }
-        double rate = readDouble("New rate (target per unit from-currency): ", 0.0001);
+        double rate = co_await readDouble("New mid rate (target per unit from-currency): ", 0.0001);
+        double margin = co_await readDouble("Margin on each side of mid, in percent (0 quotes at mid): ", 0.0) / 100.0;
 
+        std::lock_guard<std::mutex> guard(officeMutex);
         manager.setExchangeRate(from, to, rate);
+        manager.setExchangeMargin(from, to, margin);
         persistRates();
-        std::cout << "Exchange rate updated for " << to_string(from) << " -> " << to_string(to) << ".\n";
+        auto rates = office.rateConfig();
+        out << "Exchange rate updated for " << to_string(from) << " -> " << to_string(to) << ": bid "
+            << rates->bid(from, to) << ", ask " << rates->ask(from, to) << ".\n";
     } catch (const std::exception& error) {
-        std::cout << "Rate update failed: " << error.what() << '\n';
+        out << "Rate update failed: " << error.what() << '\n';
     }
 }
 
-void ConsoleUI::managerSetCriticalReserve(Manager& manager) {
-    Currency currency = readCurrency("Currency: ");
-    double amount = readDouble("Critical minimum amount: ", 0.0);
+Task<void> ConsoleUI::managerSetCriticalReserve(Manager& manager) {
+    Currency currency = co_await readCurrency("Currency: ");
+    double amount = co_await readDouble("Critical minimum amount: ", 0.0);
+    std::lock_guard<std::mutex> guard(officeMutex);
     manager.setCriticalReserve(currency, amount);
     persistCriticalMinimums();
-    std::cout << "Critical minimum updated for " << to_string(currency) << ".\n";
+    out << "Critical minimum updated for " << to_string(currency) << ".\n";
+}
+
+Task<void> ConsoleUI::managerPlanRebalancing(Manager& manager) {
+    try {
+        RebalanceOptions options;
+        options.horizonHours = co_await readDouble("Forecast horizon in hours: ", 0.0);
+        options.topUpCost = co_await readDouble("Cost of an external top-up, in percent of its value: ", 0.0) / 100.0;
+        ReservePlanner planner(options);
+
+        std::unique_lock<std::mutex> guard(officeMutex);
+        RebalancePlan plan = planner.plan(office, std::time(nullptr));
+        std::string shown = ReservePlanner::format(plan, office.reserve().allBalances());
+        while (true) {
+            guard.unlock();
+            out << shown;
+            if (plan.empty() || !co_await readYesNo("Apply this plan? (y/n): ")) {
+                co_return;
+            }
+
+            // Re-planned under the lock; only the plan the manager confirmed is applied.
+            guard.lock();
+            plan = planner.plan(office, std::time(nullptr));
+            std::string current = ReservePlanner::format(plan, office.reserve().allBalances());
+            if (current == shown) {
+                break;
+            }
+            out << "The reserve changed while the plan was open; the plan is now:\n";
+            shown = std::move(current);
+        }
+        manager.applyRebalancing(plan);
+        persistReserve();
+        out << "Reserve rebalanced; cost " << plan.costBase << " charged to today's profit.\n";
+    } catch (const std::exception& error) {
+        out << "Rebalancing failed: " << error.what() << '\n';
+    }
+}
+
+Task<void> ConsoleUI::managerQueryTransactions() {
+    try {
+        std::string specification = co_await readLine("Filter (client= cashier= currency= from= to= on= min= max= limit=, blank for all): ");
+        TransactionQuery query = TransactionQuery::parse(specification);
+        if (query.limit == 0) {
+            query.limit = 50;
+        }
+
+        std::lock_guard<std::mutex> guard(officeMutex);
+        const TransactionIndex& index = store.transactionIndex();
+
+        auto started = std::chrono::steady_clock::now();
+        QueryResult result = index.run(query);
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started);
+
+        out << index.format(result) << "Query answered in ";
+        out.writeFixed(elapsed.count(), 3) << " ms over " << index.size() << " receipt(s).\n";
+    } catch (const std::exception& error) {
+        out << "Query failed: " << error.what() << '\n';
+    }
 }
@@ -1,25 +1,24 @@
 #include "employee.h"
 
-#include <iomanip>
-#include <iostream>
-#include <sstream>
+#include "trace.h"
+
+#include <map>
 #include <utility>
 
 namespace {
-    void printPayout(std::ostream& stream, const PayoutDetail& payout) {
-        stream << "  -> " << to_string(payout.currency)
-               << " amount: " << std::fixed << std::setprecision(2) << payout.amountPaid;
+    void printPayout(OutputSink& out, const PayoutDetail& payout) {
+        out << "  -> " << to_string(payout.currency) << " amount: " << payout.amountPaid;
         if (!payout.denominations.empty()) {
-            stream << " (denominations: ";
+            out << " (denominations: ";
             for (std::size_t i = 0; i < payout.denominations.size(); ++i) {
-                stream << payout.denominations[i];
+                out << payout.denominations[i];
                 if (i + 1 != payout.denominations.size()) {
-                    stream << ", ";
+                    out << ", ";
                 }
             }
-            stream << ")";
+            out << ")";
         }
-        stream << '\n';
+        out << '\n';
     }
 }
 
@@ -40,21 +39,20 @@ Cashier::Cashier(int cashierId, std::string cashierName, ExchangeOffice& exchang
       office(exchangeOffice) {}
 
 Receipt Cashier::handleRequest(const ExchangeRequest& request) {
+    TRACE_SPAN("Cashier::handleRequest", "exchange");
     return office.executeTransaction(request, name, id);
 }
 
-void Cashier::printReceipt(const Receipt& receipt) const {
-    std::ostringstream builder;
-    builder << "Receipt #" << receipt.id() << " for client " << receipt.client()
-            << " (ID " << receipt.clientIdentifier() << ") handled by "
-            << receipt.cashier() << " (ID " << receipt.cashierIdentifier() << ")\n";
-    builder << "Source: " << to_string(receipt.source()) << " amount "
-            << std::fixed << std::setprecision(2) << receipt.sourceAmountValue() << '\n';
+void Cashier::printReceipt(const Receipt& receipt, OutputSink& out) const {
+    out << "Receipt #" << receipt.id() << " for client " << receipt.client()
+        << " (ID " << receipt.clientIdentifier() << ") handled by "
+        << receipt.cashier() << " (ID " << receipt.cashierIdentifier() << ")\n";
+    out << "Source: " << to_string(receipt.source()) << " amount " << receipt.sourceAmountValue() << '\n';
     for (const auto& payout : receipt.payouts()) {
-        printPayout(builder, payout);
+        printPayout(out, payout);
     }
-    builder << "Profit (base): " << std::fixed << std::setprecision(2) << receipt.profitInBase() << '\n';
-    std::cout << builder.str();
+    out << "Profit (base): " << receipt.profitInBase() << " (commission " << receipt.commissionInBase()
+        << ", spread " << receipt.spreadInBase() << ")\n";
 }
 
 bool Cashier::collectLowReserveAlerts(std::vector<Currency>& lowCurrencies) const {
@@ -72,42 +70,46 @@ std::string Cashier::role() const {
     return "Cashier";
 }
 
-void Cashier::performDailyDuties() {
+void Cashier::performDailyDuties(OutputSink& out) {
     std::vector<Currency> lowCurrencies;
     if (collectLowReserveAlerts(lowCurrencies)) {
-        std::cout << "Cashier " << name << " (ID " << id << ") alerts: low reserves for ";
+        out << "Cashier " << name << " (ID " << id << ") alerts: low reserves for ";
         for (std::size_t i = 0; i < lowCurrencies.size(); ++i) {
-            std::cout << to_string(lowCurrencies[i]);
+            out << to_string(lowCurrencies[i]);
             if (i + 1 != lowCurrencies.size()) {
-                std::cout << ", ";
+                out << ", ";
             }
         }
-        std::cout << std::endl;
+        out << '\n';
     } else {
-        std::cout << "Cashier " << name << " (ID " << id << "): all reserves above critical thresholds.\n";
+        out << "Cashier " << name << " (ID " << id << "): all reserves above critical thresholds.\n";
     }
 }
 
-Manager::Manager(int managerId, std::string managerName, ExchangeOffice& exchangeOffice, std::unique_ptr<BonusPolicy> policy)
+Manager::Manager(int managerId,
+                 std::string managerName,
+                 ExchangeOffice& exchangeOffice,
+                 std::unique_ptr<BonusPolicy> policy,
+                 std::unique_ptr<BonusPolicy> monthlyPolicy)
     : Employee(managerId, std::move(managerName)),
       office(exchangeOffice),
-      bonusPolicy(std::move(policy)) {}
+      bonusPolicy(std::move(policy)),
+      monthlyBonusPolicy(std::move(monthlyPolicy)) {}
 
 std::string Manager::role() const {
     return "Manager";
 }
 
-void Manager::performDailyDuties() {
+void Manager::performDailyDuties(OutputSink& out) {
     auto report = compileDailyReport();
-    std::cout << "Manager " << name << " (ID " << id << ") daily report (profit base: "
-              << std::fixed << std::setprecision(2) << report.profitInBase() << ")\n";
+    out << "Manager " << name << " (ID " << id << ") daily report (profit base: " << report.profitInBase() << ")\n";
     for (const auto& [currency, balance] : report.endBalances()) {
-        std::cout << "  Reserve " << to_string(currency) << ": " << std::fixed << std::setprecision(2) << balance;
+        out << "  Reserve " << to_string(currency) << ": " << balance;
         auto thresholdIt = report.criticalThresholds().find(currency);
         if (thresholdIt != report.criticalThresholds().end()) {
-            std::cout << " (critical min " << std::fixed << std::setprecision(2) << thresholdIt->second << ")";
+            out << " (critical min " << thresholdIt->second << ")";
         }
-        std::cout << '\n';
+        out << '\n';
     }
 }
 
@@ -115,6 +117,10 @@ void Manager::setExchangeRate(Currency from, Currency to, double rate) {
     office.updateRate(from, to, rate);
 }
 
+void Manager::setExchangeMargin(Currency from, Currency to, double margin) {
+    office.updateMargin(from, to, margin);
+}
+
 void Manager::setCriticalReserve(Currency currency, double amount) {
     office.setCriticalMinimum(currency, amount);
 }
@@ -123,10 +129,28 @@ void Manager::topUpReserve(Currency currency, double amount) {
     office.topUpReserve(currency, amount);
 }
 
+void Manager::applyRebalancing(const RebalancePlan& plan) {
+    // Netted per currency so the office can check every withdrawal before it moves anything.
+    std::map<Currency, double> deltas;
+    for (const auto& conversion : plan.conversions) {
+        deltas[conversion.from] -= conversion.amountFrom;
+        deltas[conversion.to] += conversion.amountTo;
+    }
+    for (const auto& topUp : plan.topUps) {
+        deltas[topUp.currency] += topUp.amount;
+    }
+    office.rebalanceReserves(deltas, plan.costBase);
+}
+
 double Manager::calculateBonus(double profitBaseCurrency) const {
     return bonusPolicy ? bonusPolicy->calculateBonus(profitBaseCurrency) : 0.0;
 }
 
+std::vector<CashierBonus> Manager::cashierBonuses(BonusWindow window) const {
+    const auto& policy = window == BonusWindow::Day ? bonusPolicy : monthlyBonusPolicy;
+    return policy ? policy->evaluate(office.cashierTotalsMap(), window) : std::vector<CashierBonus>{};
+}
+
 DailyReport Manager::compileDailyReport() const {
     return office.compileDailyReport();
 }
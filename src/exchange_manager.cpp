@@ -1,11 +1,59 @@
 #include "exchange_manager.h"
 
+#include "latency_histogram.h"
+#include "metrics.h"
+#include "split_optimizer.h"
+#include "trace.h"
+
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <ctime>
+#include <sstream>
+#include <tuple>
 #include <utility>
 
 namespace {
     constexpr double kEpsilon = 1e-8;
+
+    // [start, end) of the local calendar month containing `timestamp`.
+    std::pair<std::time_t, std::time_t> month_bounds(std::time_t timestamp) {
+        std::tm info{};
+        if (!local_time(timestamp, info)) {
+            return {timestamp, timestamp + 31 * 24 * 3600};
+        }
+        info.tm_mday = 1;
+        info.tm_hour = 0;
+        info.tm_min = 0;
+        info.tm_sec = 0;
+        info.tm_isdst = -1;
+        std::tm next = info;
+        next.tm_mon += 1;
+        return {std::mktime(&info), std::mktime(&next)};
+    }
+
+    ClientVolume volume_of(const TransactionRecord& record) {
+        ClientVolume volume{};
+        volume[static_cast<std::size_t>(record.sourceCurrency)] += record.sourceAmount;
+        for (const auto& payout : record.payouts) {
+            volume[static_cast<std::size_t>(payout.currency)] += payout.amountPaid + payout.commissionTaken;
+        }
+        return volume;
+    }
+
+    double parse_bonus_number(const std::string& text, const std::string& specification) {
+        std::size_t used = 0;
+        double value = 0.0;
+        try {
+            value = std::stod(text, &used);
+        } catch (const std::exception&) {
+            used = 0;
+        }
+        if (used == 0 || used != text.size()) {
+            throw ExchangeError("Invalid number '" + text + "' in bonus policy '" + specification + "'");
+        }
+        return value;
+    }
 }
 
 Reserve::Reserve() = default;
@@ -51,74 +99,147 @@ const std::map<Currency, double>& Reserve::allBalances() const {
 
 RateTable::RateTable(Currency base) : baseCurrency(base) {}
 
-void RateTable::setRate(Currency from, Currency to, double rate) {
+void RateTable::rebuildQuotes() {
+    std::size_t base = static_cast<std::size_t>(baseCurrency);
+    for (std::size_t from = 0; from < 4; ++from) {
+        for (std::size_t to = 0; to < 4; ++to) {
+            if (from == to) {
+                midQuotes[from][to] = 1.0;
+                clientQuotes[from][to] = 1.0;
+            } else if (mids[from][to] > 0.0) {
+                midQuotes[from][to] = mids[from][to];
+                clientQuotes[from][to] = mids[from][to] * (1.0 - margins[from][to]);
+            } else if (mids[from][base] > 0.0 && mids[base][to] > 0.0) {
+                // Crosses go through the base currency, paying the margin on both legs.
+                midQuotes[from][to] = mids[from][base] * mids[base][to];
+                clientQuotes[from][to] = mids[from][base] * (1.0 - margins[from][base])
+                                         * mids[base][to] * (1.0 - margins[base][to]);
+            } else {
+                midQuotes[from][to] = 0.0;
+                clientQuotes[from][to] = 0.0;
+            }
+        }
+    }
+}
+
+double RateTable::lookup(const Matrix& matrix, Currency from, Currency to) const {
+    double rate = matrix[static_cast<std::size_t>(from)][static_cast<std::size_t>(to)];
+    if (rate <= 0.0) {
+        throw RateNotFoundError("Unable to convert from " + to_string(from) + " to " + to_string(to));
+    }
+    return rate;
+}
+
+void RateTable::storeRate(Currency from, Currency to, double rate) {
     if (rate <= 0.0) {
         throw ExchangeError("Exchange rate must be positive");
     }
-    directRates[{from, to}] = rate;
-    directRates[{to, from}] = 1.0 / rate;
+    if (from == to) {
+        throw ExchangeError("A rate needs two different currencies");
+    }
+    auto forward = static_cast<std::size_t>(from);
+    auto reverse = static_cast<std::size_t>(to);
+    mids[forward][reverse] = rate;
+    mids[reverse][forward] = 1.0 / rate;
+}
+
+void RateTable::storeMargin(Currency from, Currency to, double margin) {
+    if (margin < 0.0 || margin >= 0.5) {
+        throw ExchangeError("Margin must be at least 0 and below 0.5");
+    }
+    auto forward = static_cast<std::size_t>(from);
+    auto reverse = static_cast<std::size_t>(to);
+    if (from == to || mids[forward][reverse] <= 0.0) {
+        throw RateNotFoundError("Rate not configured for conversion from " + to_string(from) + " to " + to_string(to));
+    }
+    margins[forward][reverse] = margin;
+    margins[reverse][forward] = margin;
+}
+
+void RateTable::setRate(Currency from, Currency to, double rate) {
+    storeRate(from, to, rate);
+    rebuildQuotes();
+}
+
+void RateTable::setMargin(Currency from, Currency to, double margin) {
+    storeMargin(from, to, margin);
+    rebuildQuotes();
+}
+
+void RateTable::apply(const std::vector<RateUpdate>& updates) {
+    // Staged on a copy so that a bad update leaves the table as it was.
+    RateTable staged(*this);
+    for (const auto& update : updates) {
+        staged.storeRate(update.from, update.to, update.mid);
+        if (update.margin) {
+            staged.storeMargin(update.from, update.to, *update.margin);
+        }
+    }
+    staged.rebuildQuotes();
+    *this = staged;
+}
+
+void RateTable::setBidAsk(Currency from, Currency to, double bid, double ask) {
+    if (bid <= 0.0 || ask < bid) {
+        throw ExchangeError("Bid must be positive and no greater than the ask");
+    }
+    // bid = m * (1 - s) and ask = m / (1 - s), so m is their geometric mean.
+    apply({RateUpdate{from, to, std::sqrt(bid * ask), 1.0 - std::sqrt(bid / ask)}});
 }
 
 double RateTable::getRate(Currency from, Currency to) const {
     if (from == to) {
         return 1.0;
     }
-    auto iterator = directRates.find({from, to});
-    if (iterator != directRates.end()) {
-        return iterator->second;
+    double rate = mids[static_cast<std::size_t>(from)][static_cast<std::size_t>(to)];
+    if (rate > 0.0) {
+        return rate;
     }
     throw RateNotFoundError("Rate not configured for conversion from " + to_string(from) + " to " + to_string(to));
 }
 
+double RateTable::margin(Currency from, Currency to) const {
+    return margins[static_cast<std::size_t>(from)][static_cast<std::size_t>(to)];
+}
+
 bool RateTable::canConvert(Currency from, Currency to) const {
-    if (from == to) {
-        return true;
-    }
-    if (directRates.count({from, to}) > 0) {
-        return true;
-    }
-    try {
-        (void)getRate(from, to);
-        return true;
-    } catch (...) {
-        // ignored
-    }
-    // Attempt via base currency
-    auto toBase = directRates.find({from, baseCurrency});
-    auto fromBase = directRates.find({baseCurrency, to});
-    return toBase != directRates.end() && fromBase != directRates.end();
+    return from == to || midQuotes[static_cast<std::size_t>(from)][static_cast<std::size_t>(to)] > 0.0;
 }
 
 double RateTable::convert(double amount, Currency from, Currency to) const {
     if (from == to) {
         return amount;
     }
-    auto iterator = directRates.find({from, to});
-    if (iterator != directRates.end()) {
-        return amount * iterator->second;
-    }
-    // Attempt conversion via base currency
-    auto toBase = directRates.find({from, baseCurrency});
-    auto fromBase = directRates.find({baseCurrency, to});
-    if (toBase != directRates.end() && fromBase != directRates.end()) {
-        double amountInBase = amount * toBase->second;
-        return amountInBase * fromBase->second;
-    }
-    throw RateNotFoundError("Unable to convert from " + to_string(from) + " to " + to_string(to));
+    return amount * lookup(midQuotes, from, to);
+}
+
+double RateTable::midRate(Currency from, Currency to) const {
+    return from == to ? 1.0 : lookup(midQuotes, from, to);
+}
+
+double RateTable::quoteRate(Currency from, Currency to) const {
+    return from == to ? 1.0 : lookup(clientQuotes, from, to);
+}
+
+double RateTable::bid(Currency from, Currency to) const {
+    return quoteRate(from, to);
+}
+
+double RateTable::ask(Currency from, Currency to) const {
+    return 1.0 / quoteRate(to, from);
 }
 
 Currency RateTable::base() const {
     return baseCurrency;
 }
 
-std::vector<std::tuple<Currency, Currency, double>> RateTable::serialize() const {
-    std::vector<std::tuple<Currency, Currency, double>> entries;
-    entries.reserve(directRates.size());
-    for (const auto& entry : directRates) {
-        auto from = entry.first.first;
-        auto to = entry.first.second;
-        if (static_cast<int>(from) < static_cast<int>(to)) {
-            entries.emplace_back(from, to, entry.second);
+std::vector<PairRate> RateTable::serialize() const {
+    std::vector<PairRate> entries;
+    for (std::size_t from = 0; from < 4; ++from) {
+        for (std::size_t to = from + 1; to < 4; ++to) {
+            if (mids[from][to] > 0.0) {
+                entries.push_back(PairRate{static_cast<Currency>(from), static_cast<Currency>(to), mids[from][to], margins[from][to]});
+            }
         }
     }
     return entries;
@@ -134,6 +255,7 @@ Receipt::Receipt(int id,
                  std::vector<PayoutDetail> details,
                  double profitBase,
                  double commissionBase,
+                 double spreadBase,
                  time_t timestamp)
     : transactionID(id),
       cashierId(cashierIdentifier),
@@ -145,6 +267,7 @@ Receipt::Receipt(int id,
       payoutDetails(std::move(details)),
       profitBaseCurrency(profitBase),
       commissionBaseCurrency(commissionBase),
+      spreadBaseCurrency(spreadBase),
       transactionTime(timestamp) {}
 
 int Receipt::id() const {
@@ -187,6 +310,10 @@ double Receipt::commissionInBase() const {
     return commissionBaseCurrency;
 }
 
+double Receipt::spreadInBase() const {
+    return spreadBaseCurrency;
+}
+
 time_t Receipt::timestamp() const {
     return transactionTime;
 }
@@ -196,12 +323,16 @@ DailyReport::DailyReport(std::map<Currency, double> start,
                          std::map<Currency, double> thresholds,
                          std::vector<TransactionRecord> records,
                          double profit,
+                         double spreadIncome,
+                         double rebalancingCost,
                          time_t generated)
     : startingBalances(std::move(start)),
       endingBalances(std::move(end)),
       minimumThresholds(std::move(thresholds)),
       transactions(std::move(records)),
       totalProfitBase(profit),
+      totalSpreadBase(spreadIncome),
+      totalRebalancingBase(rebalancingCost),
       generatedAt(generated) {}
 
 const std::map<Currency, double>& DailyReport::startBalances() const {
@@ -224,6 +355,18 @@ double DailyReport::profitInBase() const {
     return totalProfitBase;
 }
 
+double DailyReport::spreadIncomeBase() const {
+    return totalSpreadBase;
+}
+
+double DailyReport::commissionIncomeBase() const {
+    return totalProfitBase + totalRebalancingBase - totalSpreadBase;
+}
+
+double DailyReport::rebalancingCostBase() const {
+    return totalRebalancingBase;
+}
+
 time_t DailyReport::generatedOn() const {
     return generatedAt;
 }
@@ -238,13 +381,130 @@ double PercentageBonusPolicy::calculateBonus(double profitBaseCurrency) const {
     return profitBaseCurrency * percentage;
 }
 
+std::vector<CashierBonus> BonusPolicy::evaluate(const std::map<int, CashierTotals>& cashiers, BonusWindow window) const {
+    std::vector<CashierBonus> bonuses;
+    bonuses.reserve(cashiers.size());
+    for (const auto& [cashierId, totals] : cashiers) {
+        bool day = window == BonusWindow::Day;
+        if ((day ? totals.dayTransactions : totals.monthTransactions) == 0) {
+            continue;
+        }
+        double profit = day ? totals.dayProfitBase : totals.monthProfitBase;
+        bonuses.push_back(CashierBonus{cashierId, totals.name, profit, calculateBonus(profit)});
+    }
+    return bonuses;
+}
+
+std::unique_ptr<BonusPolicy> BonusPolicy::parse(const std::string& specification) {
+    auto colon = specification.find(':');
+    if (colon == std::string::npos) {
+        throw ExchangeError("Bonus policy '" + specification + "' should look like percent:5, threshold:2000@10 or tiered:0@1;5000@3");
+    }
+    std::string kind = specification.substr(0, colon);
+    std::string arguments = specification.substr(colon + 1);
+    auto split = [&](const std::string& pair) {
+        auto at = pair.find('@');
+        if (at == std::string::npos) {
+            throw ExchangeError("Expected <profit>@<percent> in bonus policy '" + specification + "'");
+        }
+        return std::make_pair(parse_bonus_number(pair.substr(0, at), specification),
+                              parse_bonus_number(pair.substr(at + 1), specification) / 100.0);
+    };
+    if (kind == "percent") {
+        return std::make_unique<PercentageBonusPolicy>(parse_bonus_number(arguments, specification) / 100.0);
+    }
+    if (kind == "threshold") {
+        auto [threshold, share] = split(arguments);
+        return std::make_unique<ThresholdBonusPolicy>(threshold, share);
+    }
+    if (kind == "tiered") {
+        std::vector<std::pair<double, double>> tiers;
+        std::istringstream stream(arguments);
+        std::string tier;
+        while (std::getline(stream, tier, ';')) {
+            tiers.push_back(split(tier));
+        }
+        return std::make_unique<TieredBonusPolicy>(std::move(tiers));
+    }
+    throw ExchangeError("Unknown bonus policy '" + kind + "'");
+}
+
+ThresholdBonusPolicy::ThresholdBonusPolicy(double profitThreshold, double percent)
+    : threshold(profitThreshold), percentage(percent) {
+    if (threshold < 0.0 || percentage < 0.0) {
+        throw ExchangeError("Bonus threshold and percentage cannot be negative");
+    }
+}
+
+double ThresholdBonusPolicy::calculateBonus(double profitBaseCurrency) const {
+    return std::max(0.0, profitBaseCurrency - threshold) * percentage;
+}
+
+TieredBonusPolicy::TieredBonusPolicy(std::vector<std::pair<double, double>> bandRates) : tiers(std::move(bandRates)) {
+    if (tiers.empty()) {
+        throw ExchangeError("A tiered bonus policy needs at least one tier");
+    }
+    for (std::size_t i = 0; i < tiers.size(); ++i) {
+        if (tiers[i].first < 0.0 || tiers[i].second < 0.0) {
+            throw ExchangeError("Bonus tiers cannot be negative");
+        }
+        if (i > 0 && tiers[i].first <= tiers[i - 1].first) {
+            throw ExchangeError("Bonus tiers must be in ascending order of profit");
+        }
+    }
+}
+
+double TieredBonusPolicy::calculateBonus(double profitBaseCurrency) const {
+    double bonus = 0.0;
+    for (std::size_t i = 0; i < tiers.size() && profitBaseCurrency > tiers[i].first; ++i) {
+        double upper = i + 1 < tiers.size() ? std::min(profitBaseCurrency, tiers[i + 1].first) : profitBaseCurrency;
+        bonus += (upper - tiers[i].first) * tiers[i].second;
+    }
+    return bonus;
+}
+
+RateBoard::RateBoard(RateTable initial) : current(std::make_shared<const RateTable>(std::move(initial))) {}
+
+std::shared_ptr<const RateTable> RateBoard::snapshot() const {
+    return current.load(std::memory_order_acquire);
+}
+
+void RateBoard::setRate(Currency from, Currency to, double rate) {
+    std::lock_guard<std::mutex> guard(writerMutex);
+    auto updated = std::make_shared<RateTable>(*current.load(std::memory_order_acquire));
+    updated->setRate(from, to, rate);
+    current.store(std::move(updated), std::memory_order_release);
+}
+
+void RateBoard::setMargin(Currency from, Currency to, double margin) {
+    std::lock_guard<std::mutex> guard(writerMutex);
+    auto updated = std::make_shared<RateTable>(*current.load(std::memory_order_acquire));
+    updated->setMargin(from, to, margin);
+    current.store(std::move(updated), std::memory_order_release);
+}
+
+void RateBoard::apply(const std::vector<RateUpdate>& updates) {
+    std::lock_guard<std::mutex> guard(writerMutex);
+    auto updated = std::make_shared<RateTable>(*current.load(std::memory_order_acquire));
+    updated->apply(updates);
+    current.store(std::move(updated), std::memory_order_release);
+}
+
 ExchangeOffice::ExchangeOffice(RateTable rates, Reserve reserve, double commission)
-    : rateTable(std::move(rates)),
+    : ExchangeOffice(std::make_shared<RateBoard>(std::move(rates)), std::move(reserve), commission) {}
+
+ExchangeOffice::ExchangeOffice(std::shared_ptr<RateBoard> sharedRates, Reserve reserve, double commission)
+    : rateBoard(std::move(sharedRates)),
       currentReserve(std::move(reserve)),
       startingReserve(currentReserve),
       profitInBase(0.0),
+      spreadIncomeBase(0.0),
+      rebalancingCostBase(0.0),
       commissionPercent(commission),
-      nextReceiptId(1) {
+      nextReceiptId(1),
+      gaugesEnabled(true),
+      monthStart(0),
+      monthEnd(0) {
     if (commissionPercent < 0.0 || commissionPercent >= 1.0) {
         throw ExchangeError("Commission percentage must be between 0 and 1");
     }
@@ -254,15 +514,68 @@ double ExchangeOffice::commissionFor(double amount) const {
     return amount * commissionPercent;
 }
 
+ExchangeRequest ExchangeOffice::plannedSplit(const ExchangeRequest& request) const {
+    ExchangeRequest planned(request.clientId, request.clientName, request.sourceCurrency, request.totalAmount);
+    planned.portions = SplitOptimizer::plan(*this, request, *request.automaticSplit, std::time(nullptr)).portions;
+    return planned;
+}
+
 Receipt ExchangeOffice::executeTransaction(const ExchangeRequest& request, const std::string& cashierName, int cashierId) {
+    TRACE_SPAN("ExchangeOffice::executeTransaction", "exchange");
+    auto& metrics = OfficeMetrics::instance();
+    std::array<bool, 4> wasBelow{};
+    for (const auto& [currency, minimum] : criticalMinimums) {
+        wasBelow[static_cast<std::size_t>(currency)] = currentReserve.getBalance(currency) < minimum;
+    }
+    try {
+        Receipt receipt = request.automaticSplit ? settleTransaction(plannedSplit(request), cashierName, cashierId)
+                                                 : settleTransaction(request, cashierName, cashierId);
+        metrics.transactions.increment();
+        for (const auto& [currency, minimum] : criticalMinimums) {
+            if (!wasBelow[static_cast<std::size_t>(currency)] && currentReserve.getBalance(currency) < minimum) {
+                metrics.criticalBreaches[static_cast<std::size_t>(currency)]->increment();
+            }
+        }
+        publishMetrics();
+        return receipt;
+    } catch (const ExchangeError& error) {
+        metrics.countFailure(error);
+        throw;
+    }
+}
+
+Receipt ExchangeOffice::settleTransaction(const ExchangeRequest& request, const std::string& cashierName, int cashierId) {
+    ScopedLatency timed(LatencyStage::Transaction);
+    StageClock stages;
     if (request.totalAllocatedSource() - request.totalAmount > kEpsilon) {
         throw ExchangeError("Requested source allocation exceeds available amount");
     }
 
+    std::shared_ptr<const RateTable> rates = rateBoard->snapshot();
+    const RateTable& rateTable = *rates;
     double remainingSource = request.totalAmount;
     std::vector<PayoutDetail> payoutDetails;
     double profitBase = 0.0;
     double commissionBase = 0.0;
+    double spreadBase = 0.0;
+    time_t now = std::time(nullptr);
+    std::array<double, 4> moved{}; // Net reserve change per currency, applied once the listeners have the record
+
+    if (clientLimits.enabled()) {
+        // What the request would move, worked out before the first portion touches the reserve.
+        ClientVolume volume{};
+        double unallocated = request.totalAmount;
+        for (const auto& portion : request.portions) {
+            double slice = std::clamp(portion.useRemainder ? unallocated : portion.sourceAmount, 0.0, unallocated);
+            volume[static_cast<std::size_t>(request.sourceCurrency)] += slice;
+            if (rateTable.canConvert(request.sourceCurrency, portion.targetCurrency)) {
+                volume[static_cast<std::size_t>(portion.targetCurrency)] += slice * rateTable.quoteRate(request.sourceCurrency, portion.targetCurrency);
+            }
+            unallocated -= slice;
+        }
+        clientLimits.check(request.clientId, volume, now);
+        stages.lap(LatencyStage::Validate);
+    }
 
     for (const auto& portion : request.portions) {
         double sourceSlice = portion.useRemainder ? remainingSource : portion.sourceAmount;
@@ -275,32 +588,42 @@ Receipt ExchangeOffice::executeTransaction(const ExchangeRequest& request, const
         if (sourceSlice < kEpsilon) {
             continue;
         }
+        stages.lap(LatencyStage::Validate);
 
         if (!rateTable.canConvert(request.sourceCurrency, portion.targetCurrency)) {
             throw RateNotFoundError("No rate for converting from " + to_string(request.sourceCurrency) + " to " + to_string(portion.targetCurrency));
         }
+        stages.lap(LatencyStage::RateLookup);
 
-        double convertedAmount = rateTable.convert(sourceSlice, request.sourceCurrency, portion.targetCurrency);
+        double midAmount = sourceSlice * rateTable.midRate(request.sourceCurrency, portion.targetCurrency);
+        double convertedAmount = sourceSlice * rateTable.quoteRate(request.sourceCurrency, portion.targetCurrency);
+        double spread = midAmount - convertedAmount;
         double commission = commissionFor(convertedAmount);
         double payout = convertedAmount - commission;
+        stages.lap(LatencyStage::Convert);
 
-        if (!currentReserve.canWithdraw(portion.targetCurrency, convertedAmount)) {
+        double available = currentReserve.getBalance(portion.targetCurrency) + moved[static_cast<std::size_t>(portion.targetCurrency)];
+        if (available + kEpsilon < convertedAmount) {
             throw ReserveError("Insufficient reserve for " + to_string(portion.targetCurrency));
         }
-
-        currentReserve.withdraw(portion.targetCurrency, convertedAmount);
-        currentReserve.deposit(portion.targetCurrency, commission);
-        currentReserve.deposit(request.sourceCurrency, sourceSlice);
+        moved[static_cast<std::size_t>(portion.targetCurrency)] -= payout;
+        moved[static_cast<std::size_t>(request.sourceCurrency)] += sourceSlice;
+        stages.lap(LatencyStage::ReserveUpdate);
 
         double commissionInBase = rateTable.convert(commission, portion.targetCurrency, rateTable.base());
-        profitBase += commissionInBase;
+        double spreadInBase = rateTable.convert(spread, portion.targetCurrency, rateTable.base());
+        profitBase += commissionInBase + spreadInBase;
         commissionBase += commissionInBase;
+        spreadBase += spreadInBase;
+        stages.lap(LatencyStage::Convert);
 
         payoutDetails.push_back(PayoutDetail{
             portion.targetCurrency,
             payout,
             commission,
-            portion.denominations
+            portion.denominations,
+            sourceSlice,
+            spread
         });
 
         remainingSource -= sourceSlice;
@@ -308,10 +631,7 @@ Receipt ExchangeOffice::executeTransaction(const ExchangeRequest& request, const
 
     // Any remainder is returned to the client in the original currency, so no reserve change.
     double usedSource = request.totalAmount - remainingSource;
-    time_t now = std::time(nullptr);
-    int receiptId = nextReceiptId++;
-
-    profitInBase += profitBase;
+    int receiptId = nextReceiptId;
 
     TransactionRecord record{
         receiptId,
@@ -323,21 +643,67 @@ Receipt ExchangeOffice::executeTransaction(const ExchangeRequest& request, const
         usedSource,
         payoutDetails,
         profitBase,
-        now
+        now,
+        spreadBase
     };
+    stages.lap(LatencyStage::Receipt);
+    // Write-ahead: the journal has the record before anything changes, so a failed append leaves the
+    // office as it was and the exchange is reported as failed.
+    for (auto* listener : listeners) {
+        listener->onTransaction(record);
+    }
+    stages.lap(LatencyStage::Notify);
+
+    for (const auto& payout : payoutDetails) {
+        currentReserve.withdraw(payout.currency, payout.amountPaid + payout.commissionTaken);
+        currentReserve.deposit(payout.currency, payout.commissionTaken);
+        currentReserve.deposit(request.sourceCurrency, payout.sourceAmount);
+    }
+    stages.lap(LatencyStage::ReserveUpdate);
+    nextReceiptId++;
+    profitInBase += profitBase;
+    spreadIncomeBase += spreadBase;
     dailyTransactions.push_back(record);
+    accrueCashierProfit(record);
+    clientLimits.record(record.clientId, volume_of(record), now);
+
+    Receipt receipt(receiptId,
+                    cashierId,
+                    cashierName,
+                    request.clientId,
+                    request.clientName,
+                    request.sourceCurrency,
+                    usedSource,
+                    payoutDetails,
+                    profitBase,
+                    commissionBase,
+                    spreadBase,
+                    now);
+    stages.lap(LatencyStage::Receipt);
+    return receipt;
+}
 
-    return Receipt(receiptId,
-                   cashierId,
-                   cashierName,
-                   request.clientId,
-                   request.clientName,
-                   request.sourceCurrency,
-                   usedSource,
-                   payoutDetails,
-                   profitBase,
-                   commissionBase,
-                   now);
+ExchangeQuote ExchangeOffice::quote(Currency from, Currency to, double amount) const {
+    if (amount <= 0.0) {
+        throw ExchangeError("Quote amount must be positive");
+    }
+    std::shared_ptr<const RateTable> rates = rateBoard->snapshot();
+    const RateTable& rateTable = *rates;
+    if (!rateTable.canConvert(from, to)) {
+        throw RateNotFoundError("No rate for converting from " + to_string(from) + " to " + to_string(to));
+    }
+    double convertedAmount = amount * rateTable.quoteRate(from, to);
+    double commission = commissionFor(convertedAmount);
+    return ExchangeQuote{
+        from,
+        to,
+        amount,
+        convertedAmount,
+        commission,
+        convertedAmount - commission,
+        amount * rateTable.midRate(from, to) - convertedAmount,
+        currentReserve.canWithdraw(to, convertedAmount)
+    };
 }
 
 bool ExchangeOffice::isBelowCritical(Currency currency) const {
@@ -358,6 +724,10 @@ void ExchangeOffice::setCriticalMinimum(Currency currency, double amount) {
         throw ExchangeError("Critical minimum cannot be negative");
     }
     criticalMinimums[currency] = amount;
+    for (auto* listener : listeners) {
+        listener->onCriticalMinimumChanged(currency, amount);
+    }
+    publishMetrics();
 }
 
 void ExchangeOffice::initializeCriticalMinimums(const std::map<Currency, double>& minima) {
@@ -367,40 +737,248 @@ void ExchangeOffice::initializeCriticalMinimums(const std::map<Currency, double>
         }
     }
     criticalMinimums = minima;
+    for (auto* listener : listeners) {
+        for (const auto& [currency, amount] : criticalMinimums) {
+            listener->onCriticalMinimumChanged(currency, amount);
+        }
+    }
+}
+
+void ExchangeOffice::updateCriticalMinimums(const std::map<Currency, double>& minima) {
+    for (const auto& [currency, amount] : minima) {
+        if (amount < 0.0) {
+            throw ExchangeError("Critical minimum cannot be negative");
+        }
+    }
+    std::map<Currency, double> changed;
+    for (const auto& [currency, amount] : criticalMinimums) {
+        if (minima.count(currency) == 0 && amount != 0.0) {
+            changed[currency] = 0.0;
+        }
+    }
+    for (const auto& [currency, amount] : minima) {
+        if (criticalMinimum(currency) != amount || criticalMinimums.count(currency) == 0) {
+            changed[currency] = amount;
+        }
+    }
+    for (const auto& [currency, amount] : changed) {
+        criticalMinimums[currency] = amount;
+    }
+    for (auto* listener : listeners) {
+        for (const auto& [currency, amount] : changed) {
+            listener->onCriticalMinimumChanged(currency, amount);
+        }
+    }
+    publishMetrics();
+}
+
+void ExchangeOffice::setClientLimits(const std::map<Currency, ClientLimit>& limits) {
+    clientLimits.setLimits(limits);
 }
 
 void ExchangeOffice::topUpReserve(Currency currency, double amount) {
     currentReserve.deposit(currency, amount);
+    for (auto* listener : listeners) {
+        listener->onReserveAdjusted(currency, amount);
+    }
+    publishMetrics();
 }
 
 void ExchangeOffice::reduceReserve(Currency currency, double amount) {
     currentReserve.withdraw(currency, amount);
+    for (auto* listener : listeners) {
+        listener->onReserveAdjusted(currency, -amount);
+    }
+    publishMetrics();
+}
+
+void ExchangeOffice::rebalanceReserves(const std::map<Currency, double>& deltas, double costBase) {
+    for (const auto& [currency, delta] : deltas) {
+        if (delta < 0.0 && !currentReserve.canWithdraw(currency, -delta)) {
+            throw ReserveError("Insufficient reserve for " + to_string(currency));
+        }
+    }
+    for (auto* listener : listeners) {
+        listener->onReservesRebalanced(deltas, costBase);
+    }
+    for (const auto& [currency, delta] : deltas) {
+        if (delta < 0.0) {
+            currentReserve.withdraw(currency, -delta);
+        } else {
+            currentReserve.deposit(currency, delta);
+        }
+    }
+    profitInBase -= costBase;
+    rebalancingCostBase += costBase;
+    publishMetrics();
 }
 
 void ExchangeOffice::updateRate(Currency from, Currency to, double rate) {
-    rateTable.setRate(from, to, rate);
+    rateBoard->setRate(from, to, rate);
+    for (auto* listener : listeners) {
+        listener->onRateChanged(from, to, rate);
+    }
+}
+
+void ExchangeOffice::updateMargin(Currency from, Currency to, double margin) {
+    rateBoard->setMargin(from, to, margin);
+    for (auto* listener : listeners) {
+        listener->onSpreadChanged(from, to, margin);
+    }
+}
+
+void ExchangeOffice::applyRates(const std::vector<RateUpdate>& updates) {
+    rateBoard->apply(updates);
+    for (auto* listener : listeners) {
+        for (const auto& update : updates) {
+            listener->onRateChanged(update.from, update.to, update.mid);
+            if (update.margin) {
+                listener->onSpreadChanged(update.from, update.to, *update.margin);
+            }
+        }
+    }
 }
 
 double ExchangeOffice::currentProfitBase() const {
     return profitInBase;
 }
 
+double ExchangeOffice::currentSpreadIncomeBase() const {
+    return spreadIncomeBase;
+}
+
+double ExchangeOffice::currentRebalancingCostBase() const {
+    return rebalancingCostBase;
+}
+
 const Reserve& ExchangeOffice::reserve() const {
     return currentReserve;
 }
 
-RateTable& ExchangeOffice::rateConfig() {
-    return rateTable;
+std::shared_ptr<const RateTable> ExchangeOffice::rateConfig() const {
+    return rateBoard->snapshot();
 }
 
-const RateTable& ExchangeOffice::rateConfig() const {
-    return rateTable;
+const std::shared_ptr<RateBoard>& ExchangeOffice::sharedRates() const {
+    return rateBoard;
 }
 
 const std::map<Currency, double>& ExchangeOffice::criticalMinimumsMap() const {
     return criticalMinimums;
 }
 
+const Reserve& ExchangeOffice::startOfDayReserve() const {
+    return startingReserve;
+}
+
+const std::vector<TransactionRecord>& ExchangeOffice::transactionsToday() const {
+    return dailyTransactions;
+}
+
+const std::map<int, CashierTotals>& ExchangeOffice::cashierTotalsMap() const {
+    return cashierTotals;
+}
+
+std::time_t ExchangeOffice::cashierMonthStart() const {
+    return monthStart;
+}
+
+const ClientLimitTracker& ExchangeOffice::clientLimitTracker() const {
+    return clientLimits;
+}
+
+void ExchangeOffice::accrueCashierProfit(const TransactionRecord& record) {
+    if (record.timestamp >= monthEnd) {
+        std::tie(monthStart, monthEnd) = month_bounds(record.timestamp);
+        for (auto& [cashierId, totals] : cashierTotals) {
+            totals.monthProfitBase = 0.0;
+            totals.monthTransactions = 0;
+        }
+    }
+    CashierTotals& totals = cashierTotals[record.cashierId];
+    if (totals.name != record.cashierName) {
+        totals.name = record.cashierName;
+    }
+    totals.dayProfitBase += record.profitInBaseCurrency;
+    totals.dayTransactions++;
+    if (record.timestamp >= monthStart) {
+        totals.monthProfitBase += record.profitInBaseCurrency;
+        totals.monthTransactions++;
+    }
+}
+
+double ExchangeOffice::commissionRate() const {
+    return commissionPercent;
+}
+
+int ExchangeOffice::nextReceiptNumber() const {
+    return nextReceiptId;
+}
+
+void ExchangeOffice::addListener(OfficeEventListener* listener) {
+    if (listener != nullptr && std::find(listeners.begin(), listeners.end(), listener) == listeners.end()) {
+        listeners.push_back(listener);
+    }
+}
+
+void ExchangeOffice::removeListener(OfficeEventListener* listener) {
+    listeners.erase(std::remove(listeners.begin(), listeners.end(), listener), listeners.end());
+}
+
+void ExchangeOffice::restoreDailyState(const Reserve& startOfDay, double profit, double spreadIncome, double rebalancingCost, int nextReceipt) {
+    startingReserve = startOfDay;
+    profitInBase = profit;
+    spreadIncomeBase = spreadIncome;
+    rebalancingCostBase = rebalancingCost;
+    nextReceiptId = nextReceipt;
+}
+
+void ExchangeOffice::restoreClientWindows(const std::vector<ClientWindow>& windows) {
+    clientLimits.restore(windows);
+}
+
+void ExchangeOffice::restoreDailyTransactions(std::vector<TransactionRecord> records) {
+    dailyTransactions = std::move(records);
+}
+
+void ExchangeOffice::restoreCashierTotals(std::map<int, CashierTotals> totals, std::time_t month) {
+    cashierTotals = std::move(totals);
+    monthStart = month;
+    monthEnd = month > 0 ? month_bounds(month).second : 0;
+}
+
+void ExchangeOffice::applyRecordedTransaction(const TransactionRecord& record) {
+    // Mirrors the reserve movements of executeTransaction using the recorded payouts.
+    for (const auto& payout : record.payouts) {
+        currentReserve.withdraw(payout.currency, payout.amountPaid + payout.commissionTaken);
+        currentReserve.deposit(payout.currency, payout.commissionTaken);
+        currentReserve.deposit(record.sourceCurrency, payout.sourceAmount);
+    }
+    profitInBase += record.profitInBaseCurrency;
+    spreadIncomeBase += record.spreadInBaseCurrency;
+    dailyTransactions.push_back(record);
+    accrueCashierProfit(record);
+    clientLimits.record(record.clientId, volume_of(record), record.timestamp);
+    nextReceiptId = std::max(nextReceiptId, record.receiptId + 1);
+}
+
+void ExchangeOffice::restoreLoggedDay(const std::vector<TransactionRecord>& records, int lastReceiptId) {
+    startingReserve = currentReserve;
+    for (const auto& record : records) {
+        for (const auto& payout : record.payouts) {
+            startingReserve.deposit(payout.currency, payout.amountPaid);
+            double source = startingReserve.getBalance(record.sourceCurrency) - payout.sourceAmount;
+            startingReserve.setBalance(record.sourceCurrency, std::max(0.0, source));
+        }
+        profitInBase += record.profitInBaseCurrency;
+        spreadIncomeBase += record.spreadInBaseCurrency;
+        dailyTransactions.push_back(record);
+        accrueCashierProfit(record);
+        clientLimits.record(record.clientId, volume_of(record), record.timestamp);
+    }
+    nextReceiptId = std::max(nextReceiptId, lastReceiptId + 1);
+}
+
 DailyReport ExchangeOffice::compileDailyReport() const {
     return DailyReport(
         startingReserve.allBalances(),
@@ -408,6 +986,8 @@ DailyReport ExchangeOffice::compileDailyReport() const {
         criticalMinimums,
         dailyTransactions,
         profitInBase,
+        spreadIncomeBase,
+        rebalancingCostBase,
         std::time(nullptr)
     );
 }
@@ -416,4 +996,32 @@ void ExchangeOffice::resetDailyCycle() {
     startingReserve = currentReserve;
     dailyTransactions.clear();
     profitInBase = 0.0;
+    spreadIncomeBase = 0.0;
+    rebalancingCostBase = 0.0;
+    for (auto& [cashierId, totals] : cashierTotals) {
+        totals.dayProfitBase = 0.0;
+        totals.dayTransactions = 0;
+    }
+    for (auto* listener : listeners) {
+        listener->onDailyReset();
+    }
+    publishMetrics();
+}
+
+void ExchangeOffice::publishMetrics() const {
+    if (!gaugesEnabled) {
+        return;
+    }
+    auto& metrics = OfficeMetrics::instance();
+    int below = 0;
+    for (Currency currency : {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL}) {
+        metrics.reserveBalance[static_cast<std::size_t>(currency)]->set(currentReserve.getBalance(currency));
+        below += isBelowCritical(currency) ? 1 : 0;
+    }
+    metrics.currenciesBelowCritical.set(below);
+    metrics.profit.set(profitInBase);
+}
+
+void ExchangeOffice::setGaugesEnabled(bool enabled) {
+    gaugesEnabled = enabled;
 }
@@ -0,0 +1,569 @@
+#include "exchange_server.h"
+
+#include "report_writer.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <csignal>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::size_t kReadChunkBytes = 64 * 1024;
+    constexpr std::size_t kMaxLineBytes = 64 * 1024;
+    constexpr std::size_t kMaxPendingOutput = 4 * 1024 * 1024; // Stop reading a client that does not drain its responses
+    constexpr int kMaxEvents = 256;
+
+    std::string_view nextToken(std::string_view& text) {
+        text = trim_view(text);
+        auto space = text.find_first_of(" \t");
+        std::string_view token = text.substr(0, space);
+        text = space == std::string_view::npos ? std::string_view() : trim_view(text.substr(space));
+        return token;
+    }
+
+    std::string upper(std::string_view text) {
+        std::string value(text);
+        for (auto& ch : value) {
+            ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+        }
+        return value;
+    }
+
+    double parseAmount(std::string_view text) {
+        std::string buffer(text);
+        char* end = nullptr;
+        double value = std::strtod(buffer.c_str(), &end);
+        if (buffer.empty() || end != buffer.c_str() + buffer.size()) {
+            throw ExchangeError("Invalid amount: " + buffer);
+        }
+        return value;
+    }
+
+    void appendBalances(std::string& out, const std::map<Currency, double>& balances) {
+        out.push_back('{');
+        bool first = true;
+        for (const auto& [currency, amount] : balances) {
+            if (!first) {
+                out.push_back(',');
+            }
+            first = false;
+            out.push_back('"');
+            out.append(to_string(currency)).append("\":");
+            append_fixed(out, amount);
+        }
+        out.push_back('}');
+    }
+
+#ifdef __linux__
+    [[noreturn]] void throwSystemError(const std::string& action) {
+        throw ExchangeError(action + ": " + std::strerror(errno));
+    }
+#endif
+}
+
+ExchangeServer::ExchangeServer(ExchangeOffice& exchangeOffice, DataStore& persistence, Journal& eventJournal, std::mutex& sharedOfficeMutex,
+                               ServerEndpoint address)
+    : office(exchangeOffice),
+      store(persistence),
+      journal(eventJournal),
+      officeMutex(sharedOfficeMutex),
+      parser(persistence),
+      endpoint(std::move(address)),
+      listenDescriptor(-1),
+      epollDescriptor(-1),
+      signalDescriptor(-1),
+      boundPort(-1) {}
+
+ExchangeServer::~ExchangeServer() {
+#ifdef __linux__
+    for (const auto& [descriptor, connection] : connections) {
+        ::close(descriptor);
+    }
+    for (int descriptor : {listenDescriptor, epollDescriptor, signalDescriptor}) {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+    }
+    if (!endpoint.unixSocketPath.empty() && listenDescriptor >= 0) {
+        ::unlink(endpoint.unixSocketPath.c_str());
+    }
+#endif
+}
+
+std::string ExchangeServer::boundAddress() const {
+    if (!endpoint.unixSocketPath.empty()) {
+        return "unix:" + endpoint.unixSocketPath;
+    }
+    return endpoint.host + ":" + std::to_string(boundPort);
+}
+
+Cashier& ExchangeServer::cashierFor(Connection& connection, const std::string& name) {
+    if (!name.empty() || !connection.cashier) {
+        std::string cashierName = name.empty() ? "server" : name;
+        connection.cashier = std::make_unique<Cashier>(store.ensurePersonId("cashier", cashierName), cashierName, office);
+    }
+    return *connection.cashier;
+}
+
+void ExchangeServer::handleLine(Connection& connection, std::string_view line) {
+    line = trim_view(line);
+    if (line.empty()) {
+        return;
+    }
+
+    std::string& out = connection.output;
+    std::string_view rest = line;
+    std::string verb = upper(nextToken(rest));
+    try {
+        if (verb == "PING") {
+            out.append("OK PONG\n");
+        } else if (verb == "LOGIN") {
+            if (rest.empty()) {
+                throw ExchangeError("LOGIN requires a cashier name");
+            }
+            out.append("OK ");
+            append_integer(out, cashierFor(connection, std::string(rest)).getId());
+            out.push_back('\n');
+        } else if (verb == "QUOTE") {
+            Currency source = currency_from_string(std::string(nextToken(rest)));
+            double amount = parseAmount(nextToken(rest));
+            Currency target = currency_from_string(std::string(nextToken(rest)));
+            ExchangeQuote quote = office.quote(source, target, amount);
+            out.append("OK {\"source\":\"").append(to_string(quote.sourceCurrency));
+            out.append("\",\"target\":\"").append(to_string(quote.targetCurrency)).append("\",\"amount\":");
+            append_fixed(out, quote.sourceAmount);
+            out.append(",\"converted\":");
+            append_fixed(out, quote.convertedAmount);
+            out.append(",\"commission\":");
+            append_fixed(out, quote.commission);
+            out.append(",\"payout\":");
+            append_fixed(out, quote.payout);
+            out.append(",\"available\":").append(quote.reserveCovers ? "true" : "false").append("}\n");
+        } else if (verb == "EXCHANGE") {
+            ExchangeRequest request = parser.parse(rest, BatchFormat::Auto);
+            Receipt receipt = cashierFor(connection, std::string()).handleRequest(request);
+            store.appendTransaction(receipt);
+            out.append("OK ");
+            BatchProcessor::appendReceiptJson(out, receipt);
+            out.push_back('\n');
+        } else if (verb == "RESERVE") {
+            out.append("OK ");
+            appendBalances(out, office.reserve().allBalances());
+            out.push_back('\n');
+        } else if (verb == "REPORT") {
+            std::string json = ReportRenderer::render(office.compileDailyReport(), "server", 0).json;
+            while (!json.empty() && json.back() == '\n') {
+                json.pop_back();
+            }
+            out.append("OK ").append(json).push_back('\n');
+        } else if (verb == "QUIT") {
+            out.append("OK BYE\n");
+            connection.closing = true;
+        } else {
+            throw ExchangeError("Unknown command: " + verb);
+        }
+    } catch (const std::exception& error) {
+        out.append("ERR ");
+        for (const char* ch = error.what(); *ch != '\0'; ++ch) {
+            out.push_back(*ch == '\n' ? ' ' : *ch);
+        }
+        out.push_back('\n');
+    }
+}
+
+void ExchangeServer::handleFrame(Connection& connection, const WireFrame& frame) {
+    std::string& out = connection.output;
+    try {
+        switch (frame.type) {
+            case WireType::QuoteRequest: {
+                QuoteRequestView request = WireCodec::decodeQuoteRequest(frame.payload);
+                WireCodec::appendQuote(out, frame.correlationId,
+                                       office.quote(request.source, request.target, WireCodec::fromMinor(request.amountMinor)));
+                break;
+            }
+            case WireType::ExchangeRequest: {
+                ExchangeRequestView request = WireCodec::decodeRequest(frame.payload);
+                int clientId = request.clientId != 0 ? static_cast<int>(request.clientId)
+                                                     : store.ensurePersonId("client", std::string(request.clientName));
+                Receipt receipt = cashierFor(connection, std::string()).handleRequest(WireCodec::toRequest(request, clientId));
+                store.appendTransaction(receipt);
+                WireCodec::appendReceipt(out, frame.correlationId, receipt);
+                break;
+            }
+            default:
+                WireCodec::appendError(out, frame.correlationId, "Unsupported frame type");
+                break;
+        }
+    } catch (const std::exception& error) {
+        WireCodec::appendError(out, frame.correlationId, error.what());
+    }
+}
+
+#ifdef __linux__
+
+int open_listen_socket(const ServerEndpoint& endpoint, int& boundPort) {
+    int descriptor = -1;
+    try {
+        if (!endpoint.unixSocketPath.empty()) {
+            sockaddr_un address{};
+            if (endpoint.unixSocketPath.size() >= sizeof(address.sun_path)) {
+                throw ExchangeError("Unix socket path is too long: " + endpoint.unixSocketPath);
+            }
+            address.sun_family = AF_UNIX;
+            std::memcpy(address.sun_path, endpoint.unixSocketPath.c_str(), endpoint.unixSocketPath.size() + 1);
+            descriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (descriptor < 0) {
+                throwSystemError("socket");
+            }
+            ::unlink(endpoint.unixSocketPath.c_str());
+            if (::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                throwSystemError("Unable to bind " + endpoint.unixSocketPath);
+            }
+        } else {
+            sockaddr_in address{};
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<std::uint16_t>(endpoint.port));
+            if (::inet_pton(AF_INET, endpoint.host.c_str(), &address.sin_addr) != 1) {
+                throw ExchangeError("Invalid listen address: " + endpoint.host);
+            }
+            descriptor = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (descriptor < 0) {
+                throwSystemError("socket");
+            }
+            int enable = 1;
+            ::setsockopt(descriptor, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable));
+            if (::bind(descriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0) {
+                throwSystemError("Unable to bind " + endpoint.host + ":" + std::to_string(endpoint.port));
+            }
+            socklen_t length = sizeof(address);
+            ::getsockname(descriptor, reinterpret_cast<sockaddr*>(&address), &length);
+            boundPort = ntohs(address.sin_port);
+        }
+        if (::listen(descriptor, SOMAXCONN) != 0) {
+            throwSystemError("listen");
+        }
+    } catch (...) {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+        throw;
+    }
+    return descriptor;
+}
+
+void ExchangeServer::openListener() {
+    listenDescriptor = open_listen_socket(endpoint, boundPort);
+}
+
+void ExchangeServer::acceptConnections() {
+    while (true) {
+        int descriptor = ::accept4(listenDescriptor, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (descriptor < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ECONNABORTED) {
+                std::cerr << "accept failed: " << std::strerror(errno) << '\n';
+            }
+            return;
+        }
+        if (endpoint.unixSocketPath.empty()) {
+            int enable = 1;
+            ::setsockopt(descriptor, IPPROTO_TCP, TCP_NODELAY, &enable, sizeof(enable));
+        }
+        epoll_event event{};
+        event.events = EPOLLIN | EPOLLRDHUP;
+        event.data.fd = descriptor;
+        if (::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+            ::close(descriptor);
+            continue;
+        }
+        Connection& connection = connections[descriptor];
+        connection.descriptor = descriptor;
+    }
+}
+
+void ExchangeServer::readFrom(Connection& connection) {
+    char chunk[kReadChunkBytes];
+    bool peerClosed = false;
+    while (!peerClosed) {
+        ssize_t received = ::recv(connection.descriptor, chunk, sizeof(chunk), 0);
+        if (received > 0) {
+            connection.input.append(chunk, static_cast<std::size_t>(received));
+            if (static_cast<std::size_t>(received) < sizeof(chunk)) {
+                break;
+            }
+        } else if (received == 0) {
+            peerClosed = true;
+        } else if (errno == EINTR) {
+            continue;
+        } else {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                peerClosed = true;
+                connection.input.clear();
+            }
+            break;
+        }
+    }
+
+    if (connection.framing == Framing::Unknown && !connection.input.empty()) {
+        std::string_view preamble = WireCodec::kPreamble;
+        std::size_t compared = std::min(connection.input.size(), preamble.size());
+        if (connection.input.compare(0, compared, preamble.data(), compared) != 0) {
+            connection.framing = Framing::Text;
+        } else if (compared == preamble.size()) {
+            connection.framing = Framing::Binary;
+            connection.input.erase(0, compared);
+        }
+    }
+    if (connection.framing == Framing::Binary) {
+        consumeFrames(connection);
+    } else if (connection.framing == Framing::Text) {
+        consumeLines(connection);
+    }
+    if (peerClosed) {
+        connection.closing = true;
+    }
+
+    bool backlogged = connection.output.size() - connection.written >= kMaxPendingOutput;
+    if (backlogged != connection.readPaused) {
+        connection.readPaused = backlogged;
+        updateInterest(connection, connection.writeInterest);
+    }
+}
+
+void ExchangeServer::consumeLines(Connection& connection) {
+    // Answer every complete line; a pipelining client gets its responses back in order.
+    std::size_t consumed = 0;
+    connection.inputPending = false;
+    while (!connection.closing) {
+        auto newline = connection.input.find('\n', consumed);
+        if (newline == std::string::npos) {
+            break;
+        }
+        if (connection.output.size() - connection.written >= kMaxPendingOutput) {
+            connection.inputPending = true;
+            break;
+        }
+        handleLine(connection, std::string_view(connection.input).substr(consumed, newline - consumed));
+        consumed = newline + 1;
+    }
+    connection.input.erase(0, consumed);
+    if (connection.closing) {
+        connection.input.clear(); // Nothing after QUIT is answered
+    }
+
+    if (connection.input.size() > kMaxLineBytes && connection.input.find('\n') == std::string::npos) {
+        connection.output.append("ERR Request line too long\n");
+        connection.input.clear();
+        connection.closing = true;
+    }
+}
+
+void ExchangeServer::consumeFrames(Connection& connection) {
+    std::string_view buffer = connection.input;
+    std::size_t consumed = 0;
+    connection.inputPending = false;
+    try {
+        while (!connection.closing) {
+            WireFrame frame{};
+            std::size_t used = WireCodec::nextFrame(buffer.substr(consumed), frame);
+            if (used == 0) {
+                break;
+            }
+            if (connection.output.size() - connection.written >= kMaxPendingOutput) {
+                connection.inputPending = true;
+                break;
+            }
+            handleFrame(connection, frame);
+            consumed += used;
+        }
+        connection.input.erase(0, consumed);
+    } catch (const ExchangeError& error) {
+        // A bad length prefix leaves no way to find the next frame boundary.
+        WireCodec::appendError(connection.output, 0, error.what());
+        connection.input.clear();
+        connection.closing = true;
+    }
+}
+
+void ExchangeServer::updateInterest(Connection& connection, bool wantWrite) {
+    epoll_event event{};
+    event.events = (connection.readPaused ? 0u : static_cast<std::uint32_t>(EPOLLIN | EPOLLRDHUP)) | (wantWrite ? static_cast<std::uint32_t>(EPOLLOUT) : 0u);
+    event.data.fd = connection.descriptor;
+    ::epoll_ctl(epollDescriptor, EPOLL_CTL_MOD, connection.descriptor, &event);
+    connection.writeInterest = wantWrite;
+}
+
+bool ExchangeServer::writeTo(Connection& connection) {
+    while (connection.written < connection.output.size()) {
+        ssize_t sent = ::send(connection.descriptor,
+                              connection.output.data() + connection.written,
+                              connection.output.size() - connection.written,
+                              MSG_NOSIGNAL);
+        if (sent >= 0) {
+            connection.written += static_cast<std::size_t>(sent);
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (!connection.writeInterest) {
+                updateInterest(connection, true);
+            }
+            return true;
+        } else {
+            return false;
+        }
+    }
+
+    connection.output.clear();
+    connection.written = 0;
+    if (connection.closing && !connection.readPaused) {
+        return false;
+    }
+    if (connection.readPaused) {
+        // This runs outside the office lock, so nothing is answered here. Reading resumes in the next
+        // locked iteration: EPOLLIN for new bytes, and EPOLLOUT, ready at once, for requests already buffered.
+        connection.readPaused = false;
+        updateInterest(connection, connection.inputPending);
+    } else if (connection.writeInterest) {
+        updateInterest(connection, false);
+    }
+    return true;
+}
+
+void ExchangeServer::closeConnection(int descriptor) {
+    ::epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, nullptr);
+    ::close(descriptor);
+    connections.erase(descriptor);
+}
+
+void ExchangeServer::run() {
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    signalDescriptor = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (signalDescriptor < 0) {
+        throwSystemError("signalfd");
+    }
+
+    openListener();
+    epollDescriptor = ::epoll_create1(EPOLL_CLOEXEC);
+    if (epollDescriptor < 0) {
+        throwSystemError("epoll_create1");
+    }
+    for (int descriptor : {listenDescriptor, signalDescriptor}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = descriptor;
+        if (::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+            throwSystemError("epoll_ctl");
+        }
+    }
+    std::cerr << "Listening on " << boundAddress() << std::endl;
+
+    BulkModeScope bulk(store);
+    journal.setAutoFlush(false);
+
+    std::vector<epoll_event> events(kMaxEvents);
+    std::vector<int> ready;
+    bool running = true;
+    while (running) {
+        int count = ::epoll_wait(epollDescriptor, events.data(), kMaxEvents, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throwSystemError("epoll_wait");
+        }
+
+        std::unique_lock<std::mutex> officeLock(officeMutex);
+        for (int i = 0; i < count; ++i) {
+            int descriptor = events[i].data.fd;
+            std::uint32_t flags = events[i].events;
+            if (descriptor == listenDescriptor) {
+                acceptConnections();
+                continue;
+            }
+            if (descriptor == signalDescriptor) {
+                signalfd_siginfo info{};
+                while (::read(signalDescriptor, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+                    running = false;
+                }
+                continue;
+            }
+            auto found = connections.find(descriptor);
+            if (found == connections.end()) {
+                continue;
+            }
+            Connection& connection = found->second;
+            if ((flags & EPOLLERR) != 0) {
+                closeConnection(descriptor);
+                continue;
+            }
+            if ((flags & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)) != 0 || (connection.inputPending && !connection.readPaused)) {
+                readFrom(connection);
+            }
+            ready.push_back(descriptor);
+        }
+
+        // Group commit: everything this iteration changed reaches disk before any client hears about it.
+        journal.flush();
+        store.flushPending();
+        officeLock.unlock();
+
+        for (int descriptor : ready) {
+            auto found = connections.find(descriptor);
+            if (found != connections.end() && !writeTo(found->second)) {
+                closeConnection(descriptor);
+            }
+        }
+        ready.clear();
+    }
+
+    for (auto& [descriptor, connection] : connections) {
+        ::close(descriptor);
+    }
+    connections.clear();
+    journal.setAutoFlush(true);
+    ::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
+#else
+
+int open_listen_socket(const ServerEndpoint&, int&) {
+    throw ExchangeError("Listening sockets require Linux.");
+}
+
+void ExchangeServer::openListener() {}
+void ExchangeServer::acceptConnections() {}
+void ExchangeServer::readFrom(Connection&) {}
+void ExchangeServer::consumeLines(Connection&) {}
+void ExchangeServer::consumeFrames(Connection&) {}
+bool ExchangeServer::writeTo(Connection&) { return false; }
+void ExchangeServer::updateInterest(Connection&, bool) {}
+void ExchangeServer::closeConnection(int) {}
+
+void ExchangeServer::run() {
+    throw ExchangeError("Server mode requires Linux (epoll).");
+}
+
+#endif
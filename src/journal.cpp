@@ -0,0 +1,557 @@
+#include "journal.h"
+
+#include "metrics.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <ctime>
+#include <sstream>
+#include <utility>
+
+namespace {
+    constexpr double kReserveTolerance = 0.005;  // Snapshot files keep two decimals
+    constexpr double kRateTolerance = 1e-6;
+
+    void appendExact(std::string& out, double value) {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    void appendEscaped(std::string& out, const std::string& value) {
+        for (char ch : value) {
+            if (ch == '|' || ch == '\\' || ch == '\n') {
+                out.push_back('\\');
+                out.push_back(ch == '\n' ? 'n' : ch);
+            } else {
+                out.push_back(ch);
+            }
+        }
+    }
+
+    void appendBalances(std::string& out, const std::map<Currency, double>& balances) {
+        bool first = true;
+        for (const auto& [currency, amount] : balances) {
+            if (!first) {
+                out.push_back(';');
+            }
+            first = false;
+            out.append(to_string(currency)).push_back('=');
+            appendExact(out, amount);
+        }
+    }
+
+    std::vector<std::string> splitFields(const std::string& line) {
+        std::vector<std::string> fields(1);
+        for (std::size_t i = 0; i < line.size(); ++i) {
+            char ch = line[i];
+            if (ch == '\\' && i + 1 < line.size()) {
+                char next = line[++i];
+                fields.back().push_back(next == 'n' ? '\n' : next);
+            } else if (ch == '|') {
+                fields.emplace_back();
+            } else {
+                fields.back().push_back(ch);
+            }
+        }
+        return fields;
+    }
+
+    std::vector<std::string> splitOn(const std::string& text, char separator) {
+        std::vector<std::string> parts;
+        if (text.empty()) {
+            return parts;
+        }
+        std::size_t start = 0;
+        while (true) {
+            std::size_t end = text.find(separator, start);
+            parts.push_back(text.substr(start, end == std::string::npos ? std::string::npos : end - start));
+            if (end == std::string::npos) {
+                break;
+            }
+            start = end + 1;
+        }
+        return parts;
+    }
+
+    double parseNumber(const std::string& token) {
+        char* end = nullptr;
+        double value = std::strtod(token.c_str(), &end);
+        if (token.empty() || end != token.c_str() + token.size()) {
+            throw ExchangeError("Malformed journal number: " + token);
+        }
+        return value;
+    }
+
+    long long parseInteger(const std::string& token) {
+        long long value = 0;
+        auto result = std::from_chars(token.data(), token.data() + token.size(), value);
+        if (result.ec != std::errc() || result.ptr != token.data() + token.size()) {
+            throw ExchangeError("Malformed journal integer: " + token);
+        }
+        return value;
+    }
+
+    std::map<Currency, double> parseBalances(const std::string& text) {
+        std::map<Currency, double> balances;
+        for (const auto& entry : splitOn(text, ';')) {
+            auto separator = entry.find('=');
+            if (separator == std::string::npos) {
+                throw ExchangeError("Malformed journal balance: " + entry);
+            }
+            balances[currency_from_string(entry.substr(0, separator))] = parseNumber(entry.substr(separator + 1));
+        }
+        return balances;
+    }
+
+    std::uint64_t lastSequenceIn(const std::filesystem::path& path) {
+        std::ifstream input(path, std::ios::binary | std::ios::ate);
+        if (!input) {
+            return 0;
+        }
+        std::streamoff size = input.tellg();
+        std::streamoff start = std::max<std::streamoff>(0, size - 4096);
+        input.seekg(start);
+        std::string tail(static_cast<std::size_t>(size - start), '\0');
+        input.read(tail.data(), static_cast<std::streamsize>(tail.size()));
+
+        std::uint64_t sequence = 0;
+        std::istringstream lines(tail);
+        std::string line;
+        while (std::getline(lines, line)) {
+            std::uint64_t value = 0;
+            auto result = std::from_chars(line.data(), line.data() + line.size(), value);
+            if (result.ec == std::errc() && result.ptr != line.data() + line.size() && *result.ptr == '|') {
+                sequence = std::max(sequence, value);
+            }
+        }
+        return sequence;
+    }
+}
+
+Journal::Journal(std::filesystem::path path, std::uintmax_t rotateAfterBytes)
+    : journalPath(std::move(path)),
+      rotateBytes(rotateAfterBytes),
+      nextSequence(1),
+      autoFlush(true) {}
+
+void Journal::open(const ExchangeOffice& office) {
+    if (journalPath.has_parent_path()) {
+        std::filesystem::create_directories(journalPath.parent_path());
+    }
+    nextSequence = lastSequenceIn(journalPath) + 1;
+    if (std::filesystem::exists(journalPath) && std::filesystem::file_size(journalPath) > rotateBytes) {
+        auto previous = journalPath;
+        previous += ".1";
+        std::filesystem::rename(journalPath, previous);
+    }
+    output = std::ofstream(journalPath, std::ios::binary | std::ios::app);
+    if (!output) {
+        throw ExchangeError("Unable to open journal " + journalPath.string());
+    }
+    writeCheckpoint(office);
+}
+
+void Journal::rollover(const ExchangeOffice& office) {
+    output.close();
+    auto previous = journalPath;
+    previous += ".1";
+    std::filesystem::rename(journalPath, previous);
+    output = std::ofstream(journalPath, std::ios::binary | std::ios::app);
+    if (!output) {
+        throw ExchangeError("Unable to open journal " + journalPath.string());
+    }
+    writeCheckpoint(office);
+}
+
+std::uint64_t Journal::lastSequence() const {
+    return nextSequence - 1;
+}
+
+void Journal::flush() {
+    output.flush();
+    if (!output) {
+        throw ExchangeError("Failed to flush journal " + journalPath.string());
+    }
+}
+
+void Journal::setAutoFlush(bool enabled) {
+    autoFlush = enabled;
+    if (autoFlush) {
+        flush();
+    }
+}
+
+const std::filesystem::path& Journal::path() const {
+    return journalPath;
+}
+
+void Journal::beginLine(char type) {
+    lineBuffer.clear();
+    append_integer(lineBuffer, static_cast<long long>(nextSequence++));
+    lineBuffer.push_back('|');
+    lineBuffer.push_back(type);
+    lineBuffer.push_back('|');
+    append_integer(lineBuffer, static_cast<long long>(std::time(nullptr)));
+}
+
+void Journal::commitLine() {
+    lineBuffer.push_back('\n');
+    output.write(lineBuffer.data(), static_cast<std::streamsize>(lineBuffer.size()));
+    if (autoFlush) {
+        output.flush();
+    }
+    if (!output) {
+        throw ExchangeError("Failed to append to journal " + journalPath.string());
+    }
+    auto& metrics = OfficeMetrics::instance();
+    metrics.journalSequence.set(static_cast<double>(nextSequence - 1));
+    metrics.updateWalLag();
+}
+
+void Journal::writeCheckpoint(const ExchangeOffice& office) {
+    beginLine('C');
+    lineBuffer.push_back('|');
+    lineBuffer.append(to_string(office.rateConfig()->base())).push_back('|');
+    appendExact(lineBuffer, office.commissionRate());
+    lineBuffer.push_back('|');
+    append_integer(lineBuffer, office.nextReceiptNumber());
+    lineBuffer.push_back('|');
+    appendExact(lineBuffer, office.currentProfitBase());
+    lineBuffer.push_back('|');
+    appendBalances(lineBuffer, office.reserve().allBalances());
+    lineBuffer.push_back('|');
+    appendBalances(lineBuffer, office.startOfDayReserve().allBalances());
+    lineBuffer.push_back('|');
+    bool first = true;
+    for (const auto& [from, to, rate, margin] : office.rateConfig()->serialize()) {
+        if (!first) {
+            lineBuffer.push_back(';');
+        }
+        first = false;
+        lineBuffer.append(to_string(from)).push_back('>');
+        lineBuffer.append(to_string(to)).push_back('=');
+        appendExact(lineBuffer, rate);
+        lineBuffer.push_back('~');
+        appendExact(lineBuffer, margin);
+    }
+    lineBuffer.push_back('|');
+    appendBalances(lineBuffer, office.criticalMinimumsMap());
+    lineBuffer.push_back('|');
+    appendExact(lineBuffer, office.currentSpreadIncomeBase());
+    lineBuffer.push_back('|');
+    appendExact(lineBuffer, office.currentRebalancingCostBase());
+    commitLine();
+}
+
+void Journal::onTransaction(const TransactionRecord& record) {
+    beginLine('X');
+    lineBuffer.push_back('|');
+    append_integer(lineBuffer, record.receiptId);
+    lineBuffer.push_back('|');
+    append_integer(lineBuffer, record.cashierId);
+    lineBuffer.push_back('|');
+    appendEscaped(lineBuffer, record.cashierName);
+    lineBuffer.push_back('|');
+    append_integer(lineBuffer, record.clientId);
+    lineBuffer.push_back('|');
+    appendEscaped(lineBuffer, record.clientName);
+    lineBuffer.push_back('|');
+    lineBuffer.append(to_string(record.sourceCurrency)).push_back('|');
+    appendExact(lineBuffer, record.sourceAmount);
+    lineBuffer.push_back('|');
+    appendExact(lineBuffer, record.profitInBaseCurrency);
+    lineBuffer.push_back('|');
+    append_integer(lineBuffer, static_cast<long long>(record.timestamp));
+    lineBuffer.push_back('|');
+    appendExact(lineBuffer, record.spreadInBaseCurrency);
+    lineBuffer.push_back('|');
+    for (std::size_t i = 0; i < record.payouts.size(); ++i) {
+        const PayoutDetail& payout = record.payouts[i];
+        if (i > 0) {
+            lineBuffer.push_back(';');
+        }
+        lineBuffer.append(to_string(payout.currency)).push_back(':');
+        appendExact(lineBuffer, payout.sourceAmount);
+        lineBuffer.push_back(':');
+        appendExact(lineBuffer, payout.amountPaid);
+        lineBuffer.push_back(':');
+        appendExact(lineBuffer, payout.commissionTaken);
+        lineBuffer.push_back(':');
+        for (std::size_t d = 0; d < payout.denominations.size(); ++d) {
+            if (d > 0) {
+                lineBuffer.push_back('/');
+            }
+            append_integer(lineBuffer, payout.denominations[d]);
+        }
+        lineBuffer.push_back(':');
+        appendExact(lineBuffer, payout.spreadTaken);
+    }
+    commitLine();
+}
+
+void Journal::onReserveAdjusted(Currency currency, double delta) {
+    beginLine('T');
+    lineBuffer.push_back('|');
+    lineBuffer.append(to_string(currency)).push_back('|');
+    appendExact(lineBuffer, delta);
+    commitLine();
+}
+
+void Journal::onReservesRebalanced(const std::map<Currency, double>& deltas, double costBase) {
+    beginLine('B');
+    lineBuffer.push_back('|');
+    appendBalances(lineBuffer, deltas);
+    lineBuffer.push_back('|');
+    appendExact(lineBuffer, costBase);
+    commitLine();
+}
+
+void Journal::onRateChanged(Currency from, Currency to, double rate) {
+    beginLine('R');
+    lineBuffer.push_back('|');
+    lineBuffer.append(to_string(from)).push_back('|');
+    lineBuffer.append(to_string(to)).push_back('|');
+    appendExact(lineBuffer, rate);
+    commitLine();
+}
+
+void Journal::onSpreadChanged(Currency from, Currency to, double margin) {
+    beginLine('S');
+    lineBuffer.push_back('|');
+    lineBuffer.append(to_string(from)).push_back('|');
+    lineBuffer.append(to_string(to)).push_back('|');
+    appendExact(lineBuffer, margin);
+    commitLine();
+}
+
+void Journal::onCriticalMinimumChanged(Currency currency, double amount) {
+    beginLine('M');
+    lineBuffer.push_back('|');
+    lineBuffer.append(to_string(currency)).push_back('|');
+    appendExact(lineBuffer, amount);
+    commitLine();
+}
+
+void Journal::onDailyReset() {
+    beginLine('D');
+    commitLine();
+}
+
+std::unique_ptr<ExchangeOffice> JournalReplayer::replay(const std::filesystem::path& journalPath, ReplayStatistics& statistics) {
+    auto started = std::chrono::steady_clock::now();
+    statistics = ReplayStatistics{};
+
+    std::vector<std::string> lines = splitOn(readJournal(journalPath), '\n');
+    statistics.linesRead = lines.size();
+
+    std::size_t checkpoint = lines.size();
+    for (std::size_t i = lines.size(); i-- > 0;) {
+        auto separator = lines[i].find('|');
+        if (separator != std::string::npos && lines[i].compare(separator, 3, "|C|") == 0) {
+            checkpoint = i;
+            break;
+        }
+    }
+    if (checkpoint == lines.size()) {
+        throw ExchangeError("Journal contains no checkpoint: " + journalPath.string());
+    }
+
+    std::vector<std::string> fields = splitFields(lines[checkpoint]);
+    // Journals written before spreads existed have no margins and no spread income field,
+    // and those written before rebalancing was one event have no rebalancing cost field.
+    if (fields.size() < 11 || fields.size() > 13) {
+        throw ExchangeError("Malformed journal checkpoint");
+    }
+    RateTable rates(currency_from_string(fields[3]));
+    for (const auto& entry : splitOn(fields[9], ';')) {
+        auto arrow = entry.find('>');
+        auto equals = entry.find('=');
+        auto tilde = entry.find('~');
+        if (arrow == std::string::npos || equals == std::string::npos || equals < arrow) {
+            throw ExchangeError("Malformed journal rate: " + entry);
+        }
+        Currency from = currency_from_string(entry.substr(0, arrow));
+        Currency to = currency_from_string(entry.substr(arrow + 1, equals - arrow - 1));
+        rates.setRate(from, to, parseNumber(entry.substr(equals + 1, tilde == std::string::npos ? std::string::npos : tilde - equals - 1)));
+        if (tilde != std::string::npos) {
+            rates.setMargin(from, to, parseNumber(entry.substr(tilde + 1)));
+        }
+    }
+    auto office = std::make_unique<ExchangeOffice>(rates, Reserve(parseBalances(fields[7])), parseNumber(fields[4]));
+    office->initializeCriticalMinimums(parseBalances(fields[10]));
+    office->restoreDailyState(Reserve(parseBalances(fields[8])),
+                              parseNumber(fields[6]),
+                              fields.size() > 11 ? parseNumber(fields[11]) : 0.0,
+                              fields.size() > 12 ? parseNumber(fields[12]) : 0.0,
+                              static_cast<int>(parseInteger(fields[5])));
+    statistics.lastSequence = static_cast<std::uint64_t>(parseInteger(fields[0]));
+    statistics.eventsApplied = 1;
+
+    applyLines(*office, lines, checkpoint + 1, 0, statistics);
+    statistics.elapsedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return office;
+}
+
+ReplayStatistics JournalReplayer::applySince(ExchangeOffice& office, const std::filesystem::path& journalPath, std::uint64_t afterSequence) {
+    auto started = std::chrono::steady_clock::now();
+    ReplayStatistics statistics;
+    if (!std::filesystem::exists(journalPath)) {
+        return statistics;
+    }
+    std::vector<std::string> lines = splitOn(readJournal(journalPath), '\n');
+    statistics.linesRead = lines.size();
+    applyLines(office, lines, 0, afterSequence, statistics);
+    statistics.elapsedMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started).count();
+    return statistics;
+}
+
+std::string JournalReplayer::readJournal(const std::filesystem::path& journalPath) {
+    std::ifstream input(journalPath, std::ios::binary | std::ios::ate);
+    if (!input) {
+        throw ExchangeError("Unable to open journal " + journalPath.string());
+    }
+    std::string content(static_cast<std::size_t>(input.tellg()), '\0');
+    input.seekg(0);
+    input.read(content.data(), static_cast<std::streamsize>(content.size()));
+    return content;
+}
+
+void JournalReplayer::applyLines(ExchangeOffice& office,
+                                 const std::vector<std::string>& lines,
+                                 std::size_t firstLine,
+                                 std::uint64_t afterSequence,
+                                 ReplayStatistics& statistics) {
+    for (std::size_t i = firstLine; i < lines.size(); ++i) {
+        if (lines[i].empty()) {
+            continue;
+        }
+        std::vector<std::string> fields = splitFields(lines[i]);
+        try {
+            if (fields.size() < 3 || fields[1].size() != 1) {
+                throw ExchangeError("Malformed journal line");
+            }
+            std::uint64_t sequence = static_cast<std::uint64_t>(parseInteger(fields[0]));
+            char type = fields[1][0];
+            if (sequence <= afterSequence) {
+                continue;
+            }
+
+            if (type == 'C') {
+                // Checkpoints only restate the state already reached by the preceding events.
+            } else if (type == 'X') {
+                if (fields.size() != 13 && fields.size() != 14) {
+                    throw ExchangeError("Malformed journal exchange");
+                }
+                bool withSpread = fields.size() == 14;
+                TransactionRecord record{
+                    static_cast<int>(parseInteger(fields[3])),
+                    static_cast<int>(parseInteger(fields[4])),
+                    fields[5],
+                    static_cast<int>(parseInteger(fields[6])),
+                    fields[7],
+                    currency_from_string(fields[8]),
+                    parseNumber(fields[9]),
+                    {},
+                    parseNumber(fields[10]),
+                    static_cast<time_t>(parseInteger(fields[11])),
+                    withSpread ? parseNumber(fields[12]) : 0.0
+                };
+                for (const auto& entry : splitOn(fields[withSpread ? 13 : 12], ';')) {
+                    std::vector<std::string> parts = splitOn(entry, ':');
+                    if (parts.size() < 4) {
+                        throw ExchangeError("Malformed journal payout: " + entry);
+                    }
+                    PayoutDetail payout{currency_from_string(parts[0]),
+                                        parseNumber(parts[2]),
+                                        parseNumber(parts[3]),
+                                        {},
+                                        parseNumber(parts[1])};
+                    if (parts.size() > 4) {
+                        for (const auto& denomination : splitOn(parts[4], '/')) {
+                            payout.denominations.push_back(static_cast<int>(parseInteger(denomination)));
+                        }
+                    }
+                    if (parts.size() > 5) {
+                        payout.spreadTaken = parseNumber(parts[5]);
+                    }
+                    record.payouts.push_back(std::move(payout));
+                }
+                office.applyRecordedTransaction(record);
+            } else if (type == 'T' && fields.size() == 5) {
+                double delta = parseNumber(fields[4]);
+                if (delta >= 0.0) {
+                    office.topUpReserve(currency_from_string(fields[3]), delta);
+                } else {
+                    office.reduceReserve(currency_from_string(fields[3]), -delta);
+                }
+            } else if (type == 'B' && fields.size() == 5) {
+                office.rebalanceReserves(parseBalances(fields[3]), parseNumber(fields[4]));
+            } else if (type == 'R' && fields.size() == 6) {
+                office.updateRate(currency_from_string(fields[3]), currency_from_string(fields[4]), parseNumber(fields[5]));
+            } else if (type == 'S' && fields.size() == 6) {
+                office.updateMargin(currency_from_string(fields[3]), currency_from_string(fields[4]), parseNumber(fields[5]));
+            } else if (type == 'M' && fields.size() == 5) {
+                office.setCriticalMinimum(currency_from_string(fields[3]), parseNumber(fields[4]));
+            } else if (type == 'D') {
+                office.resetDailyCycle();
+            } else {
+                throw ExchangeError("Unknown journal event");
+            }
+            statistics.lastSequence = sequence;
+            statistics.eventsApplied++;
+        } catch (const ExchangeError&) {
+            statistics.malformedLines++;
+        }
+    }
+}
+
+std::vector<std::string> JournalReplayer::compare(const ExchangeOffice& office,
+                                                  const std::map<Currency, double>& reserve,
+                                                  const std::vector<PairRate>& rates,
+                                                  const std::map<Currency, double>& criticalMinimums) {
+    std::vector<std::string> differences;
+    auto describe = [](const std::string& what, double expected, double actual) {
+        std::string line = what + ": journal ";
+        append_fixed(line, expected, 6);
+        line.append(" vs file ");
+        append_fixed(line, actual, 6);
+        return line;
+    };
+
+    for (const auto& [currency, balance] : office.reserve().allBalances()) {
+        auto iterator = reserve.find(currency);
+        double stored = iterator != reserve.end() ? iterator->second : 0.0;
+        if (std::fabs(stored - balance) > kReserveTolerance) {
+            differences.push_back(describe("reserve " + to_string(currency), balance, stored));
+        }
+    }
+    auto journalRates = office.rateConfig();
+    for (const auto& [from, to, rate, margin] : rates) {
+        double journalRate = 0.0;
+        try {
+            journalRate = journalRates->getRate(from, to);
+        } catch (const RateNotFoundError&) {
+            differences.push_back("rate " + to_string(from) + "->" + to_string(to) + ": missing from journal state");
+            continue;
+        }
+        if (std::fabs(journalRate - rate) > kRateTolerance * std::max(1.0, std::fabs(rate))) {
+            differences.push_back(describe("rate " + to_string(from) + "->" + to_string(to), journalRate, rate));
+        }
+        if (std::fabs(journalRates->margin(from, to) - margin) > kRateTolerance) {
+            differences.push_back(describe("margin " + to_string(from) + "->" + to_string(to), journalRates->margin(from, to), margin));
+        }
+    }
+    for (const auto& [currency, minimum] : office.criticalMinimumsMap()) {
+        auto iterator = criticalMinimums.find(currency);
+        double stored = iterator != criticalMinimums.end() ? iterator->second : 0.0;
+        if (std::fabs(stored - minimum) > kReserveTolerance) {
+            differences.push_back(describe("critical minimum " + to_string(currency), minimum, stored));
+        }
+    }
+    return differences;
+}
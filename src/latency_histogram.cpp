@@ -0,0 +1,349 @@
+#include "latency_histogram.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstdio>
+#include <exception>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <mutex>
+
+namespace {
+    constexpr std::size_t kStages = static_cast<std::size_t>(LatencyStage::Count);
+
+    // One thread's histograms. Only the owning thread writes; snapshots read with relaxed loads.
+    struct ThreadBlock {
+        std::array<std::array<std::atomic<std::uint64_t>, LatencyHistogram::kBuckets>, kStages> counts{};
+        std::array<std::atomic<std::uint64_t>, kStages> totals{};
+        std::array<std::atomic<std::uint64_t>, kStages> sums{};
+        std::array<std::atomic<std::uint64_t>, kStages> maxima{};
+        std::array<std::atomic<std::uint64_t>, kStages> allocations{};
+        std::array<std::atomic<std::uint64_t>, kStages> allocatedBytes{};
+        std::atomic<bool> inUse{true};
+    };
+
+    void bump(std::atomic<std::uint64_t>& slot, std::uint64_t amount) {
+        slot.store(slot.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    class BlockRegistry {
+    private:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadBlock>> blocks;
+
+    public:
+        // Blocks outlive their threads so exited workers still count; a new thread adopts a released one.
+        ThreadBlock* acquire() {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (auto& block : blocks) {
+                bool released = false;
+                if (block->inUse.compare_exchange_strong(released, true, std::memory_order_acquire)) {
+                    return block.get();
+                }
+            }
+            blocks.push_back(std::make_unique<ThreadBlock>());
+            return blocks.back().get();
+        }
+
+        LatencyRegistry::Snapshot collect() {
+            LatencyRegistry::Snapshot merged;
+            std::lock_guard<std::mutex> guard(mutex);
+            for (const auto& block : blocks) {
+                for (std::size_t stage = 0; stage < kStages; ++stage) {
+                    const auto& counts = block->counts[stage];
+                    for (std::size_t bucket = 0; bucket < counts.size(); ++bucket) {
+                        if (std::uint64_t count = counts[bucket].load(std::memory_order_relaxed)) {
+                            merged[stage].addBucket(bucket, count);
+                        }
+                    }
+                    merged[stage].addTotals(block->totals[stage].load(std::memory_order_relaxed),
+                                            block->sums[stage].load(std::memory_order_relaxed),
+                                            block->maxima[stage].load(std::memory_order_relaxed));
+                }
+            }
+            return merged;
+        }
+
+        LatencyRegistry::AllocationSnapshot collectAllocations() {
+            LatencyRegistry::AllocationSnapshot merged{};
+            std::lock_guard<std::mutex> guard(mutex);
+            for (const auto& block : blocks) {
+                for (std::size_t stage = 0; stage < kStages; ++stage) {
+                    merged[stage] += AllocationCount{block->allocations[stage].load(std::memory_order_relaxed),
+                                                     block->allocatedBytes[stage].load(std::memory_order_relaxed)};
+                }
+            }
+            return merged;
+        }
+    };
+
+    BlockRegistry& blockRegistry() {
+        static BlockRegistry registry;
+        return registry;
+    }
+
+    struct BlockLease {
+        ThreadBlock* block = nullptr;
+
+        ~BlockLease() {
+            if (block) {
+                block->inUse.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    thread_local BlockLease lease;
+
+    ThreadBlock& localBlock() {
+        if (!lease.block) {
+            lease.block = blockRegistry().acquire();
+        }
+        return *lease.block;
+    }
+
+    std::uint64_t elapsedNanos(std::chrono::steady_clock::time_point since, std::chrono::steady_clock::time_point until) {
+        auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(until - since).count();
+        return nanos > 0 ? static_cast<std::uint64_t>(nanos) : 0;
+    }
+
+    void appendMicros(std::string& out, std::uint64_t nanos) {
+        append_fixed(out, static_cast<double>(nanos) / 1000.0, 1);
+    }
+}
+
+std::string to_string(LatencyStage stage) {
+    switch (stage) {
+        case LatencyStage::Validate: return "validate";
+        case LatencyStage::RateLookup: return "rate-lookup";
+        case LatencyStage::Convert: return "convert";
+        case LatencyStage::ReserveUpdate: return "reserve-update";
+        case LatencyStage::Notify: return "notify";
+        case LatencyStage::Receipt: return "receipt";
+        case LatencyStage::Transaction: return "transaction";
+        case LatencyStage::LogAppend: return "log-append";
+        case LatencyStage::ReservePersist: return "reserve-persist";
+        case LatencyStage::RatesPersist: return "rates-persist";
+        default: return "unknown";
+    }
+}
+
+LatencyHistogram::LatencyHistogram() : counts(kBuckets, 0), total(0), sum(0), largest(0) {}
+
+std::size_t LatencyHistogram::bucketFor(std::uint64_t nanos) {
+    if (nanos < kLinearLimit) {
+        return static_cast<std::size_t>(nanos);
+    }
+    unsigned magnitude = static_cast<unsigned>(std::bit_width(nanos)) - 1;
+    if (magnitude >= kMaxMagnitude) {
+        return kBuckets - 1;
+    }
+    unsigned shift = magnitude - kSubBucketBits;
+    std::uint64_t subBucket = (nanos >> shift) - (1u << kSubBucketBits);
+    return static_cast<std::size_t>(kLinearLimit + (magnitude - kSubBucketBits - 1) * (1u << kSubBucketBits) + subBucket);
+}
+
+std::uint64_t LatencyHistogram::bucketUpperBound(std::size_t bucket) {
+    if (bucket < kLinearLimit) {
+        return bucket;
+    }
+    std::size_t offset = bucket - kLinearLimit;
+    unsigned magnitude = static_cast<unsigned>(offset >> kSubBucketBits) + kSubBucketBits + 1;
+    std::uint64_t subBucket = (offset & ((1u << kSubBucketBits) - 1)) + (1u << kSubBucketBits);
+    unsigned shift = magnitude - kSubBucketBits;
+    return ((subBucket + 1) << shift) - 1;
+}
+
+void LatencyHistogram::record(std::uint64_t nanos) {
+    ++counts[bucketFor(nanos)];
+    addTotals(1, nanos, nanos);
+}
+
+void LatencyHistogram::addBucket(std::size_t bucket, std::uint64_t count) {
+    counts[std::min(bucket, kBuckets - 1)] += count;
+}
+
+void LatencyHistogram::addTotals(std::uint64_t count, std::uint64_t nanosSum, std::uint64_t maxNanos) {
+    total += count;
+    sum += nanosSum;
+    largest = std::max(largest, maxNanos);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        counts[bucket] += other.counts[bucket];
+    }
+    addTotals(other.total, other.sum, other.largest);
+}
+
+std::uint64_t LatencyHistogram::count() const {
+    return total;
+}
+
+std::uint64_t LatencyHistogram::max() const {
+    return largest;
+}
+
+double LatencyHistogram::mean() const {
+    return total == 0 ? 0.0 : static_cast<double>(sum) / static_cast<double>(total);
+}
+
+std::uint64_t LatencyHistogram::percentile(double percent) const {
+    std::uint64_t recorded = 0;
+    for (auto count : counts) {
+        recorded += count;
+    }
+    if (recorded == 0) {
+        return 0;
+    }
+    double clamped = std::clamp(percent, 0.0, 100.0);
+    auto rank = static_cast<std::uint64_t>(clamped / 100.0 * static_cast<double>(recorded) + 0.5);
+    rank = std::clamp<std::uint64_t>(rank, 1, recorded);
+    std::uint64_t seen = 0;
+    for (std::size_t bucket = 0; bucket < kBuckets; ++bucket) {
+        seen += counts[bucket];
+        if (seen >= rank) {
+            return std::min(bucketUpperBound(bucket), largest);
+        }
+    }
+    return largest;
+}
+
+void LatencyRegistry::record(LatencyStage stage, std::uint64_t nanos, const AllocationCount& allocated) {
+    auto index = static_cast<std::size_t>(stage);
+    ThreadBlock& block = localBlock();
+    bump(block.counts[index][LatencyHistogram::bucketFor(nanos)], 1);
+    bump(block.totals[index], 1);
+    bump(block.sums[index], nanos);
+    bump(block.allocations[index], allocated.allocations);
+    bump(block.allocatedBytes[index], allocated.bytes);
+    if (nanos > block.maxima[index].load(std::memory_order_relaxed)) {
+        block.maxima[index].store(nanos, std::memory_order_relaxed);
+    }
+}
+
+LatencyRegistry::Snapshot LatencyRegistry::snapshot() {
+    return blockRegistry().collect();
+}
+
+LatencyRegistry::AllocationSnapshot LatencyRegistry::allocations() {
+    return blockRegistry().collectAllocations();
+}
+
+std::string LatencyRegistry::formatTable(const Snapshot& stages) {
+    std::string table = "stage               count      mean_us     p50_us     p90_us     p99_us   p99.9_us     max_us\n";
+    char line[160];
+    for (std::size_t index = 0; index < kStages; ++index) {
+        const auto& histogram = stages[index];
+        if (histogram.count() == 0) {
+            continue;
+        }
+        std::snprintf(line, sizeof(line), "%-15s %9llu %12.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+                      to_string(static_cast<LatencyStage>(index)).c_str(),
+                      static_cast<unsigned long long>(histogram.count()),
+                      histogram.mean() / 1000.0,
+                      static_cast<double>(histogram.percentile(50.0)) / 1000.0,
+                      static_cast<double>(histogram.percentile(90.0)) / 1000.0,
+                      static_cast<double>(histogram.percentile(99.0)) / 1000.0,
+                      static_cast<double>(histogram.percentile(99.9)) / 1000.0,
+                      static_cast<double>(histogram.max()) / 1000.0);
+        table += line;
+    }
+    return table;
+}
+
+std::string LatencyRegistry::formatAllocationTable(const Snapshot& stages, const AllocationSnapshot& allocated) {
+    std::string table = "stage               count   allocs/op    bytes/op   total_allocs    total_bytes\n";
+    char line[160];
+    for (std::size_t index = 0; index < kStages; ++index) {
+        auto runs = stages[index].count();
+        if (runs == 0) {
+            continue;
+        }
+        std::snprintf(line, sizeof(line), "%-15s %9llu %11.2f %11.1f %14llu %14llu\n",
+                      to_string(static_cast<LatencyStage>(index)).c_str(),
+                      static_cast<unsigned long long>(runs),
+                      static_cast<double>(allocated[index].allocations) / static_cast<double>(runs),
+                      static_cast<double>(allocated[index].bytes) / static_cast<double>(runs),
+                      static_cast<unsigned long long>(allocated[index].allocations),
+                      static_cast<unsigned long long>(allocated[index].bytes));
+        table += line;
+    }
+    return table;
+}
+
+void LatencyRegistry::writeDump(const std::filesystem::path& path) {
+    Snapshot stages = snapshot();
+    std::string dump = "# Stage latencies at ";
+    append_integer(dump, static_cast<long long>(std::time(nullptr)));
+    dump += "\n";
+    dump += formatTable(stages);
+    if (AllocationTracker::kCompiledIn) {
+        dump += "\n# Heap allocations per stage\n";
+        dump += formatAllocationTable(stages, allocations());
+    }
+    // Percentile distribution per stage, suitable for plotting.
+    dump += "\nstage,percentile,value_us\n";
+    for (std::size_t index = 0; index < kStages; ++index) {
+        const auto& histogram = stages[index];
+        if (histogram.count() == 0) {
+            continue;
+        }
+        for (double percent : {0.0, 25.0, 50.0, 75.0, 90.0, 95.0, 99.0, 99.5, 99.9, 99.99, 100.0}) {
+            dump += to_string(static_cast<LatencyStage>(index));
+            dump += ',';
+            append_fixed(dump, percent, 2);
+            dump += ',';
+            appendMicros(dump, percent >= 100.0 ? histogram.max() : histogram.percentile(percent));
+            dump += '\n';
+        }
+    }
+
+    std::ofstream file(path, std::ios::trunc);
+    file << dump;
+    if (!file) {
+        throw ExchangeError("Unable to write latency dump " + path.string());
+    }
+}
+
+ScopedLatency::ScopedLatency(LatencyStage timedStage)
+    : stage(timedStage),
+      started(std::chrono::steady_clock::now()),
+      allocationsAtStart(AllocationTracker::thread()),
+      exceptionsAtStart(std::uncaught_exceptions()) {}
+
+ScopedLatency::~ScopedLatency() {
+    if (std::uncaught_exceptions() > exceptionsAtStart) {
+        return;
+    }
+    // Read the allocation counter before record(), whose first call on a thread allocates its block.
+    AllocationCount allocated = AllocationTracker::thread() - allocationsAtStart;
+    LatencyRegistry::record(stage, elapsedNanos(started, std::chrono::steady_clock::now()), allocated);
+}
+
+StageClock::StageClock()
+    : mark(std::chrono::steady_clock::now()), allocationMark(AllocationTracker::thread()), spent{}, allocated{}, touched(0) {}
+
+StageClock::~StageClock() {
+    for (std::size_t index = 0; index < kStages; ++index) {
+        if (touched & (1u << index)) {
+            LatencyRegistry::record(static_cast<LatencyStage>(index), spent[index], allocated[index]);
+        }
+    }
+}
+
+void StageClock::lap(LatencyStage stage) {
+    auto now = std::chrono::steady_clock::now();
+    auto index = static_cast<std::size_t>(stage);
+    spent[index] += elapsedNanos(mark, now);
+    if constexpr (AllocationTracker::kCompiledIn) {
+        AllocationCount current = AllocationTracker::thread();
+        allocated[index] += current - allocationMark;
+        allocationMark = current;
+    }
+    touched |= 1u << index;
+    mark = now;
+}
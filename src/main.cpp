@@ -1,13 +1,33 @@
+#include "anomaly_monitor.h"
+#include "batch_processor.h"
+#include "branch_network.h"
+#include "config_watcher.h"
 #include "console_ui.h"
+#include "exchange_server.h"
 #include "exchange_manager.h"
+#include "journal.h"
+#include "latency_histogram.h"
+#include "metrics.h"
 #include "persistence.h"
+#include "rate_feed.h"
+#include "reserve_planner.h"
+#include "session_host.h"
+#include "snapshot.h"
+#include "trace.h"
+#include "transaction_query.h"
 #include "utils.h"
 
+#include <chrono>
+#include <ctime>
 #include <exception>
+#include <fstream>
 #include <iostream>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
-#include <tuple>
+#include <vector>
 
 namespace {
     std::map<Currency, double> defaultReserveBalances() {
@@ -33,57 +53,411 @@ namespace {
             {Currency::LOCAL, 1'500.0}
         };
     }
+
+    std::unique_ptr<ExchangeOffice> loadOfficeFromCsv(DataStore& store) {
+        RateTable rateTable(Currency::LOCAL);
+        auto storedRates = store.loadRates();
+        if (storedRates.empty()) {
+            ensureDefaultRates(rateTable);
+            store.saveRates(rateTable);
+        } else {
+            for (const auto& [from, to, rate, margin] : storedRates) {
+                rateTable.setRate(from, to, rate);
+                rateTable.setMargin(from, to, margin);
+            }
+        }
+
+        std::map<Currency, double> reserveBalances = store.loadReserve(defaultReserveBalances());
+        Reserve reserve(reserveBalances);
+
+        auto office = std::make_unique<ExchangeOffice>(rateTable, reserve, 0.03);
+
+        auto criticalMinima = store.loadCriticalMinimums();
+        if (criticalMinima.empty()) {
+            criticalMinima = defaultCriticalMinimums();
+            store.saveCriticalMinimums(criticalMinima);
+        }
+        office->initializeCriticalMinimums(criticalMinima);
+        return office;
+    }
 }
 
 int main(int argc, char* argv[]) {
     try {
+        std::optional<std::string> querySpecification;
+        std::optional<std::string> replayPath;
+        bool restoreFromReplay = false;
+        bool importCsv = false;
+        std::optional<std::string> batchInput;
+        std::optional<std::string> receiptOutput;
+        std::string batchCashier = "batch";
+        BatchFormat batchFormat = BatchFormat::Auto;
+        std::optional<ServerEndpoint> serverEndpoint;
+        bool multiplex = false;
+        std::vector<std::string> branchNames;
+        bool allBranches = false;
+        MetricsExportOptions metricsOptions;
+        std::optional<std::string> tracePath;
+        SessionHostOptions sessionOptions;
+        std::optional<RateFeedOptions> feedOptions;
+        bool watchConfig = false;
+        std::optional<std::filesystem::path> anomalyLog;
+        std::optional<RebalanceOptions> rebalanceOptions;
         for (int index = 1; index < argc; ++index) {
             std::string argument = argv[index];
             if (argument == "--console") {
                 continue; // Console mode is now the only supported interface.
-            } else if (argument == "--gui" || argument == "--port" || argument == "-p") {
-                throw ExchangeError("Web GUI support has been removed. Please use the terminal interface.");
+            } else if (argument == "--query") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError("--query requires a filter such as \"client=5 from=2025-01-01\"");
+                }
+                querySpecification = argv[++index];
+            } else if (argument == "--replay") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError("--replay requires a journal path");
+                }
+                replayPath = argv[++index];
+            } else if (argument == "--restore") {
+                restoreFromReplay = true;
+            } else if (argument == "--import-csv") {
+                importCsv = true;
+            } else if (argument == "--batch" || argument == "--batch-format" || argument == "--receipts" || argument == "--cashier") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError(argument + " requires a value");
+                }
+                std::string value = argv[++index];
+                if (argument == "--batch") {
+                    batchInput = value;
+                } else if (argument == "--batch-format") {
+                    batchFormat = BatchProcessor::parseFormat(value);
+                } else if (argument == "--receipts") {
+                    receiptOutput = value;
+                } else {
+                    batchCashier = value;
+                }
+            } else if (argument == "--port" || argument == "-p" || argument == "--socket" || argument == "--listen") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError(argument + " requires a value");
+                }
+                std::string value = argv[++index];
+                if (!serverEndpoint) {
+                    serverEndpoint.emplace();
+                }
+                if (argument == "--socket") {
+                    serverEndpoint->unixSocketPath = value;
+                } else if (argument == "--listen") {
+                    serverEndpoint->host = value;
+                } else {
+                    serverEndpoint->port = std::stoi(value);
+                }
+            } else if (argument == "--metrics-file" || argument == "--metrics-socket" || argument == "--metrics-interval") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError(argument + " requires a value");
+                }
+                std::string value = argv[++index];
+                if (argument == "--metrics-file") {
+                    metricsOptions.file = value;
+                } else if (argument == "--metrics-socket") {
+                    metricsOptions.socketPath = value;
+                } else {
+                    metricsOptions.interval = std::chrono::milliseconds(static_cast<long long>(std::stod(value) * 1000.0));
+                    if (metricsOptions.interval.count() <= 0) {
+                        throw ExchangeError("--metrics-interval must be positive");
+                    }
+                }
+            } else if (argument == "--rate-feed" || argument == "--feed-window" || argument == "--feed-persist") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError(argument + " requires a value");
+                }
+                std::string value = argv[++index];
+                if (!feedOptions) {
+                    feedOptions.emplace();
+                }
+                if (argument == "--rate-feed") {
+                    feedOptions->source = value;
+                } else if (argument == "--feed-window") {
+                    feedOptions->batchWindow = std::chrono::milliseconds(std::stol(value));
+                } else {
+                    feedOptions->persistInterval = std::chrono::milliseconds(static_cast<long long>(std::stod(value) * 1000.0));
+                }
+                if (feedOptions->batchWindow.count() < 0 || feedOptions->persistInterval.count() < 0) {
+                    throw ExchangeError(argument + " cannot be negative");
+                }
+            } else if (argument == "--rebalance" || argument == "--top-up-cost") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError(argument + " requires a value");
+                }
+                std::string value = argv[++index];
+                if (!rebalanceOptions) {
+                    rebalanceOptions.emplace();
+                }
+                if (argument == "--rebalance") {
+                    rebalanceOptions->horizonHours = std::stod(value);
+                } else {
+                    rebalanceOptions->topUpCost = std::stod(value) / 100.0;
+                }
+            } else if (argument == "--watch-config") {
+                watchConfig = true;
+            } else if (argument == "--anomaly-log") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError("--anomaly-log requires an output path");
+                }
+                anomalyLog = argv[++index];
+            } else if (argument == "--trace") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError("--trace requires an output path");
+                }
+                if (!Tracer::kCompiledIn) {
+                    throw ExchangeError("Tracing is compiled out; rebuild with make clean && make TRACE=1");
+                }
+                tracePath = argv[++index];
+            } else if (argument == "--multiplex") {
+                multiplex = true;
+            } else if (argument == "--branch") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError("--branch requires a branch name");
+                }
+                branchNames.push_back(argv[++index]);
+                multiplex = true;
+            } else if (argument == "--all-branches") {
+                allBranches = true;
+                multiplex = true;
+            } else if (argument == "--pty" || argument == "--workers") {
+                if (index + 1 >= argc) {
+                    throw ExchangeError(argument + " requires a count");
+                }
+                auto count = static_cast<std::size_t>(std::stoul(argv[++index]));
+                if (argument == "--pty") {
+                    sessionOptions.pseudoTerminals = count;
+                    multiplex = true;
+                } else {
+                    sessionOptions.workerThreads = count;
+                }
+            } else if (argument == "--gui") {
+                throw ExchangeError("Web GUI support has been removed. Use the terminal interface or --port.");
             } else {
                 throw ExchangeError("Unknown argument: " + argument);
             }
         }
+        if (restoreFromReplay && !replayPath) {
+            throw ExchangeError("--restore applies to --replay <journal>");
+        }
 
         DataStore store("data");
-        store.initialize();
+        store.initialize(importCsv ? StartupSource::Csv : StartupSource::Snapshot);
 
-        RateTable rateTable(Currency::LOCAL);
-        auto storedRates = store.loadRates();
-        if (storedRates.empty()) {
-            ensureDefaultRates(rateTable);
-            store.saveRates(rateTable);
+        if (querySpecification) {
+            TransactionQuery query = TransactionQuery::parse(*querySpecification);
+            TransactionIndex index;
+            index.loadFrom(store.transactions());
+            std::cout << index.format(index.run(query));
+            return 0;
+        }
+
+        if (replayPath) {
+            ReplayStatistics statistics;
+            auto replayed = JournalReplayer::replay(*replayPath, statistics);
+            std::cout << "Replayed " << statistics.eventsApplied << " event(s) up to sequence " << statistics.lastSequence
+                      << " in " << statistics.elapsedMilliseconds << " ms";
+            if (statistics.malformedLines > 0) {
+                std::cout << " (" << statistics.malformedLines << " malformed line(s) skipped)";
+            }
+            std::cout << ".\n";
+
+            if (restoreFromReplay) {
+                store.saveReserve(replayed->reserve().allBalances());
+                store.saveRates(*replayed);
+                store.saveCriticalMinimums(replayed->criticalMinimumsMap());
+                store.saveSnapshot(*replayed, statistics.lastSequence);
+                std::cout << "Snapshot files rewritten from the journal.\n";
+                return 0;
+            }
+
+            auto differences = JournalReplayer::compare(*replayed,
+                                                        store.loadReserve({}),
+                                                        store.loadRates(),
+                                                        store.loadCriticalMinimums());
+            for (const auto& difference : differences) {
+                std::cout << "  mismatch: " << difference << '\n';
+            }
+            std::cout << (differences.empty() ? "Snapshot files match the journal.\n" : "Snapshot files differ from the journal.\n");
+            return differences.empty() ? 0 : 2;
+        }
+
+        // Cold start: one mapped snapshot plus the journal tail written since it; CSV only as a fallback.
+        Journal journal(store.journalFile());
+        std::unique_ptr<ExchangeOffice> office;
+        bool snapshotStale = true;
+        if (const auto& snapshot = store.startupSnapshot()) {
+            office = SnapshotCodec::buildOffice(*snapshot);
+            office->setClientLimits(store.loadClientLimits()); // Before the tail, so replayed exchanges count
+            auto tail = JournalReplayer::applySince(*office, journal.path(), snapshot->journalSequence);
+            snapshotStale = tail.eventsApplied > 0;
         } else {
-            for (const auto& entry : storedRates) {
-                Currency from;
-                Currency to;
-                double rate;
-                std::tie(from, to, rate) = entry;
-                rateTable.setRate(from, to, rate);
+            office = loadOfficeFromCsv(store);
+            office->setClientLimits(store.loadClientLimits());
+        }
+
+        journal.open(*office);
+        office->addListener(&journal);
+        if (snapshotStale) {
+            store.saveSnapshot(*office, journal.lastSequence());
+        }
+
+        office->publishMetrics();
+        MetricsExporter metricsExporter(MetricsRegistry::global(), metricsOptions);
+        if (!metricsOptions.file.empty() || !metricsOptions.socketPath.empty()) {
+            metricsExporter.start();
+        }
+
+        // Every session mode shares this lock with the rate feed and config watcher; branch sessions lock their branch instead.
+        std::mutex officeMutex;
+        // Listeners are registered before, and removed after, the threads that publish through the office.
+        std::optional<AnomalyMonitor> anomalyMonitor;
+        if (anomalyLog) {
+            anomalyMonitor.emplace(*office, *anomalyLog);
+            for (auto& detector : AnomalyMonitor::defaultDetectors(office->clientLimitTracker().limitsMap())) {
+                anomalyMonitor->add(std::move(detector));
             }
+            anomalyMonitor->start();
+            office->addListener(&*anomalyMonitor);
         }
 
-        std::map<Currency, double> reserveBalances = store.loadReserve(defaultReserveBalances());
-        Reserve reserve(reserveBalances);
+        std::optional<RateFeed> rateFeed;
+        if (feedOptions) {
+            if (feedOptions->source.empty()) {
+                throw ExchangeError("--feed-window and --feed-persist need --rate-feed <file|fifo>");
+            }
+            if (batchInput) {
+                throw ExchangeError("--rate-feed cannot be combined with --batch");
+            }
+            rateFeed.emplace(*office, store, officeMutex, *feedOptions);
+            rateFeed->start();
+        }
+        std::optional<ConfigWatcher> configWatcher;
+        if (watchConfig) {
+            if (batchInput) {
+                throw ExchangeError("--watch-config cannot be combined with --batch");
+            }
+            configWatcher.emplace(*office, store, officeMutex);
+            configWatcher->start();
+        }
 
-        ExchangeOffice office(rateTable, reserve, 0.03);
+        if (rebalanceOptions && !batchInput) {
+            throw ExchangeError("--rebalance and --top-up-cost apply to --batch; the manager menu plans interactively");
+        }
 
-        auto criticalMinima = store.loadCriticalMinimums();
-        if (criticalMinima.empty()) {
-            criticalMinima = defaultCriticalMinimums();
-            store.saveCriticalMinimums(criticalMinima);
+        if (batchInput) {
+            std::ifstream inputFile;
+            if (*batchInput != "-") {
+                inputFile.open(*batchInput);
+                if (!inputFile) {
+                    throw ExchangeError("Unable to open batch input " + *batchInput);
+                }
+            }
+            std::ofstream receiptFile;
+            if (receiptOutput) {
+                receiptFile.open(*receiptOutput, std::ios::trunc);
+                if (!receiptFile) {
+                    throw ExchangeError("Unable to open receipt output " + *receiptOutput);
+                }
+            }
+
+            // Group commit: the journal and transaction log are flushed once the batch is done.
+            Cashier cashier(store.ensurePersonId("cashier", batchCashier), batchCashier, *office);
+            journal.setAutoFlush(false);
+            BatchProcessor processor(cashier, store, batchFormat);
+            BatchSummary summary = processor.run(*batchInput == "-" ? std::cin : inputFile,
+                                                 receiptOutput ? receiptFile : std::cout);
+            journal.flush();
+            journal.setAutoFlush(true);
+
+            std::cerr << "Batch: " << summary.succeeded << " succeeded, " << summary.failed << " failed in "
+                      << summary.elapsedSeconds << " s";
+            if (summary.elapsedSeconds > 0.0) {
+                std::cerr << " (" << static_cast<long long>(summary.processed / summary.elapsedSeconds) << " req/s)";
+            }
+            std::cerr << ".\n";
+
+            if (rebalanceOptions) {
+                auto started = std::chrono::steady_clock::now();
+                RebalancePlan plan = ReservePlanner(*rebalanceOptions).plan(*office, std::time(nullptr));
+                auto elapsed = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - started);
+                std::cerr << ReservePlanner::format(plan, office->reserve().allBalances())
+                          << "Planned in " << static_cast<long long>(elapsed.count()) << " us.\n";
+            }
+        } else if (multiplex) {
+            // Many operator terminals in one process, each a coroutine session on the worker pool.
+            if (serverEndpoint && serverEndpoint->unixSocketPath.empty() && serverEndpoint->port < 0) {
+                throw ExchangeError("--listen needs --port as well");
+            }
+            sessionOptions.endpoint = serverEndpoint;
+            if (allBranches || !branchNames.empty()) {
+                // Branches keep their own reserve and log under data/branches/<name> and quote from this office's rates.
+                BranchNetwork network(store.branchesDirectory(), store, office->sharedRates(),
+                                      BranchDefaults{defaultReserveBalances(), defaultCriticalMinimums(), office->commissionRate(),
+                                                     office->clientLimitTracker().limitsMap()});
+                if (allBranches) {
+                    network.loadAll();
+                }
+                for (const auto& name : branchNames) {
+                    network.open(name);
+                }
+                if (network.size() == 0) {
+                    throw ExchangeError("No branches under " + store.branchesDirectory().string() + "; name one with --branch");
+                }
+                SessionHost host(network, sessionOptions);
+                host.run();
+                network.saveAll();
+            } else {
+                SessionHost host(*office, store, officeMutex, sessionOptions);
+                host.run();
+            }
+        } else if (serverEndpoint) {
+            if (serverEndpoint->unixSocketPath.empty() && serverEndpoint->port < 0) {
+                throw ExchangeError("--listen needs --port as well");
+            }
+            ExchangeServer server(*office, store, journal, officeMutex, *serverEndpoint);
+            server.run();
+        } else {
+            StreamSink console(std::cout);
+            BlockingLineInput input(std::cin);
+            ConsoleUI ui(*office, store, console, input, officeMutex);
+            ui.run();
         }
-        office.initializeCriticalMinimums(criticalMinima);
 
-        ConsoleUI ui(office, store);
-        ui.run();
+        if (configWatcher) {
+            configWatcher->stop();
+            std::cerr << "Configuration watcher: " << configWatcher->reloadCount() << " reload(s) applied.\n";
+        }
+        if (rateFeed) {
+            rateFeed->stop();
+            RateFeedStatistics feed = rateFeed->stats();
+            std::cerr << "Rate feed: " << feed.linesRead << " update(s) read, " << feed.malformedLines << " malformed, "
+                      << feed.updatesApplied << " applied in " << feed.batchesApplied << " batch(es), rates saved "
+                      << feed.saves << " time(s).\n";
+        }
+        if (anomalyMonitor) {
+            office->removeListener(&*anomalyMonitor);
+            anomalyMonitor->stop();
+            AnomalyStatistics anomalies = anomalyMonitor->stats();
+            std::cerr << "Anomaly detection: " << anomalies.observed << " transaction(s) observed, " << anomalies.dropped
+                      << " dropped, " << anomalies.alerts << " alert(s) written to " << anomalyLog->string() << ".\n";
+        }
 
-        store.saveReserve(office.reserve().allBalances());
-        store.saveRates(office.rateConfig());
-        store.saveCriticalMinimums(office.criticalMinimumsMap());
+        store.saveReserve(office->reserve().allBalances());
+        store.saveRates(*office);
+        store.saveCriticalMinimums(office->criticalMinimumsMap());
+        store.saveSnapshot(*office, journal.lastSequence());
+        journal.rollover(*office);
+        metricsExporter.stop();
+        if (tracePath) {
+            std::size_t events = Tracer::writeChromeTrace(*tracePath);
+            std::cerr << "Wrote " << events << " trace event(s) to " << *tracePath << '\n';
+        }
+        if (LatencyRegistry::snapshot()[static_cast<std::size_t>(LatencyStage::Transaction)].count() > 0) {
+            LatencyRegistry::writeDump(store.latencyDumpFile());
+        }
     } catch (const std::exception& error) {
         std::cerr << "Fatal error: " << error.what() << '\n';
         return 1;
@@ -0,0 +1,299 @@
+#include "metrics.h"
+
+#include <charconv>
+#include <fstream>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::chrono::milliseconds kPollSlice{200};
+
+    void append_number(std::string& out, double value) {
+        char buffer[32];
+        auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+        out.append(buffer, result.ptr);
+    }
+
+    std::string currencyLabel(Currency currency) {
+        return "currency=\"" + to_string(currency) + "\"";
+    }
+}
+
+MetricsRegistry::Family& MetricsRegistry::family(const std::string& name, const std::string& help, Kind kind) {
+    for (auto& existing : families) {
+        if (existing.name == name) {
+            if (existing.kind != kind) {
+                throw ExchangeError("Metric " + name + " registered with two types");
+            }
+            return existing;
+        }
+    }
+    families.push_back(Family{name, help, kind, {}});
+    return families.back();
+}
+
+Counter& MetricsRegistry::counter(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> guard(mutex);
+    Family& metric = family(name, help, Kind::Counter);
+    for (const auto& series : metric.series) {
+        if (series.labels == labels) {
+            return *series.counter;
+        }
+    }
+    Counter& created = counters.emplace_back();
+    metric.series.push_back(Series{labels, &created, nullptr});
+    return created;
+}
+
+Gauge& MetricsRegistry::gauge(const std::string& name, const std::string& help, const std::string& labels) {
+    std::lock_guard<std::mutex> guard(mutex);
+    Family& metric = family(name, help, Kind::Gauge);
+    for (const auto& series : metric.series) {
+        if (series.labels == labels) {
+            return *series.gauge;
+        }
+    }
+    Gauge& created = gauges.emplace_back();
+    metric.series.push_back(Series{labels, nullptr, &created});
+    return created;
+}
+
+std::string MetricsRegistry::exposition() const {
+    std::string text;
+    std::lock_guard<std::mutex> guard(mutex);
+    for (const auto& metric : families) {
+        text += "# HELP " + metric.name + ' ' + metric.help + '\n';
+        text += "# TYPE " + metric.name + (metric.kind == Kind::Counter ? " counter\n" : " gauge\n");
+        for (const auto& series : metric.series) {
+            text += metric.name;
+            if (!series.labels.empty()) {
+                text += '{' + series.labels + '}';
+            }
+            text += ' ';
+            if (series.counter) {
+                append_integer(text, static_cast<long long>(series.counter->get()));
+            } else {
+                append_number(text, series.gauge->get());
+            }
+            text += '\n';
+        }
+    }
+    return text;
+}
+
+MetricsRegistry& MetricsRegistry::global() {
+    static MetricsRegistry registry;
+    return registry;
+}
+
+void OfficeMetrics::countFailure(const ExchangeError& error) {
+    if (dynamic_cast<const ReserveError*>(&error)) {
+        reserveShortfalls.increment();
+    } else if (dynamic_cast<const RateNotFoundError*>(&error)) {
+        missingRates.increment();
+    } else if (dynamic_cast<const LimitExceededError*>(&error)) {
+        clientLimitRejections.increment();
+    } else {
+        invalidRequests.increment();
+    }
+}
+
+void OfficeMetrics::updateWalLag() {
+    double lag = journalSequence.get() - snapshotSequence.get();
+    walLag.set(lag > 0.0 ? lag : 0.0);
+}
+
+OfficeMetrics& OfficeMetrics::instance() {
+    static OfficeMetrics metrics = []() {
+        auto& registry = MetricsRegistry::global();
+        const char* failures = "exchange_failures_total";
+        const char* failureHelp = "Exchanges rejected, by ExchangeError subtype.";
+        std::array<Counter*, 4> breaches{};
+        std::array<Gauge*, 4> balances{};
+        for (Currency currency : {Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL}) {
+            auto index = static_cast<std::size_t>(currency);
+            breaches[index] = &registry.counter("exchange_critical_breaches_total",
+                                                "Times a currency's reserve dropped below its critical minimum.",
+                                                currencyLabel(currency));
+            balances[index] = &registry.gauge("exchange_reserve_balance", "Current reserve balance.", currencyLabel(currency));
+        }
+        return OfficeMetrics{
+            registry.counter("exchange_transactions_total", "Exchanges completed."),
+            registry.counter(failures, failureHelp, "type=\"invalid_request\""),
+            registry.counter(failures, failureHelp, "type=\"rate_not_found\""),
+            registry.counter(failures, failureHelp, "type=\"reserve\""),
+            registry.counter(failures, failureHelp, "type=\"client_limit\""),
+            breaches,
+            balances,
+            registry.gauge("exchange_currencies_below_critical", "Currencies currently under their critical minimum."),
+            registry.gauge("exchange_profit_base", "Profit since the start of the day, in the base currency."),
+            registry.counter("exchange_log_appends_total", "Receipts appended to the transaction log."),
+            registry.counter("exchange_store_writes_total", "CSV and snapshot files rewritten by the data store."),
+            registry.gauge("exchange_journal_sequence", "Last journal event sequence number written."),
+            registry.gauge("exchange_snapshot_sequence", "Journal sequence covered by the last state snapshot."),
+            registry.gauge("exchange_wal_lag_events", "Journal events not yet covered by a state snapshot."),
+            registry.counter("exchange_rate_feed_updates_total", "Rate updates read from the rate feed."),
+            registry.counter("exchange_rate_feed_applied_total", "Rate updates applied after coalescing the feed per pair.")
+        };
+    }();
+    return metrics;
+}
+
+MetricsExporter::MetricsExporter(MetricsRegistry& metrics, MetricsExportOptions exportOptions)
+    : registry(metrics),
+      options(std::move(exportOptions)),
+      stopping(false),
+      listenDescriptor(-1) {}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+void MetricsExporter::start() {
+    if (!options.socketPath.empty()) {
+#ifdef __linux__
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::string path = options.socketPath.string();
+        if (path.size() >= sizeof(address.sun_path)) {
+            throw ExchangeError("Metrics socket path too long: " + path);
+        }
+        std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+        ::unlink(path.c_str());
+        listenDescriptor = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (listenDescriptor < 0
+            || ::bind(listenDescriptor, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0
+            || ::listen(listenDescriptor, 16) != 0) {
+            int error = errno;
+            if (listenDescriptor >= 0) {
+                ::close(listenDescriptor);
+                listenDescriptor = -1;
+            }
+            throw ExchangeError("Unable to listen for metrics on " + path + ": " + std::strerror(error));
+        }
+#else
+        throw ExchangeError("Metrics sockets require Linux; use --metrics-file instead.");
+#endif
+    }
+    worker = std::thread(&MetricsExporter::run, this);
+}
+
+void MetricsExporter::stop() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        if (stopping) {
+            return;
+        }
+        stopping = true;
+    }
+    wake.notify_all();
+    bool wasRunning = worker.joinable();
+    if (wasRunning) {
+        worker.join();
+    }
+    if (wasRunning && !options.file.empty()) {
+        try {
+            writeFile();
+        } catch (const std::exception& error) {
+            std::cerr << "Metrics export failed: " << error.what() << '\n';
+        }
+    }
+#ifdef __linux__
+    if (listenDescriptor >= 0) {
+        ::close(listenDescriptor);
+        ::unlink(options.socketPath.c_str());
+        listenDescriptor = -1;
+    }
+#endif
+}
+
+void MetricsExporter::writeFile() const {
+    // Write-then-rename so a scraper never reads a half-written file.
+    std::filesystem::path temporary = options.file;
+    temporary += ".tmp";
+    {
+        std::ofstream output(temporary, std::ios::trunc);
+        output << registry.exposition();
+        if (!output) {
+            throw ExchangeError("Unable to write " + temporary.string());
+        }
+    }
+    std::filesystem::rename(temporary, options.file);
+}
+
+void MetricsExporter::serveClients() {
+#ifdef __linux__
+    while (true) {
+        int client = ::accept4(listenDescriptor, nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            return;
+        }
+        std::string text = registry.exposition();
+        std::size_t sent = 0;
+        while (sent < text.size()) {
+            ssize_t written = ::send(client, text.data() + sent, text.size() - sent, MSG_NOSIGNAL);
+            if (written <= 0) {
+                break;
+            }
+            sent += static_cast<std::size_t>(written);
+        }
+        ::close(client);
+    }
+#endif
+}
+
+void MetricsExporter::run() {
+#ifdef __linux__
+    // SIGINT/SIGTERM are for the server's signalfd, not this thread.
+    sigset_t all;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_BLOCK, &all, nullptr);
+#endif
+    auto nextWrite = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        auto now = std::chrono::steady_clock::now();
+        if (!options.file.empty() && now >= nextWrite) {
+            lock.unlock();
+            try {
+                writeFile();
+            } catch (const std::exception& error) {
+                std::cerr << "Metrics export failed: " << error.what() << '\n';
+            }
+            lock.lock();
+            nextWrite = now + options.interval;
+            continue;
+        }
+        if (listenDescriptor < 0) {
+            if (options.file.empty()) {
+                wake.wait(lock, [this]() {
+                    return stopping;
+                });
+            } else {
+                wake.wait_until(lock, nextWrite);
+            }
+            continue;
+        }
+#ifdef __linux__
+        // Socket mode polls in short slices so stop() is noticed promptly.
+        lock.unlock();
+        pollfd ready{listenDescriptor, POLLIN, 0};
+        auto slice = options.file.empty() ? kPollSlice
+                                          : std::min(kPollSlice, std::chrono::duration_cast<std::chrono::milliseconds>(nextWrite - now));
+        if (::poll(&ready, 1, static_cast<int>(std::max<long long>(slice.count(), 1))) > 0) {
+            serveClients();
+        }
+        lock.lock();
+#endif
+    }
+}
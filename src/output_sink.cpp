@@ -0,0 +1,174 @@
+#include "output_sink.h"
+
+#include "utils.h"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+OutputSink::OutputSink(std::size_t bufferBytes) : capacity(bufferBytes == 0 ? 1 : bufferBytes) {
+    buffer.reserve(capacity);
+}
+
+OutputSink& OutputSink::write(std::string_view text) {
+    if (buffer.size() + text.size() > capacity) {
+        if (!buffer.empty()) {
+            drain(buffer.data(), buffer.size());
+            buffer.clear();
+        }
+        if (text.size() >= capacity) {
+            drain(text.data(), text.size());
+            return *this;
+        }
+    }
+    buffer.append(text.data(), text.size());
+    return *this;
+}
+
+OutputSink& OutputSink::writeFixed(double value, int precision) {
+    char digits[64];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value, std::chars_format::fixed, precision);
+    return write(result.ec == std::errc() ? std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)) : "nan");
+}
+
+OutputSink& OutputSink::writeNumber(double value) {
+    char digits[64];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return write(result.ec == std::errc() ? std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)) : "nan");
+}
+
+void OutputSink::flush() {
+    if (!buffer.empty()) {
+        drain(buffer.data(), buffer.size());
+        buffer.clear();
+    }
+    sync();
+}
+
+OutputSink& OutputSink::operator<<(std::string_view text) {
+    return write(text);
+}
+
+OutputSink& OutputSink::operator<<(const std::string& text) {
+    return write(text);
+}
+
+OutputSink& OutputSink::operator<<(const char* text) {
+    return write(std::string_view(text));
+}
+
+OutputSink& OutputSink::operator<<(char ch) {
+    return write(std::string_view(&ch, 1));
+}
+
+OutputSink& OutputSink::operator<<(int value) {
+    return *this << static_cast<long long>(value);
+}
+
+OutputSink& OutputSink::operator<<(long long value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return write(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+}
+
+OutputSink& OutputSink::operator<<(std::size_t value) {
+    char digits[24];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    return write(std::string_view(digits, static_cast<std::size_t>(result.ptr - digits)));
+}
+
+OutputSink& OutputSink::operator<<(double value) {
+    return writeFixed(value, 2);
+}
+
+StreamSink::StreamSink(std::ostream& target, std::size_t bufferBytes) : OutputSink(bufferBytes), stream(target) {}
+
+StreamSink::~StreamSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void StreamSink::drain(const char* data, std::size_t size) {
+    stream.write(data, static_cast<std::streamsize>(size));
+}
+
+void StreamSink::sync() {
+    stream.flush();
+}
+
+FileSink::FileSink(const std::filesystem::path& path, bool append, std::size_t bufferBytes)
+    : OutputSink(bufferBytes),
+      file(path, append ? std::ios::app : std::ios::trunc) {
+    if (!file) {
+        throw ExchangeError("Unable to open " + path.string() + " for writing");
+    }
+}
+
+FileSink::~FileSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void FileSink::drain(const char* data, std::size_t size) {
+    file.write(data, static_cast<std::streamsize>(size));
+    if (!file) {
+        throw ExchangeError("Failed to write output file");
+    }
+}
+
+void FileSink::sync() {
+    file.flush();
+}
+
+DescriptorSink::DescriptorSink(int fileDescriptor, std::size_t bufferBytes) : OutputSink(bufferBytes), descriptor(fileDescriptor) {}
+
+DescriptorSink::~DescriptorSink() {
+    try {
+        flush();
+    } catch (...) {
+    }
+}
+
+void DescriptorSink::drain(const char* data, std::size_t size) {
+    while (size > 0) {
+#ifdef _WIN32
+        int written = ::_write(descriptor, data, static_cast<unsigned int>(size));
+#else
+        ssize_t written = ::write(descriptor, data, size);
+#endif
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw ExchangeError(std::string("Output descriptor write failed: ") + std::strerror(errno));
+        }
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+StringSink::StringSink(std::size_t bufferBytes) : OutputSink(bufferBytes) {}
+
+void StringSink::drain(const char* data, std::size_t size) {
+    collected.append(data, size);
+}
+
+const std::string& StringSink::str() {
+    flush();
+    return collected;
+}
+
+void StringSink::clear() {
+    flush();
+    collected.clear();
+}
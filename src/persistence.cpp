@@ -1,15 +1,24 @@
 #include "persistence.h"
 
+#include "latency_histogram.h"
+#include "metrics.h"
+#include "snapshot.h"
+#include "trace.h"
 #include "utils.h"
 
 #include <algorithm>
 #include <cctype>
 #include <fstream>
+#include <functional>
 #include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <limits>
 #include <vector>
 #include <sstream>
 #include <stdexcept>
 #include <cstdio>
+#include <utility>
 
 namespace {
     std::string canonicalKey(const std::string& role, const std::string& name) {
@@ -25,17 +34,153 @@ namespace {
     Currency parseCurrency(const std::string& token) {
         return currency_from_string(token);
     }
+
+    std::vector<PairRate> parseRates(std::istream& input) {
+        std::vector<PairRate> rates;
+        std::string line;
+        while (std::getline(input, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            std::istringstream stream(line);
+            std::string fromToken;
+            std::string toToken;
+            std::string rateToken;
+            std::string marginToken;
+            if (!std::getline(stream, fromToken, ',')) {
+                continue;
+            }
+            if (!std::getline(stream, toToken, ',')) {
+                continue;
+            }
+            if (!std::getline(stream, rateToken, ',')) {
+                continue;
+            }
+            // The margin column is optional; files written before spreads existed quote at mid.
+            std::getline(stream, marginToken);
+            try {
+                Currency from = parseCurrency(fromToken);
+                Currency to = parseCurrency(toToken);
+                double rate = std::stod(rateToken);
+                double margin = marginToken.empty() ? 0.0 : std::stod(marginToken);
+                rates.push_back(PairRate{from, to, rate, margin});
+            } catch (...) {
+                // Ignore malformed entries
+            }
+        }
+        return rates;
+    }
+
+    std::map<Currency, double> parseMinimums(std::istream& input) {
+        std::map<Currency, double> minima;
+        std::string line;
+        while (std::getline(input, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            std::istringstream stream(line);
+            std::string currencyToken;
+            std::string amountToken;
+            if (!std::getline(stream, currencyToken, ',')) {
+                continue;
+            }
+            if (!std::getline(stream, amountToken)) {
+                continue;
+            }
+            try {
+                Currency currency = parseCurrency(currencyToken);
+                double amount = std::stod(amountToken);
+                minima[currency] = amount;
+            } catch (...) {
+                // Ignore malformed entries
+            }
+        }
+        return minima;
+    }
+
+    // Written aside and renamed into place, so readers and the config watcher always see a complete file.
+    std::size_t fingerprint(const std::filesystem::path& path, const std::string& content) {
+        return std::hash<std::string>{}(path.string()) ^ (std::hash<std::string>{}(content) * 31);
+    }
 }
 
 DataStore::DataStore(const std::string& baseDir)
     : baseDirectory(baseDir),
       reportsDirectory(baseDirectory / "reports"),
-      nextPersonId(1) {}
+      ratesMutex(std::make_shared<std::mutex>()),
+      reportWriter(reportsDirectory),
+      transactionLog(baseDirectory / "transactions"),
+      nextPersonId(1),
+      bulkMode(false),
+      peopleDirty(false) {}
 
-void DataStore::initialize() {
+void DataStore::initialize(StartupSource source) {
+    TRACE_SPAN("DataStore::initialize", "persistence");
     std::filesystem::create_directories(baseDirectory);
     std::filesystem::create_directories(reportsDirectory);
-    loadPeople();
+    startupState.reset();
+
+    if (source == StartupSource::Snapshot && std::filesystem::exists(snapshotFile())) {
+        std::string error;
+        startupState = SnapshotCodec::readFile(snapshotFile(), error);
+        if (!startupState) {
+            std::cerr << "Ignoring state snapshot: " << error << '\n';
+        } else {
+            OfficeMetrics::instance().snapshotSequence.set(static_cast<double>(startupState->journalSequence));
+        }
+    }
+
+    std::error_code ignored;
+    bool peopleChangedSinceSnapshot = startupState
+        && std::filesystem::exists(peopleFile())
+        && std::filesystem::last_write_time(peopleFile(), ignored) > std::filesystem::last_write_time(snapshotFile(), ignored);
+    if (startupState && !peopleChangedSinceSnapshot) {
+        restorePeople(startupState->people);
+    } else {
+        loadPeople();
+    }
+    transactionLog.open(transactionsFile());
+}
+
+void DataStore::shareRatesWith(const DataStore& owner) {
+    sharedRatesPath = owner.ratesFile();
+    ratesMutex = owner.ratesMutex;
+}
+
+const std::optional<OfficeSnapshot>& DataStore::startupSnapshot() const {
+    return startupState;
+}
+
+void DataStore::saveSnapshot(const ExchangeOffice& office, std::uint64_t journalSequence) const {
+    TRACE_SPAN("DataStore::saveSnapshot", "persistence");
+    SnapshotCodec::writeFile(snapshotFile(), SnapshotCodec::capture(office, peopleEntries(), journalSequence));
+    auto& metrics = OfficeMetrics::instance();
+    metrics.fileWrites.increment();
+    metrics.snapshotSequence.set(static_cast<double>(journalSequence));
+    metrics.updateWalLag();
+}
+
+std::vector<PersonEntry> DataStore::peopleEntries() const {
+    std::vector<PersonEntry> entries;
+    entries.reserve(people.size());
+    for (const auto& [_, entry] : people) {
+        entries.push_back(entry);
+    }
+    std::sort(entries.begin(), entries.end(), [](const PersonEntry& lhs, const PersonEntry& rhs) {
+        return lhs.id < rhs.id;
+    });
+    return entries;
+}
+
+void DataStore::restorePeople(const std::vector<PersonEntry>& entries) {
+    people.clear();
+    nextPersonId = 1;
+    for (const auto& entry : entries) {
+        people[canonicalKey(entry.role, entry.name)] = entry;
+        if (entry.id >= nextPersonId) {
+            nextPersonId = entry.id + 1;
+        }
+    }
 }
 
 std::filesystem::path DataStore::reserveFile() const {
@@ -43,7 +188,7 @@ std::filesystem::path DataStore::reserveFile() const {
 }
 
 std::filesystem::path DataStore::ratesFile() const {
-    return baseDirectory / "rates.csv";
+    return sharedRatesPath.empty() ? baseDirectory / "rates.csv" : sharedRatesPath;
 }
 
 std::filesystem::path DataStore::criticalFile() const {
@@ -58,7 +203,32 @@ std::filesystem::path DataStore::transactionsFile() const {
     return baseDirectory / "transactions.log";
 }
 
+std::filesystem::path DataStore::snapshotFile() const {
+    return baseDirectory / "state.snapshot";
+}
+
+std::filesystem::path DataStore::journalFile() const {
+    return baseDirectory / "journal.log";
+}
+
+std::filesystem::path DataStore::bonusFile() const {
+    return baseDirectory / "bonus.csv";
+}
+
+std::filesystem::path DataStore::limitsFile() const {
+    return baseDirectory / "limits.csv";
+}
+
+std::filesystem::path DataStore::latencyDumpFile() const {
+    return baseDirectory / "latency.txt";
+}
+
+std::filesystem::path DataStore::branchesDirectory() const {
+    return baseDirectory / "branches";
+}
+
 void DataStore::loadPeople() {
+    TRACE_SPAN("DataStore::loadPeople", "persistence");
     people.clear();
     nextPersonId = 1;
     auto filePath = peopleFile();
@@ -100,22 +270,16 @@ void DataStore::loadPeople() {
 }
 
 void DataStore::persistPeople() const {
+    TRACE_SPAN("DataStore::persistPeople", "persistence");
+    OfficeMetrics::instance().fileWrites.increment();
     std::ofstream output(peopleFile(), std::ios::trunc);
-    std::vector<PersonEntry> entries;
-    entries.reserve(people.size());
-    for (const auto& [_, entry] : people) {
-        entries.push_back(entry);
-    }
-    std::sort(entries.begin(), entries.end(), [](const PersonEntry& lhs, const PersonEntry& rhs) {
-        return lhs.id < rhs.id;
-    });
-
-    for (const auto& entry : entries) {
+    for (const auto& entry : peopleEntries()) {
         output << entry.role << ';' << entry.id << ';' << entry.name << '\n';
     }
 }
 
 std::map<Currency, double> DataStore::loadReserve(const std::map<Currency, double>& defaults) const {
+    TRACE_SPAN("DataStore::loadReserve", "persistence");
     auto filePath = reserveFile();
     if (!std::filesystem::exists(filePath)) {
         const_cast<DataStore*>(this)->saveReserve(defaults);
@@ -150,109 +314,161 @@ std::map<Currency, double> DataStore::loadReserve(const std::map<Currency, doubl
 }
 
 void DataStore::saveReserve(const std::map<Currency, double>& balances) const {
+    TRACE_SPAN("DataStore::saveReserve", "persistence");
+    ScopedLatency timed(LatencyStage::ReservePersist);
+    OfficeMetrics::instance().fileWrites.increment();
     std::ofstream output(reserveFile(), std::ios::trunc);
     for (const auto& [currency, amount] : balances) {
         output << to_string(currency) << ',' << std::fixed << std::setprecision(2) << amount << '\n';
     }
 }
 
-std::vector<std::tuple<Currency, Currency, double>> DataStore::loadRates() const {
+std::vector<PairRate> DataStore::loadRates() const {
+    TRACE_SPAN("DataStore::loadRates", "persistence");
     auto filePath = ratesFile();
-    std::vector<std::tuple<Currency, Currency, double>> rates;
     if (!std::filesystem::exists(filePath)) {
-        return rates;
+        return {};
     }
-
     std::ifstream input(filePath);
-    std::string line;
-    while (std::getline(input, line)) {
-        if (line.empty()) {
-            continue;
-        }
-        std::istringstream stream(line);
-        std::string fromToken;
-        std::string toToken;
-        std::string rateToken;
-        if (!std::getline(stream, fromToken, ',')) {
-            continue;
-        }
-        if (!std::getline(stream, toToken, ',')) {
-            continue;
-        }
-        if (!std::getline(stream, rateToken)) {
-            continue;
-        }
-        try {
-            Currency from = parseCurrency(fromToken);
-            Currency to = parseCurrency(toToken);
-            double rate = std::stod(rateToken);
-            rates.emplace_back(from, to, rate);
-        } catch (...) {
-            // Ignore malformed entries
-        }
+    return parseRates(input);
+}
+
+std::optional<std::vector<PairRate>> DataStore::reloadRates() const {
+    TRACE_SPAN("DataStore::reloadRates", "persistence");
+    auto content = readIfForeign(ratesFile());
+    if (!content) {
+        return std::nullopt;
     }
-    return rates;
+    std::istringstream input(*content);
+    return parseRates(input);
 }
 
 void DataStore::saveRates(const RateTable& table) const {
-    std::ofstream output(ratesFile(), std::ios::trunc);
-    for (const auto& entry : table.serialize()) {
-        Currency from;
-        Currency to;
-        double rate;
-        std::tie(from, to, rate) = entry;
-        output << to_string(from) << ',' << to_string(to) << ',' << std::setprecision(10) << rate << '\n';
+    std::lock_guard<std::mutex> guard(*ratesMutex);
+    writeRates(table);
+}
+
+void DataStore::saveRates(const ExchangeOffice& office) const {
+    std::lock_guard<std::mutex> guard(*ratesMutex);
+    writeRates(*office.rateConfig());
+}
+
+void DataStore::writeRates(const RateTable& table) const {
+    TRACE_SPAN("DataStore::saveRates", "persistence");
+    ScopedLatency timed(LatencyStage::RatesPersist);
+    OfficeMetrics::instance().fileWrites.increment();
+    std::ostringstream text;
+    for (const auto& [from, to, rate, margin] : table.serialize()) {
+        text << to_string(from) << ',' << to_string(to) << ',' << std::setprecision(10) << rate << ',' << margin << '\n';
     }
+    std::string content = text.str();
+    rememberWrite(ratesFile(), content);
+    replace_file(ratesFile(), content);
 }
 
 std::map<Currency, double> DataStore::loadCriticalMinimums() const {
+    TRACE_SPAN("DataStore::loadCriticalMinimums", "persistence");
     auto filePath = criticalFile();
-    std::map<Currency, double> minima;
     if (!std::filesystem::exists(filePath)) {
-        return minima;
+        return {};
     }
-
     std::ifstream input(filePath);
+    return parseMinimums(input);
+}
+
+std::optional<std::map<Currency, double>> DataStore::reloadCriticalMinimums() const {
+    TRACE_SPAN("DataStore::reloadCriticalMinimums", "persistence");
+    auto content = readIfForeign(criticalFile());
+    if (!content) {
+        return std::nullopt;
+    }
+    std::istringstream input(*content);
+    return parseMinimums(input);
+}
+
+void DataStore::saveCriticalMinimums(const std::map<Currency, double>& minima) const {
+    TRACE_SPAN("DataStore::saveCriticalMinimums", "persistence");
+    OfficeMetrics::instance().fileWrites.increment();
+    std::ostringstream text;
+    for (const auto& [currency, amount] : minima) {
+        text << to_string(currency) << ',' << std::fixed << std::setprecision(2) << amount << '\n';
+    }
+    std::string content = text.str();
+    rememberWrite(criticalFile(), content);
+    replace_file(criticalFile(), content);
+}
+
+void DataStore::rememberWrite(const std::filesystem::path& path, const std::string& content) const {
+    std::lock_guard<std::mutex> guard(writesMutex);
+    recentWrites[nextWriteSlot] = fingerprint(path, content);
+    nextWriteSlot = (nextWriteSlot + 1) % recentWrites.size();
+}
+
+std::optional<std::string> DataStore::readIfForeign(const std::filesystem::path& path) const {
+    std::ifstream input(path, std::ios::binary);
+    if (!input) {
+        return std::nullopt;
+    }
+    std::string content((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+    std::size_t key = fingerprint(path, content);
+    std::lock_guard<std::mutex> guard(writesMutex);
+    if (std::find(recentWrites.begin(), recentWrites.end(), key) != recentWrites.end()) {
+        return std::nullopt;
+    }
+    return content;
+}
+
+BonusPolicies DataStore::loadBonusPolicies() const {
+    BonusPolicies policies{std::make_unique<PercentageBonusPolicy>(0.05), nullptr};
+    std::ifstream input(bonusFile());
     std::string line;
     while (std::getline(input, line)) {
         if (line.empty()) {
             continue;
         }
-        std::istringstream stream(line);
-        std::string currencyToken;
-        std::string amountToken;
-        if (!std::getline(stream, currencyToken, ',')) {
+        auto comma = line.find(',');
+        std::string window = line.substr(0, comma);
+        try {
+            if (comma == std::string::npos || (window != "day" && window != "month")) {
+                throw ExchangeError("expected day,<policy> or month,<policy>");
+            }
+            (window == "day" ? policies.daily : policies.monthly) = BonusPolicy::parse(line.substr(comma + 1));
+        } catch (const ExchangeError& error) {
+            std::cerr << "Ignoring " << bonusFile().string() << " line '" << line << "': " << error.what() << '\n';
+        }
+    }
+    return policies;
+}
+
+std::map<Currency, ClientLimit> DataStore::loadClientLimits() const {
+    TRACE_SPAN("DataStore::loadClientLimits", "persistence");
+    std::map<Currency, ClientLimit> limits;
+    std::ifstream input(limitsFile());
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.empty()) {
             continue;
         }
-        if (!std::getline(stream, amountToken)) {
+        std::istringstream stream(line);
+        std::string currencyToken;
+        std::string dailyToken;
+        std::string weeklyToken;
+        if (!std::getline(stream, currencyToken, ',') || !std::getline(stream, dailyToken, ',')) {
             continue;
         }
+        std::getline(stream, weeklyToken);
         try {
-            Currency currency = parseCurrency(currencyToken);
-            double amount = std::stod(amountToken);
-            minima[currency] = amount;
+            limits[parseCurrency(currencyToken)] =
+                ClientLimit{std::stod(dailyToken), weeklyToken.empty() ? 0.0 : std::stod(weeklyToken)};
         } catch (...) {
             // Ignore malformed entries
         }
     }
-    return minima;
-}
-
-void DataStore::saveCriticalMinimums(const std::map<Currency, double>& minima) const {
-    std::ofstream output(criticalFile(), std::ios::trunc);
-    for (const auto& [currency, amount] : minima) {
-        output << to_string(currency) << ',' << std::fixed << std::setprecision(2) << amount << '\n';
-    }
+    return limits;
 }
 
 int DataStore::ensurePersonId(const std::string& role, const std::string& name) {
-    std::string trimmedName = name;
-    trimmedName.erase(trimmedName.begin(), std::find_if(trimmedName.begin(), trimmedName.end(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }));
-    trimmedName.erase(std::find_if(trimmedName.rbegin(), trimmedName.rend(), [](unsigned char ch) {
-        return !std::isspace(ch);
-    }).base(), trimmedName.end());
+    std::string trimmedName = trim(name);
 
     std::string key = canonicalKey(role, trimmedName);
     auto iterator = people.find(key);
@@ -262,59 +478,90 @@ int DataStore::ensurePersonId(const std::string& role, const std::string& name)
 
     PersonEntry entry{nextPersonId++, role, trimmedName};
     people[key] = entry;
-    persistPeople();
+    if (bulkMode) {
+        peopleDirty = true;
+    } else {
+        persistPeople();
+    }
     return entry.id;
 }
 
-void DataStore::appendTransaction(const Receipt& receipt) const {
-    std::ofstream output(transactionsFile(), std::ios::app);
-    output << receipt.timestamp() << '|'
-           << receipt.id() << '|'
-           << receipt.cashierIdentifier() << '|'
-           << receipt.cashier() << '|'
-           << receipt.clientIdentifier() << '|'
-           << receipt.client() << '|'
-           << to_string(receipt.source()) << '|'
-           << std::fixed << std::setprecision(2) << receipt.sourceAmountValue() << '|'
-           << std::fixed << std::setprecision(2) << receipt.profitInBase() << '|'
-           << std::fixed << std::setprecision(2) << receipt.commissionInBase() << '\n';
+void DataStore::setBulkMode(bool enabled) {
+    bulkMode = enabled;
+    transactionLog.setAutoFlush(!enabled);
+    if (!bulkMode && peopleDirty) {
+        persistPeople();
+        peopleDirty = false;
+    }
 }
 
-std::filesystem::path DataStore::persistReport(const DailyReport& report, const Manager& manager) const {
-    std::time_t timestamp = report.generatedOn();
-    std::tm* timeInfo = std::localtime(&timestamp);
-    char buffer[32];
-    if (timeInfo != nullptr) {
-        std::strftime(buffer, sizeof(buffer), "report-%Y%m%d-%H%M%S.txt", timeInfo);
-    } else {
-        std::snprintf(buffer, sizeof(buffer), "report-%lld.txt", static_cast<long long>(timestamp));
-    }
-    auto path = reportsDirectory / buffer;
-    std::ofstream output(path, std::ios::trunc);
-    output << "Manager: " << manager.getName() << " (ID " << manager.getId() << ")\n";
-    std::tm* reportInfo = std::localtime(&timestamp);
-    if (reportInfo) {
-        output << "Generated: " << std::put_time(reportInfo, "%Y-%m-%d %H:%M:%S") << '\n';
-    } else {
-        output << "Generated (timestamp): " << static_cast<long long>(timestamp) << '\n';
-    }
-    output << "Profit (base currency): " << std::fixed << std::setprecision(2) << report.profitInBase() << "\n\n";
-    output << "Ending reserves:\n";
-    for (const auto& [currency, balance] : report.endBalances()) {
-        output << "  " << to_string(currency) << ": " << std::fixed << std::setprecision(2) << balance;
-        auto thresholdIt = report.criticalThresholds().find(currency);
-        if (thresholdIt != report.criticalThresholds().end()) {
-            output << " (critical min " << std::fixed << std::setprecision(2) << thresholdIt->second << ")";
-        }
-        output << '\n';
+BulkModeScope::BulkModeScope(DataStore& bulkStore) : store(bulkStore) {
+    store.setBulkMode(true);
+}
+
+BulkModeScope::~BulkModeScope() {
+    try {
+        store.setBulkMode(false);
+    } catch (const std::exception& error) {
+        std::cerr << "Leaving bulk mode failed: " << error.what() << '\n';
     }
-    output << "\nTransactions:\n";
-    for (const auto& record : report.history()) {
-        output << "  Receipt #" << record.receiptId << " | Cashier "
-               << record.cashierName << " (ID " << record.cashierId << ") | Client "
-               << record.clientName << " (ID " << record.clientId << ") | Source "
-               << to_string(record.sourceCurrency) << ' ' << std::fixed << std::setprecision(2) << record.sourceAmount
-               << " | Profit base " << std::fixed << std::setprecision(2) << record.profitInBaseCurrency << '\n';
+}
+
+void DataStore::flushPending() {
+    TRACE_SPAN("DataStore::flushPending", "persistence");
+    transactionLog.flush();
+    if (peopleDirty) {
+        persistPeople();
+        peopleDirty = false;
+    }
+}
+
+void DataStore::appendTransaction(const Receipt& receipt) {
+    TRACE_SPAN("DataStore::appendTransaction", "persistence");
+    ScopedLatency timed(LatencyStage::LogAppend);
+    OfficeMetrics::instance().logAppends.increment();
+    transactionLog.append(receipt);
+    if (queryIndex) {
+        queryIndex->add(receipt);
+    }
+}
+
+const TransactionLog& DataStore::transactions() const {
+    return transactionLog;
+}
+
+TransactionIndex& DataStore::transactionIndex() {
+    if (!queryIndex) {
+        transactionLog.flush(); // Bulk mode may still hold lines back
+        queryIndex.emplace();
+        queryIndex->loadFrom(transactionLog);
+        queryIndex->reindex();
     }
-    return path;
+    return *queryIndex;
+}
+
+LoggedDay DataStore::loadLoggedDay(std::time_t since) const {
+    TRACE_SPAN("DataStore::loadLoggedDay", "persistence");
+    TransactionLog log(baseDirectory / "transactions");
+    log.load();
+    LoggedDay day;
+    for (const auto& segment : log.manifest()) {
+        day.lastReceiptId = std::max(day.lastReceiptId, segment.lastReceiptId);
+    }
+    log.scan(since, std::numeric_limits<std::time_t>::max(), [&](const std::string& line) {
+        if (auto record = TransactionLog::parseRecord(line)) {
+            day.records.push_back(std::move(*record));
+        }
+    });
+    return day;
+}
+
+std::filesystem::path DataStore::persistReport(const DailyReport& report, const Manager& manager) const {
+    TRACE_SPAN("DataStore::persistReport", "persistence");
+    return reportWriter.write(report, manager.getName(), manager.getId()).text;
+}
+
+std::future<ReportFiles> DataStore::persistReportAsync(DailyReport report, const Manager& manager) const {
+    TRACE_SPAN("DataStore::persistReportAsync", "persistence");
+    return reportWriter.writeAsync(std::move(report), manager.getName(), manager.getId());
 }
@@ -0,0 +1,287 @@
+#include "rate_feed.h"
+
+#include "metrics.h"
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::chrono::milliseconds kIdlePoll{100};
+    constexpr std::size_t kReadChunk = 64 * 1024;
+
+    bool parse_number(std::string_view text, double& value) {
+        text = trim_view(text);
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        return result.ec == std::errc() && result.ptr == text.data() + text.size();
+    }
+}
+
+RateFeed::RateFeed(ExchangeOffice& exchangeOffice, DataStore& persistence, std::mutex& sharedOfficeMutex, RateFeedOptions feedOptions)
+    : office(exchangeOffice),
+      store(persistence),
+      officeMutex(sharedOfficeMutex),
+      options(std::move(feedOptions)),
+      stopping(false),
+      descriptor(-1),
+      followingFile(false),
+      pendingCount(0) {}
+
+RateFeed::~RateFeed() {
+    stop();
+}
+
+std::optional<RateUpdate> RateFeed::parseLine(std::string_view line) {
+    std::array<std::string_view, 4> fields;
+    std::size_t count = 0;
+    while (count < fields.size()) {
+        auto comma = line.find(',');
+        fields[count++] = line.substr(0, comma);
+        if (comma == std::string_view::npos) {
+            line = {};
+            break;
+        }
+        line.remove_prefix(comma + 1);
+    }
+    if (count < 3 || !line.empty()) {
+        return std::nullopt;
+    }
+    try {
+        RateUpdate update{currency_from_string(std::string(trim_view(fields[0]))),
+                          currency_from_string(std::string(trim_view(fields[1]))),
+                          0.0,
+                          std::nullopt};
+        double margin = 0.0;
+        if (update.from == update.to || !parse_number(fields[2], update.mid) || update.mid <= 0.0) {
+            return std::nullopt;
+        }
+        if (count == 4) {
+            if (!parse_number(fields[3], margin) || margin < 0.0 || margin >= 0.5) {
+                return std::nullopt;
+            }
+            update.margin = margin;
+        }
+        // Margins are symmetric, so a reversed quote is the same pair at the inverse mid.
+        if (update.to < update.from) {
+            std::swap(update.from, update.to);
+            update.mid = 1.0 / update.mid;
+        }
+        return update;
+    } catch (const ExchangeError&) {
+        return std::nullopt;
+    }
+}
+
+void RateFeed::ingest(std::string_view line) {
+    line = trim_view(line);
+    if (line.empty()) {
+        return;
+    }
+    std::optional<RateUpdate> update = parseLine(line);
+    std::lock_guard<std::mutex> guard(statisticsMutex);
+    statistics.linesRead++;
+    if (!update) {
+        statistics.malformedLines++;
+        return;
+    }
+    OfficeMetrics::instance().feedUpdates.increment();
+    auto& slot = pending[static_cast<std::size_t>(update->from) * 4 + static_cast<std::size_t>(update->to)];
+    if (!slot) {
+        pendingCount++;
+    } else if (!update->margin) {
+        update->margin = slot->margin; // A margin seen earlier in the window still applies
+    }
+    slot = update;
+}
+
+void RateFeed::applyPending() {
+    TRACE_SPAN("RateFeed::applyPending", "exchange");
+    std::vector<RateUpdate> batch;
+    batch.reserve(pendingCount);
+    for (auto& slot : pending) {
+        if (slot) {
+            batch.push_back(*slot);
+            slot.reset();
+        }
+    }
+    pendingCount = 0;
+    {
+        std::lock_guard<std::mutex> guard(officeMutex);
+        office.applyRates(batch);
+    }
+    OfficeMetrics::instance().feedApplied.increment(batch.size());
+    std::lock_guard<std::mutex> guard(statisticsMutex);
+    statistics.updatesApplied += batch.size();
+    statistics.batchesApplied++;
+}
+
+void RateFeed::persist() {
+    // saveRates reads the board under the store's save lock, so a session's newer save is never overwritten.
+    store.saveRates(office);
+    std::lock_guard<std::mutex> guard(statisticsMutex);
+    statistics.saves++;
+}
+
+RateFeedStatistics RateFeed::stats() const {
+    std::lock_guard<std::mutex> guard(statisticsMutex);
+    return statistics;
+}
+
+#ifdef __linux__
+
+void RateFeed::start() {
+    struct stat info {};
+    if (::stat(options.source.c_str(), &info) != 0) {
+        throw ExchangeError("Unable to open rate feed " + options.source.string() + ": " + std::strerror(errno));
+    }
+    followingFile = !S_ISFIFO(info.st_mode);
+    // Holding the write end of a FIFO ourselves keeps it from reporting EOF between feed writers.
+    int flags = (followingFile ? O_RDONLY : O_RDWR) | O_NONBLOCK | O_CLOEXEC;
+    descriptor = ::open(options.source.c_str(), flags);
+    if (descriptor < 0) {
+        throw ExchangeError("Unable to open rate feed " + options.source.string() + ": " + std::strerror(errno));
+    }
+    // Like tail -f, a followed file is read from its current end; older lines are rates already superseded.
+    if (followingFile && ::lseek(descriptor, 0, SEEK_END) < 0) {
+        int error = errno;
+        ::close(descriptor);
+        descriptor = -1;
+        throw ExchangeError("Unable to seek rate feed " + options.source.string() + ": " + std::strerror(error));
+    }
+    worker = std::thread(&RateFeed::run, this);
+}
+
+void RateFeed::stop() {
+    if (stopping.exchange(true)) {
+        return;
+    }
+    if (worker.joinable()) {
+        worker.join();
+    }
+    if (descriptor >= 0) {
+        ::close(descriptor);
+        descriptor = -1;
+    }
+}
+
+bool RateFeed::readAvailable() {
+    char buffer[kReadChunk];
+    bool any = false;
+    while (true) {
+        ssize_t received = ::read(descriptor, buffer, sizeof(buffer));
+        if (received <= 0) {
+            if (received < 0 && errno == EINTR) {
+                continue;
+            }
+            return any;
+        }
+        any = true;
+        std::string_view chunk(buffer, static_cast<std::size_t>(received));
+        while (true) {
+            auto newline = chunk.find('\n');
+            if (newline == std::string_view::npos) {
+                partialLine.append(chunk);
+                break;
+            }
+            if (partialLine.empty()) {
+                ingest(chunk.substr(0, newline));
+            } else {
+                partialLine.append(chunk.substr(0, newline));
+                ingest(partialLine);
+                partialLine.clear();
+            }
+            chunk.remove_prefix(newline + 1);
+        }
+    }
+}
+
+void RateFeed::run() {
+    // SIGINT/SIGTERM belong to the session threads, not this one.
+    sigset_t all;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_BLOCK, &all, nullptr);
+
+    using Clock = std::chrono::steady_clock;
+    auto windowEnd = Clock::time_point::max();
+    auto nextSave = Clock::now();
+    bool unsaved = false;
+    while (!stopping.load(std::memory_order_relaxed)) {
+        auto now = Clock::now();
+        auto wait = pendingCount > 0 ? std::chrono::duration_cast<std::chrono::milliseconds>(windowEnd - now) : kIdlePoll;
+        wait = std::clamp(wait, std::chrono::milliseconds(0), kIdlePoll);
+        bool wasIdle = pendingCount == 0;
+        if (followingFile) {
+            if (!readAvailable()) {
+                std::this_thread::sleep_for(wait);
+            }
+        } else {
+            pollfd entry{descriptor, POLLIN, 0};
+            if (::poll(&entry, 1, static_cast<int>(wait.count())) > 0) {
+                readAvailable();
+            }
+        }
+
+        now = Clock::now();
+        if (wasIdle && pendingCount > 0) {
+            windowEnd = now + options.batchWindow;
+        }
+        try {
+            if (pendingCount > 0 && now >= windowEnd) {
+                applyPending();
+                windowEnd = Clock::time_point::max();
+                unsaved = true;
+            }
+            if (unsaved && now >= nextSave) {
+                persist();
+                unsaved = false;
+                nextSave = now + options.persistInterval;
+            }
+        } catch (const std::exception& error) {
+            std::cerr << "Rate feed update failed: " << error.what() << '\n';
+        }
+    }
+
+    try {
+        if (pendingCount > 0) {
+            applyPending();
+            unsaved = true;
+        }
+        if (unsaved) {
+            persist();
+        }
+    } catch (const std::exception& error) {
+        std::cerr << "Rate feed update failed: " << error.what() << '\n';
+    }
+}
+
+#else
+
+void RateFeed::start() {
+    throw ExchangeError("Rate feeds require Linux.");
+}
+
+void RateFeed::stop() {
+    stopping = true;
+}
+
+bool RateFeed::readAvailable() {
+    return false;
+}
+
+void RateFeed::run() {}
+
+#endif
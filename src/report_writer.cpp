@@ -0,0 +1,227 @@
+#include "report_writer.h"
+
+#include "trace.h"
+#include "utils.h"
+
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+#include <utility>
+
+namespace {
+    constexpr std::size_t kTextBytesPerRecord = 128;
+    constexpr std::size_t kCsvBytesPerRecord = 80;
+    constexpr std::size_t kJsonBytesPerRecord = 192;
+
+    void appendCsvField(std::string& out, const std::string& value) {
+        if (value.find_first_of(",\"\n") == std::string::npos) {
+            out.append(value);
+            return;
+        }
+        out.push_back('"');
+        for (char ch : value) {
+            if (ch == '"') {
+                out.push_back('"');
+            }
+            out.push_back(ch);
+        }
+        out.push_back('"');
+    }
+
+    void appendBalancesJson(std::string& out, const std::map<Currency, double>& balances) {
+        out.push_back('{');
+        bool first = true;
+        for (const auto& [currency, amount] : balances) {
+            if (!first) {
+                out.push_back(',');
+            }
+            first = false;
+            out.push_back('"');
+            out.append(to_string(currency));
+            out.append("\":");
+            append_fixed(out, amount);
+        }
+        out.push_back('}');
+    }
+
+    // Tells apart reports written by concurrent sessions within the same second.
+    std::atomic<unsigned> reportSequence{0};
+}
+
+RenderedReport ReportRenderer::render(const DailyReport& report, const std::string& managerName, int managerId) {
+    const auto& history = report.history();
+    RenderedReport rendered;
+    rendered.text.reserve(512 + history.size() * kTextBytesPerRecord);
+    rendered.csv.reserve(128 + history.size() * kCsvBytesPerRecord);
+    rendered.json.reserve(512 + history.size() * kJsonBytesPerRecord);
+
+    std::string& text = rendered.text;
+    std::string& csv = rendered.csv;
+    std::string& json = rendered.json;
+
+    std::time_t generated = report.generatedOn();
+    std::tm generatedInfo{};
+    char generatedText[32];
+    bool haveLocalTime = local_time(generated, generatedInfo)
+        && std::strftime(generatedText, sizeof(generatedText), "%Y-%m-%d %H:%M:%S", &generatedInfo) > 0;
+
+    text.append("Manager: ").append(managerName).append(" (ID ");
+    append_integer(text, managerId);
+    text.append(")\n");
+    if (haveLocalTime) {
+        text.append("Generated: ").append(generatedText).push_back('\n');
+    } else {
+        text.append("Generated (timestamp): ");
+        append_integer(text, static_cast<long long>(generated));
+        text.push_back('\n');
+    }
+    text.append("Profit (base currency): ");
+    append_fixed(text, report.profitInBase());
+    text.append("\n  Commission income: ");
+    append_fixed(text, report.commissionIncomeBase());
+    text.append("\n  Spread income: ");
+    append_fixed(text, report.spreadIncomeBase());
+    text.append("\n  Rebalancing cost: ");
+    append_fixed(text, report.rebalancingCostBase());
+    text.append("\n\nEnding reserves:\n");
+    for (const auto& [currency, balance] : report.endBalances()) {
+        text.append("  ").append(to_string(currency)).append(": ");
+        append_fixed(text, balance);
+        auto thresholdIt = report.criticalThresholds().find(currency);
+        if (thresholdIt != report.criticalThresholds().end()) {
+            text.append(" (critical min ");
+            append_fixed(text, thresholdIt->second);
+            text.push_back(')');
+        }
+        text.push_back('\n');
+    }
+    text.append("\nTransactions:\n");
+
+    csv.append("receipt_id,timestamp,cashier_id,cashier,client_id,client,source_currency,source_amount,profit_base,spread_base\n");
+
+    json.append("{\"manager\":{\"id\":");
+    append_integer(json, managerId);
+    json.append(",\"name\":");
+    append_json_string(json, managerName);
+    json.append("},\"generated\":");
+    append_integer(json, static_cast<long long>(generated));
+    json.append(",\"profit_base\":");
+    append_fixed(json, report.profitInBase());
+    json.append(",\"commission_base\":");
+    append_fixed(json, report.commissionIncomeBase());
+    json.append(",\"spread_base\":");
+    append_fixed(json, report.spreadIncomeBase());
+    json.append(",\"rebalancing_cost_base\":");
+    append_fixed(json, report.rebalancingCostBase());
+    json.append(",\"starting_reserves\":");
+    appendBalancesJson(json, report.startBalances());
+    json.append(",\"ending_reserves\":");
+    appendBalancesJson(json, report.endBalances());
+    json.append(",\"critical_minimums\":");
+    appendBalancesJson(json, report.criticalThresholds());
+    json.append(",\"transactions\":[");
+
+    bool firstRecord = true;
+    for (const auto& record : history) {
+        const std::string source = to_string(record.sourceCurrency);
+
+        text.append("  Receipt #");
+        append_integer(text, record.receiptId);
+        text.append(" | Cashier ").append(record.cashierName).append(" (ID ");
+        append_integer(text, record.cashierId);
+        text.append(") | Client ").append(record.clientName).append(" (ID ");
+        append_integer(text, record.clientId);
+        text.append(") | Source ").append(source).push_back(' ');
+        append_fixed(text, record.sourceAmount);
+        text.append(" | Profit base ");
+        append_fixed(text, record.profitInBaseCurrency);
+        text.append(" (spread ");
+        append_fixed(text, record.spreadInBaseCurrency);
+        text.append(")\n");
+
+        append_integer(csv, record.receiptId);
+        csv.push_back(',');
+        append_integer(csv, static_cast<long long>(record.timestamp));
+        csv.push_back(',');
+        append_integer(csv, record.cashierId);
+        csv.push_back(',');
+        appendCsvField(csv, record.cashierName);
+        csv.push_back(',');
+        append_integer(csv, record.clientId);
+        csv.push_back(',');
+        appendCsvField(csv, record.clientName);
+        csv.push_back(',');
+        csv.append(source).push_back(',');
+        append_fixed(csv, record.sourceAmount);
+        csv.push_back(',');
+        append_fixed(csv, record.profitInBaseCurrency);
+        csv.push_back(',');
+        append_fixed(csv, record.spreadInBaseCurrency);
+        csv.push_back('\n');
+
+        if (!firstRecord) {
+            json.push_back(',');
+        }
+        firstRecord = false;
+        json.append("{\"receipt_id\":");
+        append_integer(json, record.receiptId);
+        json.append(",\"timestamp\":");
+        append_integer(json, static_cast<long long>(record.timestamp));
+        json.append(",\"cashier_id\":");
+        append_integer(json, record.cashierId);
+        json.append(",\"cashier\":");
+        append_json_string(json, record.cashierName);
+        json.append(",\"client_id\":");
+        append_integer(json, record.clientId);
+        json.append(",\"client\":");
+        append_json_string(json, record.clientName);
+        json.append(",\"source_currency\":\"").append(source).append("\",\"source_amount\":");
+        append_fixed(json, record.sourceAmount);
+        json.append(",\"profit_base\":");
+        append_fixed(json, record.profitInBaseCurrency);
+        json.append(",\"spread_base\":");
+        append_fixed(json, record.spreadInBaseCurrency);
+        json.push_back('}');
+    }
+    json.append("]}\n");
+
+    return rendered;
+}
+
+ReportWriter::ReportWriter(std::filesystem::path directory) : outputDirectory(std::move(directory)) {}
+
+ReportFiles ReportWriter::write(const DailyReport& report, const std::string& managerName, int managerId) const {
+    TRACE_SPAN("ReportWriter::write", "persistence");
+    std::time_t timestamp = report.generatedOn();
+    std::tm timeInfo{};
+    char stamp[32];
+    if (local_time(timestamp, timeInfo)) {
+        std::strftime(stamp, sizeof(stamp), "report-%Y%m%d-%H%M%S", &timeInfo);
+    } else {
+        std::snprintf(stamp, sizeof(stamp), "report-%lld", static_cast<long long>(timestamp));
+    }
+    std::string stem = stamp;
+    stem.append("-m");
+    append_integer(stem, managerId);
+    stem.push_back('-');
+    append_integer(stem, ++reportSequence);
+
+    RenderedReport rendered = ReportRenderer::render(report, managerName, managerId);
+
+    ReportFiles files{
+        outputDirectory / (stem + ".txt"),
+        outputDirectory / (stem + ".csv"),
+        outputDirectory / (stem + ".json")
+    };
+    replace_file(files.text, rendered.text);
+    replace_file(files.csv, rendered.csv);
+    replace_file(files.json, rendered.json);
+    return files;
+}
+
+std::future<ReportFiles> ReportWriter::writeAsync(DailyReport report, std::string managerName, int managerId) const {
+    return std::async(std::launch::async,
+                      [writer = *this, report = std::move(report), managerName = std::move(managerName), managerId]() {
+                          return writer.write(report, managerName, managerId);
+                      });
+}
@@ -0,0 +1,236 @@
+#include "reserve_planner.h"
+
+#include "trace.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <limits>
+
+namespace {
+    constexpr double kEpsilon = 1e-9;
+    constexpr double kUnlimited = std::numeric_limits<double>::infinity();
+    constexpr std::array<Currency, 4> kCurrencies{Currency::USD, Currency::EUR, Currency::GBP, Currency::LOCAL};
+
+    // The next whole cent above the amount, so a covered currency ends above its requirement, not level with it.
+    double round_up_cents(double amount) {
+        return std::floor(amount * 100.0 + 1.0) / 100.0;
+    }
+
+    // Successive shortest paths with Bellman-Ford; the planning graph has ten nodes, so this solves in microseconds.
+    class MinCostFlow {
+    private:
+        struct Arc {
+            std::size_t to;
+            std::size_t reverse;
+            double capacity;
+            double cost;
+        };
+        std::vector<std::vector<Arc>> graph;
+
+    public:
+        explicit MinCostFlow(std::size_t nodes) : graph(nodes) {}
+
+        std::size_t addArc(std::size_t from, std::size_t to, double capacity, double cost) {
+            graph[from].push_back(Arc{to, graph[to].size(), capacity, cost});
+            graph[to].push_back(Arc{from, graph[from].size() - 1, 0.0, -cost});
+            return graph[from].size() - 1;
+        }
+
+        double flow(std::size_t from, std::size_t arc) const {
+            const Arc& forward = graph[from][arc];
+            return graph[forward.to][forward.reverse].capacity;
+        }
+
+        // Pushes up to `required` units from source to sink along cheapest paths; returns the total cost.
+        double solve(std::size_t source, std::size_t sink, double required) {
+            double totalCost = 0.0;
+            std::vector<double> distance(graph.size());
+            std::vector<std::size_t> previousNode(graph.size());
+            std::vector<std::size_t> previousArc(graph.size());
+            while (required > kEpsilon) {
+                std::fill(distance.begin(), distance.end(), kUnlimited);
+                distance[source] = 0.0;
+                for (std::size_t round = 0; round + 1 < graph.size(); ++round) {
+                    bool relaxed = false;
+                    for (std::size_t node = 0; node < graph.size(); ++node) {
+                        if (distance[node] == kUnlimited) {
+                            continue;
+                        }
+                        for (std::size_t index = 0; index < graph[node].size(); ++index) {
+                            const Arc& arc = graph[node][index];
+                            if (arc.capacity > kEpsilon && distance[node] + arc.cost < distance[arc.to] - kEpsilon) {
+                                distance[arc.to] = distance[node] + arc.cost;
+                                previousNode[arc.to] = node;
+                                previousArc[arc.to] = index;
+                                relaxed = true;
+                            }
+                        }
+                    }
+                    if (!relaxed) {
+                        break;
+                    }
+                }
+                if (distance[sink] == kUnlimited) {
+                    break;
+                }
+                double push = required;
+                for (std::size_t node = sink; node != source; node = previousNode[node]) {
+                    push = std::min(push, graph[previousNode[node]][previousArc[node]].capacity);
+                }
+                for (std::size_t node = sink; node != source; node = previousNode[node]) {
+                    Arc& arc = graph[previousNode[node]][previousArc[node]];
+                    arc.capacity -= push;
+                    graph[node][arc.reverse].capacity += push;
+                }
+                required -= push;
+                totalCost += push * distance[sink];
+            }
+            return totalCost;
+        }
+    };
+}
+
+bool RebalancePlan::empty() const {
+    return conversions.empty() && topUps.empty();
+}
+
+ReservePlanner::ReservePlanner(RebalanceOptions plannerOptions) : options(plannerOptions) {
+    if (options.horizonHours < 0.0 || options.windowHours <= 0.0 || options.topUpCost < 0.0) {
+        throw ExchangeError("Rebalancing needs a non-negative horizon and top-up cost and a positive window");
+    }
+}
+
+std::map<Currency, double> ReservePlanner::outflowRates(const std::vector<TransactionRecord>& transactions,
+                                                        std::time_t now,
+                                                        double windowHours) {
+    std::array<double, 4> net{};
+    std::time_t since = now - static_cast<std::time_t>(windowHours * 3600.0);
+    for (auto record = transactions.rbegin(); record != transactions.rend() && record->timestamp > since; ++record) {
+        net[static_cast<std::size_t>(record->sourceCurrency)] -= record->sourceAmount;
+        for (const auto& payout : record->payouts) {
+            net[static_cast<std::size_t>(payout.currency)] += payout.amountPaid;
+        }
+    }
+    std::map<Currency, double> rates;
+    for (Currency currency : kCurrencies) {
+        rates[currency] = std::max(0.0, net[static_cast<std::size_t>(currency)]) / windowHours;
+    }
+    return rates;
+}
+
+RebalancePlan ReservePlanner::plan(const ExchangeOffice& office, std::time_t now) const {
+    TRACE_SPAN("ReservePlanner::plan", "exchange");
+    auto rates = office.rateConfig();
+    RebalancePlan result;
+    result.outflowPerHour = outflowRates(office.transactionsToday(), now, options.windowHours);
+
+    // Node layout: source, surplus side per currency, shortfall side per currency, sink.
+    constexpr std::size_t kSource = 0;
+    constexpr std::size_t kSink = 9;
+    auto surplusNode = [](Currency currency) { return 1 + static_cast<std::size_t>(currency); };
+    auto shortfallNode = [](Currency currency) { return 5 + static_cast<std::size_t>(currency); };
+
+    std::array<double, 4> valueRate{};
+    std::array<double, 4> surplusValue{};
+    double shortfallTotal = 0.0;
+    MinCostFlow network(10);
+    for (Currency currency : kCurrencies) {
+        double required = office.criticalMinimum(currency) + result.outflowPerHour[currency] * options.horizonHours;
+        result.required[currency] = required;
+        if (!rates->canConvert(currency, rates->base())) {
+            continue; // Cannot be valued, so it takes no part in the plan
+        }
+        std::size_t index = static_cast<std::size_t>(currency);
+        valueRate[index] = rates->midRate(currency, rates->base());
+        double gap = (office.reserve().getBalance(currency) - required) * valueRate[index];
+        if (gap > kEpsilon) {
+            surplusValue[index] = gap;
+        } else if (gap < -kEpsilon) {
+            network.addArc(shortfallNode(currency), kSink, -gap, 0.0);
+            shortfallTotal -= gap;
+        }
+    }
+    if (shortfallTotal <= kEpsilon) {
+        return result;
+    }
+
+    std::map<std::pair<Currency, Currency>, std::size_t> conversionArcs;
+    for (Currency from : kCurrencies) {
+        std::size_t fromIndex = static_cast<std::size_t>(from);
+        if (surplusValue[fromIndex] <= 0.0) {
+            continue;
+        }
+        double dearestLoss = 0.0;
+        for (Currency to : kCurrencies) {
+            if (to == from || valueRate[static_cast<std::size_t>(to)] <= 0.0 || !rates->canConvert(from, to)) {
+                continue;
+            }
+            double kept = rates->quoteRate(from, to) / rates->midRate(from, to);
+            dearestLoss = std::max(dearestLoss, 1.0 - kept);
+            // Cost per unit of value delivered: the margin taken on the value sent.
+            conversionArcs[{from, to}] = network.addArc(surplusNode(from), shortfallNode(to), kUnlimited, 1.0 / kept - 1.0);
+        }
+        network.addArc(kSource, surplusNode(from), surplusValue[fromIndex] * (1.0 - dearestLoss), 0.0);
+    }
+    std::array<std::size_t, 4> topUpArcs{};
+    for (Currency currency : kCurrencies) {
+        if (valueRate[static_cast<std::size_t>(currency)] > 0.0) {
+            topUpArcs[static_cast<std::size_t>(currency)] = network.addArc(kSource, shortfallNode(currency), kUnlimited, options.topUpCost);
+        }
+    }
+
+    result.costBase = network.solve(kSource, kSink, shortfallTotal);
+
+    for (const auto& [pair, arc] : conversionArcs) {
+        double delivered = network.flow(surplusNode(pair.first), arc);
+        if (delivered <= kEpsilon) {
+            continue;
+        }
+        double amountTo = round_up_cents(delivered / valueRate[static_cast<std::size_t>(pair.second)]);
+        result.conversions.push_back(
+            ReserveConversion{pair.first, pair.second, amountTo / rates->quoteRate(pair.first, pair.second), amountTo});
+    }
+    for (Currency currency : kCurrencies) {
+        std::size_t index = static_cast<std::size_t>(currency);
+        if (valueRate[index] <= 0.0) {
+            continue;
+        }
+        double delivered = network.flow(kSource, topUpArcs[index]);
+        if (delivered > kEpsilon) {
+            result.topUps.push_back(ReserveTopUp{currency, round_up_cents(delivered / valueRate[index])});
+        }
+    }
+    return result;
+}
+
+std::string ReservePlanner::format(const RebalancePlan& plan, const std::map<Currency, double>& balances) {
+    char line[160];
+    std::string text = "\nCurrency         Balance    Outflow/h     Required\n";
+    for (const auto& [currency, required] : plan.required) {
+        auto balance = balances.find(currency);
+        auto outflow = plan.outflowPerHour.find(currency);
+        std::snprintf(line, sizeof(line), "%-8s %15.2f %12.2f %12.2f\n", to_string(currency).c_str(),
+                      balance != balances.end() ? balance->second : 0.0,
+                      outflow != plan.outflowPerHour.end() ? outflow->second : 0.0, required);
+        text += line;
+    }
+    if (plan.empty()) {
+        text += "Every currency covers its requirement; nothing to rebalance.\n";
+        return text;
+    }
+    for (const auto& conversion : plan.conversions) {
+        std::snprintf(line, sizeof(line), "Convert %.2f %s -> %.2f %s\n", conversion.amountFrom,
+                      to_string(conversion.from).c_str(), conversion.amountTo, to_string(conversion.to).c_str());
+        text += line;
+    }
+    for (const auto& topUp : plan.topUps) {
+        std::snprintf(line, sizeof(line), "Top up %.2f %s\n", topUp.amount, to_string(topUp.currency).c_str());
+        text += line;
+    }
+    std::snprintf(line, sizeof(line), "Estimated cost (base currency): %.2f\n", plan.costBase);
+    text += line;
+    return text;
+}
@@ -0,0 +1,421 @@
+#include "session_host.h"
+
+#include "utils.h"
+
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+
+#ifdef __linux__
+#include <csignal>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr std::size_t kMaxPendingInput = 64 * 1024;
+    constexpr int kMaxEvents = 64;
+}
+
+TerminalInput::TerminalInput(WorkerPool& workers)
+    : eof(false),
+      waiter(nullptr),
+      waiterSlot(nullptr),
+      pool(workers) {}
+
+bool TerminalInput::takeOrPark(std::coroutine_handle<> waiting, std::optional<std::string>& line) {
+    std::lock_guard<std::mutex> guard(mutex);
+    if (!lines.empty()) {
+        line = std::move(lines.front());
+        lines.pop_front();
+        return false;
+    }
+    if (eof) {
+        line.reset();
+        return false;
+    }
+    waiter = waiting;
+    waiterSlot = &line;
+    return true;
+}
+
+void TerminalInput::feed(const char* data, std::size_t size) {
+    std::coroutine_handle<> ready;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        partial.append(data, size);
+        std::size_t start = 0;
+        for (auto newline = partial.find('\n'); newline != std::string::npos; newline = partial.find('\n', start)) {
+            std::size_t end = newline;
+            if (end > start && partial[end - 1] == '\r') {
+                --end;
+            }
+            lines.emplace_back(partial, start, end - start);
+            start = newline + 1;
+        }
+        partial.erase(0, start);
+        if (partial.size() > kMaxPendingInput) {
+            partial.clear(); // An operator does not type 64 KiB without a newline
+        }
+        if (waiter && !lines.empty()) {
+            *waiterSlot = std::move(lines.front());
+            lines.pop_front();
+            ready = std::exchange(waiter, nullptr);
+        }
+    }
+    if (ready) {
+        pool.resume(ready);
+    }
+}
+
+void TerminalInput::close() {
+    std::coroutine_handle<> ready;
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        eof = true;
+        if (waiter) {
+            waiterSlot->reset();
+            ready = std::exchange(waiter, nullptr);
+        }
+    }
+    if (ready) {
+        pool.resume(ready);
+    }
+}
+
+bool TerminalInput::closed() const {
+    std::lock_guard<std::mutex> guard(mutex);
+    return eof && lines.empty();
+}
+
+SessionHost::SessionHost(ExchangeOffice& exchangeOffice, DataStore& persistence, std::mutex& sharedOfficeMutex, SessionHostOptions hostOptions)
+    : office(&exchangeOffice),
+      store(&persistence),
+      officeMutex(&sharedOfficeMutex),
+      network(nullptr),
+      options(std::move(hostOptions)),
+      pool(options.workerThreads),
+      epollDescriptor(-1),
+      listenDescriptor(-1),
+      wakeDescriptor(-1),
+      signalDescriptor(-1) {}
+
+SessionHost::SessionHost(BranchNetwork& branches, SessionHostOptions hostOptions)
+    : office(nullptr),
+      store(nullptr),
+      officeMutex(nullptr),
+      network(&branches),
+      options(std::move(hostOptions)),
+      pool(options.workerThreads),
+      epollDescriptor(-1),
+      listenDescriptor(-1),
+      wakeDescriptor(-1),
+      signalDescriptor(-1) {}
+
+SessionHost::~SessionHost() {
+    pool.stop();
+#ifdef __linux__
+    while (!terminals.empty()) {
+        closeTerminal(terminals.begin()->first);
+    }
+    for (int descriptor : {listenDescriptor, wakeDescriptor, signalDescriptor, epollDescriptor}) {
+        if (descriptor >= 0) {
+            ::close(descriptor);
+        }
+    }
+    if (options.endpoint && !options.endpoint->unixSocketPath.empty()) {
+        ::unlink(options.endpoint->unixSocketPath.c_str());
+    }
+#endif
+}
+
+Task<void> SessionHost::branchSession(Terminal& terminal) {
+    OutputSink& out = *terminal.output;
+    while (true) {
+        out << "\n=== Branches ===\n";
+        for (const auto& name : network->names()) {
+            out << name << '\n';
+        }
+        out << "Branch (* for the consolidated report): ";
+        out.flush();
+        std::optional<std::string> line = co_await terminal.input->readLine();
+        if (!line) {
+            co_return;
+        }
+        std::string name = trim(*line);
+        if (name == "*") {
+            out << BranchNetwork::format(network->consolidate());
+            continue;
+        }
+        Branch* branch = network->find(name);
+        if (!branch) {
+            out << "Unknown branch.\n";
+            continue;
+        }
+        {
+            std::lock_guard<std::mutex> guard(branch->mutex);
+            branch->openStore();
+        }
+        out << "Branch " << branch->name << ".\n";
+        terminal.ui = std::make_unique<ConsoleUI>(branch->office, branch->store, out, *terminal.input, branch->mutex);
+        co_await terminal.ui->session();
+        co_return;
+    }
+}
+
+#ifdef __linux__
+
+void SessionHost::openListener() {
+    int boundPort = -1;
+    listenDescriptor = open_listen_socket(*options.endpoint, boundPort);
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = listenDescriptor;
+    ::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, listenDescriptor, &event);
+    if (options.endpoint->unixSocketPath.empty()) {
+        std::cerr << "Terminal sessions on " << options.endpoint->host << ':' << boundPort << '\n';
+    } else {
+        std::cerr << "Terminal sessions on unix:" << options.endpoint->unixSocketPath << '\n';
+    }
+}
+
+void SessionHost::openPseudoTerminal(std::size_t index) {
+    int master = ::posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (master < 0 || ::grantpt(master) != 0 || ::unlockpt(master) != 0) {
+        if (master >= 0) {
+            ::close(master);
+        }
+        throw ExchangeError(std::string("Unable to allocate a pseudo-terminal: ") + std::strerror(errno));
+    }
+    char name[128];
+    if (::ptsname_r(master, name, sizeof(name)) != 0) {
+        ::close(master);
+        throw ExchangeError("Unable to name pseudo-terminal");
+    }
+    int slave = ::open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (slave < 0) {
+        ::close(master);
+        throw ExchangeError(std::string("Unable to open ") + name);
+    }
+    // Raw mode: the line discipline must neither echo our prompts back as input nor rewrite newlines.
+    termios settings{};
+    if (::tcgetattr(slave, &settings) == 0) {
+        ::cfmakeraw(&settings);
+        ::tcsetattr(slave, TCSANOW, &settings);
+    }
+    std::cerr << "Terminal " << index + 1 << " on " << name << '\n';
+    addTerminal(master, slave, name);
+}
+
+void SessionHost::acceptTerminals() {
+    while (true) {
+        // Terminal descriptors stay blocking: reads only follow readiness and output is written whole.
+        int descriptor = ::accept4(listenDescriptor, nullptr, nullptr, SOCK_CLOEXEC);
+        if (descriptor < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        addTerminal(descriptor, -1, "connection " + std::to_string(descriptor));
+        // The listener is non-blocking, so the loop ends on EAGAIN once the backlog is empty.
+    }
+}
+
+void SessionHost::addTerminal(int descriptor, int slaveDescriptor, std::string label) {
+    auto terminal = std::make_unique<Terminal>();
+    terminal->descriptor = descriptor;
+    terminal->slaveDescriptor = slaveDescriptor;
+    terminal->label = std::move(label);
+    terminal->input = std::make_unique<TerminalInput>(pool);
+    terminal->output = std::make_unique<DescriptorSink>(descriptor);
+
+    epoll_event event{};
+    event.events = EPOLLIN | EPOLLRDHUP;
+    event.data.fd = descriptor;
+    if (::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event) != 0) {
+        ::close(descriptor);
+        if (slaveDescriptor >= 0) {
+            ::close(slaveDescriptor);
+        }
+        return;
+    }
+    Terminal& added = *terminal;
+    terminals[descriptor] = std::move(terminal);
+    startSession(added);
+}
+
+void SessionHost::startSession(Terminal& terminal) {
+    Terminal* session = &terminal;
+    if (!network) {
+        terminal.ui = std::make_unique<ConsoleUI>(*office, *store, *terminal.output, *terminal.input, *officeMutex);
+    }
+    TerminalInput* input = terminal.input.get();
+    int descriptor = terminal.descriptor;
+    std::string label = terminal.label;
+    pool.post([this, session, input, descriptor, label]() {
+        spawn_task(network ? branchSession(*session) : session->ui->session(), [this, input, descriptor, label](std::exception_ptr error) {
+            if (error && !input->closed()) {
+                try {
+                    std::rethrow_exception(error);
+                } catch (const std::exception& failure) {
+                    std::cerr << "Session on " << label << " failed: " << failure.what() << '\n';
+                }
+            }
+            {
+                std::lock_guard<std::mutex> guard(finishedMutex);
+                finished.push_back(descriptor);
+            }
+            std::uint64_t one = 1;
+            [[maybe_unused]] auto written = ::write(wakeDescriptor, &one, sizeof(one));
+        });
+    });
+}
+
+void SessionHost::readTerminal(Terminal& terminal) {
+    char chunk[4096];
+    ssize_t received = ::read(terminal.descriptor, chunk, sizeof(chunk));
+    if (received > 0) {
+        terminal.input->feed(chunk, static_cast<std::size_t>(received));
+        return;
+    }
+    if (received < 0 && (errno == EINTR || errno == EAGAIN)) {
+        return;
+    }
+    // Operator gone: stop polling and let the session run into end of input.
+    ::epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, terminal.descriptor, nullptr);
+    terminal.input->close();
+}
+
+void SessionHost::reapFinished(bool stopping) {
+    std::vector<int> done;
+    {
+        std::lock_guard<std::mutex> guard(finishedMutex);
+        done.swap(finished);
+    }
+    for (int descriptor : done) {
+        auto found = terminals.find(descriptor);
+        if (found == terminals.end()) {
+            continue;
+        }
+        Terminal& terminal = *found->second;
+        terminal.output->flush();
+        if (terminal.slaveDescriptor >= 0 && !stopping && !terminal.input->closed()) {
+            startSession(terminal); // PTYs are kiosks: a new login screen after every quit
+        } else {
+            closeTerminal(descriptor);
+        }
+    }
+}
+
+void SessionHost::closeTerminal(int descriptor) {
+    auto found = terminals.find(descriptor);
+    if (found == terminals.end()) {
+        return;
+    }
+    Terminal& terminal = *found->second;
+    terminal.ui.reset();
+    try {
+        terminal.output->flush();
+    } catch (const std::exception&) {
+    }
+    terminal.output.reset();
+    ::epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, descriptor, nullptr);
+    ::close(descriptor);
+    if (terminal.slaveDescriptor >= 0) {
+        ::close(terminal.slaveDescriptor);
+    }
+    terminals.erase(found);
+}
+
+void SessionHost::run() {
+    std::signal(SIGPIPE, SIG_IGN); // A vanished operator surfaces as a write error in its own session
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    ::pthread_sigmask(SIG_BLOCK, &mask, nullptr);
+    signalDescriptor = ::signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    epollDescriptor = ::epoll_create1(EPOLL_CLOEXEC);
+    wakeDescriptor = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (signalDescriptor < 0 || epollDescriptor < 0 || wakeDescriptor < 0) {
+        throw ExchangeError(std::string("Unable to set up the session reactor: ") + std::strerror(errno));
+    }
+    for (int descriptor : {signalDescriptor, wakeDescriptor}) {
+        epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = descriptor;
+        ::epoll_ctl(epollDescriptor, EPOLL_CTL_ADD, descriptor, &event);
+    }
+
+    if (options.endpoint) {
+        openListener();
+    }
+    for (std::size_t i = 0; i < options.pseudoTerminals; ++i) {
+        openPseudoTerminal(i);
+    }
+    if (listenDescriptor < 0 && terminals.empty()) {
+        throw ExchangeError("Session host needs a listening endpoint or at least one PTY");
+    }
+
+    epoll_event events[kMaxEvents];
+    bool stopping = false;
+    while (!stopping || !terminals.empty()) {
+        int count = ::epoll_wait(epollDescriptor, events, kMaxEvents, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw ExchangeError(std::string("epoll_wait failed: ") + std::strerror(errno));
+        }
+        for (int i = 0; i < count; ++i) {
+            int descriptor = events[i].data.fd;
+            if (descriptor == listenDescriptor) {
+                acceptTerminals();
+            } else if (descriptor == wakeDescriptor) {
+                std::uint64_t value = 0;
+                [[maybe_unused]] auto drained = ::read(wakeDescriptor, &value, sizeof(value));
+                reapFinished(stopping);
+            } else if (descriptor == signalDescriptor) {
+                signalfd_siginfo info{};
+                while (::read(signalDescriptor, &info, sizeof(info)) == static_cast<ssize_t>(sizeof(info))) {
+                }
+                stopping = true;
+                if (listenDescriptor >= 0) {
+                    ::epoll_ctl(epollDescriptor, EPOLL_CTL_DEL, listenDescriptor, nullptr);
+                }
+                for (auto& [terminalDescriptor, terminal] : terminals) {
+                    terminal->input->close();
+                }
+            } else if (auto found = terminals.find(descriptor); found != terminals.end()) {
+                readTerminal(*found->second);
+            }
+        }
+    }
+
+    pool.stop();
+    ::pthread_sigmask(SIG_UNBLOCK, &mask, nullptr);
+}
+
+#else
+
+void SessionHost::openListener() {}
+void SessionHost::openPseudoTerminal(std::size_t) {}
+void SessionHost::acceptTerminals() {}
+void SessionHost::addTerminal(int, int, std::string) {}
+void SessionHost::startSession(Terminal&) {}
+void SessionHost::readTerminal(Terminal&) {}
+void SessionHost::reapFinished(bool) {}
+void SessionHost::closeTerminal(int) {}
+
+void SessionHost::run() {
+    throw ExchangeError("Multiplexed sessions require Linux (epoll).");
+}
+
+#endif
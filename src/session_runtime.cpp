@@ -0,0 +1,143 @@
+#include "session_runtime.h"
+
+#include "utils.h"
+
+#ifdef __linux__
+#include <csignal>
+#include <pthread.h>
+#endif
+
+namespace {
+    struct DetachedTask {
+        struct promise_type {
+            DetachedTask get_return_object() noexcept {
+                return {};
+            }
+
+            std::suspend_never initial_suspend() noexcept {
+                return {};
+            }
+
+            std::suspend_never final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() noexcept {}
+
+            void unhandled_exception() noexcept {
+                std::terminate();
+            }
+        };
+    };
+
+    DetachedTask runDetached(Task<void> task, std::function<void(std::exception_ptr)> done) {
+        std::exception_ptr error;
+        try {
+            co_await task;
+        } catch (...) {
+            error = std::current_exception();
+        }
+        done(error);
+    }
+}
+
+BlockingLineInput::BlockingLineInput(std::istream& source) : stream(source) {}
+
+bool BlockingLineInput::takeOrPark(std::coroutine_handle<>, std::optional<std::string>& line) {
+    std::string text;
+    if (std::getline(stream, text)) {
+        line = std::move(text);
+    } else {
+        line.reset();
+    }
+    return false;
+}
+
+bool BlockingLineInput::closed() const {
+    return !stream;
+}
+
+WorkerPool::WorkerPool(std::size_t threads) : stopping(false) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    workers.reserve(threads);
+    for (std::size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(&WorkerPool::work, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+void WorkerPool::work() {
+#ifdef __linux__
+    // Signals belong to whichever thread reads the signalfd, never to a worker mid-session.
+    sigset_t all;
+    sigfillset(&all);
+    ::pthread_sigmask(SIG_BLOCK, &all, nullptr);
+#endif
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]() {
+                return stopping || !jobs.empty();
+            });
+            if (jobs.empty()) {
+                return;
+            }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void WorkerPool::post(std::function<void()> job) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wake.notify_one();
+}
+
+void WorkerPool::resume(std::coroutine_handle<> coroutine) {
+    post([coroutine]() {
+        coroutine.resume();
+    });
+}
+
+void WorkerPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    workers.clear();
+}
+
+void spawn_task(Task<void> task, std::function<void(std::exception_ptr)> done) {
+    runDetached(std::move(task), std::move(done));
+}
+
+void run_blocking(Task<void> task) {
+    bool finished = false;
+    std::exception_ptr failure;
+    spawn_task(std::move(task), [&finished, &failure](std::exception_ptr error) {
+        finished = true;
+        failure = error;
+    });
+    if (!finished) {
+        throw ExchangeError("Blocking session suspended on asynchronous input");
+    }
+    if (failure) {
+        std::rethrow_exception(failure);
+    }
+}
@@ -0,0 +1,511 @@
+#include "snapshot.h"
+
+#include "utils.h"
+
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+    constexpr char kMagic[8] = {'C', 'X', 'S', 'N', 'A', 'P', '\0', '\0'};
+    constexpr std::size_t kHeaderSize = 32;
+
+    std::uint64_t fnv1a(const unsigned char* data, std::size_t size) {
+        std::uint64_t hash = 1469598103934665603ULL;
+        for (std::size_t i = 0; i < size; ++i) {
+            hash ^= data[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    class Writer {
+    private:
+        std::string& out;
+
+    public:
+        explicit Writer(std::string& target) : out(target) {}
+
+        void u8(std::uint8_t value) {
+            out.push_back(static_cast<char>(value));
+        }
+
+        void u16(std::uint16_t value) {
+            for (int shift = 0; shift < 16; shift += 8) {
+                u8(static_cast<std::uint8_t>(value >> shift));
+            }
+        }
+
+        void u32(std::uint32_t value) {
+            for (int shift = 0; shift < 32; shift += 8) {
+                u8(static_cast<std::uint8_t>(value >> shift));
+            }
+        }
+
+        void u64(std::uint64_t value) {
+            for (int shift = 0; shift < 64; shift += 8) {
+                u8(static_cast<std::uint8_t>(value >> shift));
+            }
+        }
+
+        void f64(double value) {
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            u64(bits);
+        }
+
+        void text(const std::string& value) {
+            if (value.size() > 0xFFFF) {
+                throw ExchangeError("Snapshot string too long");
+            }
+            u16(static_cast<std::uint16_t>(value.size()));
+            out.append(value);
+        }
+
+        void balances(const std::map<Currency, double>& entries) {
+            u32(static_cast<std::uint32_t>(entries.size()));
+            for (const auto& [currency, amount] : entries) {
+                u8(static_cast<std::uint8_t>(currency));
+                f64(amount);
+            }
+        }
+    };
+
+    class Reader {
+    private:
+        const unsigned char* cursor;
+        const unsigned char* end;
+
+        void require(std::size_t bytes) const {
+            if (static_cast<std::size_t>(end - cursor) < bytes) {
+                throw ExchangeError("Snapshot payload truncated");
+            }
+        }
+
+    public:
+        Reader(const unsigned char* data, std::size_t size) : cursor(data), end(data + size) {}
+
+        std::uint8_t u8() {
+            require(1);
+            return *cursor++;
+        }
+
+        std::uint16_t u16() {
+            require(2);
+            std::uint16_t value = static_cast<std::uint16_t>(cursor[0] | (cursor[1] << 8));
+            cursor += 2;
+            return value;
+        }
+
+        std::uint32_t u32() {
+            require(4);
+            std::uint32_t value = 0;
+            for (int i = 3; i >= 0; --i) {
+                value = (value << 8) | cursor[i];
+            }
+            cursor += 4;
+            return value;
+        }
+
+        std::uint64_t u64() {
+            require(8);
+            std::uint64_t value = 0;
+            for (int i = 7; i >= 0; --i) {
+                value = (value << 8) | cursor[i];
+            }
+            cursor += 8;
+            return value;
+        }
+
+        double f64() {
+            std::uint64_t bits = u64();
+            double value = 0.0;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+
+        Currency currency() {
+            std::uint8_t value = u8();
+            if (value > static_cast<std::uint8_t>(Currency::LOCAL)) {
+                throw ExchangeError("Snapshot contains an unknown currency id");
+            }
+            return static_cast<Currency>(value);
+        }
+
+        std::string text() {
+            std::uint16_t length = u16();
+            require(length);
+            std::string value(reinterpret_cast<const char*>(cursor), length);
+            cursor += length;
+            return value;
+        }
+
+        std::map<Currency, double> balances() {
+            std::map<Currency, double> entries;
+            std::uint32_t count = u32();
+            for (std::uint32_t i = 0; i < count; ++i) {
+                Currency currency = this->currency();
+                entries[currency] = f64();
+            }
+            return entries;
+        }
+
+        bool exhausted() const {
+            return cursor == end;
+        }
+    };
+
+    // Read-only view of the snapshot file, memory-mapped where the platform allows it.
+    class MappedFile {
+    private:
+        const unsigned char* bytes;
+        std::size_t length;
+#ifdef _WIN32
+        std::vector<unsigned char> buffer;
+#endif
+
+    public:
+        explicit MappedFile(const std::filesystem::path& path) : bytes(nullptr), length(0) {
+#ifdef _WIN32
+            std::ifstream input(path, std::ios::binary | std::ios::ate);
+            if (!input) {
+                throw ExchangeError("Unable to open snapshot " + path.string());
+            }
+            buffer.resize(static_cast<std::size_t>(input.tellg()));
+            input.seekg(0);
+            input.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+            bytes = buffer.data();
+            length = buffer.size();
+#else
+            int descriptor = ::open(path.c_str(), O_RDONLY);
+            if (descriptor < 0) {
+                throw ExchangeError("Unable to open snapshot " + path.string());
+            }
+            struct stat info {};
+            if (::fstat(descriptor, &info) != 0) {
+                ::close(descriptor);
+                throw ExchangeError("Unable to stat snapshot " + path.string());
+            }
+            length = static_cast<std::size_t>(info.st_size);
+            if (length > 0) {
+                void* mapped = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, descriptor, 0);
+                if (mapped == MAP_FAILED) {
+                    ::close(descriptor);
+                    throw ExchangeError("Unable to map snapshot " + path.string());
+                }
+                bytes = static_cast<const unsigned char*>(mapped);
+            }
+            ::close(descriptor);
+#endif
+        }
+
+        ~MappedFile() {
+#ifndef _WIN32
+            if (bytes != nullptr) {
+                ::munmap(const_cast<unsigned char*>(bytes), length);
+            }
+#endif
+        }
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+
+        const unsigned char* data() const {
+            return bytes;
+        }
+
+        std::size_t size() const {
+            return length;
+        }
+    };
+}
+
+std::string SnapshotCodec::encode(const OfficeSnapshot& snapshot) {
+    std::string payload;
+    payload.reserve(256 + snapshot.people.size() * 32 + snapshot.transactions.size() * 128);
+    Writer body(payload);
+    body.u64(snapshot.journalSequence);
+    body.u8(static_cast<std::uint8_t>(snapshot.baseCurrency));
+    body.f64(snapshot.commissionRate);
+    body.u32(static_cast<std::uint32_t>(snapshot.nextReceiptId));
+    body.f64(snapshot.profitInBase);
+    body.f64(snapshot.spreadIncomeBase);
+    body.balances(snapshot.reserve);
+    body.balances(snapshot.startOfDayReserve);
+    body.balances(snapshot.criticalMinimums);
+    body.u32(static_cast<std::uint32_t>(snapshot.rates.size()));
+    for (const auto& [from, to, rate, margin] : snapshot.rates) {
+        body.u8(static_cast<std::uint8_t>(from));
+        body.u8(static_cast<std::uint8_t>(to));
+        body.f64(rate);
+        body.f64(margin);
+    }
+    body.u32(static_cast<std::uint32_t>(snapshot.people.size()));
+    for (const auto& person : snapshot.people) {
+        body.u32(static_cast<std::uint32_t>(person.id));
+        body.text(person.role);
+        body.text(person.name);
+    }
+    body.u64(static_cast<std::uint64_t>(snapshot.cashierMonthStart));
+    body.u32(static_cast<std::uint32_t>(snapshot.cashierTotals.size()));
+    for (const auto& [cashierId, totals] : snapshot.cashierTotals) {
+        body.u32(static_cast<std::uint32_t>(cashierId));
+        body.text(totals.name);
+        body.f64(totals.dayProfitBase);
+        body.u64(totals.dayTransactions);
+        body.f64(totals.monthProfitBase);
+        body.u64(totals.monthTransactions);
+    }
+    // Most buckets are empty, so each currency's ring is a bitmask followed by the non-zero days.
+    body.u32(static_cast<std::uint32_t>(snapshot.clientWindows.size()));
+    for (const auto& window : snapshot.clientWindows) {
+        body.u32(static_cast<std::uint32_t>(window.clientId));
+        body.u32(static_cast<std::uint32_t>(window.newestDay));
+        for (const auto& days : window.buckets) {
+            std::uint8_t present = 0;
+            for (std::size_t day = 0; day < days.size(); ++day) {
+                present |= days[day] != 0.0 ? static_cast<std::uint8_t>(1u << day) : 0;
+            }
+            body.u8(present);
+            for (double amount : days) {
+                if (amount != 0.0) {
+                    body.f64(amount);
+                }
+            }
+        }
+    }
+    body.u32(static_cast<std::uint32_t>(snapshot.transactions.size()));
+    for (const auto& record : snapshot.transactions) {
+        body.u32(static_cast<std::uint32_t>(record.receiptId));
+        body.u32(static_cast<std::uint32_t>(record.cashierId));
+        body.text(record.cashierName);
+        body.u32(static_cast<std::uint32_t>(record.clientId));
+        body.text(record.clientName);
+        body.u8(static_cast<std::uint8_t>(record.sourceCurrency));
+        body.f64(record.sourceAmount);
+        body.f64(record.profitInBaseCurrency);
+        body.u64(static_cast<std::uint64_t>(record.timestamp));
+        body.f64(record.spreadInBaseCurrency);
+        body.u32(static_cast<std::uint32_t>(record.payouts.size()));
+        for (const auto& payout : record.payouts) {
+            body.u8(static_cast<std::uint8_t>(payout.currency));
+            body.f64(payout.amountPaid);
+            body.f64(payout.commissionTaken);
+            body.f64(payout.sourceAmount);
+            body.f64(payout.spreadTaken);
+            body.u32(static_cast<std::uint32_t>(payout.denominations.size()));
+            for (int note : payout.denominations) {
+                body.u32(static_cast<std::uint32_t>(note));
+            }
+        }
+    }
+    body.f64(snapshot.rebalancingCostBase);
+
+    std::string image;
+    image.reserve(kHeaderSize + payload.size());
+    image.append(kMagic, sizeof(kMagic));
+    Writer header(image);
+    header.u32(kVersion);
+    header.u32(0);
+    header.u64(payload.size());
+    header.u64(fnv1a(reinterpret_cast<const unsigned char*>(payload.data()), payload.size()));
+    image.append(payload);
+    return image;
+}
+
+bool SnapshotCodec::decode(const unsigned char* data, std::size_t size, OfficeSnapshot& snapshot, std::string& error) {
+    if (size < kHeaderSize || std::memcmp(data, kMagic, sizeof(kMagic)) != 0) {
+        error = "not a state snapshot";
+        return false;
+    }
+    try {
+        Reader header(data + sizeof(kMagic), kHeaderSize - sizeof(kMagic));
+        std::uint32_t version = header.u32();
+        (void)header.u32();
+        std::uint64_t payloadSize = header.u64();
+        std::uint64_t checksum = header.u64();
+        if (version < 1 || version > kVersion) {
+            error = "unsupported snapshot version " + std::to_string(version);
+            return false;
+        }
+        if (payloadSize != size - kHeaderSize) {
+            error = "snapshot size mismatch";
+            return false;
+        }
+        const unsigned char* payload = data + kHeaderSize;
+        if (fnv1a(payload, static_cast<std::size_t>(payloadSize)) != checksum) {
+            error = "snapshot checksum mismatch";
+            return false;
+        }
+
+        Reader body(payload, static_cast<std::size_t>(payloadSize));
+        OfficeSnapshot decoded;
+        decoded.journalSequence = body.u64();
+        decoded.baseCurrency = body.currency();
+        decoded.commissionRate = body.f64();
+        decoded.nextReceiptId = static_cast<int>(body.u32());
+        decoded.profitInBase = body.f64();
+        decoded.spreadIncomeBase = version >= 2 ? body.f64() : 0.0;
+        decoded.reserve = body.balances();
+        decoded.startOfDayReserve = body.balances();
+        decoded.criticalMinimums = body.balances();
+        std::uint32_t rateCount = body.u32();
+        decoded.rates.reserve(rateCount);
+        for (std::uint32_t i = 0; i < rateCount; ++i) {
+            Currency from = body.currency();
+            Currency to = body.currency();
+            double rate = body.f64();
+            decoded.rates.push_back(PairRate{from, to, rate, version >= 2 ? body.f64() : 0.0});
+        }
+        std::uint32_t peopleCount = body.u32();
+        decoded.people.reserve(peopleCount);
+        for (std::uint32_t i = 0; i < peopleCount; ++i) {
+            int id = static_cast<int>(body.u32());
+            std::string role = body.text();
+            std::string name = body.text();
+            decoded.people.push_back(PersonEntry{id, std::move(role), std::move(name)});
+        }
+        if (version >= 3) {
+            decoded.cashierMonthStart = static_cast<std::time_t>(body.u64());
+            std::uint32_t cashierCount = body.u32();
+            for (std::uint32_t i = 0; i < cashierCount; ++i) {
+                int id = static_cast<int>(body.u32());
+                CashierTotals& totals = decoded.cashierTotals[id];
+                totals.name = body.text();
+                totals.dayProfitBase = body.f64();
+                totals.dayTransactions = static_cast<std::size_t>(body.u64());
+                totals.monthProfitBase = body.f64();
+                totals.monthTransactions = static_cast<std::size_t>(body.u64());
+            }
+        }
+        if (version >= 4) {
+            std::uint32_t windowCount = body.u32();
+            decoded.clientWindows.resize(windowCount);
+            for (auto& window : decoded.clientWindows) {
+                window.clientId = static_cast<int>(body.u32());
+                window.newestDay = static_cast<std::int32_t>(body.u32());
+                for (auto& days : window.buckets) {
+                    std::uint8_t present = body.u8();
+                    for (std::size_t day = 0; day < days.size(); ++day) {
+                        days[day] = (present >> day) & 1u ? body.f64() : 0.0;
+                    }
+                }
+            }
+        }
+        if (version >= 5) {
+            std::uint32_t transactionCount = body.u32();
+            decoded.transactions.reserve(transactionCount);
+            for (std::uint32_t i = 0; i < transactionCount; ++i) {
+                TransactionRecord record{};
+                record.receiptId = static_cast<int>(body.u32());
+                record.cashierId = static_cast<int>(body.u32());
+                record.cashierName = body.text();
+                record.clientId = static_cast<int>(body.u32());
+                record.clientName = body.text();
+                record.sourceCurrency = body.currency();
+                record.sourceAmount = body.f64();
+                record.profitInBaseCurrency = body.f64();
+                record.timestamp = static_cast<std::time_t>(body.u64());
+                record.spreadInBaseCurrency = body.f64();
+                record.payouts.resize(body.u32());
+                for (auto& payout : record.payouts) {
+                    payout.currency = body.currency();
+                    payout.amountPaid = body.f64();
+                    payout.commissionTaken = body.f64();
+                    payout.sourceAmount = body.f64();
+                    payout.spreadTaken = body.f64();
+                    payout.denominations.resize(body.u32());
+                    for (int& note : payout.denominations) {
+                        note = static_cast<int>(body.u32());
+                    }
+                }
+                decoded.transactions.push_back(std::move(record));
+            }
+        }
+        decoded.rebalancingCostBase = version >= 6 ? body.f64() : 0.0;
+        if (!body.exhausted()) {
+            error = "trailing bytes after snapshot payload";
+            return false;
+        }
+        snapshot = std::move(decoded);
+        return true;
+    } catch (const ExchangeError& failure) {
+        error = failure.what();
+        return false;
+    }
+}
+
+std::optional<OfficeSnapshot> SnapshotCodec::readFile(const std::filesystem::path& path, std::string& error) {
+    try {
+        MappedFile file(path);
+        OfficeSnapshot snapshot;
+        if (file.data() == nullptr || !decode(file.data(), file.size(), snapshot, error)) {
+            if (error.empty()) {
+                error = "empty snapshot file";
+            }
+            return std::nullopt;
+        }
+        return snapshot;
+    } catch (const ExchangeError& failure) {
+        error = failure.what();
+        return std::nullopt;
+    }
+}
+
+void SnapshotCodec::writeFile(const std::filesystem::path& path, const OfficeSnapshot& snapshot) {
+    std::string image = encode(snapshot);
+    auto temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        output.write(image.data(), static_cast<std::streamsize>(image.size()));
+        if (!output) {
+            throw ExchangeError("Failed to write snapshot " + temporary.string());
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
+
+OfficeSnapshot SnapshotCodec::capture(const ExchangeOffice& office, std::vector<PersonEntry> people, std::uint64_t journalSequence) {
+    return OfficeSnapshot{
+        journalSequence,
+        office.rateConfig()->base(),
+        office.commissionRate(),
+        office.nextReceiptNumber(),
+        office.currentProfitBase(),
+        office.currentSpreadIncomeBase(),
+        office.reserve().allBalances(),
+        office.startOfDayReserve().allBalances(),
+        office.criticalMinimumsMap(),
+        office.rateConfig()->serialize(),
+        std::move(people),
+        office.cashierMonthStart(),
+        office.cashierTotalsMap(),
+        office.clientLimitTracker().activeWindows(std::time(nullptr)),
+        office.transactionsToday(),
+        office.currentRebalancingCostBase()
+    };
+}
+
+std::unique_ptr<ExchangeOffice> SnapshotCodec::buildOffice(const OfficeSnapshot& snapshot) {
+    RateTable rates(snapshot.baseCurrency);
+    for (const auto& [from, to, rate, margin] : snapshot.rates) {
+        rates.setRate(from, to, rate);
+        rates.setMargin(from, to, margin);
+    }
+    auto office = std::make_unique<ExchangeOffice>(rates, Reserve(snapshot.reserve), snapshot.commissionRate);
+    office->initializeCriticalMinimums(snapshot.criticalMinimums);
+    office->restoreDailyState(Reserve(snapshot.startOfDayReserve), snapshot.profitInBase, snapshot.spreadIncomeBase,
+                              snapshot.rebalancingCostBase, snapshot.nextReceiptId);
+    office->restoreCashierTotals(snapshot.cashierTotals, snapshot.cashierMonthStart);
+    office->restoreClientWindows(snapshot.clientWindows);
+    office->restoreDailyTransactions(snapshot.transactions);
+    return office;
+}
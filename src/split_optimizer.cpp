@@ -0,0 +1,182 @@
+#include "split_optimizer.h"
+
+#include "trace.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+
+namespace {
+    constexpr double kCent = 0.01;
+
+    struct Candidate {
+        SplitTarget target;
+        double sourceCap;      // Most source this currency can take
+        double payoutPerUnit;  // Payout value per unit of source, in the base currency
+        bool limitBound;
+    };
+}
+
+SplitPlan SplitOptimizer::plan(const ExchangeOffice& office, const ExchangeRequest& request, const SplitPreferences& preferences,
+                               std::time_t now) {
+    TRACE_SPAN("SplitOptimizer::plan", "exchange");
+    auto rates = office.rateConfig();
+    const ClientLimitTracker& limits = office.clientLimitTracker();
+    Currency source = request.sourceCurrency;
+    double kept = 1.0 - office.commissionRate();
+    auto value_rate = [&](Currency currency) {
+        return rates->canConvert(currency, rates->base()) ? rates->midRate(currency, rates->base()) : 0.0;
+    };
+
+    std::array<bool, 4> seen{};
+    std::vector<Candidate> candidates;
+    candidates.reserve(preferences.targets.size());
+    for (const auto& target : preferences.targets) {
+        std::size_t index = static_cast<std::size_t>(target.currency);
+        if (seen[index]) {
+            continue;
+        }
+        seen[index] = true;
+        if (target.currency == source) {
+            // Keeping the source always ranks first at mid and no commission; it takes what the others leave instead.
+            continue;
+        }
+        if (!rates->canConvert(source, target.currency)) {
+            continue;
+        }
+        double quote = rates->quoteRate(source, target.currency);
+        double balance = office.reserve().getBalance(target.currency);
+        // Gross conversion is withdrawn; the commission comes back, so the balance drops by the payout.
+        double grossCap = std::min(balance, (balance - office.criticalMinimum(target.currency)) / kept);
+        if (target.maxPayout > 0.0) {
+            grossCap = std::min(grossCap, target.maxPayout / kept);
+        }
+        bool limitBound = false;
+        if (limits.enabled()) {
+            double headroom = limits.headroom(request.clientId, target.currency, now);
+            limitBound = headroom < grossCap;
+            grossCap = std::min(grossCap, headroom);
+        }
+        candidates.push_back(Candidate{target, std::max(0.0, grossCap) / quote, quote * kept * value_rate(target.currency), limitBound});
+    }
+
+    if (preferences.objective == SplitObjective::ClientPayout) {
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const Candidate& left, const Candidate& right) { return left.payoutPerUnit > right.payoutPerUnit; });
+    } else if (preferences.objective == SplitObjective::OfficeProfit) {
+        std::stable_sort(candidates.begin(), candidates.end(),
+                         [](const Candidate& left, const Candidate& right) { return left.payoutPerUnit < right.payoutPerUnit; });
+    }
+
+    SplitPlan result;
+    double budget = request.totalAmount;
+    bool limitBound = false;
+    if (limits.enabled()) {
+        double headroom = limits.headroom(request.clientId, source, now);
+        limitBound = headroom < budget;
+        budget = std::min(budget, headroom);
+    }
+    double sourceValue = value_rate(source);
+    for (const auto& candidate : candidates) {
+        if (budget < kCent) {
+            break;
+        }
+        double slice = budget;
+        if (candidate.sourceCap < budget) {
+            slice = std::floor(candidate.sourceCap / kCent) * kCent; // Whole cents, so rounding never overdraws
+            limitBound = limitBound || candidate.limitBound;
+        }
+        if (slice < kCent) {
+            continue;
+        }
+        budget -= slice;
+        Currency target = candidate.target.currency;
+        double quote = rates->quoteRate(source, target);
+        result.portions.emplace_back(target, slice);
+        result.payouts.push_back(slice * quote * kept);
+        result.payoutBase += slice * candidate.payoutPerUnit;
+        result.profitBase += slice * sourceValue - slice * candidate.payoutPerUnit;
+    }
+    if (result.portions.empty()) {
+        if (limitBound) {
+            throw LimitExceededError("Client " + std::to_string(request.clientId) + " has no limit headroom in the accepted currencies");
+        }
+        char message[160];
+        std::snprintf(message, sizeof(message), "None of the accepted currencies can pay out any of %.2f %s", request.totalAmount,
+                      to_string(source).c_str());
+        throw ReserveError(message);
+    }
+    double placed = 0.0;
+    for (const auto& portion : result.portions) {
+        placed += portion.sourceAmount;
+    }
+    result.returnedSource = request.totalAmount - placed;
+    return result;
+}
+
+SplitPreferences SplitOptimizer::parse(const std::string& specification) {
+    auto colon = specification.find(':');
+    if (colon == std::string::npos) {
+        throw ExchangeError("Automatic split must look like prefer:EUR;USD, payout:... or profit:...");
+    }
+    SplitPreferences preferences;
+    std::string objective = trim(specification.substr(0, colon));
+    if (objective == "prefer") {
+        preferences.objective = SplitObjective::Preference;
+    } else if (objective == "payout") {
+        preferences.objective = SplitObjective::ClientPayout;
+    } else if (objective == "profit") {
+        preferences.objective = SplitObjective::OfficeProfit;
+    } else {
+        throw ExchangeError("Unknown split objective '" + objective + "' (prefer, payout or profit)");
+    }
+    std::size_t start = colon + 1;
+    while (start <= specification.size()) {
+        auto separator = specification.find(';', start);
+        std::string part = trim(specification.substr(start, separator == std::string::npos ? std::string::npos : separator - start));
+        if (!part.empty()) {
+            SplitTarget target{Currency::LOCAL, 0.0};
+            auto cap = part.find("<=");
+            target.currency = currency_from_string(trim(part.substr(0, cap)));
+            if (cap != std::string::npos) {
+                try {
+                    target.maxPayout = std::stod(part.substr(cap + 2));
+                } catch (const std::exception&) {
+                    throw ExchangeError("Invalid payout cap in '" + part + "'");
+                }
+                if (target.maxPayout <= 0.0) {
+                    throw ExchangeError("Payout caps must be positive");
+                }
+            }
+            preferences.targets.push_back(target);
+        }
+        if (separator == std::string::npos) {
+            break;
+        }
+        start = separator + 1;
+    }
+    if (preferences.targets.empty()) {
+        throw ExchangeError("Automatic split needs at least one currency");
+    }
+    return preferences;
+}
+
+std::string SplitOptimizer::format(const SplitPlan& plan, Currency source) {
+    char line[160];
+    std::string text;
+    for (std::size_t i = 0; i < plan.portions.size(); ++i) {
+        std::snprintf(line, sizeof(line), "  %.2f %s -> %.2f %s\n", plan.portions[i].sourceAmount, to_string(source).c_str(),
+                      plan.payouts[i], to_string(plan.portions[i].targetCurrency).c_str());
+        text += line;
+    }
+    if (plan.returnedSource >= kCent) {
+        std::snprintf(line, sizeof(line), "  %.2f %s returned to the client\n", plan.returnedSource, to_string(source).c_str());
+        text += line;
+    }
+    std::snprintf(line, sizeof(line), "  Payout value %.2f, office profit %.2f (base currency)\n", plan.payoutBase, plan.profitBase);
+    text += line;
+    return text;
+}
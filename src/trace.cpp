@@ -0,0 +1,152 @@
+#include "trace.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace {
+    struct TraceEvent {
+        const char* name;
+        const char* category;
+        std::int64_t startNanos;
+        std::int64_t durationNanos;
+    };
+
+    // One thread's ring. The owner is the only writer, so its mutex is uncontended except while a dump runs.
+    struct ThreadRing {
+        std::mutex mutex;
+        std::vector<TraceEvent> events;
+        std::uint64_t written = 0;
+        int threadId = 0;
+        bool inUse = true;
+    };
+
+    class RingRegistry {
+    private:
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadRing>> rings;
+        int nextThreadId = 1;
+
+    public:
+        const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+        // Rings outlive their threads so a dump still shows work done by threads that have exited;
+        // a new thread takes over a released ring (and its track) before another is allocated.
+        ThreadRing* acquire() {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (auto& existing : rings) {
+                std::lock_guard<std::mutex> ringGuard(existing->mutex);
+                if (!existing->inUse) {
+                    existing->inUse = true;
+                    return existing.get();
+                }
+            }
+            auto ring = std::make_unique<ThreadRing>();
+            ring->events.resize(Tracer::kEventsPerThread);
+            ring->threadId = nextThreadId++;
+            rings.push_back(std::move(ring));
+            return rings.back().get();
+        }
+
+        template <typename Visitor>
+        void forEach(Visitor&& visit) {
+            std::lock_guard<std::mutex> guard(mutex);
+            for (auto& ring : rings) {
+                std::lock_guard<std::mutex> ringGuard(ring->mutex);
+                visit(*ring);
+            }
+        }
+    };
+
+    RingRegistry& ringRegistry() {
+        static RingRegistry registry;
+        return registry;
+    }
+
+    struct RingLease {
+        ThreadRing* ring = nullptr;
+
+        ~RingLease() {
+            if (ring) {
+                std::lock_guard<std::mutex> guard(ring->mutex);
+                ring->inUse = false;
+            }
+        }
+    };
+
+    thread_local RingLease lease;
+
+    void appendMicros(std::string& out, std::int64_t nanos) {
+        append_integer(out, nanos / 1000);
+        out.push_back('.');
+        auto fraction = static_cast<int>(nanos % 1000);
+        out.push_back(static_cast<char>('0' + fraction / 100));
+        out.push_back(static_cast<char>('0' + fraction / 10 % 10));
+        out.push_back(static_cast<char>('0' + fraction % 10));
+    }
+}
+
+void Tracer::record(const char* name, const char* category,
+                    std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point end) {
+    auto& registry = ringRegistry();
+    if (!lease.ring) {
+        lease.ring = registry.acquire();
+    }
+    ThreadRing& ring = *lease.ring;
+    TraceEvent event{
+        name,
+        category,
+        // The first span can start before the registry (and its epoch) exists.
+        std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(start - registry.epoch).count()),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()
+    };
+    std::lock_guard<std::mutex> guard(ring.mutex);
+    ring.events[ring.written % kEventsPerThread] = event;
+    ++ring.written;
+}
+
+std::size_t Tracer::writeChromeTrace(const std::filesystem::path& path) {
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    std::size_t count = 0;
+    auto separator = [&json, &count]() {
+        json += count++ == 0 ? "\n" : ",\n";
+    };
+    ringRegistry().forEach([&](const ThreadRing& ring) {
+        separator();
+        json += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+        append_integer(json, ring.threadId);
+        json += ",\"args\":{\"name\":\"thread ";
+        append_integer(json, ring.threadId);
+        json += "\"}}";
+
+        std::uint64_t first = ring.written > kEventsPerThread ? ring.written - kEventsPerThread : 0;
+        for (std::uint64_t index = first; index < ring.written; ++index) {
+            const TraceEvent& event = ring.events[index % kEventsPerThread];
+            separator();
+            json += "{\"name\":";
+            append_json_string(json, event.name);
+            json += ",\"cat\":";
+            append_json_string(json, event.category);
+            json += ",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            append_integer(json, ring.threadId);
+            json += ",\"ts\":";
+            appendMicros(json, event.startNanos);
+            json += ",\"dur\":";
+            appendMicros(json, event.durationNanos);
+            json += '}';
+        }
+    });
+    json += "\n]}\n";
+
+    std::ofstream output(path, std::ios::trunc);
+    output << json;
+    if (!output) {
+        throw ExchangeError("Unable to write trace " + path.string());
+    }
+    return count;
+}
@@ -0,0 +1,546 @@
+#include "transaction_log.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <sstream>
+#include <utility>
+
+namespace {
+    constexpr const char* kManifestHeader = "# sequence|first_receipt|last_receipt|first_ts|last_ts|bytes|records|sealed";
+
+    bool parseLineHead(const std::string& line, time_t& timestamp, int& receiptId) {
+        const char* begin = line.data();
+        const char* end = begin + line.size();
+        long long seconds = 0;
+        auto stampResult = std::from_chars(begin, end, seconds);
+        if (stampResult.ec != std::errc() || stampResult.ptr == end || *stampResult.ptr != '|') {
+            return false;
+        }
+        auto idResult = std::from_chars(stampResult.ptr + 1, end, receiptId);
+        if (idResult.ec != std::errc()) {
+            return false;
+        }
+        timestamp = static_cast<time_t>(seconds);
+        return true;
+    }
+
+    int dayKey(time_t timestamp) {
+        std::tm info{};
+        if (!local_time(timestamp, info)) {
+            return static_cast<int>(timestamp / 86400);
+        }
+        return (info.tm_year + 1900) * 10000 + (info.tm_mon + 1) * 100 + info.tm_mday;
+    }
+
+    void recordLine(LogSegmentInfo& segment, int receiptId, time_t timestamp, std::size_t lineBytes) {
+        if (segment.records == 0) {
+            segment.firstReceiptId = receiptId;
+            segment.lastReceiptId = receiptId;
+            segment.firstTimestamp = timestamp;
+            segment.lastTimestamp = timestamp;
+        } else {
+            segment.firstReceiptId = std::min(segment.firstReceiptId, receiptId);
+            segment.lastReceiptId = std::max(segment.lastReceiptId, receiptId);
+            segment.firstTimestamp = std::min(segment.firstTimestamp, timestamp);
+            segment.lastTimestamp = std::max(segment.lastTimestamp, timestamp);
+        }
+        segment.bytes += lineBytes;
+        segment.records++;
+    }
+
+    int monthKey(time_t timestamp) {
+        std::tm info{};
+        if (!local_time(timestamp, info)) {
+            return -1;
+        }
+        return (info.tm_year + 1900) * 100 + info.tm_mon + 1;
+    }
+
+    // The YYYYMM of a monthly archive file, or -1 for files named after their segment.
+    int archiveMonth(const std::filesystem::path& file) {
+        std::string stem = file.stem().string();
+        auto separator = stem.rfind('-');
+        int key = 0;
+        if (separator == std::string::npos
+            || std::from_chars(stem.data() + separator + 1, stem.data() + stem.size(), key).ec != std::errc()
+            || key / 100 < 1970 || key % 100 < 1 || key % 100 > 12) {
+            return -1;
+        }
+        return key;
+    }
+
+    LogSegmentInfo emptySegment(int sequence) {
+        return LogSegmentInfo{sequence, 0, 0, 0, 0, 0, 0, false};
+    }
+}
+
+TransactionLog::TransactionLog(std::filesystem::path logDirectory, LogRotationPolicy rotation)
+    : directory(std::move(logDirectory)),
+      archiveDirectory(directory / "archive"),
+      policy(rotation),
+      activeDay(0),
+      autoFlush(true) {
+    if (policy.indexStride == 0) {
+        policy.indexStride = 1;
+    }
+}
+
+std::filesystem::path TransactionLog::segmentFile(int sequence) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%06d.log", sequence);
+    return directory / name;
+}
+
+std::filesystem::path TransactionLog::indexFile(int sequence) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%06d.idx", sequence);
+    return directory / name;
+}
+
+std::filesystem::path TransactionLog::manifestFile() const {
+    return directory / "MANIFEST";
+}
+
+void TransactionLog::open(const std::filesystem::path& legacyLog) {
+    std::filesystem::create_directories(directory);
+    std::filesystem::create_directories(archiveDirectory);
+    loadManifest();
+
+    if (segments.empty() && std::filesystem::exists(legacyLog)) {
+        importLegacyLog(legacyLog);
+    }
+
+    if (!segments.empty() && !segments.back().sealed) {
+        recoverActiveSegment();
+    } else {
+        openSegment(segments.empty() ? 1 : segments.back().sequence + 1);
+    }
+    archiveExpiredSegments();
+}
+
+void TransactionLog::loadManifest() {
+    segments.clear();
+    std::ifstream input(manifestFile());
+    std::string line;
+    while (std::getline(input, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream stream(line);
+        std::string field;
+        std::vector<long long> values;
+        while (std::getline(stream, field, '|')) {
+            try {
+                values.push_back(std::stoll(field));
+            } catch (...) {
+                values.clear();
+                break;
+            }
+        }
+        if (values.size() != 8) {
+            continue; // Skip malformed manifest rows
+        }
+        segments.push_back(LogSegmentInfo{
+            static_cast<int>(values[0]),
+            static_cast<int>(values[1]),
+            static_cast<int>(values[2]),
+            static_cast<time_t>(values[3]),
+            static_cast<time_t>(values[4]),
+            static_cast<std::uintmax_t>(values[5]),
+            static_cast<std::size_t>(values[6]),
+            values[7] != 0
+        });
+    }
+    std::sort(segments.begin(), segments.end(), [](const LogSegmentInfo& lhs, const LogSegmentInfo& rhs) {
+        return lhs.sequence < rhs.sequence;
+    });
+}
+
+void TransactionLog::persistManifest() const {
+    auto temporary = manifestFile();
+    temporary += ".tmp";
+    {
+        std::ofstream output(temporary, std::ios::trunc);
+        output << kManifestHeader << '\n';
+        for (const auto& segment : segments) {
+            output << segment.sequence << '|'
+                   << segment.firstReceiptId << '|'
+                   << segment.lastReceiptId << '|'
+                   << static_cast<long long>(segment.firstTimestamp) << '|'
+                   << static_cast<long long>(segment.lastTimestamp) << '|'
+                   << segment.bytes << '|'
+                   << segment.records << '|'
+                   << (segment.sealed ? 1 : 0) << '\n';
+        }
+    }
+    std::filesystem::rename(temporary, manifestFile());
+}
+
+void TransactionLog::openSegment(int sequence) {
+    segments.push_back(emptySegment(sequence));
+    activeDay = 0;
+    activeStream = std::ofstream(segmentFile(sequence), std::ios::binary | std::ios::app);
+    activeIndex = std::ofstream(indexFile(sequence), std::ios::trunc);
+    persistManifest();
+}
+
+void TransactionLog::load() {
+    loadManifest();
+    if (!segments.empty() && !segments.back().sealed) {
+        rescanSegment(segments.back(), nullptr);
+    }
+}
+
+void TransactionLog::rescanSegment(LogSegmentInfo& segment, std::ofstream* index) const {
+    int sequence = segment.sequence;
+    segment = emptySegment(sequence);
+
+    std::ifstream input(segmentFile(sequence), std::ios::binary);
+    std::string line;
+    while (std::getline(input, line)) {
+        std::size_t lineBytes = line.size() + 1;
+        time_t timestamp = 0;
+        int receiptId = 0;
+        if (!parseLineHead(line, timestamp, receiptId)) {
+            segment.bytes += lineBytes;
+            continue;
+        }
+        if (index && segment.records % policy.indexStride == 0) {
+            *index << receiptId << ' ' << segment.bytes << ' ' << static_cast<long long>(timestamp) << '\n';
+        }
+        recordLine(segment, receiptId, timestamp, lineBytes);
+    }
+}
+
+void TransactionLog::recoverActiveSegment() {
+    // Only the open segment may be ahead of the manifest; rescan it and rebuild its index.
+    LogSegmentInfo& segment = segments.back();
+    activeIndex = std::ofstream(indexFile(segment.sequence), std::ios::trunc);
+    rescanSegment(segment, &activeIndex);
+    activeDay = segment.records > 0 ? dayKey(segment.lastTimestamp) : 0;
+    activeIndex.flush();
+    activeStream = std::ofstream(segmentFile(segment.sequence), std::ios::binary | std::ios::app);
+    persistManifest();
+}
+
+void TransactionLog::importLegacyLog(const std::filesystem::path& legacyLog) {
+    std::filesystem::rename(legacyLog, segmentFile(1));
+    segments.push_back(emptySegment(1));
+    recoverActiveSegment();
+    activeStream.close();
+    activeIndex.close();
+    segments.back().sealed = true;
+    persistManifest();
+}
+
+bool TransactionLog::needsRotation(time_t timestamp, std::size_t lineBytes) const {
+    const LogSegmentInfo& segment = segments.back();
+    if (segment.records == 0) {
+        return false;
+    }
+    if (segment.bytes + lineBytes > policy.maxSegmentBytes) {
+        return true;
+    }
+    return policy.rotateDaily && dayKey(timestamp) != activeDay;
+}
+
+void TransactionLog::sealActiveSegment() {
+    activeStream.close();
+    activeIndex.close();
+    segments.back().sealed = true;
+    persistManifest();
+}
+
+void TransactionLog::archiveExpiredSegments() {
+    std::size_t sealedCount = static_cast<std::size_t>(std::count_if(segments.begin(), segments.end(), [](const LogSegmentInfo& segment) {
+        return segment.sealed;
+    }));
+    bool changed = false;
+    while (sealedCount > policy.retainedSegments && !segments.empty() && segments.front().sealed) {
+        const LogSegmentInfo segment = segments.front();
+
+        // Compact expired segments into one archive file per month.
+        std::tm info{};
+        char name[40];
+        if (local_time(segment.firstTimestamp, info)) {
+            std::strftime(name, sizeof(name), "transactions-%Y%m.log", &info);
+        } else {
+            std::snprintf(name, sizeof(name), "transactions-%06d.log", segment.sequence);
+        }
+        {
+            std::ifstream input(segmentFile(segment.sequence), std::ios::binary);
+            std::ofstream output(archiveDirectory / name, std::ios::binary | std::ios::app);
+            output << input.rdbuf();
+        }
+        std::filesystem::remove(segmentFile(segment.sequence));
+        std::filesystem::remove(indexFile(segment.sequence));
+        segments.erase(segments.begin());
+        sealedCount--;
+        changed = true;
+    }
+    if (changed) {
+        persistManifest();
+    }
+}
+
+std::string TransactionLog::formatLine(const Receipt& receipt) {
+    std::string line;
+    line.reserve(96 + receipt.cashier().size() + receipt.client().size());
+    append_integer(line, static_cast<long long>(receipt.timestamp()));
+    line.push_back('|');
+    append_integer(line, receipt.id());
+    line.push_back('|');
+    append_integer(line, receipt.cashierIdentifier());
+    line.push_back('|');
+    line.append(receipt.cashier()).push_back('|');
+    append_integer(line, receipt.clientIdentifier());
+    line.push_back('|');
+    line.append(receipt.client()).push_back('|');
+    line.append(to_string(receipt.source())).push_back('|');
+    append_fixed(line, receipt.sourceAmountValue());
+    line.push_back('|');
+    append_fixed(line, receipt.profitInBase());
+    line.push_back('|');
+    append_fixed(line, receipt.commissionInBase());
+    // Payouts as currency:paid:commission:source slice, so a restart can rebuild the day's records.
+    line.push_back('|');
+    bool first = true;
+    for (const auto& payout : receipt.payouts()) {
+        if (!first) {
+            line.push_back(';');
+        }
+        first = false;
+        line.append(to_string(payout.currency)).push_back(':');
+        append_fixed(line, payout.amountPaid);
+        line.push_back(':');
+        append_fixed(line, payout.commissionTaken);
+        line.push_back(':');
+        append_fixed(line, payout.sourceAmount);
+    }
+    return line;
+}
+
+std::optional<TransactionRecord> TransactionLog::parseRecord(const std::string& line) {
+    std::vector<std::string> fields;
+    std::istringstream stream(line);
+    std::string field;
+    while (std::getline(stream, field, '|')) {
+        fields.push_back(field);
+    }
+    if (fields.size() < 10) {
+        return std::nullopt;
+    }
+    try {
+        TransactionRecord record{std::stoi(fields[1]),
+                                 std::stoi(fields[2]),
+                                 fields[3],
+                                 std::stoi(fields[4]),
+                                 fields[5],
+                                 currency_from_string(fields[6]),
+                                 std::stod(fields[7]),
+                                 {},
+                                 std::stod(fields[8]),
+                                 static_cast<time_t>(std::stoll(fields[0])),
+                                 std::stod(fields[8]) - std::stod(fields[9])};
+        std::istringstream payouts(fields.size() > 10 ? fields[10] : "");
+        std::string payout;
+        while (std::getline(payouts, payout, ';')) {
+            std::istringstream parts(payout);
+            std::string currency;
+            std::string paid;
+            std::string commission;
+            std::string slice;
+            if (std::getline(parts, currency, ':') && std::getline(parts, paid, ':') && std::getline(parts, commission, ':')
+                && std::getline(parts, slice)) {
+                record.payouts.push_back(PayoutDetail{currency_from_string(currency), std::stod(paid), std::stod(commission), {},
+                                                      std::stod(slice)});
+            }
+        }
+        return record;
+    } catch (const std::exception&) {
+        return std::nullopt;
+    }
+}
+
+void TransactionLog::append(const Receipt& receipt) {
+    appendLine(formatLine(receipt), receipt.id(), receipt.timestamp());
+}
+
+void TransactionLog::appendLine(const std::string& line, int receiptId, time_t timestamp) {
+    std::size_t lineBytes = line.size() + 1;
+    if (needsRotation(timestamp, lineBytes)) {
+        sealActiveSegment();
+        openSegment(segments.back().sequence + 1);
+        archiveExpiredSegments();
+    }
+
+    LogSegmentInfo& segment = segments.back();
+    if (segment.records == 0) {
+        activeDay = dayKey(timestamp);
+    }
+    if (segment.records % policy.indexStride == 0) {
+        activeIndex << receiptId << ' ' << segment.bytes << ' ' << static_cast<long long>(timestamp) << '\n';
+    }
+    activeStream.write(line.data(), static_cast<std::streamsize>(line.size()));
+    activeStream.put('\n');
+    if (autoFlush) {
+        flush();
+    }
+    if (!activeStream) {
+        throw ExchangeError("Failed to append to transaction log segment " + segmentFile(segment.sequence).string());
+    }
+    recordLine(segment, receiptId, timestamp, lineBytes);
+}
+
+void TransactionLog::flush() {
+    activeStream.flush();
+    activeIndex.flush();
+}
+
+void TransactionLog::setAutoFlush(bool enabled) {
+    autoFlush = enabled;
+    if (autoFlush) {
+        flush();
+    }
+}
+
+std::vector<LogIndexEntry> TransactionLog::loadIndex(int sequence) const {
+    std::vector<LogIndexEntry> entries;
+    std::ifstream input(indexFile(sequence));
+    int receiptId = 0;
+    std::uintmax_t offset = 0;
+    long long timestamp = 0;
+    while (input >> receiptId >> offset >> timestamp) {
+        entries.push_back(LogIndexEntry{receiptId, offset, static_cast<time_t>(timestamp)});
+    }
+    return entries;
+}
+
+std::vector<std::filesystem::path> TransactionLog::archiveFiles() const {
+    std::vector<std::filesystem::path> files;
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(archiveDirectory, error)) {
+        if (entry.is_regular_file() && entry.path().extension() == ".log") {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::optional<std::string> TransactionLog::findReceipt(int receiptId) const {
+    for (auto segment = segments.rbegin(); segment != segments.rend(); ++segment) {
+        if (segment->records == 0 || receiptId < segment->firstReceiptId || receiptId > segment->lastReceiptId) {
+            continue;
+        }
+
+        std::uintmax_t startOffset = 0;
+        auto index = loadIndex(segment->sequence);
+        auto position = std::upper_bound(index.begin(), index.end(), receiptId, [](int id, const LogIndexEntry& entry) {
+            return id < entry.receiptId;
+        });
+        if (position != index.begin()) {
+            startOffset = std::prev(position)->offset;
+        }
+
+        std::ifstream input(segmentFile(segment->sequence), std::ios::binary);
+        // Receipt ids are normally increasing; fall back to a full segment scan if the seek misses.
+        for (std::uintmax_t offset : {startOffset, std::uintmax_t{0}}) {
+            input.clear();
+            input.seekg(static_cast<std::streamoff>(offset));
+            std::string line;
+            while (std::getline(input, line)) {
+                time_t timestamp = 0;
+                int lineId = 0;
+                if (parseLineHead(line, timestamp, lineId) && lineId == receiptId) {
+                    return line;
+                }
+            }
+            if (offset == 0) {
+                break;
+            }
+        }
+    }
+
+    // Archived months have no index; the latest line with the id wins, as in the live segments.
+    auto files = archiveFiles();
+    for (auto file = files.rbegin(); file != files.rend(); ++file) {
+        std::ifstream input(*file, std::ios::binary);
+        std::optional<std::string> found;
+        std::string line;
+        while (std::getline(input, line)) {
+            time_t timestamp = 0;
+            int lineId = 0;
+            if (parseLineHead(line, timestamp, lineId) && lineId == receiptId) {
+                found = line;
+            }
+        }
+        if (found) {
+            return found;
+        }
+    }
+    return std::nullopt;
+}
+
+void TransactionLog::scan(time_t from, time_t to, const std::function<void(const std::string&)>& visitor, bool includeArchive) const {
+    if (includeArchive) {
+        int firstMonth = monthKey(from);
+        int lastMonth = monthKey(to);
+        for (const auto& file : archiveFiles()) {
+            int month = archiveMonth(file);
+            if (month != -1 && ((firstMonth != -1 && month < firstMonth) || (lastMonth != -1 && month > lastMonth))) {
+                continue;
+            }
+            std::ifstream input(file, std::ios::binary);
+            std::string line;
+            while (std::getline(input, line)) {
+                time_t timestamp = 0;
+                int receiptId = 0;
+                if (parseLineHead(line, timestamp, receiptId) && timestamp >= from && timestamp <= to) {
+                    visitor(line);
+                }
+            }
+        }
+    }
+
+    for (const auto& segment : segments) {
+        if (segment.records == 0 || segment.lastTimestamp < from || segment.firstTimestamp > to) {
+            continue;
+        }
+
+        std::uintmax_t startOffset = 0;
+        if (segment.firstTimestamp < from) {
+            auto index = loadIndex(segment.sequence);
+            auto position = std::lower_bound(index.begin(), index.end(), from, [](const LogIndexEntry& entry, time_t value) {
+                return entry.timestamp < value;
+            });
+            if (position != index.begin()) {
+                startOffset = std::prev(position)->offset;
+            }
+        }
+
+        std::ifstream input(segmentFile(segment.sequence), std::ios::binary);
+        input.seekg(static_cast<std::streamoff>(startOffset));
+        std::string line;
+        while (std::getline(input, line)) {
+            time_t timestamp = 0;
+            int receiptId = 0;
+            if (!parseLineHead(line, timestamp, receiptId)) {
+                continue;
+            }
+            if (timestamp > to) {
+                break;
+            }
+            if (timestamp >= from) {
+                visitor(line);
+            }
+        }
+    }
+}
+
+const std::vector<LogSegmentInfo>& TransactionLog::manifest() const {
+    return segments;
+}
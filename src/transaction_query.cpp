@@ -0,0 +1,515 @@
+#include "transaction_query.h"
+
+#include "utils.h"
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+
+namespace {
+    std::string toUpper(std::string value) {
+        for (auto& ch : value) {
+            ch = static_cast<char>(std::toupper(static_cast<unsigned char>(ch)));
+        }
+        return value;
+    }
+
+    bool isNumber(const std::string& text) {
+        return !text.empty() && std::all_of(text.begin(), text.end(), [](unsigned char ch) {
+            return std::isdigit(ch) != 0;
+        });
+    }
+
+    time_t startOfDay(int year, int month, int day) {
+        std::tm info{};
+        info.tm_year = year - 1900;
+        info.tm_mon = month - 1;
+        info.tm_mday = day;
+        info.tm_isdst = -1;
+        return std::mktime(&info);
+    }
+
+    // Accepts epoch seconds, YYYY-MM-DD (local time) or "today".
+    time_t parseTime(const std::string& text, bool endOfDay) {
+        if (isNumber(text) && text.size() > 8) {
+            return static_cast<time_t>(std::stoll(text));
+        }
+        int year = 0;
+        int month = 0;
+        int day = 0;
+        if (toUpper(text) == "TODAY") {
+            std::tm now{};
+            if (!local_time(std::time(nullptr), now)) {
+                throw ExchangeError("Unable to resolve local date");
+            }
+            year = now.tm_year + 1900;
+            month = now.tm_mon + 1;
+            day = now.tm_mday;
+        } else if (std::sscanf(text.c_str(), "%d-%d-%d", &year, &month, &day) != 3) {
+            throw ExchangeError("Invalid date: " + text);
+        }
+        time_t start = startOfDay(year, month, day);
+        return endOfDay ? startOfDay(year, month, day + 1) - 1 : start;
+    }
+
+    // Splits on spaces and commas; double quotes keep names with spaces together.
+    std::vector<std::string> tokenize(const std::string& text) {
+        std::vector<std::string> tokens;
+        std::string current;
+        bool quoted = false;
+        for (char ch : text) {
+            if (ch == '"') {
+                quoted = !quoted;
+            } else if (!quoted && (ch == ' ' || ch == ',' || ch == '\t')) {
+                if (!current.empty()) {
+                    tokens.push_back(current);
+                    current.clear();
+                }
+            } else {
+                current.push_back(ch);
+            }
+        }
+        if (!current.empty()) {
+            tokens.push_back(current);
+        }
+        return tokens;
+    }
+
+    bool parseIntField(const std::string& line, std::size_t& position, long long& value) {
+        std::size_t end = line.find('|', position);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        auto result = std::from_chars(line.data() + position, line.data() + end, value);
+        position = end + 1;
+        return result.ec == std::errc();
+    }
+
+    bool parseDoubleField(const std::string& line, std::size_t& position, double& value) {
+        std::size_t end = line.find('|', position);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        char* parsedEnd = nullptr;
+        value = std::strtod(line.c_str() + position, &parsedEnd);
+        bool ok = parsedEnd == line.c_str() + end;
+        position = end + 1;
+        return ok;
+    }
+
+    bool parseTextField(const std::string& line, std::size_t& position, std::string& value) {
+        std::size_t end = line.find('|', position);
+        if (end == std::string::npos) {
+            return false;
+        }
+        value.assign(line, position, end - position);
+        position = end + 1;
+        return true;
+    }
+
+    // Reads the trailing currency:paid:commission:slice list written since payouts were logged.
+    bool parsePayoutsField(const std::string& line, std::size_t position, std::array<double, 4>& paid) {
+        paid.fill(0.0);
+        while (position < line.size()) {
+            std::size_t end = line.find(';', position);
+            if (end == std::string::npos) {
+                end = line.size();
+            }
+            std::size_t colon = line.find(':', position);
+            if (colon == std::string::npos || colon > end) {
+                return false;
+            }
+            char* parsedEnd = nullptr;
+            double amount = std::strtod(line.c_str() + colon + 1, &parsedEnd);
+            if (parsedEnd == line.c_str() + colon + 1 || *parsedEnd != ':') {
+                return false;
+            }
+            try {
+                paid[static_cast<std::size_t>(currency_from_string(line.substr(position, colon - position)))] += amount;
+            } catch (const ExchangeError&) {
+                return false;
+            }
+            position = end + 1;
+        }
+        return true;
+    }
+
+    std::array<double, 4> paidByCurrency(const std::vector<PayoutDetail>& payouts) {
+        std::array<double, 4> paid{};
+        for (const auto& payout : payouts) {
+            paid[static_cast<std::size_t>(payout.currency)] += payout.amountPaid;
+        }
+        return paid;
+    }
+
+    void appendTotals(std::string& out, const std::array<double, 4>& totals) {
+        bool first = true;
+        for (std::size_t currency = 0; currency < totals.size(); ++currency) {
+            if (totals[currency] == 0.0) {
+                continue;
+            }
+            out.append(first ? " " : ", ").append(to_string(static_cast<Currency>(currency))).push_back(' ');
+            append_fixed(out, totals[currency]);
+            first = false;
+        }
+        if (first) {
+            out.append(" none");
+        }
+    }
+}
+
+TransactionQuery TransactionQuery::parse(const std::string& specification) {
+    TransactionQuery query;
+    for (const auto& token : tokenize(specification)) {
+        auto separator = token.find('=');
+        if (separator == std::string::npos || separator == 0 || separator + 1 == token.size()) {
+            throw ExchangeError("Query terms must look like key=value: " + token);
+        }
+        std::string key = toUpper(token.substr(0, separator));
+        std::string value = token.substr(separator + 1);
+        try {
+            if (key == "CLIENT") {
+                if (isNumber(value)) {
+                    query.clientId = std::stoi(value);
+                } else {
+                    query.clientName = value;
+                }
+            } else if (key == "CASHIER") {
+                if (isNumber(value)) {
+                    query.cashierId = std::stoi(value);
+                } else {
+                    query.cashierName = value;
+                }
+            } else if (key == "CURRENCY") {
+                query.currency = currency_from_string(value);
+            } else if (key == "FROM") {
+                query.from = parseTime(value, false);
+            } else if (key == "TO") {
+                query.to = parseTime(value, true);
+            } else if (key == "ON") {
+                query.from = parseTime(value, false);
+                query.to = parseTime(value, true);
+            } else if (key == "MIN") {
+                query.minAmount = std::stod(value);
+            } else if (key == "MAX") {
+                query.maxAmount = std::stod(value);
+            } else if (key == "LIMIT") {
+                query.limit = static_cast<std::size_t>(std::stoul(value));
+            } else {
+                throw ExchangeError("Unknown query key: " + key);
+            }
+        } catch (const ExchangeError&) {
+            throw;
+        } catch (const std::exception&) {
+            throw ExchangeError("Invalid value for " + key + ": " + value);
+        }
+    }
+    return query;
+}
+
+TransactionIndex::TransactionIndex() : timeOrdered(true) {}
+
+bool TransactionIndex::parseLogLine(const std::string& line, TransactionRow& row, std::string& cashierName, std::string& clientName) {
+    std::size_t position = 0;
+    long long timestamp = 0;
+    long long receiptId = 0;
+    long long cashierId = 0;
+    long long clientId = 0;
+    std::string currencyToken;
+    double commission = 0.0;
+    if (!parseIntField(line, position, timestamp)
+        || !parseIntField(line, position, receiptId)
+        || !parseIntField(line, position, cashierId)
+        || !parseTextField(line, position, cashierName)
+        || !parseIntField(line, position, clientId)
+        || !parseTextField(line, position, clientName)
+        || !parseTextField(line, position, currencyToken)
+        || !parseDoubleField(line, position, row.sourceAmount)
+        || !parseDoubleField(line, position, row.profitInBase)
+        || !parseDoubleField(line, position, commission)
+        || !parsePayoutsField(line, position, row.paid)) {
+        return false;
+    }
+    try {
+        row.sourceCurrency = currency_from_string(currencyToken);
+    } catch (const ExchangeError&) {
+        return false;
+    }
+    row.timestamp = static_cast<time_t>(timestamp);
+    row.receiptId = static_cast<int>(receiptId);
+    row.cashierId = static_cast<int>(cashierId);
+    row.clientId = static_cast<int>(clientId);
+    return true;
+}
+
+std::size_t TransactionIndex::RowKeyHash::operator()(const RowKey& key) const {
+    // Only spreads the buckets; equality on the full tuple decides duplicates.
+    std::uint64_t hash = static_cast<std::uint64_t>(key.timestamp) * 0x9e3779b97f4a7c15ull;
+    hash ^= static_cast<std::uint32_t>(key.receiptId) + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    hash ^= static_cast<std::uint32_t>(key.clientId) + 0x9e3779b9u + (hash << 6) + (hash >> 2);
+    return static_cast<std::size_t>(hash);
+}
+
+void TransactionIndex::indexRow(std::uint32_t position) {
+    const TransactionRow& row = rows[position];
+    byClient[row.clientId].push_back(position);
+    byCashier[row.cashierId].push_back(position);
+    for (std::size_t currency = 0; currency < byCurrency.size(); ++currency) {
+        if (static_cast<Currency>(currency) == row.sourceCurrency || row.paid[currency] > 0.0) {
+            byCurrency[currency].push_back(position);
+        }
+    }
+}
+
+bool TransactionIndex::add(const TransactionRow& row, const std::string& cashier, const std::string& client) {
+    if (!seenKeys.insert(RowKey{row.receiptId, row.timestamp, row.clientId}).second) {
+        return false;
+    }
+    if (!rows.empty() && row.timestamp < rows.back().timestamp) {
+        timeOrdered = false;
+    }
+    rows.push_back(row);
+    indexRow(static_cast<std::uint32_t>(rows.size() - 1));
+    if (clientNames.find(row.clientId) == clientNames.end()) {
+        clientNames.emplace(row.clientId, client);
+    }
+    if (cashierNames.find(row.cashierId) == cashierNames.end()) {
+        cashierNames.emplace(row.cashierId, cashier);
+    }
+    return true;
+}
+
+void TransactionIndex::add(const TransactionRecord& record) {
+    add(TransactionRow{record.receiptId,
+                       record.cashierId,
+                       record.clientId,
+                       record.sourceCurrency,
+                       record.sourceAmount,
+                       record.profitInBaseCurrency,
+                       record.timestamp,
+                       paidByCurrency(record.payouts)},
+        record.cashierName,
+        record.clientName);
+}
+
+void TransactionIndex::add(const Receipt& receipt) {
+    add(TransactionRow{receipt.id(),
+                       receipt.cashierIdentifier(),
+                       receipt.clientIdentifier(),
+                       receipt.source(),
+                       receipt.sourceAmountValue(),
+                       receipt.profitInBase(),
+                       receipt.timestamp(),
+                       paidByCurrency(receipt.payouts())},
+        receipt.cashier(),
+        receipt.client());
+}
+
+void TransactionIndex::loadFrom(const TransactionLog& log) {
+    TransactionRow row{};
+    std::string cashier;
+    std::string client;
+    log.scan(0, std::numeric_limits<time_t>::max(), [&](const std::string& line) {
+        if (parseLogLine(line, row, cashier, client)) {
+            add(row, cashier, client);
+        }
+    }, true);
+}
+
+void TransactionIndex::reindex() {
+    if (!timeOrdered) {
+        std::stable_sort(rows.begin(), rows.end(), [](const TransactionRow& lhs, const TransactionRow& rhs) {
+            return lhs.timestamp < rhs.timestamp;
+        });
+        timeOrdered = true;
+    }
+    byClient.clear();
+    byCashier.clear();
+    for (auto& postings : byCurrency) {
+        postings.clear();
+    }
+    for (std::uint32_t position = 0; position < rows.size(); ++position) {
+        indexRow(position);
+    }
+}
+
+QueryResult TransactionIndex::run(const TransactionQuery& query) const {
+    QueryResult result;
+
+    std::optional<int> clientId = query.clientId;
+    if (!clientId && query.clientName) {
+        clientId = findClientByName(*query.clientName);
+        if (!clientId) {
+            return result;
+        }
+    }
+    std::optional<int> cashierId = query.cashierId;
+    if (!cashierId && query.cashierName) {
+        cashierId = findCashierByName(*query.cashierName);
+        if (!cashierId) {
+            return result;
+        }
+    }
+
+    // Drive the scan from the most selective posting list.
+    static const std::vector<std::uint32_t> kEmpty;
+    const std::vector<std::uint32_t>* postings = nullptr;
+    auto consider = [&postings](const std::vector<std::uint32_t>& candidate) {
+        if (postings == nullptr || candidate.size() < postings->size()) {
+            postings = &candidate;
+        }
+    };
+    if (clientId) {
+        auto iterator = byClient.find(*clientId);
+        consider(iterator != byClient.end() ? iterator->second : kEmpty);
+    }
+    if (cashierId) {
+        auto iterator = byCashier.find(*cashierId);
+        consider(iterator != byCashier.end() ? iterator->second : kEmpty);
+    }
+    if (query.currency) {
+        consider(byCurrency[static_cast<std::size_t>(*query.currency)]);
+    }
+
+    auto matches = [&](const TransactionRow& row) {
+        return (!clientId || row.clientId == *clientId)
+            && (!cashierId || row.cashierId == *cashierId)
+            && (!query.currency || row.sourceCurrency == *query.currency
+                || row.paid[static_cast<std::size_t>(*query.currency)] > 0.0)
+            && (!query.from || row.timestamp >= *query.from)
+            && (!query.to || row.timestamp <= *query.to)
+            && (!query.minAmount || row.sourceAmount >= *query.minAmount)
+            && (!query.maxAmount || row.sourceAmount <= *query.maxAmount);
+    };
+    auto accept = [&](const TransactionRow& row) {
+        result.matched++;
+        result.totalSource[static_cast<std::size_t>(row.sourceCurrency)] += row.sourceAmount;
+        for (std::size_t currency = 0; currency < row.paid.size(); ++currency) {
+            result.totalPaid[currency] += row.paid[currency];
+        }
+        result.totalProfit += row.profitInBase;
+        if (query.limit == 0 || result.rows.size() < query.limit) {
+            result.rows.push_back(row);
+        }
+    };
+
+    auto earlierThan = [this](std::uint32_t position, time_t value) {
+        return rows[position].timestamp < value;
+    };
+    auto laterThan = [this](time_t value, std::uint32_t position) {
+        return value < rows[position].timestamp;
+    };
+
+    if (postings != nullptr) {
+        auto first = postings->begin();
+        auto last = postings->end();
+        if (timeOrdered && query.from) {
+            first = std::lower_bound(first, last, *query.from, earlierThan);
+        }
+        if (timeOrdered && query.to) {
+            last = std::upper_bound(first, last, *query.to, laterThan);
+        }
+        for (auto iterator = first; iterator != last; ++iterator) {
+            const TransactionRow& row = rows[*iterator];
+            if (matches(row)) {
+                accept(row);
+            }
+        }
+        return result;
+    }
+
+    auto first = rows.begin();
+    auto last = rows.end();
+    if (timeOrdered && query.from) {
+        first = std::lower_bound(first, last, *query.from, [](const TransactionRow& row, time_t value) {
+            return row.timestamp < value;
+        });
+    }
+    if (timeOrdered && query.to) {
+        last = std::upper_bound(first, last, *query.to, [](time_t value, const TransactionRow& row) {
+            return value < row.timestamp;
+        });
+    }
+    for (auto iterator = first; iterator != last; ++iterator) {
+        if (matches(*iterator)) {
+            accept(*iterator);
+        }
+    }
+    return result;
+}
+
+std::size_t TransactionIndex::size() const {
+    return rows.size();
+}
+
+std::optional<int> TransactionIndex::findClientByName(const std::string& name) const {
+    std::string wanted = toUpper(name);
+    for (const auto& [id, clientName] : clientNames) {
+        if (toUpper(clientName) == wanted) {
+            return id;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<int> TransactionIndex::findCashierByName(const std::string& name) const {
+    std::string wanted = toUpper(name);
+    for (const auto& [id, cashierName] : cashierNames) {
+        if (toUpper(cashierName) == wanted) {
+            return id;
+        }
+    }
+    return std::nullopt;
+}
+
+const std::string& TransactionIndex::clientName(int clientId) const {
+    static const std::string kUnknown = "?";
+    auto iterator = clientNames.find(clientId);
+    return iterator != clientNames.end() ? iterator->second : kUnknown;
+}
+
+const std::string& TransactionIndex::cashierName(int cashierId) const {
+    static const std::string kUnknown = "?";
+    auto iterator = cashierNames.find(cashierId);
+    return iterator != cashierNames.end() ? iterator->second : kUnknown;
+}
+
+std::string TransactionIndex::format(const QueryResult& result) const {
+    std::string out;
+    out.reserve(128 + result.rows.size() * 112);
+    for (const auto& row : result.rows) {
+        out.append("  Receipt #");
+        append_integer(out, row.receiptId);
+        out.append(" | ");
+        append_integer(out, static_cast<long long>(row.timestamp));
+        out.append(" | Cashier ").append(cashierName(row.cashierId)).append(" (ID ");
+        append_integer(out, row.cashierId);
+        out.append(") | Client ").append(clientName(row.clientId)).append(" (ID ");
+        append_integer(out, row.clientId);
+        out.append(") | Source ").append(to_string(row.sourceCurrency)).push_back(' ');
+        append_fixed(out, row.sourceAmount);
+        out.append(" | Paid");
+        appendTotals(out, row.paid);
+        out.append(" | Profit base ");
+        append_fixed(out, row.profitInBase);
+        out.push_back('\n');
+    }
+    out.append("Matched ");
+    append_integer(out, static_cast<long long>(result.matched));
+    out.append(" receipt(s)");
+    if (result.rows.size() < result.matched) {
+        out.append(", showing ");
+        append_integer(out, static_cast<long long>(result.rows.size()));
+    }
+    out.append(". Total source:");
+    appendTotals(out, result.totalSource);
+    out.append(" | Total paid:");
+    appendTotals(out, result.totalPaid);
+    out.append(" | Total profit base: ");
+    append_fixed(out, result.totalProfit);
+    out.push_back('\n');
+    return out;
+}
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 #include <cctype>
+#include <charconv>
+#include <fstream>
 #include <map>
 
 namespace {
@@ -32,12 +34,88 @@ Currency currency_from_string(const std::string& symbol) {
     throw ExchangeError("Unsupported currency symbol: " + symbol);
 }
 
+void append_fixed(std::string& out, double value, int precision) {
+    char buffer[64];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, std::chars_format::fixed, precision);
+    if (result.ec != std::errc()) {
+        out.append("nan");
+        return;
+    }
+    out.append(buffer, result.ptr);
+}
+
+void append_integer(std::string& out, long long value) {
+    char buffer[24];
+    auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+    out.append(buffer, result.ptr);
+}
+
+void append_json_string(std::string& out, const std::string& value) {
+    static const char kHex[] = "0123456789abcdef";
+    out.push_back('"');
+    for (char ch : value) {
+        switch (ch) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\n': out.append("\\n"); break;
+            case '\r': out.append("\\r"); break;
+            case '\t': out.append("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(ch) < 0x20) {
+                    out.append("\\u00");
+                    out.push_back(kHex[(ch >> 4) & 0xF]);
+                    out.push_back(kHex[ch & 0xF]);
+                } else {
+                    out.push_back(ch);
+                }
+        }
+    }
+    out.push_back('"');
+}
+
+bool local_time(std::time_t timestamp, std::tm& result) {
+#ifdef _WIN32
+    return localtime_s(&result, &timestamp) == 0;
+#else
+    return localtime_r(&timestamp, &result) != nullptr;
+#endif
+}
+
+std::string_view trim_view(std::string_view text) {
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.front()))) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && std::isspace(static_cast<unsigned char>(text.back()))) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
+std::string trim(std::string_view text) {
+    return std::string(trim_view(text));
+}
+
+void replace_file(const std::filesystem::path& path, const std::string& content) {
+    std::filesystem::path temporary = path;
+    temporary += ".tmp";
+    {
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        output.write(content.data(), static_cast<std::streamsize>(content.size()));
+        if (!output) {
+            throw ExchangeError("Failed to write " + path.string());
+        }
+    }
+    std::filesystem::rename(temporary, path);
+}
+
 ExchangeError::ExchangeError(const std::string& message) : std::runtime_error(message) {}
 
 RateNotFoundError::RateNotFoundError(const std::string& message) : ExchangeError(message) {}
 
 ReserveError::ReserveError(const std::string& message) : ExchangeError(message) {}
 
+LimitExceededError::LimitExceededError(const std::string& message) : ExchangeError(message) {}
+
 ExchangePortion::ExchangePortion(Currency target, double amount)
     : targetCurrency(target),
       sourceAmount(amount),
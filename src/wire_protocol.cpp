@@ -0,0 +1,335 @@
+#include "wire_protocol.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+    void putU8(std::string& out, std::uint8_t value) {
+        out.push_back(static_cast<char>(value));
+    }
+
+    void putU32(std::string& out, std::uint32_t value) {
+        char bytes[4];
+        for (int i = 0; i < 4; ++i) {
+            bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+        out.append(bytes, sizeof(bytes));
+    }
+
+    void putU64(std::string& out, std::uint64_t value) {
+        char bytes[8];
+        for (int i = 0; i < 8; ++i) {
+            bytes[i] = static_cast<char>((value >> (8 * i)) & 0xFF);
+        }
+        out.append(bytes, sizeof(bytes));
+    }
+
+    void putVarint(std::string& out, std::uint64_t value) {
+        char bytes[10];
+        std::size_t length = 0;
+        while (value >= 0x80) {
+            bytes[length++] = static_cast<char>((value & 0x7F) | 0x80);
+            value >>= 7;
+        }
+        bytes[length++] = static_cast<char>(value);
+        out.append(bytes, length);
+    }
+
+    void putSigned(std::string& out, std::int64_t value) {
+        putVarint(out, (static_cast<std::uint64_t>(value) << 1) ^ static_cast<std::uint64_t>(value >> 63));
+    }
+
+    void putAmount(std::string& out, double amount) {
+        putSigned(out, static_cast<std::int64_t>(std::llround(amount * 100.0)));
+    }
+
+    void putName(std::string& out, std::string_view name) {
+        if (name.size() > 0xFF) {
+            name = name.substr(0, 0xFF);
+        }
+        putU8(out, static_cast<std::uint8_t>(name.size()));
+        out.append(name.data(), name.size());
+    }
+
+    void require(const std::string_view& cursor, std::size_t bytes) {
+        if (cursor.size() < bytes) {
+            throw ExchangeError("Malformed frame: payload truncated");
+        }
+    }
+
+    std::uint8_t takeU8(std::string_view& cursor) {
+        require(cursor, 1);
+        auto value = static_cast<std::uint8_t>(cursor[0]);
+        cursor.remove_prefix(1);
+        return value;
+    }
+
+    std::uint32_t takeU32(std::string_view& cursor) {
+        require(cursor, 4);
+        std::uint32_t value = 0;
+        for (int i = 3; i >= 0; --i) {
+            value = (value << 8) | static_cast<std::uint8_t>(cursor[static_cast<std::size_t>(i)]);
+        }
+        cursor.remove_prefix(4);
+        return value;
+    }
+
+    std::uint64_t takeU64(std::string_view& cursor) {
+        require(cursor, 8);
+        std::uint64_t value = 0;
+        for (int i = 7; i >= 0; --i) {
+            value = (value << 8) | static_cast<std::uint8_t>(cursor[static_cast<std::size_t>(i)]);
+        }
+        cursor.remove_prefix(8);
+        return value;
+    }
+
+    std::int64_t takeSigned(std::string_view& cursor) {
+        std::uint64_t raw = WireCodec::readVarint(cursor);
+        return static_cast<std::int64_t>(raw >> 1) ^ -static_cast<std::int64_t>(raw & 1);
+    }
+
+    Currency takeCurrency(std::string_view& cursor) {
+        std::uint8_t value = takeU8(cursor);
+        if (value > static_cast<std::uint8_t>(Currency::LOCAL)) {
+            throw ExchangeError("Malformed frame: unknown currency id");
+        }
+        return static_cast<Currency>(value);
+    }
+
+    std::string_view takeName(std::string_view& cursor) {
+        std::uint8_t length = takeU8(cursor);
+        require(cursor, length);
+        std::string_view name = cursor.substr(0, length);
+        cursor.remove_prefix(length);
+        return name;
+    }
+
+    // Frames are written header-first and the length is patched once the payload is known.
+    std::size_t beginFrame(std::string& out, WireType type, std::uint32_t correlationId) {
+        std::size_t start = out.size();
+        putU32(out, 0);
+        putU8(out, static_cast<std::uint8_t>(type));
+        putU32(out, correlationId);
+        return start;
+    }
+
+    void endFrame(std::string& out, std::size_t start) {
+        auto length = static_cast<std::uint32_t>(out.size() - start - WireCodec::kHeaderSize);
+        for (int i = 0; i < 4; ++i) {
+            out[start + static_cast<std::size_t>(i)] = static_cast<char>((length >> (8 * i)) & 0xFF);
+        }
+    }
+
+    std::uint8_t checkedCount(std::size_t count, const char* what) {
+        if (count > 0xFF) {
+            throw ExchangeError(std::string("Too many ") + what + " for one frame");
+        }
+        return static_cast<std::uint8_t>(count);
+    }
+}
+
+std::uint64_t WireCodec::readVarint(std::string_view& cursor) {
+    std::uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        std::uint8_t byte = takeU8(cursor);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0) {
+            return value;
+        }
+    }
+    throw ExchangeError("Malformed frame: varint too long");
+}
+
+double WireCodec::fromMinor(std::int64_t minor) {
+    return static_cast<double>(minor) / 100.0;
+}
+
+std::size_t WireCodec::nextFrame(std::string_view buffer, WireFrame& frame) {
+    if (buffer.size() < kHeaderSize) {
+        return 0;
+    }
+    std::string_view cursor = buffer;
+    std::uint32_t length = takeU32(cursor);
+    if (length > kMaxPayload) {
+        throw ExchangeError("Malformed frame: payload of " + std::to_string(length) + " bytes exceeds the limit");
+    }
+    if (buffer.size() < kHeaderSize + length) {
+        return 0;
+    }
+    frame.type = static_cast<WireType>(takeU8(cursor));
+    frame.correlationId = takeU32(cursor);
+    frame.payload = cursor.substr(0, length);
+    return kHeaderSize + length;
+}
+
+void WireCodec::appendQuoteRequest(std::string& out, std::uint32_t correlationId, Currency source, Currency target, double amount) {
+    std::size_t start = beginFrame(out, WireType::QuoteRequest, correlationId);
+    putU8(out, static_cast<std::uint8_t>(source));
+    putU8(out, static_cast<std::uint8_t>(target));
+    putAmount(out, amount);
+    endFrame(out, start);
+}
+
+void WireCodec::appendQuote(std::string& out, std::uint32_t correlationId, const ExchangeQuote& quote) {
+    std::size_t start = beginFrame(out, WireType::Quote, correlationId);
+    putU8(out, static_cast<std::uint8_t>(quote.sourceCurrency));
+    putU8(out, static_cast<std::uint8_t>(quote.targetCurrency));
+    putAmount(out, quote.sourceAmount);
+    putAmount(out, quote.convertedAmount);
+    putAmount(out, quote.commission);
+    putAmount(out, quote.payout);
+    putU8(out, quote.reserveCovers ? 1 : 0);
+    endFrame(out, start);
+}
+
+void WireCodec::appendRequest(std::string& out, std::uint32_t correlationId, const ExchangeRequest& request) {
+    std::size_t start = beginFrame(out, WireType::ExchangeRequest, correlationId);
+    putU32(out, static_cast<std::uint32_t>(request.clientId));
+    putName(out, request.clientName);
+    putU8(out, static_cast<std::uint8_t>(request.sourceCurrency));
+    putAmount(out, request.totalAmount);
+    putU8(out, checkedCount(request.portions.size(), "portions"));
+    for (const auto& portion : request.portions) {
+        putU8(out, static_cast<std::uint8_t>(portion.targetCurrency));
+        putU8(out, portion.useRemainder ? 1 : 0);
+        if (!portion.useRemainder) {
+            putAmount(out, portion.sourceAmount);
+        }
+        putU8(out, checkedCount(portion.denominations.size(), "denominations"));
+        for (int denomination : portion.denominations) {
+            putVarint(out, static_cast<std::uint64_t>(denomination));
+        }
+    }
+    endFrame(out, start);
+}
+
+void WireCodec::appendReceipt(std::string& out, std::uint32_t correlationId, const Receipt& receipt) {
+    std::size_t start = beginFrame(out, WireType::Receipt, correlationId);
+    putU32(out, static_cast<std::uint32_t>(receipt.id()));
+    putU64(out, static_cast<std::uint64_t>(receipt.timestamp()));
+    putU32(out, static_cast<std::uint32_t>(receipt.cashierIdentifier()));
+    putName(out, receipt.cashier());
+    putU32(out, static_cast<std::uint32_t>(receipt.clientIdentifier()));
+    putName(out, receipt.client());
+    putU8(out, static_cast<std::uint8_t>(receipt.source()));
+    putAmount(out, receipt.sourceAmountValue());
+    putAmount(out, receipt.profitInBase());
+    putU8(out, checkedCount(receipt.payouts().size(), "payouts"));
+    for (const auto& payout : receipt.payouts()) {
+        putU8(out, static_cast<std::uint8_t>(payout.currency));
+        putAmount(out, payout.amountPaid);
+        putAmount(out, payout.commissionTaken);
+    }
+    endFrame(out, start);
+}
+
+void WireCodec::appendError(std::string& out, std::uint32_t correlationId, std::string_view message) {
+    std::size_t start = beginFrame(out, WireType::Error, correlationId);
+    out.append(message.data(), std::min(message.size(), kMaxPayload));
+    endFrame(out, start);
+}
+
+QuoteRequestView WireCodec::decodeQuoteRequest(std::string_view payload) {
+    QuoteRequestView view{};
+    view.source = takeCurrency(payload);
+    view.target = takeCurrency(payload);
+    view.amountMinor = takeSigned(payload);
+    return view;
+}
+
+ExchangeQuote WireCodec::decodeQuote(std::string_view payload) {
+    ExchangeQuote quote{};
+    quote.sourceCurrency = takeCurrency(payload);
+    quote.targetCurrency = takeCurrency(payload);
+    quote.sourceAmount = fromMinor(takeSigned(payload));
+    quote.convertedAmount = fromMinor(takeSigned(payload));
+    quote.commission = fromMinor(takeSigned(payload));
+    quote.payout = fromMinor(takeSigned(payload));
+    quote.reserveCovers = takeU8(payload) != 0;
+    return quote;
+}
+
+PortionView WireCodec::readPortion(std::string_view& cursor) {
+    PortionView portion{};
+    portion.target = takeCurrency(cursor);
+    portion.remainder = takeU8(cursor) != 0;
+    portion.amountMinor = portion.remainder ? 0 : takeSigned(cursor);
+    portion.denominationCount = takeU8(cursor);
+    std::string_view start = cursor;
+    for (std::uint8_t i = 0; i < portion.denominationCount; ++i) {
+        readVarint(cursor);
+    }
+    portion.denominations = start.substr(0, start.size() - cursor.size());
+    return portion;
+}
+
+PayoutView WireCodec::readPayout(std::string_view& cursor) {
+    PayoutView payout{};
+    payout.currency = takeCurrency(cursor);
+    payout.amountMinor = takeSigned(cursor);
+    payout.commissionMinor = takeSigned(cursor);
+    return payout;
+}
+
+ExchangeRequestView WireCodec::decodeRequest(std::string_view payload) {
+    ExchangeRequestView view{};
+    view.clientId = takeU32(payload);
+    view.clientName = takeName(payload);
+    view.source = takeCurrency(payload);
+    view.amountMinor = takeSigned(payload);
+    view.portionCount = takeU8(payload);
+    view.portions = payload;
+    // Validate the packed list once so later walks cannot run off the end.
+    std::string_view cursor = payload;
+    for (std::uint8_t i = 0; i < view.portionCount; ++i) {
+        readPortion(cursor);
+    }
+    if (!cursor.empty()) {
+        throw ExchangeError("Malformed frame: trailing bytes after portions");
+    }
+    return view;
+}
+
+ReceiptView WireCodec::decodeReceipt(std::string_view payload) {
+    ReceiptView view{};
+    view.receiptId = takeU32(payload);
+    view.timestamp = takeU64(payload);
+    view.cashierId = takeU32(payload);
+    view.cashierName = takeName(payload);
+    view.clientId = takeU32(payload);
+    view.clientName = takeName(payload);
+    view.source = takeCurrency(payload);
+    view.sourceAmountMinor = takeSigned(payload);
+    view.profitMinor = takeSigned(payload);
+    view.payoutCount = takeU8(payload);
+    view.payouts = payload;
+    std::string_view cursor = payload;
+    for (std::uint8_t i = 0; i < view.payoutCount; ++i) {
+        readPayout(cursor);
+    }
+    if (!cursor.empty()) {
+        throw ExchangeError("Malformed frame: trailing bytes after payouts");
+    }
+    return view;
+}
+
+std::string_view WireCodec::decodeError(std::string_view payload) {
+    return payload;
+}
+
+ExchangeRequest WireCodec::toRequest(const ExchangeRequestView& request, int clientId) {
+    std::vector<ExchangePortion> portions;
+    portions.reserve(request.portionCount);
+    forEachPortion(request, [&portions](const PortionView& view) {
+        ExchangePortion portion = view.remainder ? ExchangePortion::remainder(view.target)
+                                                 : ExchangePortion(view.target, fromMinor(view.amountMinor));
+        portion.denominations.reserve(view.denominationCount);
+        forEachDenomination(view, [&portion](int denomination) {
+            portion.denominations.push_back(denomination);
+        });
+        portions.push_back(std::move(portion));
+    });
+    return ExchangeRequest(clientId, std::string(request.clientName), request.source, fromMinor(request.amountMinor), std::move(portions));
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cmath>
+#include <cstdio>
+
+// Minimal assertions for the round-trip tests: failures are counted and reported, and the test
+// binary exits non-zero if any check failed.
+namespace check {
+    inline int failures = 0;
+
+    inline void record(bool passed, const char* expression, const char* file, int line) {
+        if (!passed) {
+            ++failures;
+            std::fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+        }
+    }
+
+    inline int finish(const char* name) {
+        if (failures == 0) {
+            std::printf("%s: ok\n", name);
+            return 0;
+        }
+        std::printf("%s: %d check(s) failed\n", name, failures);
+        return 1;
+    }
+}
+
+#define CHECK(expression) check::record(static_cast<bool>(expression), #expression, __FILE__, __LINE__)
+#define CHECK_NEAR(actual, expected, tolerance) \
+    check::record(std::fabs((actual) - (expected)) <= (tolerance), #actual " ~ " #expected, __FILE__, __LINE__)
@@ -0,0 +1,120 @@
+// Journals every event type from a live office and replays it, then replays a journal in the
+// older line formats (no spread fields, no margins, four-part payouts).
+#include "check.h"
+#include "journal.h"
+
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <unistd.h>
+
+namespace {
+    std::filesystem::path scratchDirectory() {
+        auto directory = std::filesystem::temp_directory_path() / ("cx-journal-test-" + std::to_string(::getpid()));
+        std::filesystem::remove_all(directory);
+        std::filesystem::create_directories(directory);
+        return directory;
+    }
+
+    void sameOffice(const ExchangeOffice& replayed, const ExchangeOffice& live) {
+        for (const auto& [currency, balance] : live.reserve().allBalances()) {
+            CHECK_NEAR(replayed.reserve().getBalance(currency), balance, 1e-9);
+        }
+        for (const auto& [currency, balance] : live.startOfDayReserve().allBalances()) {
+            CHECK_NEAR(replayed.startOfDayReserve().getBalance(currency), balance, 1e-9);
+        }
+        CHECK(replayed.criticalMinimumsMap() == live.criticalMinimumsMap());
+        CHECK(replayed.rateConfig()->serialize().size() == live.rateConfig()->serialize().size());
+        CHECK_NEAR(replayed.rateConfig()->getRate(Currency::EUR, Currency::LOCAL), live.rateConfig()->getRate(Currency::EUR, Currency::LOCAL), 1e-12);
+        CHECK_NEAR(replayed.rateConfig()->margin(Currency::USD, Currency::LOCAL), live.rateConfig()->margin(Currency::USD, Currency::LOCAL), 1e-12);
+        CHECK_NEAR(replayed.currentProfitBase(), live.currentProfitBase(), 1e-9);
+        CHECK_NEAR(replayed.currentSpreadIncomeBase(), live.currentSpreadIncomeBase(), 1e-9);
+        CHECK_NEAR(replayed.currentRebalancingCostBase(), live.currentRebalancingCostBase(), 1e-12);
+        CHECK(replayed.nextReceiptNumber() == live.nextReceiptNumber());
+        CHECK(replayed.transactionsToday().size() == live.transactionsToday().size());
+        if (!live.transactionsToday().empty() && replayed.transactionsToday().size() == live.transactionsToday().size()) {
+            const TransactionRecord& record = replayed.transactionsToday().back();
+            const TransactionRecord& original = live.transactionsToday().back();
+            CHECK(record.receiptId == original.receiptId);
+            CHECK(record.clientName == original.clientName);
+            CHECK(record.payouts.size() == original.payouts.size());
+            CHECK((record.payouts[0].denominations == original.payouts[0].denominations));
+            CHECK_NEAR(record.payouts[0].spreadTaken, original.payouts[0].spreadTaken, 1e-12);
+        }
+    }
+
+    void currentFormat(const std::filesystem::path& directory) {
+        RateTable rates(Currency::LOCAL);
+        rates.setRate(Currency::USD, Currency::LOCAL, 1.08);
+        rates.setRate(Currency::EUR, Currency::LOCAL, 1.0);
+        ExchangeOffice office(rates, Reserve({{Currency::USD, 5000.0}, {Currency::EUR, 5000.0}, {Currency::LOCAL, 5000.0}}), 0.03);
+
+        Journal journal(directory / "journal.log");
+        journal.open(office);
+        office.addListener(&journal);
+        office.executeTransaction(ExchangeRequest(4, "Cid|Pipe", Currency::USD, 80.0, {ExchangePortion::remainder(Currency::EUR)}), "Ann", 3);
+        office.resetDailyCycle();
+        office.topUpReserve(Currency::GBP, 700.0);
+        office.reduceReserve(Currency::USD, 25.5);
+        office.updateRate(Currency::EUR, Currency::LOCAL, 1.1);
+        office.updateMargin(Currency::USD, Currency::LOCAL, 0.02);
+        office.setCriticalMinimum(Currency::EUR, 300.0);
+        ExchangePortion euros(Currency::EUR, 60.0);
+        euros.denominations = {50, 10};
+        office.executeTransaction(ExchangeRequest(5, "Dee", Currency::USD, 100.0, {euros, ExchangePortion::remainder(Currency::LOCAL)}), "Ann", 3);
+        office.rebalanceReserves({{Currency::USD, -10.0}, {Currency::LOCAL, 10.8}}, 0.75);
+        journal.flush();
+        office.removeListener(&journal);
+
+        ReplayStatistics statistics;
+        auto replayed = JournalReplayer::replay(directory / "journal.log", statistics);
+        CHECK(statistics.malformedLines == 0);
+        CHECK(statistics.eventsApplied == 10);
+        CHECK(statistics.lastSequence == journal.lastSequence());
+        sameOffice(*replayed, office);
+    }
+
+    void olderFormat(const std::filesystem::path& directory) {
+        auto path = directory / "legacy.log";
+        std::ofstream(path)
+            << "1|C|1700000000|LOCAL|0.03|5|10|USD=1000;LOCAL=2000|USD=1000;LOCAL=2000|USD>LOCAL=1.1|USD=100\n"
+            << "2|D|1700000001\n"
+            << "3|X|1700000002|5|3|Ann|8|Bob|USD|100|3.3|1700000002|LOCAL:100:106.7:3.3\n"
+            << "4|T|1700000003|USD|50\n"
+            << "5|T|1700000004|LOCAL|-0.3\n"
+            << "6|R|1700000005|USD|LOCAL|1.2\n"
+            << "7|S|1700000006|USD|LOCAL|0.01\n"
+            << "8|M|1700000007|LOCAL|500\n";
+
+        ReplayStatistics statistics;
+        auto office = JournalReplayer::replay(path, statistics);
+        CHECK(statistics.malformedLines == 0);
+        CHECK(statistics.lastSequence == 8);
+        CHECK_NEAR(office->reserve().getBalance(Currency::USD), 1150.0, 1e-9);
+        CHECK_NEAR(office->reserve().getBalance(Currency::LOCAL), 1893.0, 1e-9);
+        CHECK_NEAR(office->startOfDayReserve().getBalance(Currency::USD), 1000.0, 1e-9);
+        CHECK_NEAR(office->currentProfitBase(), 3.3, 1e-9);
+        CHECK_NEAR(office->currentSpreadIncomeBase(), 0.0, 1e-12);
+        CHECK_NEAR(office->currentRebalancingCostBase(), 0.0, 1e-12);
+        CHECK(office->nextReceiptNumber() == 6);
+        CHECK_NEAR(office->rateConfig()->getRate(Currency::USD, Currency::LOCAL), 1.2, 1e-12);
+        CHECK_NEAR(office->rateConfig()->margin(Currency::USD, Currency::LOCAL), 0.01, 1e-12);
+        CHECK_NEAR(office->criticalMinimum(Currency::LOCAL), 500.0, 1e-12);
+        CHECK(office->transactionsToday().size() == 1);
+        if (office->transactionsToday().size() == 1) {
+            const PayoutDetail& payout = office->transactionsToday()[0].payouts.at(0);
+            CHECK_NEAR(payout.sourceAmount, 100.0, 1e-12);
+            CHECK_NEAR(payout.amountPaid, 106.7, 1e-12);
+            CHECK_NEAR(payout.commissionTaken, 3.3, 1e-12);
+            CHECK(payout.denominations.empty());
+        }
+    }
+}
+
+int main() {
+    auto directory = scratchDirectory();
+    currentFormat(directory);
+    olderFormat(directory);
+    std::filesystem::remove_all(directory);
+    return check::finish("journal_test");
+}
@@ -0,0 +1,234 @@
+// Round-trips the current snapshot format and decodes hand-built images of every older version.
+#include "check.h"
+#include "snapshot.h"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace {
+    // Writes the payload layout of a given version, independently of SnapshotCodec::encode.
+    class LegacyImage {
+    private:
+        std::string payload;
+
+        void bytes(std::uint64_t value, int count) {
+            for (int i = 0; i < count; ++i) {
+                payload.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+            }
+        }
+
+    public:
+        void u8(std::uint8_t value) { bytes(value, 1); }
+        void u16(std::uint16_t value) { bytes(value, 2); }
+        void u32(std::uint32_t value) { bytes(value, 4); }
+        void u64(std::uint64_t value) { bytes(value, 8); }
+
+        void f64(double value) {
+            std::uint64_t bits = 0;
+            std::memcpy(&bits, &value, sizeof(bits));
+            u64(bits);
+        }
+
+        void text(const std::string& value) {
+            u16(static_cast<std::uint16_t>(value.size()));
+            payload.append(value);
+        }
+
+        void balance(Currency currency, double amount) {
+            u32(1);
+            u8(static_cast<std::uint8_t>(currency));
+            f64(amount);
+        }
+
+        std::string image(std::uint32_t version) const {
+            std::uint64_t hash = 1469598103934665603ULL;
+            for (unsigned char ch : payload) {
+                hash ^= ch;
+                hash *= 1099511628211ULL;
+            }
+            LegacyImage header;
+            header.payload.assign("CXSNAP\0\0", 8);
+            header.u32(version);
+            header.u32(0);
+            header.u64(payload.size());
+            header.u64(hash);
+            return header.payload + payload;
+        }
+    };
+
+    bool decode(const std::string& image, OfficeSnapshot& snapshot, std::string& error) {
+        return SnapshotCodec::decode(reinterpret_cast<const unsigned char*>(image.data()), image.size(), snapshot, error);
+    }
+
+    std::string legacyImage(std::uint32_t version) {
+        LegacyImage body;
+        body.u64(17);
+        body.u8(static_cast<std::uint8_t>(Currency::LOCAL));
+        body.f64(0.03);
+        body.u32(12);
+        body.f64(45.5);
+        if (version >= 2) {
+            body.f64(4.5);
+        }
+        body.balance(Currency::USD, 900.0);
+        body.balance(Currency::USD, 1000.0);
+        body.balance(Currency::USD, 100.0);
+        body.u32(1);
+        body.u8(static_cast<std::uint8_t>(Currency::USD));
+        body.u8(static_cast<std::uint8_t>(Currency::LOCAL));
+        body.f64(1.08);
+        if (version >= 2) {
+            body.f64(0.01);
+        }
+        body.u32(1);
+        body.u32(3);
+        body.text("cashier");
+        body.text("Ann");
+        if (version >= 3) {
+            body.u64(1790000000);
+            body.u32(1);
+            body.u32(3);
+            body.text("Ann");
+            body.f64(45.5);
+            body.u64(11);
+            body.f64(300.0);
+            body.u64(80);
+        }
+        if (version >= 4) {
+            body.u32(1);
+            body.u32(8);
+            body.u32(20000);
+            body.u8(0b10);
+            body.f64(250.0);
+            for (int currency = 1; currency < 4; ++currency) {
+                body.u8(0);
+            }
+        }
+        if (version >= 5) {
+            body.u32(1);
+            body.u32(11);
+            body.u32(3);
+            body.text("Ann");
+            body.u32(8);
+            body.text("Bob");
+            body.u8(static_cast<std::uint8_t>(Currency::USD));
+            body.f64(100.0);
+            body.f64(3.24);
+            body.u64(1792369729);
+            body.f64(0.5);
+            body.u32(1);
+            body.u8(static_cast<std::uint8_t>(Currency::LOCAL));
+            body.f64(104.76);
+            body.f64(3.24);
+            body.f64(100.0);
+            body.f64(0.54);
+            body.u32(2);
+            body.u32(100);
+            body.u32(4);
+        }
+        return body.image(version);
+    }
+
+    void olderVersions() {
+        for (std::uint32_t version = 1; version < SnapshotCodec::kVersion; ++version) {
+            OfficeSnapshot snapshot;
+            std::string error;
+            bool decoded = decode(legacyImage(version), snapshot, error);
+            CHECK(decoded);
+            if (!decoded) {
+                std::fprintf(stderr, "version %u: %s\n", version, error.c_str());
+                continue;
+            }
+            CHECK(snapshot.journalSequence == 17);
+            CHECK(snapshot.baseCurrency == Currency::LOCAL);
+            CHECK(snapshot.nextReceiptId == 12);
+            CHECK_NEAR(snapshot.profitInBase, 45.5, 1e-12);
+            CHECK_NEAR(snapshot.spreadIncomeBase, version >= 2 ? 4.5 : 0.0, 1e-12);
+            CHECK_NEAR(snapshot.reserve[Currency::USD], 900.0, 1e-12);
+            CHECK_NEAR(snapshot.startOfDayReserve[Currency::USD], 1000.0, 1e-12);
+            CHECK_NEAR(snapshot.criticalMinimums[Currency::USD], 100.0, 1e-12);
+            CHECK(snapshot.rates.size() == 1);
+            if (!snapshot.rates.empty()) {
+                CHECK_NEAR(snapshot.rates[0].mid, 1.08, 1e-12);
+                CHECK_NEAR(snapshot.rates[0].margin, version >= 2 ? 0.01 : 0.0, 1e-12);
+            }
+            CHECK(snapshot.people.size() == 1 && snapshot.people[0].name == "Ann");
+            CHECK(snapshot.cashierTotals.size() == (version >= 3 ? 1u : 0u));
+            if (version >= 3 && !snapshot.cashierTotals.empty()) {
+                CHECK(snapshot.cashierTotals[3].monthTransactions == 80);
+            }
+            CHECK(snapshot.clientWindows.size() == (version >= 4 ? 1u : 0u));
+            if (version >= 4 && !snapshot.clientWindows.empty()) {
+                CHECK_NEAR(snapshot.clientWindows[0].buckets[0][1], 250.0, 1e-12);
+                CHECK_NEAR(snapshot.clientWindows[0].buckets[0][0], 0.0, 1e-12);
+            }
+            CHECK(snapshot.transactions.size() == (version >= 5 ? 1u : 0u));
+            if (version >= 5 && !snapshot.transactions.empty()) {
+                const TransactionRecord& record = snapshot.transactions[0];
+                CHECK(record.clientName == "Bob");
+                CHECK(record.payouts.size() == 1);
+                CHECK((record.payouts[0].denominations == std::vector<int>{100, 4}));
+            }
+            CHECK_NEAR(snapshot.rebalancingCostBase, 0.0, 1e-12);
+        }
+    }
+
+    void currentVersion() {
+        RateTable rates(Currency::LOCAL);
+        rates.setRate(Currency::USD, Currency::LOCAL, 1.08);
+        rates.setRate(Currency::EUR, Currency::LOCAL, 1.0);
+        rates.setMargin(Currency::USD, Currency::LOCAL, 0.01);
+        ExchangeOffice office(rates, Reserve({{Currency::USD, 5000.0}, {Currency::EUR, 5000.0}, {Currency::LOCAL, 5000.0}}), 0.03);
+        office.setCriticalMinimum(Currency::EUR, 250.0);
+        ExchangePortion euros(Currency::EUR, 60.0);
+        euros.denominations = {50, 10};
+        office.executeTransaction(ExchangeRequest(4, "Cid", Currency::USD, 100.0, {euros, ExchangePortion::remainder(Currency::LOCAL)}), "Ann", 3);
+        office.executeTransaction(ExchangeRequest(5, "Dee", Currency::EUR, 40.0, {ExchangePortion::remainder(Currency::USD)}), "Ann", 3);
+        office.rebalanceReserves({{Currency::USD, -10.0}, {Currency::LOCAL, 10.8}}, 1.25);
+
+        OfficeSnapshot captured = SnapshotCodec::capture(office, {PersonEntry{3, "cashier", "Ann"}}, 99);
+        OfficeSnapshot snapshot;
+        std::string error;
+        CHECK(decode(SnapshotCodec::encode(captured), snapshot, error));
+        CHECK(snapshot.journalSequence == 99);
+        CHECK(snapshot.nextReceiptId == office.nextReceiptNumber());
+        CHECK_NEAR(snapshot.profitInBase, office.currentProfitBase(), 1e-12);
+        CHECK_NEAR(snapshot.spreadIncomeBase, office.currentSpreadIncomeBase(), 1e-12);
+        CHECK_NEAR(snapshot.rebalancingCostBase, 1.25, 1e-12);
+        CHECK(snapshot.reserve == office.reserve().allBalances());
+        CHECK(snapshot.startOfDayReserve == office.startOfDayReserve().allBalances());
+        CHECK(snapshot.criticalMinimums == office.criticalMinimumsMap());
+        CHECK(snapshot.rates.size() == captured.rates.size());
+        CHECK(snapshot.cashierTotals.size() == 1);
+        CHECK(snapshot.clientWindows.size() == captured.clientWindows.size());
+        CHECK(snapshot.transactions.size() == 2);
+        if (snapshot.transactions.size() == 2) {
+            const TransactionRecord& record = snapshot.transactions[0];
+            const TransactionRecord& original = office.transactionsToday()[0];
+            CHECK(record.receiptId == original.receiptId);
+            CHECK(record.clientName == "Cid");
+            CHECK(record.timestamp == original.timestamp);
+            CHECK(record.payouts.size() == 2);
+            CHECK((record.payouts[0].denominations == original.payouts[0].denominations));
+            CHECK_NEAR(record.payouts[1].amountPaid, original.payouts[1].amountPaid, 1e-12);
+            CHECK_NEAR(record.spreadInBaseCurrency, original.spreadInBaseCurrency, 1e-12);
+        }
+
+        auto rebuilt = SnapshotCodec::buildOffice(snapshot);
+        CHECK(rebuilt->reserve().allBalances() == office.reserve().allBalances());
+        CHECK(rebuilt->transactionsToday().size() == 2);
+        CHECK_NEAR(rebuilt->compileDailyReport().rebalancingCostBase(), 1.25, 1e-12);
+
+        std::string image = SnapshotCodec::encode(captured);
+        image.back() ^= 0x01;
+        CHECK(!decode(image, snapshot, error));
+        CHECK(error == "snapshot checksum mismatch");
+    }
+}
+
+int main() {
+    olderVersions();
+    currentVersion();
+    return check::finish("snapshot_test");
+}
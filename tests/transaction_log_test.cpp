@@ -0,0 +1,121 @@
+// Round-trips transaction log lines through both parsers, with and without the payout field,
+// and reads them back from a segment on disk.
+#include "check.h"
+#include "transaction_log.h"
+#include "transaction_query.h"
+
+#include <filesystem>
+#include <limits>
+#include <string>
+#include <unistd.h>
+
+namespace {
+    Receipt sampleReceipt(int id, time_t timestamp) {
+        std::vector<PayoutDetail> payouts{{Currency::EUR, 47.49, 1.47, {20, 20}, 45.33, 0.2},
+                                          {Currency::GBP, 46.94, 1.45, {}, 54.67, 0.0}};
+        return Receipt(id, 3, "Ann", 8, "Bob Ray", Currency::USD, 100.0, payouts, 3.24, 2.92, 0.32, timestamp);
+    }
+
+    void withPayouts() {
+        Receipt receipt = sampleReceipt(12, 1792369729);
+        std::string line = TransactionLog::formatLine(receipt);
+
+        auto record = TransactionLog::parseRecord(line);
+        CHECK(record.has_value());
+        if (record) {
+            CHECK(record->receiptId == 12);
+            CHECK(record->cashierId == 3);
+            CHECK(record->cashierName == "Ann");
+            CHECK(record->clientId == 8);
+            CHECK(record->clientName == "Bob Ray");
+            CHECK(record->sourceCurrency == Currency::USD);
+            CHECK_NEAR(record->sourceAmount, 100.0, 1e-9);
+            CHECK_NEAR(record->profitInBaseCurrency, 3.24, 1e-9);
+            CHECK(record->timestamp == 1792369729);
+            CHECK(record->payouts.size() == 2);
+            if (record->payouts.size() == 2) {
+                CHECK(record->payouts[0].currency == Currency::EUR);
+                CHECK_NEAR(record->payouts[0].amountPaid, 47.49, 1e-9);
+                CHECK_NEAR(record->payouts[0].commissionTaken, 1.47, 1e-9);
+                CHECK_NEAR(record->payouts[0].sourceAmount, 45.33, 1e-9);
+                CHECK(record->payouts[1].currency == Currency::GBP);
+                CHECK_NEAR(record->payouts[1].sourceAmount, 54.67, 1e-9);
+            }
+        }
+
+        TransactionRow row{};
+        std::string cashier;
+        std::string client;
+        CHECK(TransactionIndex::parseLogLine(line, row, cashier, client));
+        CHECK(row.receiptId == 12);
+        CHECK(row.timestamp == 1792369729);
+        CHECK(cashier == "Ann");
+        CHECK(client == "Bob Ray");
+        CHECK(row.sourceCurrency == Currency::USD);
+        CHECK_NEAR(row.paid[static_cast<std::size_t>(Currency::EUR)], 47.49, 1e-9);
+        CHECK_NEAR(row.paid[static_cast<std::size_t>(Currency::GBP)], 46.94, 1e-9);
+        CHECK_NEAR(row.paid[static_cast<std::size_t>(Currency::USD)], 0.0, 1e-12);
+    }
+
+    void withoutPayouts() {
+        const std::string line = "1792369730|9|1|X|5|Dan|GBP|10.00|0.50|0.10";
+
+        auto record = TransactionLog::parseRecord(line);
+        CHECK(record.has_value());
+        if (record) {
+            CHECK(record->receiptId == 9);
+            CHECK(record->clientName == "Dan");
+            CHECK(record->sourceCurrency == Currency::GBP);
+            CHECK_NEAR(record->spreadInBaseCurrency, 0.4, 1e-9);
+            CHECK(record->payouts.empty());
+        }
+
+        TransactionRow row{};
+        std::string cashier;
+        std::string client;
+        CHECK(TransactionIndex::parseLogLine(line, row, cashier, client));
+        CHECK(row.receiptId == 9);
+        CHECK_NEAR(row.sourceAmount, 10.0, 1e-9);
+        for (double paid : row.paid) {
+            CHECK_NEAR(paid, 0.0, 1e-12);
+        }
+
+        CHECK(!TransactionLog::parseRecord("1792369730|9|1|X|5").has_value());
+        CHECK(!TransactionIndex::parseLogLine("1792369730|9|1|X|5|Dan|XYZ|10.00|0.50|0.10", row, cashier, client));
+        CHECK(!TransactionIndex::parseLogLine(line + "|EUR", row, cashier, client));
+    }
+
+    void segmentOnDisk() {
+        auto directory = std::filesystem::temp_directory_path() / ("cx-log-test-" + std::to_string(::getpid()));
+        std::filesystem::remove_all(directory);
+        {
+            TransactionLog log(directory);
+            log.open(directory / "missing-legacy.log");
+            log.append(sampleReceipt(1, 1792369729));
+            log.append(sampleReceipt(2, 1792369731));
+            log.flush();
+
+            auto found = log.findReceipt(2);
+            CHECK(found.has_value() && *found == TransactionLog::formatLine(sampleReceipt(2, 1792369731)));
+            CHECK(!log.findReceipt(3).has_value());
+        }
+
+        TransactionLog reopened(directory);
+        reopened.load();
+        std::size_t lines = 0;
+        reopened.scan(1792369730, std::numeric_limits<time_t>::max(), [&lines](const std::string& line) {
+            auto record = TransactionLog::parseRecord(line);
+            CHECK(record.has_value() && record->receiptId == 2 && record->payouts.size() == 2);
+            ++lines;
+        });
+        CHECK(lines == 1);
+        std::filesystem::remove_all(directory);
+    }
+}
+
+int main() {
+    withPayouts();
+    withoutPayouts();
+    segmentOnDisk();
+    return check::finish("transaction_log_test");
+}
@@ -0,0 +1,151 @@
+// Round-trips every CXB1 frame type through WireCodec and checks the framing edge cases.
+#include "check.h"
+#include "wire_protocol.h"
+
+#include <string>
+#include <vector>
+
+namespace {
+    WireFrame onlyFrame(const std::string& buffer) {
+        WireFrame frame{};
+        std::size_t used = WireCodec::nextFrame(buffer, frame);
+        CHECK(used == buffer.size());
+        return frame;
+    }
+
+    void quoteRequest() {
+        std::string buffer;
+        WireCodec::appendQuoteRequest(buffer, 7, Currency::USD, Currency::EUR, 123.45);
+        WireFrame frame = onlyFrame(buffer);
+        CHECK(frame.type == WireType::QuoteRequest);
+        CHECK(frame.correlationId == 7);
+        QuoteRequestView view = WireCodec::decodeQuoteRequest(frame.payload);
+        CHECK(view.source == Currency::USD);
+        CHECK(view.target == Currency::EUR);
+        CHECK(view.amountMinor == 12345);
+    }
+
+    void quote() {
+        ExchangeQuote sent{Currency::GBP, Currency::LOCAL, 50.0, 61.0, 1.83, 59.17, 0.0, true};
+        std::string buffer;
+        WireCodec::appendQuote(buffer, 8, sent);
+        WireFrame frame = onlyFrame(buffer);
+        CHECK(frame.type == WireType::Quote);
+        ExchangeQuote received = WireCodec::decodeQuote(frame.payload);
+        CHECK(received.sourceCurrency == Currency::GBP);
+        CHECK(received.targetCurrency == Currency::LOCAL);
+        CHECK_NEAR(received.sourceAmount, 50.0, 1e-9);
+        CHECK_NEAR(received.convertedAmount, 61.0, 1e-9);
+        CHECK_NEAR(received.commission, 1.83, 1e-9);
+        CHECK_NEAR(received.payout, 59.17, 1e-9);
+        CHECK(received.reserveCovers);
+    }
+
+    void exchangeRequest() {
+        ExchangePortion euros(Currency::EUR, 40.0);
+        euros.denominations = {20, 10, 500};
+        ExchangeRequest sent(42, "Ann Lee", Currency::USD, 100.0, {euros, ExchangePortion::remainder(Currency::GBP)});
+        std::string buffer;
+        WireCodec::appendRequest(buffer, 9, sent);
+        WireFrame frame = onlyFrame(buffer);
+        CHECK(frame.type == WireType::ExchangeRequest);
+        ExchangeRequestView view = WireCodec::decodeRequest(frame.payload);
+        CHECK(view.clientId == 42);
+        CHECK(view.clientName == "Ann Lee");
+        CHECK(view.source == Currency::USD);
+        CHECK(view.amountMinor == 10000);
+        CHECK(view.portionCount == 2);
+
+        ExchangeRequest received = WireCodec::toRequest(view, 42);
+        CHECK(received.clientName == "Ann Lee");
+        CHECK_NEAR(received.totalAmount, 100.0, 1e-9);
+        CHECK(received.portions.size() == 2);
+        if (received.portions.size() == 2) {
+            CHECK(received.portions[0].targetCurrency == Currency::EUR);
+            CHECK(!received.portions[0].useRemainder);
+            CHECK_NEAR(received.portions[0].sourceAmount, 40.0, 1e-9);
+            CHECK((received.portions[0].denominations == std::vector<int>{20, 10, 500}));
+            CHECK(received.portions[1].targetCurrency == Currency::GBP);
+            CHECK(received.portions[1].useRemainder);
+        }
+    }
+
+    void receipt() {
+        std::vector<PayoutDetail> payouts{{Currency::EUR, 104.76, 3.24, {}, 100.0, 0.0},
+                                          {Currency::LOCAL, 10.5, 0.33, {}, 10.0, 0.0}};
+        Receipt sent(31, 2, "Cashier", 5, "Client", Currency::USD, 110.0, payouts, 3.6, 3.6, 0.0, 1792369729);
+        std::string buffer;
+        WireCodec::appendReceipt(buffer, 10, sent);
+        WireFrame frame = onlyFrame(buffer);
+        CHECK(frame.type == WireType::Receipt);
+        ReceiptView view = WireCodec::decodeReceipt(frame.payload);
+        CHECK(view.receiptId == 31);
+        CHECK(view.timestamp == 1792369729);
+        CHECK(view.cashierId == 2);
+        CHECK(view.cashierName == "Cashier");
+        CHECK(view.clientId == 5);
+        CHECK(view.clientName == "Client");
+        CHECK(view.source == Currency::USD);
+        CHECK(view.sourceAmountMinor == 11000);
+        CHECK(view.profitMinor == 360);
+        CHECK(view.payoutCount == 2);
+        std::vector<PayoutView> received;
+        WireCodec::forEachPayout(view, [&received](const PayoutView& payout) {
+            received.push_back(payout);
+        });
+        CHECK(received.size() == 2);
+        if (received.size() == 2) {
+            CHECK(received[0].currency == Currency::EUR);
+            CHECK(received[0].amountMinor == 10476);
+            CHECK(received[0].commissionMinor == 324);
+            CHECK(received[1].currency == Currency::LOCAL);
+            CHECK(received[1].amountMinor == 1050);
+        }
+    }
+
+    void error() {
+        std::string buffer;
+        WireCodec::appendError(buffer, 11, "Insufficient reserve for EUR");
+        WireFrame frame = onlyFrame(buffer);
+        CHECK(frame.type == WireType::Error);
+        CHECK(frame.correlationId == 11);
+        CHECK(WireCodec::decodeError(frame.payload) == "Insufficient reserve for EUR");
+    }
+
+    void framing() {
+        std::string buffer;
+        WireCodec::appendQuoteRequest(buffer, 1, Currency::USD, Currency::LOCAL, -0.01);
+        WireCodec::appendError(buffer, 2, "");
+        std::size_t first = buffer.size() - WireCodec::kHeaderSize;
+
+        WireFrame frame{};
+        for (std::size_t cut = 0; cut < first; ++cut) {
+            CHECK(WireCodec::nextFrame(std::string_view(buffer).substr(0, cut), frame) == 0);
+        }
+        std::size_t used = WireCodec::nextFrame(buffer, frame);
+        CHECK(used == first);
+        CHECK(WireCodec::decodeQuoteRequest(frame.payload).amountMinor == -1);
+        CHECK(WireCodec::nextFrame(std::string_view(buffer).substr(used), frame) == WireCodec::kHeaderSize);
+        CHECK(frame.correlationId == 2);
+        CHECK(frame.payload.empty());
+
+        std::string oversized(WireCodec::kHeaderSize, '\xff');
+        bool rejected = false;
+        try {
+            WireCodec::nextFrame(oversized, frame);
+        } catch (const ExchangeError&) {
+            rejected = true;
+        }
+        CHECK(rejected);
+    }
+}
+
+int main() {
+    quoteRequest();
+    quote();
+    exchangeRequest();
+    receipt();
+    error();
+    framing();
+    return check::finish("wire_protocol_test");
+}